@@ -573,6 +573,20 @@ void ne_ssl_set_clicert(ne_session *sess, const ne_ssl_client_cert *cc)
     sess->client_cert = dup_client_cert(cc);
 }
 
+#ifdef WINSCP
+static int new_session_callback(SSL *ssl, SSL_SESSION *ssl_session)
+{
+    ne_session *sess = SSL_get_app_data(ssl);
+    /* Sessions (like TLS 1.3 tickets) received before the certificate
+     * is verified are cached by ne__negotiate_ssl. */
+    if (sess->ssl_context->verified) {
+        ne_ssl_cache_session(sess, ssl_session, sess->ssl_context->failures);
+    }
+    /* the cache takes its own reference */
+    return 0;
+}
+
+#endif
 ne_ssl_context *ne_ssl_context_create(int mode)
 {
     ne_ssl_context *ctx = ne_calloc(sizeof *ctx);
@@ -584,6 +598,12 @@ ne_ssl_context *ne_ssl_context_create(int mode)
         /* enable workarounds for buggy SSL server implementations */
         SSL_CTX_set_options(ctx->ctx, SSL_OP_ALL);
         SSL_CTX_set_verify(ctx->ctx, SSL_VERIFY_PEER, verify_callback);
+#ifdef WINSCP
+        /* Pass new sessions to the process-wide cache. That includes
+         * TLS 1.3 tickets, which arrive only after the handshake. */
+        SSL_CTX_set_session_cache_mode(ctx->ctx, SSL_SESS_CACHE_CLIENT | SSL_SESS_CACHE_NO_INTERNAL_STORE);
+        SSL_CTX_sess_set_new_cb(ctx->ctx, new_session_callback);
+#endif
     } else if (mode == NE_SSL_CTX_SERVER) {
         ctx->ctx = SSL_CTX_new(SSLv23_server_method());
         SSL_CTX_set_session_cache_mode(ctx->ctx, SSL_SESS_CACHE_CLIENT);
@@ -701,6 +721,9 @@ int ne__negotiate_ssl(ne_session *sess)
     SSL *ssl;
     STACK_OF(X509) *chain;
     int freechain = 0; /* non-zero if chain should be free'd. */
+#ifdef WINSCP
+    int cached = 0, cached_failures = 0;
+#endif
 
     NE_DEBUG(NE_DBG_SSL, "Doing SSL negotiation.\n");
     
@@ -711,11 +734,23 @@ int ne__negotiate_ssl(ne_session *sess)
     sess->ssl_cc_requested = 0;
     ctx->failures = 0;
 
+#ifdef WINSCP
+    ctx->verified = 0;
+    if (ctx->sess == NULL) {
+        /* try session negotiated by another ne_session */
+        ctx->sess = ne_ssl_cached_session(sess, &cached_failures);
+        cached = (ctx->sess != NULL);
+    }
+#endif
+
     if (ne_sock_connect_ssl(sess->socket, ctx, sess)) {
 	if (ctx->sess) {
 	    /* remove cached session. */
 	    SSL_SESSION_free(ctx->sess);
 	    ctx->sess = NULL;
+#ifdef WINSCP
+	    ne_ssl_cache_session(sess, NULL, 0);
+#endif
 	}
         if (sess->ssl_cc_requested) {
             ne_set_error(sess, _("SSL handshake failed, "
@@ -731,6 +766,15 @@ int ne__negotiate_ssl(ne_session *sess)
     
     ssl = ne__sock_sslsock(sess->socket);
 
+#ifdef WINSCP
+    if (cached && SSL_session_reused(ssl)) {
+        /* verify_callback is not called for a resumed session,
+         * check the certificate with the failures found, when the
+         * cached session was negotiated. */
+        ctx->failures = cached_failures;
+    }
+#endif
+
     chain = SSL_get_peer_cert_chain(ssl);
     /* For an SSLv2 connection, the cert chain will always be NULL. */
     if (chain == NULL) {
@@ -761,11 +805,20 @@ int ne__negotiate_ssl(ne_session *sess)
 	    NE_DEBUG(NE_DBG_SSL, "SSL certificate checks failed: %s\n",
 		     sess->error);
 	    ne_ssl_cert_free(cert);
+#ifdef WINSCP
+	    /* never resume a session with a rejected certificate */
+	    ne_ssl_cache_session(sess, NULL, 0);
+#endif
 	    return NE_ERROR;
 	}
 	/* remember the chain. */
         sess->server_cert = cert;
     }
+
+#ifdef WINSCP
+    ctx->verified = 1;
+    ne_ssl_cache_session(sess, SSL_get0_session(ssl), ctx->failures);
+#endif
     
     if (ctx->sess) {
         SSL_SESSION *newsess = SSL_get0_session(ssl);
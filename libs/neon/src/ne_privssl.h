@@ -41,6 +41,9 @@ struct ne_ssl_context_s {
     SSL_SESSION *sess;
     const char *hostname; /* for SNI */
     int failures; /* bitmask of exposed failure bits. */
+#ifdef WINSCP
+    int verified; /* non-zero once the certificate was verified. */
+#endif
 };
 
 typedef SSL *ne_ssl_socket;
@@ -299,6 +299,15 @@ const char * ne_ssl_get_version(ne_session *sess);
 char * ne_ssl_get_cipher(ne_session *sess);
 struct ssl_st;
 void ne_init_ssl_session(struct ssl_st *ssl, ne_session *sess);
+/* Process-wide TLS session cache, implemented by WinSCP.
+ * ne_ssl_cached_session returns a new reference or NULL and sets
+ * *failures to the certificate verification failures of the cached session,
+ * ne_ssl_cache_session stores a session whose certificate was verified
+ * with given failures, with NULL session it drops the cached session. */
+struct ssl_session_st;
+struct ssl_session_st *ne_ssl_cached_session(ne_session *sess, int *failures);
+void ne_ssl_cache_session(ne_session *sess, struct ssl_session_st *ssl_session,
+                          int failures);
 #endif                            
 
 /* Set the timeout (in seconds) used when reading from a socket.  The
@@ -111,6 +111,8 @@ void __fastcall TConfiguration::Default()
   FExternalIpAddress = L"";
   FTryFtpWhenSshFails = true;
   FParallelDurationThreshold = 10;
+  FGlobalCPSLimit = 0;
+  FHostCPSLimit = 0;
   FMimeTypes = UnicodeString();
   FDontReloadMoreThanSessions = 1000;
   FScriptProgressFileNameLimit = 25;
@@ -133,6 +135,7 @@ void __fastcall TConfiguration::Default()
   FLogActions = false;
   FPermanentLogActions = false;
   FLogActionsRequired = false;
+  FEventFeedFileName = L"";
   FActionsLogFileName = L"%TEMP%\\!S.xml";
   FPermanentActionsLogFileName = FActionsLogFileName;
   FProgramIniPathWrittable = -1;
@@ -239,6 +242,8 @@ UnicodeString __fastcall TConfiguration::PropertyToKey(const UnicodeString & Pro
     KEY(String,   ExternalIpAddress); \
     KEY(Bool,     TryFtpWhenSshFails); \
     KEY(Integer,  ParallelDurationThreshold); \
+    KEY(Integer,  GlobalCPSLimit); \
+    KEY(Integer,  HostCPSLimit); \
     KEY(String,   MimeTypes); \
     KEY(Integer,  DontReloadMoreThanSessions); \
     KEY(Integer,  ScriptProgressFileNameLimit); \
@@ -585,6 +590,56 @@ void __fastcall TConfiguration::SaveDirectoryChangesCache(const UnicodeString Se
   }
 }
 //---------------------------------------------------------------------------
+UnicodeString __fastcall TConfiguration::GetDirectoryCacheFileName(const UnicodeString & SessionKey)
+{
+  // Listings can be large, so they are not stored in the configuration storage,
+  // but in a file next to the random seed file.
+  UnicodeString Result;
+  UnicodeString SeedFileName = RandomSeedFileName;
+  if (!SeedFileName.IsEmpty())
+  {
+    RawByteString Hash;
+    Hash.SetLength(16);
+    md5checksum(
+      reinterpret_cast<const char*>(SessionKey.c_str()), SessionKey.Length() * sizeof(wchar_t),
+      (unsigned char*)Hash.c_str());
+    Result = IncludeTrailingBackslash(ExtractFilePath(SeedFileName)) + L"WinSCP.dircache." + BytesToHex(Hash);
+  }
+  return Result;
+}
+//---------------------------------------------------------------------------
+void __fastcall TConfiguration::LoadDirectoryCache(const UnicodeString SessionKey,
+  TRemoteDirectoryCache * DirectoryCache, TTerminal * Terminal, TDateTime MinTimestamp)
+{
+  UnicodeString FileName = GetDirectoryCacheFileName(SessionKey);
+  if (!FileName.IsEmpty() && FileExists(ApiPath(FileName)))
+  {
+    std::unique_ptr<TMemoryStream> Stream(new TMemoryStream());
+    Stream->LoadFromFile(ApiPath(FileName));
+    DirectoryCache->Deserialize(Stream.get(), Terminal, MinTimestamp);
+  }
+}
+//---------------------------------------------------------------------------
+void __fastcall TConfiguration::SaveDirectoryCache(const UnicodeString SessionKey,
+  TRemoteDirectoryCache * DirectoryCache)
+{
+  UnicodeString FileName = GetDirectoryCacheFileName(SessionKey);
+  if (!FileName.IsEmpty())
+  {
+    std::unique_ptr<TMemoryStream> Stream(new TMemoryStream());
+    DirectoryCache->Serialize(Stream.get());
+    // Write a complete file first, so that a concurrent session never reads a partial one
+    UnicodeString TempFileName = FileName + L".tmp";
+    Stream->SaveToFile(ApiPath(TempFileName));
+    if (!MoveFileEx(ApiPath(TempFileName).c_str(), ApiPath(FileName).c_str(), MOVEFILE_REPLACE_EXISTING))
+    {
+      int Error = GetLastError();
+      DeleteFile(ApiPath(TempFileName));
+      RaiseLastOSError(Error);
+    }
+  }
+}
+//---------------------------------------------------------------------------
 UnicodeString __fastcall TConfiguration::BannerHash(const UnicodeString & Banner)
 {
   RawByteString Result;
@@ -1605,6 +1660,16 @@ void __fastcall TConfiguration::SetParallelDurationThreshold(int value)
   SET_CONFIG_PROPERTY(ParallelDurationThreshold);
 }
 //---------------------------------------------------------------------
+void __fastcall TConfiguration::SetGlobalCPSLimit(int value)
+{
+  SET_CONFIG_PROPERTY(GlobalCPSLimit);
+}
+//---------------------------------------------------------------------
+void __fastcall TConfiguration::SetHostCPSLimit(int value)
+{
+  SET_CONFIG_PROPERTY(HostCPSLimit);
+}
+//---------------------------------------------------------------------
 void __fastcall TConfiguration::SetPuttyRegistryStorageKey(UnicodeString value)
 {
   SET_CONFIG_PROPERTY(PuttyRegistryStorageKey);
@@ -1645,6 +1710,11 @@ void __fastcall TConfiguration::TemporaryActionsLogging(const UnicodeString ALog
   FActionsLogFileName = ALogFileName;
 }
 //---------------------------------------------------------------------
+void __fastcall TConfiguration::TemporaryEventFeed(const UnicodeString AFeedFileName)
+{
+  FEventFeedFileName = AFeedFileName;
+}
+//---------------------------------------------------------------------
 void __fastcall TConfiguration::TemporaryLogProtocol(int ALogProtocol)
 {
   FLogProtocol = ALogProtocol;
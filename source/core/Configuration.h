@@ -49,6 +49,7 @@ private:
   bool FLogActions;
   bool FPermanentLogActions;
   bool FLogActionsRequired;
+  UnicodeString FEventFeedFileName;
   UnicodeString FActionsLogFileName;
   UnicodeString FPermanentActionsLogFileName;
   bool FConfirmOverwriting;
@@ -73,6 +74,8 @@ private:
   UnicodeString FExternalIpAddress;
   bool FTryFtpWhenSshFails;
   int FParallelDurationThreshold;
+  int FGlobalCPSLimit;
+  int FHostCPSLimit;
   bool FScripting;
   UnicodeString FMimeTypes;
   int FDontReloadMoreThanSessions;
@@ -141,6 +144,8 @@ private:
   void __fastcall SetExternalIpAddress(UnicodeString value);
   void __fastcall SetTryFtpWhenSshFails(bool value);
   void __fastcall SetParallelDurationThreshold(int value);
+  void __fastcall SetGlobalCPSLimit(int value);
+  void __fastcall SetHostCPSLimit(int value);
   void __fastcall SetMimeTypes(UnicodeString value);
   bool __fastcall GetCollectUsage();
   void __fastcall SetCollectUsage(bool value);
@@ -165,6 +170,7 @@ protected:
     THierarchicalStorage * Source, THierarchicalStorage * Target, const UnicodeString & Name);
   bool __fastcall CopySubKey(THierarchicalStorage * Source, THierarchicalStorage * Target, const UnicodeString & Name);
   UnicodeString __fastcall BannerHash(const UnicodeString & Banner);
+  UnicodeString __fastcall GetDirectoryCacheFileName(const UnicodeString & SessionKey);
   void __fastcall SetBannerData(const UnicodeString & SessionKey, const UnicodeString & BannerHash, unsigned int Params);
   void __fastcall GetBannerData(const UnicodeString & SessionKey, UnicodeString & BannerHash, unsigned int & Params);
   static UnicodeString __fastcall PropertyToKey(const UnicodeString & Property);
@@ -235,6 +241,10 @@ public:
     TRemoteDirectoryChangesCache * DirectoryChangesCache);
   void __fastcall SaveDirectoryChangesCache(const UnicodeString SessionKey,
     TRemoteDirectoryChangesCache * DirectoryChangesCache);
+  void __fastcall LoadDirectoryCache(const UnicodeString SessionKey,
+    TRemoteDirectoryCache * DirectoryCache, TTerminal * Terminal, TDateTime MinTimestamp);
+  void __fastcall SaveDirectoryCache(const UnicodeString SessionKey,
+    TRemoteDirectoryCache * DirectoryCache);
   TStrings * __fastcall LoadDirectoryStatisticsCache(
     const UnicodeString & SessionKey, const UnicodeString & Path, const TCopyParamType & CopyParam);
   void __fastcall SaveDirectoryStatisticsCache(
@@ -248,6 +258,7 @@ public:
   virtual THierarchicalStorage * CreateScpStorage(bool & SessionList);
   void __fastcall TemporaryLogging(const UnicodeString ALogFileName);
   void __fastcall TemporaryActionsLogging(const UnicodeString ALogFileName);
+  void __fastcall TemporaryEventFeed(const UnicodeString AFeedFileName);
   void __fastcall TemporaryLogProtocol(int ALogProtocol);
   void __fastcall TemporaryLogSensitive(bool ALogSensitive);
   void __fastcall TemporaryLogMaxSize(__int64 ALogMaxSize);
@@ -300,6 +311,7 @@ public:
   __property int ActualLogProtocol  = { read=FActualLogProtocol };
   __property bool LogActions  = { read=FLogActions, write=SetLogActions };
   __property bool LogActionsRequired  = { read=FLogActionsRequired, write=FLogActionsRequired };
+  __property UnicodeString EventFeedFileName  = { read=FEventFeedFileName };
   __property UnicodeString ActionsLogFileName  = { read=GetActionsLogFileName, write=SetActionsLogFileName };
   __property UnicodeString DefaultLogFileName  = { read=GetDefaultLogFileName };
   __property TNotifyEvent OnChange = { read = FOnChange, write = FOnChange };
@@ -319,6 +331,9 @@ public:
   __property UnicodeString ExternalIpAddress = { read = FExternalIpAddress, write = SetExternalIpAddress };
   __property bool TryFtpWhenSshFails = { read = FTryFtpWhenSshFails, write = SetTryFtpWhenSshFails };
   __property int ParallelDurationThreshold = { read = FParallelDurationThreshold, write = SetParallelDurationThreshold };
+  // Shared by all transfers of the process and by all transfers to the same host (bytes per second, 0 = unlimited)
+  __property int GlobalCPSLimit = { read = FGlobalCPSLimit, write = SetGlobalCPSLimit };
+  __property int HostCPSLimit = { read = FHostCPSLimit, write = SetHostCPSLimit };
   __property UnicodeString MimeTypes = { read = FMimeTypes, write = SetMimeTypes };
   __property int DontReloadMoreThanSessions = { read = FDontReloadMoreThanSessions, write = FDontReloadMoreThanSessions };
   __property int ScriptProgressFileNameLimit = { read = FScriptProgressFileNameLimit, write = FScriptProgressFileNameLimit };
@@ -17,6 +17,7 @@ static UnicodeString AllFileMasksDelimiters = FileMasksDelimiters + IncludeExclu
 static UnicodeString DirectoryMaskDelimiters = L"/\\";
 static UnicodeString FileMasksDelimiterStr = UnicodeString(FileMasksDelimiters[1]) + L' ';
 UnicodeString AnyMask = L"*.*";
+static UnicodeString MaskChars = L"*?[]";
 //---------------------------------------------------------------------------
 __fastcall EFileMasksException::EFileMasksException(
     UnicodeString Message, int AErrorStart, int AErrorLen) :
@@ -26,6 +27,11 @@ __fastcall EFileMasksException::EFileMasksException(
   ErrorLen = AErrorLen;
 }
 //---------------------------------------------------------------------------
+static bool __fastcall HasMaskChars(const UnicodeString & Str)
+{
+  return (Str.LastDelimiter(MaskChars) > 0);
+}
+//---------------------------------------------------------------------------
 UnicodeString __fastcall MaskFilePart(const UnicodeString Part, const UnicodeString Mask, bool& Masked)
 {
   UnicodeString Result;
@@ -292,6 +298,35 @@ void __fastcall TFileMasks::Clear()
   for (int Index = 0; Index < 4; Index++)
   {
     Clear(FMasks[Index]);
+    FMasksIndex[Index].Names.clear();
+    FMasksIndex[Index].Extensions.clear();
+    FMasksIndex[Index].Others.clear();
+  }
+}
+//---------------------------------------------------------------------------
+void __fastcall TFileMasks::BuildIndex(const TMasks & Masks, TMasksIndex & Index)
+{
+  TMasks::const_iterator I = Masks.begin();
+  while (I != Masks.end())
+  {
+    const TMask & Mask = *I;
+    bool Plain =
+      (Mask.DirectoryMask.Kind == TMaskMask::Any) &&
+      (Mask.HighSizeMask == TMask::None) && (Mask.LowSizeMask == TMask::None) &&
+      (Mask.HighModificationMask == TMask::None) && (Mask.LowModificationMask == TMask::None);
+    if (Plain && (Mask.FileNameMask.Kind == TMaskMask::Literal))
+    {
+      Index.Names.insert(Mask.FileNameMask.Value);
+    }
+    else if (Plain && (Mask.FileNameMask.Kind == TMaskMask::Extension))
+    {
+      Index.Extensions.insert(Mask.FileNameMask.Value);
+    }
+    else
+    {
+      Index.Others.push_back(&Mask);
+    }
+    I++;
   }
 }
 //---------------------------------------------------------------------------
@@ -307,95 +342,125 @@ void __fastcall TFileMasks::Clear(TMasks & Masks)
   Masks.clear();
 }
 //---------------------------------------------------------------------------
-bool __fastcall TFileMasks::MatchesMasks(const UnicodeString FileName, bool Directory,
-  const UnicodeString Path, const TParams * Params, const TMasks & Masks, bool Recurse)
+bool __fastcall TFileMasks::MatchesMask(const TMask & Mask, const UnicodeString & FileName,
+  const UnicodeString & Path, const TParams * Params)
 {
-  bool Result = false;
+  bool Result =
+    MatchesMaskMask(Mask.DirectoryMask, Path) &&
+    MatchesMaskMask(Mask.FileNameMask, FileName);
 
-  TMasks::const_iterator I = Masks.begin();
-  while (!Result && (I != Masks.end()))
+  if (Result)
   {
-    const TMask & Mask = *I;
-    Result =
-      MatchesMaskMask(Mask.DirectoryMask, Path) &&
-      MatchesMaskMask(Mask.FileNameMask, FileName);
+    bool HasSize = (Params != NULL);
 
-    if (Result)
+    switch (Mask.HighSizeMask)
     {
-      bool HasSize = (Params != NULL);
+      case TMask::None:
+        Result = true;
+        break;
+
+      case TMask::Open:
+        Result = HasSize && (Params->Size < Mask.HighSize);
+        break;
 
-      switch (Mask.HighSizeMask)
+      case TMask::Close:
+        Result = HasSize && (Params->Size <= Mask.HighSize);
+        break;
+    }
+
+    if (Result)
+    {
+      switch (Mask.LowSizeMask)
       {
         case TMask::None:
           Result = true;
           break;
 
         case TMask::Open:
-          Result = HasSize && (Params->Size < Mask.HighSize);
+          Result = HasSize && (Params->Size > Mask.LowSize);
           break;
 
         case TMask::Close:
-          Result = HasSize && (Params->Size <= Mask.HighSize);
+          Result = HasSize && (Params->Size >= Mask.LowSize);
           break;
       }
+    }
 
-      if (Result)
+    bool HasModification = (Params != NULL);
+
+    if (Result)
+    {
+      switch (Mask.HighModificationMask)
       {
-        switch (Mask.LowSizeMask)
-        {
-          case TMask::None:
-            Result = true;
-            break;
+        case TMask::None:
+          Result = true;
+          break;
 
-          case TMask::Open:
-            Result = HasSize && (Params->Size > Mask.LowSize);
-            break;
+        case TMask::Open:
+          Result = HasModification && (Params->Modification < Mask.HighModification);
+          break;
 
-          case TMask::Close:
-            Result = HasSize && (Params->Size >= Mask.LowSize);
-            break;
-        }
+        case TMask::Close:
+          Result = HasModification && (Params->Modification <= Mask.HighModification);
+          break;
       }
+    }
 
-      bool HasModification = (Params != NULL);
-
-      if (Result)
+    if (Result)
+    {
+      switch (Mask.LowModificationMask)
       {
-        switch (Mask.HighModificationMask)
-        {
-          case TMask::None:
-            Result = true;
-            break;
+        case TMask::None:
+          Result = true;
+          break;
 
-          case TMask::Open:
-            Result = HasModification && (Params->Modification < Mask.HighModification);
-            break;
+        case TMask::Open:
+          Result = HasModification && (Params->Modification > Mask.LowModification);
+          break;
 
-          case TMask::Close:
-            Result = HasModification && (Params->Modification <= Mask.HighModification);
-            break;
-        }
+        case TMask::Close:
+          Result = HasModification && (Params->Modification >= Mask.LowModification);
+          break;
       }
+    }
+  }
 
-      if (Result)
+  return Result;
+}
+//---------------------------------------------------------------------------
+bool __fastcall TFileMasks::MatchesIndex(const TMasksIndex & Index, const UnicodeString & FileName)
+{
+  bool Result = false;
+  if (!Index.Names.empty() || !Index.Extensions.empty())
+  {
+    UnicodeString Name = AnsiUpperCase(FileName);
+    Result = (Index.Names.find(Name) != Index.Names.end());
+    if (!Result && !Index.Extensions.empty())
+    {
+      // "*.ext" can match also a (multi-dot) extension starting at any of the dots
+      int P = Name.Length();
+      while (!Result && (P >= 1))
       {
-        switch (Mask.LowModificationMask)
+        if (Name[P] == L'.')
         {
-          case TMask::None:
-            Result = true;
-            break;
-
-          case TMask::Open:
-            Result = HasModification && (Params->Modification > Mask.LowModification);
-            break;
-
-          case TMask::Close:
-            Result = HasModification && (Params->Modification >= Mask.LowModification);
-            break;
+          Result = (Index.Extensions.find(Name.SubString(P, Name.Length() - P + 1)) != Index.Extensions.end());
         }
+        P--;
       }
     }
+  }
+  return Result;
+}
+//---------------------------------------------------------------------------
+bool __fastcall TFileMasks::MatchesMasks(const UnicodeString FileName, bool Directory,
+  const UnicodeString Path, const TParams * Params, const TMasksIndex & Index, bool Recurse)
+{
+  bool Result = MatchesIndex(Index, FileName);
 
+  std::vector<const TMask *>::const_iterator I = Index.Others.begin();
+  while (!Result && (I != Index.Others.end()))
+  {
+    Result = MatchesMask(**I, FileName, Path, Params);
     I++;
   }
 
@@ -407,7 +472,7 @@ bool __fastcall TFileMasks::MatchesMasks(const UnicodeString FileName, bool Dire
     // Currently it includes Size/Time only, what is not used for directories.
     // So it depends on future use. Possibly we should make a copy
     // and pass on only relevant fields.
-    Result = MatchesMasks(ParentFileName, true, ParentPath, Params, Masks, Recurse);
+    Result = MatchesMasks(ParentFileName, true, ParentPath, Params, Index, Recurse);
   }
 
   return Result;
@@ -425,10 +490,10 @@ bool __fastcall TFileMasks::Matches(const UnicodeString FileName, bool Directory
   bool RecurseInclude, bool & ImplicitMatch) const
 {
   bool ImplicitIncludeMatch = (FAllDirsAreImplicitlyIncluded && Directory) || FMasks[MASK_INDEX(Directory, true)].empty();
-  bool ExplicitIncludeMatch = MatchesMasks(FileName, Directory, Path, Params, FMasks[MASK_INDEX(Directory, true)], RecurseInclude);
+  bool ExplicitIncludeMatch = MatchesMasks(FileName, Directory, Path, Params, FMasksIndex[MASK_INDEX(Directory, true)], RecurseInclude);
   bool Result =
     (ImplicitIncludeMatch || ExplicitIncludeMatch) &&
-    !MatchesMasks(FileName, Directory, Path, Params, FMasks[MASK_INDEX(Directory, false)], false);
+    !MatchesMasks(FileName, Directory, Path, Params, FMasksIndex[MASK_INDEX(Directory, false)], false);
   ImplicitMatch =
     Result && ImplicitIncludeMatch && !ExplicitIncludeMatch &&
     ((Directory && FNoImplicitMatchWithDirExcludeMask) || FMasks[MASK_INDEX(Directory, false)].empty());
@@ -508,6 +573,19 @@ void __fastcall TFileMasks::CreateMaskMask(const UnicodeString & Mask, int Start
       MaskMask.Kind = TMaskMask::Any;
       MaskMask.Mask = NULL;
     }
+    else if (!Mask.IsEmpty() && !HasMaskChars(Mask))
+    {
+      MaskMask.Kind = TMaskMask::Literal;
+      MaskMask.Mask = NULL;
+      MaskMask.Value = AnsiUpperCase(Mask);
+    }
+    else if (Ex && (Mask.Length() > 2) && (Mask.SubString(1, 2) == L"*.") &&
+             !HasMaskChars(Mask.SubString(2, Mask.Length() - 1)))
+    {
+      MaskMask.Kind = TMaskMask::Extension;
+      MaskMask.Mask = NULL;
+      MaskMask.Value = AnsiUpperCase(Mask.SubString(2, Mask.Length() - 1));
+    }
     else
     {
       MaskMask.Kind = (Ex && (Mask == L"*.")) ? TMaskMask::NoExt : TMaskMask::Regular;
@@ -702,6 +780,17 @@ bool __fastcall TFileMasks::MatchesMaskMask(const TMaskMask & MaskMask, const Un
   {
     Result = true;
   }
+  else if (MaskMask.Kind == TMaskMask::Literal)
+  {
+    Result = (AnsiUpperCase(Str) == MaskMask.Value);
+  }
+  else if (MaskMask.Kind == TMaskMask::Extension)
+  {
+    UnicodeString UpperStr = AnsiUpperCase(Str);
+    Result =
+      (UpperStr.Length() >= MaskMask.Value.Length()) &&
+      (UpperStr.SubString(UpperStr.Length() - MaskMask.Value.Length() + 1, MaskMask.Value.Length()) == MaskMask.Value);
+  }
   else if ((MaskMask.Kind == TMaskMask::NoExt) && (Str.Pos(L".") == 0))
   {
     Result = true;
@@ -772,6 +861,11 @@ void __fastcall TFileMasks::SetStr(const UnicodeString Str, bool SingleMask)
         }
       }
     }
+
+    for (int Index = 0; Index < 4; Index++)
+    {
+      BuildIndex(FMasks[Index], FMasksIndex[Index]);
+    }
   }
   catch(...)
   {
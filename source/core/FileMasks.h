@@ -3,6 +3,7 @@
 #define FileMasksH
 //---------------------------------------------------------------------------
 #include <vector>
+#include <set>
 #include <Masks.hpp>
 //---------------------------------------------------------------------------
 class EFileMasksException : public Exception
@@ -74,8 +75,10 @@ private:
 
   struct TMaskMask
   {
-    enum { Any, NoExt, Regular } Kind;
+    enum { Any, NoExt, Regular, Literal, Extension } Kind;
     TMask * Mask;
+    // Upper-cased name for Literal, upper-cased ".ext" for Extension
+    UnicodeString Value;
   };
 
   struct TMask
@@ -101,6 +104,16 @@ private:
 
   typedef std::vector<TMask> TMasks;
   TMasks FMasks[4];
+
+  // Lookup structure for plain name and extension masks,
+  // so that long mask lists do not have to be scanned one by one
+  struct TMasksIndex
+  {
+    std::set<UnicodeString> Names;
+    std::set<UnicodeString> Extensions;
+    std::vector<const TMask *> Others;
+  };
+  TMasksIndex FMasksIndex[4];
   mutable TStrings * FMasksStr[4];
 
   void __fastcall SetStr(const UnicodeString value, bool SingleMask);
@@ -118,7 +131,11 @@ private:
   static void __fastcall Clear(TMasks & Masks);
   static void __fastcall TrimEx(UnicodeString & Str, int & Start, int & End);
   static bool __fastcall MatchesMasks(const UnicodeString FileName, bool Directory,
-    const UnicodeString Path, const TParams * Params, const TMasks & Masks, bool Recurse);
+    const UnicodeString Path, const TParams * Params, const TMasksIndex & Index, bool Recurse);
+  static bool __fastcall MatchesMask(const TMask & Mask, const UnicodeString & FileName,
+    const UnicodeString & Path, const TParams * Params);
+  static bool __fastcall MatchesIndex(const TMasksIndex & Index, const UnicodeString & FileName);
+  static void __fastcall BuildIndex(const TMasks & Masks, TMasksIndex & Index);
   static inline bool __fastcall MatchesMaskMask(const TMaskMask & MaskMask, const UnicodeString & Str);
   void __fastcall ThrowError(int Start, int End);
 };
@@ -5,9 +5,73 @@
 #include "Common.h"
 #include "FileOperationProgress.h"
 #include "CoreMain.h"
+#include <map>
 //---------------------------------------------------------------------------
 #define TRANSFER_BUF_SIZE 32768
 //---------------------------------------------------------------------------
+// Token bucket shared by all transfers that are subject to the same limit.
+// The bucket holds at most a tenth of a second worth of data (but at least one small block),
+// so that the traffic is smooth, rather than coming in one-second bursts.
+struct TBandwidthBucket
+{
+  TBandwidthBucket()
+  {
+    Tokens = 0;
+    LastTicks = 0;
+    Fresh = true;
+  }
+
+  double Tokens;
+  unsigned long LastTicks;
+  bool Fresh;
+  // Transfers that have drawn from the bucket recently, to divide the bandwidth among them
+  std::map<const void *, unsigned long> Consumers;
+};
+//---------------------------------------------------------------------------
+static const unsigned long BandwidthWaitSlice = 20;
+static const unsigned long BandwidthConsumerTimeout = 1000;
+static std::unique_ptr<TCriticalSection> BandwidthSection(TraceInitPtr(new TCriticalSection()));
+static TBandwidthBucket GlobalBandwidthBucket;
+static std::map<UnicodeString, TBandwidthBucket> HostBandwidthBuckets;
+static std::map<const void *, TBandwidthBucket> OperationBandwidthBuckets;
+//---------------------------------------------------------------------------
+static unsigned long __fastcall BandwidthAvailable(
+  TBandwidthBucket & Bucket, unsigned long Rate, const void * Consumer, unsigned long Ticks)
+{
+  double Capacity = std::max(Rate / 10.0, static_cast<double>(std::min(Rate, 4096ul)));
+  if (Bucket.Fresh)
+  {
+    Bucket.Tokens = Capacity;
+    Bucket.Fresh = false;
+  }
+  else
+  {
+    // unsigned arithmetic handles tick counter wraparound
+    unsigned long Elapsed = Ticks - Bucket.LastTicks;
+    Bucket.Tokens = std::min(Capacity, Bucket.Tokens + (static_cast<double>(Rate) * Elapsed / MSecsPerSec));
+  }
+  Bucket.LastTicks = Ticks;
+
+  Bucket.Consumers[Consumer] = Ticks;
+  std::map<const void *, unsigned long>::iterator I = Bucket.Consumers.begin();
+  while (I != Bucket.Consumers.end())
+  {
+    if (Ticks - I->second > BandwidthConsumerTimeout)
+    {
+      I = Bucket.Consumers.erase(I);
+    }
+    else
+    {
+      ++I;
+    }
+  }
+
+  // Fair share of the bucket, so that one transfer cannot drain it before others get their turn
+  double Share = std::max(Capacity / Bucket.Consumers.size(), 1.0);
+  double Result = std::min(Bucket.Tokens, Share);
+  return (Result >= 1) ? static_cast<unsigned long>(Result) : 0;
+}
+//---------------------------------------------------------------------------
 TFileOperationStatistics::TFileOperationStatistics()
 {
   memset(this, 0, sizeof(*this));
@@ -68,6 +132,11 @@ __fastcall TFileOperationProgressType::~TFileOperationProgressType()
 {
   DebugAssert(!InProgress || FReset);
   DebugAssert(!Suspended || FReset);
+  if (FParent == NULL)
+  {
+    TGuard Guard(BandwidthSection.get());
+    OperationBandwidthBuckets.erase(this);
+  }
   SAFE_DESTROY(FSection);
   SAFE_DESTROY(FUserSelectionsSection);
 }
@@ -144,7 +213,6 @@ void __fastcall TFileOperationProgressType::ClearTransfer()
   FSkippedSize = 0;
   FTransferredSize = 0;
   FTransferringFile = false;
-  FLastSecond = 0;
 }
 //---------------------------------------------------------------------------
 void __fastcall TFileOperationProgressType::Start(TFileOperation AOperation,
@@ -428,41 +496,77 @@ unsigned long __fastcall TFileOperationProgressType::AdjustToCPSLimit(
 {
   SetSpeedCounters();
 
+  // we must not return 0, hence, if the buckets are empty,
+  // we wait until they refill
+  unsigned long Result = TakeBandwidth(Size);
+  unsigned long LastProgress = GetTickCount();
+  while (Result == 0)
+  {
+    SleepEx(BandwidthWaitSlice, true);
+    // Limits may have been dropped in DoProgress
+    if (GetTickCount() - LastProgress >= 100)
+    {
+      DoProgress();
+      LastProgress = GetTickCount();
+    }
+    Result = TakeBandwidth(Size);
+  }
+  return Result;
+}
+//---------------------------------------------------------------------------
+unsigned long __fastcall TFileOperationProgressType::TakeBandwidth(unsigned long Size)
+{
+  // Limits are read on each call, so that they can be changed while transferring.
   // CPSLimit reader is guarded, we cannot block whole method as it can last long.
-  if (CPSLimit > 0)
+  unsigned long OperationLimit = CPSLimit;
+  unsigned long GlobalLimit = static_cast<unsigned long>(std::max(Configuration->GlobalCPSLimit, 0));
+  unsigned long HostLimit = static_cast<unsigned long>(std::max(Configuration->HostCPSLimit, 0));
+  UnicodeString Host = GetBandwidthHost();
+  if (Host.IsEmpty())
   {
-    // we must not return 0, hence, if we reach zero,
-    // we wait until the next second
-    do
-    {
-      unsigned int Second = (GetTickCount() / MSecsPerSec);
+    HostLimit = 0;
+  }
 
-      if (Second != FLastSecond)
-      {
-        FRemainingCPS = CPSLimit;
-        FLastSecond = Second;
-      }
+  unsigned long Result = Size;
+  if ((OperationLimit > 0) || (GlobalLimit > 0) || (HostLimit > 0))
+  {
+    TGuard Guard(BandwidthSection.get());
+    unsigned long Ticks = GetTickCount();
 
-      if (FRemainingCPS == 0)
-      {
-        SleepEx(100, true);
-        DoProgress();
-      }
+    // Parallel transfers share the limit of the operation they belong to
+    const TFileOperationProgressType * Root = this;
+    while (Root->FParent != NULL)
+    {
+      Root = Root->FParent;
     }
-    while ((CPSLimit > 0) && (FRemainingCPS == 0));
 
-    // CPSLimit may have been dropped in DoProgress
-    if (CPSLimit > 0)
+    TBandwidthBucket * Buckets[3];
+    int Count = 0;
+    if (OperationLimit > 0)
     {
-      if (FRemainingCPS < Size)
-      {
-        Size = FRemainingCPS;
-      }
+      Buckets[Count] = &OperationBandwidthBuckets[Root];
+      Result = std::min(Result, BandwidthAvailable(*Buckets[Count], OperationLimit, this, Ticks));
+      Count++;
+    }
+    if (HostLimit > 0)
+    {
+      Buckets[Count] = &HostBandwidthBuckets[Host];
+      Result = std::min(Result, BandwidthAvailable(*Buckets[Count], HostLimit, this, Ticks));
+      Count++;
+    }
+    if (GlobalLimit > 0)
+    {
+      Buckets[Count] = &GlobalBandwidthBucket;
+      Result = std::min(Result, BandwidthAvailable(*Buckets[Count], GlobalLimit, this, Ticks));
+      Count++;
+    }
 
-      FRemainingCPS -= Size;
+    for (int Index = 0; Index < Count; Index++)
+    {
+      Buckets[Index]->Tokens -= Result;
     }
   }
-  return Size;
+  return Result;
 }
 //---------------------------------------------------------------------------
 // Use in SCP protocol only
@@ -592,6 +696,27 @@ unsigned long __fastcall TFileOperationProgressType::GetCPSLimit()
   return Result;
 }
 //---------------------------------------------------------------------------
+void __fastcall TFileOperationProgressType::SetBandwidthHost(const UnicodeString & Host)
+{
+  TGuard Guard(FSection);
+  FBandwidthHost = Host;
+}
+//---------------------------------------------------------------------------
+UnicodeString __fastcall TFileOperationProgressType::GetBandwidthHost() const
+{
+  UnicodeString Result;
+  if (FParent != NULL)
+  {
+    Result = FParent->GetBandwidthHost();
+  }
+  else
+  {
+    TGuard Guard(FSection);
+    Result = FBandwidthHost;
+  }
+  return Result;
+}
+//---------------------------------------------------------------------------
 void __fastcall TFileOperationProgressType::SetCPSLimit(unsigned long ACPSLimit)
 {
   if (FParent != NULL)
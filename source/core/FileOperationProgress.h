@@ -93,8 +93,7 @@ private:
   TFileOperationProgressEvent FOnProgress;
   TFileOperationFinished FOnFinished;
   bool FReset;
-  unsigned int FLastSecond;
-  unsigned long FRemainingCPS;
+  UnicodeString FBandwidthHost;
   TOnceDoneOperation FInitialOnceDoneOperation;
   TPersistence FPersistence;
   TCriticalSection * FSection;
@@ -121,6 +120,8 @@ protected:
   void __fastcall Init();
   static bool __fastcall PassCancelToParent(TCancelStatus ACancel);
   void __fastcall DoClear(bool Batch, bool Speed);
+  unsigned long __fastcall TakeBandwidth(unsigned long Size);
+  UnicodeString __fastcall GetBandwidthHost() const;
 
 public:
   // common data
@@ -221,6 +222,7 @@ public:
   void __fastcall SetCancelAtLeast(TCancelStatus ACancel);
   bool __fastcall ClearCancelFile();
   void __fastcall SetCPSLimit(unsigned long ACPSLimit);
+  void __fastcall SetBandwidthHost(const UnicodeString & Host);
   void __fastcall SetBatchOverwrite(TBatchOverwrite ABatchOverwrite);
   void __fastcall SetSkipToAll();
   UnicodeString __fastcall GetLogStr(bool Done);
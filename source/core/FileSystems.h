@@ -17,7 +17,8 @@ struct TLocalFileHandle;
 //---------------------------------------------------------------------------
 enum TFSCommand { fsNull = 0, fsVarValue, fsLastLine, fsFirstLine,
   fsCurrentDirectory, fsChangeDirectory, fsListDirectory, fsListCurrentDirectory,
-  fsListFile, fsLookupUsersGroups, fsCopyToRemote, fsCopyToLocal, fsDeleteFile,
+  fsListFile, fsListDirectoryTree, fsLookupUsersGroups, fsCopyToRemote, fsCopyToLocal,
+  fsTarCopyToRemote, fsTarCopyToLocal, fsDeleteFile,
   fsRenameFile, fsCreateDirectory, fsChangeMode, fsChangeGroup, fsChangeOwner,
   fsHomeDirectory, fsUnset, fsUnalias, fsCreateLink, fsCopyFile,
   fsAnyCommand, fsLang, fsReadSymlink, fsChangeProperties, fsMoveFile,
@@ -47,6 +48,11 @@ public:
     const TRemoteFile * File, const TRemoteProperties * Properties,
     TChmodSessionAction & Action) = 0;
   virtual bool __fastcall LoadFilesProperties(TStrings * FileList) = 0;
+  // Pipelined ChangeFileProperties and DeleteFile of many files at once (fcPipelinedChanges),
+  // without recursion. Files that failed are added to FailedFiles, in the same order.
+  virtual void __fastcall ChangeFilesProperties(TStrings * FileList,
+    const TRemoteProperties * Properties, TStrings * FailedFiles) = 0;
+  virtual void __fastcall DeleteFiles(TStrings * FileList, TStrings * FailedFiles) = 0;
   virtual void __fastcall CalculateFilesChecksum(const UnicodeString & Alg,
     TStrings * FileList, TStrings * Checksums,
     TCalculatedChecksumEvent OnCalculatedChecksum) = 0;
@@ -86,6 +92,7 @@ public:
   virtual void __fastcall LookupUsersGroups() = 0;
   virtual void __fastcall ReadCurrentDirectory() = 0;
   virtual void __fastcall ReadDirectory(TRemoteFileList * FileList) = 0;
+  virtual bool __fastcall ReadDirectoryTree(const UnicodeString & Directory, TObjectList * FileLists) = 0;
   virtual void __fastcall ReadFile(const UnicodeString FileName,
     TRemoteFile *& File) = 0;
   virtual void __fastcall ReadSymlink(TRemoteFile * SymLinkFile,
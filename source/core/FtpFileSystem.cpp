@@ -63,6 +63,9 @@ protected:
   virtual wchar_t * LastSysErrorMessage();
   virtual std::wstring GetClientString();
   virtual void SetupSsl(ssl_st * Ssl);
+  virtual SSL_SESSION * RetrieveTlsSession(int & VerificationResult, int & VerificationDepth);
+  virtual void StoreTlsSession(SSL_SESSION * Session, int VerificationResult, int VerificationDepth);
+  virtual void DropTlsSession();
 
 private:
   TFTPFileSystem * FFileSystem;
@@ -169,6 +172,21 @@ void TFileZillaImpl::SetupSsl(ssl_st * Ssl)
   ::SetupSsl(Ssl, FFileSystem->FTerminal->SessionData->MinTlsVersion, FFileSystem->FTerminal->SessionData->MaxTlsVersion);
 }
 //---------------------------------------------------------------------------
+SSL_SESSION * TFileZillaImpl::RetrieveTlsSession(int & VerificationResult, int & VerificationDepth)
+{
+  return FFileSystem->RetrieveTlsSession(VerificationResult, VerificationDepth);
+}
+//---------------------------------------------------------------------------
+void TFileZillaImpl::StoreTlsSession(SSL_SESSION * Session, int VerificationResult, int VerificationDepth)
+{
+  FFileSystem->StoreTlsSession(Session, VerificationResult, VerificationDepth);
+}
+//---------------------------------------------------------------------------
+void TFileZillaImpl::DropTlsSession()
+{
+  FFileSystem->StoreTlsSession(NULL, 0, 0);
+}
+//---------------------------------------------------------------------------
 //---------------------------------------------------------------------------
 class TMessageQueue : public std::list<std::pair<WPARAM, LPARAM> >
 {
@@ -249,6 +267,8 @@ __fastcall TFTPFileSystem::TFTPFileSystem(TTerminal * ATerminal):
   FOnCaptureOutput(NULL),
   FFileSystemInfoValid(false),
   FDoListAll(false),
+  FDoListRecursive(false),
+  FListTree(NULL),
   FServerCapabilities(NULL),
   FReadCurrentDirectory(false)
 {
@@ -1849,6 +1869,7 @@ bool __fastcall TFTPFileSystem::IsCapable(int Capability) const
     case fcPreservingTimestampDirs:
     case fcResumeSupport:
     case fcChangePassword:
+    case fcPipelinedChanges:
       return false;
 
     default:
@@ -2243,6 +2264,123 @@ void __fastcall TFTPFileSystem::ReadDirectory(TRemoteFileList * FileList)
   }
 }
 //---------------------------------------------------------------------------
+bool __fastcall TFTPFileSystem::ReadDirectoryTree(const UnicodeString & Directory, TObjectList * FileLists)
+{
+  // MLSD has no recursive variant
+  bool Result =
+    FTerminal->SessionData->FtpListRecursive &&
+    !FFileZillaIntf->UsingMlsd();
+
+  if (Result)
+  {
+    FBytesAvailable = -1;
+    FLastReadDirectoryProgress = 0;
+
+    UnicodeString Path = AbsolutePath(Directory, false);
+    TRemoteFileList * FileList = new TRemoteFileList();
+    FileList->Directory = Path;
+    FileList->AddFile(new TRemoteParentDirectory(FTerminal));
+    FileLists->Add(FileList);
+
+    FListTree = FileLists;
+    FListTreeSection = UnicodeString();
+    try
+    {
+      TFileListHelper Helper(this, FileList, false);
+      TAutoFlag ListRecursiveFlag(FDoListRecursive);
+
+      FFileZillaIntf->List(Path.c_str());
+
+      GotReply(WaitForCommandReply(), REPLY_2XX_CODE | REPLY_ALLOW_CANCEL);
+    }
+    __finally
+    {
+      FListTree = NULL;
+    }
+
+    // Servers that do not support -R either fail, list the directory only (what we handle fine),
+    // or take it as a mask and return an empty listing.
+    if (IsEmptyFileList(FileList))
+    {
+      FTerminal->LogEvent(L"Recursive listing returned empty listing, ignoring it.");
+      FileLists->Clear();
+      Result = false;
+    }
+    else
+    {
+      AutoDetectTimeDifference(FileList);
+      CheckTimeDifference();
+
+      if ((FTimeDifference != 0) || !FUploadedTimes.empty()) // optimization
+      {
+        for (int ListIndex = 0; ListIndex < FileLists->Count; ListIndex++)
+        {
+          TRemoteFileList * AFileList = static_cast<TRemoteFileList *>(FileLists->Items[ListIndex]);
+          for (int Index = 0; Index < AFileList->Count; Index++)
+          {
+            ApplyTimeDifference(AFileList->Files[Index]);
+          }
+        }
+      }
+
+      FTerminal->LogEvent(FORMAT(L"Recursive listing of \"%s\" returned %d directories.", (Path, FileLists->Count)));
+    }
+
+    FLastDataSent = Now();
+    FAnyTransferSucceeded = true;
+  }
+
+  return Result;
+}
+//---------------------------------------------------------------------------
+void __fastcall TFTPFileSystem::ChangeFilesProperties(TStrings * FileList,
+  const TRemoteProperties * /*Properties*/, TStrings * FailedFiles)
+{
+  DebugFail();
+  FailedFiles->Assign(FileList);
+}
+//---------------------------------------------------------------------------
+void __fastcall TFTPFileSystem::DeleteFiles(TStrings * FileList, TStrings * FailedFiles)
+{
+  DebugFail();
+  FailedFiles->Assign(FileList);
+}
+//---------------------------------------------------------------------------
+void __fastcall TFTPFileSystem::SwitchListTreeSection(const UnicodeString & Section)
+{
+  FListTreeSection = Section;
+
+  TRemoteFileList * Root = static_cast<TRemoteFileList *>(FListTree->Items[0]);
+  UnicodeString Path = Section;
+  // ls -R uses "./subdir:" or "subdir:" headings, some servers use absolute paths
+  if (StartsStr(L"./", Path))
+  {
+    Path.Delete(1, 2);
+  }
+  if (Path.IsEmpty() || (Path == L"."))
+  {
+    Path = Root->Directory;
+  }
+  else if (!UnixIsAbsolutePath(Path))
+  {
+    Path = UnixIncludeTrailingBackslash(Root->Directory) + Path;
+  }
+  Path = UnixExcludeTrailingBackslash(Path);
+
+  if (UnixSamePath(Path, Root->Directory))
+  {
+    FFileList = Root;
+  }
+  else
+  {
+    TRemoteFileList * FileList = new TRemoteFileList();
+    FileList->Directory = Path;
+    FileList->AddFile(new TRemoteParentDirectory(FTerminal));
+    FListTree->Add(FileList);
+    FFileList = FileList;
+  }
+}
+//---------------------------------------------------------------------------
 void __fastcall TFTPFileSystem::DoReadFile(const UnicodeString & AFileName,
   TRemoteFile *& AFile)
 {
@@ -2738,6 +2876,10 @@ int __fastcall TFTPFileSystem::GetOptionVal(int OptionID) const
       Result = FFileTransferNoList ? TRUE : FALSE;
       break;
 
+    case OPTION_MPEXT_LIST_RECURSIVE:
+      Result = (FDoListRecursive ? TRUE : FALSE);
+      break;
+
     default:
       DebugFail();
       Result = FALSE;
@@ -4160,6 +4302,11 @@ bool __fastcall TFTPFileSystem::HandleListData(const wchar_t * Path,
     for (unsigned int Index = 0; Index < Count; Index++)
     {
       const TListDataEntry * Entry = &Entries[Index];
+      if ((FListTree != NULL) && (FListTreeSection != Entry->Section))
+      {
+        SwitchListTreeSection(Entry->Section);
+      }
+
       TRemoteFile * File = new TRemoteFile();
       try
       {
@@ -4462,6 +4609,39 @@ bool __fastcall TFTPFileSystem::GetFileModificationTimeInUtc(const wchar_t * Fil
   return Result;
 }
 //---------------------------------------------------------------------------
+UnicodeString __fastcall TFTPFileSystem::GetTlsSessionCacheKey()
+{
+  TSessionData * Data = FTerminal->SessionData;
+  return TlsSessionCacheKey(Data, FORMAT(L"ftp://%s:%d", (Data->HostNameExpanded, Data->PortNumber)));
+}
+//---------------------------------------------------------------------------
+SSL_SESSION * __fastcall TFTPFileSystem::RetrieveTlsSession(int & VerificationResult, int & VerificationDepth)
+{
+  SSL_SESSION * Result = NULL;
+  UnicodeString Key = GetTlsSessionCacheKey();
+  if (!Key.IsEmpty())
+  {
+    UnicodeString Fingerprint;
+    Result = ::RetrieveTlsSession(Key, VerificationResult, VerificationDepth, Fingerprint);
+    UnicodeString Message;
+    if (Result != NULL)
+    {
+      Message = FORMAT(L"Resuming cached TLS session of certificate %s", (Fingerprint));
+    }
+    else
+    {
+      Message = L"No cached TLS session";
+    }
+    FTerminal->LogEvent(FORMAT(L"%s (TLS session cache: %s)", (Message, TlsSessionCacheStatistics())));
+  }
+  return Result;
+}
+//---------------------------------------------------------------------------
+void __fastcall TFTPFileSystem::StoreTlsSession(SSL_SESSION * Session, int VerificationResult, int VerificationDepth)
+{
+  ::StoreTlsSession(GetTlsSessionCacheKey(), Session, VerificationResult, VerificationDepth);
+}
+//---------------------------------------------------------------------------
 void __fastcall TFTPFileSystem::RegisterChecksumAlgCommand(const UnicodeString & Alg, const UnicodeString & Command)
 {
   FChecksumAlgs->Add(Alg);
@@ -40,6 +40,9 @@ public:
     const TRemoteFile * File, const TRemoteProperties * Properties,
     TChmodSessionAction & Action);
   virtual bool __fastcall LoadFilesProperties(TStrings * FileList);
+  virtual void __fastcall ChangeFilesProperties(TStrings * FileList,
+    const TRemoteProperties * Properties, TStrings * FailedFiles);
+  virtual void __fastcall DeleteFiles(TStrings * FileList, TStrings * FailedFiles);
   virtual void __fastcall CalculateFilesChecksum(const UnicodeString & Alg,
     TStrings * FileList, TStrings * Checksums,
     TCalculatedChecksumEvent OnCalculatedChecksum);
@@ -75,6 +78,7 @@ public:
   virtual void __fastcall LookupUsersGroups();
   virtual void __fastcall ReadCurrentDirectory();
   virtual void __fastcall ReadDirectory(TRemoteFileList * FileList);
+  virtual bool __fastcall ReadDirectoryTree(const UnicodeString & Directory, TObjectList * FileLists);
   virtual void __fastcall ReadFile(const UnicodeString FileName,
     TRemoteFile *& File);
   virtual void __fastcall ReadSymlink(TRemoteFile * SymlinkFile,
@@ -151,6 +155,9 @@ protected:
   bool __fastcall CheckError(int ReturnCode, const wchar_t * Context);
   void __fastcall PreserveDownloadFileTime(HANDLE Handle, void * UserData);
   bool __fastcall GetFileModificationTimeInUtc(const wchar_t * FileName, struct tm & Time);
+  struct ssl_session_st * __fastcall RetrieveTlsSession(int & VerificationResult, int & VerificationDepth);
+  void __fastcall StoreTlsSession(struct ssl_session_st * Session, int VerificationResult, int VerificationDepth);
+  UnicodeString __fastcall GetTlsSessionCacheKey();
   void __fastcall EnsureLocation(const UnicodeString & Directory, bool Log);
   void __fastcall EnsureLocation();
   UnicodeString __fastcall ActualCurrentDirectory();
@@ -173,6 +180,7 @@ protected:
   void __fastcall ResetCaches();
   void __fastcall CaptureOutput(const UnicodeString & Str);
   void __fastcall DoReadDirectory(TRemoteFileList * FileList);
+  void __fastcall SwitchListTreeSection(const UnicodeString & Section);
   void __fastcall DoReadFile(const UnicodeString & FileName, TRemoteFile *& AFile);
   void __fastcall FileTransfer(const UnicodeString & FileName, const UnicodeString & LocalFile,
     const UnicodeString & RemoteFile, const UnicodeString & RemotePath, bool Get,
@@ -269,6 +277,9 @@ private:
   UnicodeString FUserName;
   TAutoSwitch FListAll;
   bool FDoListAll;
+  bool FDoListRecursive;
+  TObjectList * FListTree;
+  UnicodeString FListTreeSection;
   TFTPServerCapabilities * FServerCapabilities;
   TDateTime FLastDataSent;
   bool FAnyTransferSucceeded;
@@ -17,6 +17,7 @@ extern "C"
 }
 #include <StrUtils.hpp>
 #include <openssl/ssl.h>
+#include <map>
 //---------------------------------------------------------------------------
 #define SESSION_PROXY_AUTH_KEY "proxyauth"
 #define SESSION_TLS_INIT_KEY "tlsinit"
@@ -128,6 +129,11 @@ void DestroyNeonSession(ne_session * Session)
   ne_session_destroy(Session);
 }
 //---------------------------------------------------------------------------
+void SetNeonSessionTerminal(ne_session * Session, TTerminal * Terminal)
+{
+  ne_set_session_private(Session, SESSION_TERMINAL_KEY, Terminal);
+}
+//---------------------------------------------------------------------------
 UnicodeString GetNeonError(ne_session * Session)
 {
   return StrFromNeon(ne_get_error(Session));
@@ -517,6 +523,223 @@ void SetupSsl(ssl_st * Ssl, TTlsVersion MinTlsVersion, TTlsVersion MaxTlsVersion
   SSL_set_options(Ssl, Options);
 }
 //---------------------------------------------------------------------------
+// Process-wide cache of TLS sessions, so that new connections to the same server,
+// even those of other sessions, can resume a TLS session with an abbreviated handshake.
+// Only sessions whose certificate was verified (and accepted) are cached.
+// As the certificate callbacks are not called for a resumed session,
+// the entry keeps the verification failures of the original handshake,
+// so that the certificate is checked again, the same way as with a full handshake.
+struct TTlsCachedSession
+{
+  SSL_SESSION * Session;
+  int Failures;
+  int FailureDepth;
+  UnicodeString Fingerprint;
+};
+typedef std::map<UnicodeString, TTlsCachedSession> TTlsSessionCache;
+static const size_t TlsSessionCacheMax = 64;
+static std::unique_ptr<TCriticalSection> TlsSessionCacheSection(TraceInitPtr(new TCriticalSection));
+static TTlsSessionCache TlsSessionCache;
+static int TlsSessionCacheHits = 0;
+static int TlsSessionCacheMisses = 0;
+//---------------------------------------------------------------------------
+UnicodeString TlsSessionCacheKey(TSessionData * Data, const UnicodeString & Server)
+{
+  UnicodeString Result;
+  // Fingerprint scan needs to see the certificate with a full handshake
+  if (!Data->FingerprintScan)
+  {
+    // Never resume a session established with a different client certificate,
+    // outside of the TLS version range of the session
+    // or with different certificate trust settings.
+    Result =
+      FORMAT(L"%d|%s|%d|%d|%s|%s",
+        (int(Data->FSProtocol), Server, int(Data->MinTlsVersion), int(Data->MaxTlsVersion), Data->TlsCertificateFile,
+         Data->HostKey));
+  }
+  return Result;
+}
+//---------------------------------------------------------------------------
+static bool IsTlsSessionUsable(SSL_SESSION * Session)
+{
+  return
+    SSL_SESSION_is_resumable(Session) &&
+    (time(NULL) < SSL_SESSION_get_time(Session) + SSL_SESSION_get_timeout(Session));
+}
+//---------------------------------------------------------------------------
+static UnicodeString TlsSessionFingerprint(SSL_SESSION * Session)
+{
+  UnicodeString Result;
+  X509 * Certificate = SSL_SESSION_get0_peer(Session);
+  unsigned char Digest[EVP_MAX_MD_SIZE];
+  unsigned int Length = 0;
+  if ((Certificate != NULL) && X509_digest(Certificate, EVP_sha256(), Digest, &Length))
+  {
+    Result = BytesToHex(Digest, Length, false, L':');
+  }
+  return Result;
+}
+//---------------------------------------------------------------------------
+static void ExpireTlsSessionCache(bool All)
+{
+  TTlsSessionCache::iterator I = TlsSessionCache.begin();
+  while (I != TlsSessionCache.end())
+  {
+    if (All || !IsTlsSessionUsable(I->second.Session))
+    {
+      SSL_SESSION_free(I->second.Session);
+      I = TlsSessionCache.erase(I);
+    }
+    else
+    {
+      ++I;
+    }
+  }
+}
+//---------------------------------------------------------------------------
+SSL_SESSION * RetrieveTlsSession(const UnicodeString & Key, int & Failures, int & FailureDepth, UnicodeString & Fingerprint)
+{
+  SSL_SESSION * Result = NULL;
+  if (!Key.IsEmpty())
+  {
+    TGuard Guard(TlsSessionCacheSection.get());
+    TTlsSessionCache::iterator I = TlsSessionCache.find(Key);
+    if (I != TlsSessionCache.end())
+    {
+      if (IsTlsSessionUsable(I->second.Session))
+      {
+        Result = I->second.Session;
+        SSL_SESSION_up_ref(Result);
+        Failures = I->second.Failures;
+        FailureDepth = I->second.FailureDepth;
+        Fingerprint = I->second.Fingerprint;
+      }
+      else
+      {
+        SSL_SESSION_free(I->second.Session);
+        TlsSessionCache.erase(I);
+      }
+    }
+
+    if (Result != NULL)
+    {
+      TlsSessionCacheHits++;
+    }
+    else
+    {
+      TlsSessionCacheMisses++;
+    }
+  }
+  return Result;
+}
+//---------------------------------------------------------------------------
+void StoreTlsSession(const UnicodeString & Key, SSL_SESSION * Session, int Failures, int FailureDepth)
+{
+  if (!Key.IsEmpty())
+  {
+    TGuard Guard(TlsSessionCacheSection.get());
+    TTlsSessionCache::iterator I = TlsSessionCache.find(Key);
+    if ((I == TlsSessionCache.end()) || (I->second.Session != Session))
+    {
+      if (I != TlsSessionCache.end())
+      {
+        SSL_SESSION_free(I->second.Session);
+        TlsSessionCache.erase(I);
+      }
+
+      // NULL session only removes the cached session
+      // (after a failed handshake or a rejected certificate)
+      if ((Session != NULL) && IsTlsSessionUsable(Session))
+      {
+        if (TlsSessionCache.size() >= TlsSessionCacheMax)
+        {
+          ExpireTlsSessionCache(false);
+          if (TlsSessionCache.size() >= TlsSessionCacheMax)
+          {
+            SSL_SESSION_free(TlsSessionCache.begin()->second.Session);
+            TlsSessionCache.erase(TlsSessionCache.begin());
+          }
+        }
+        SSL_SESSION_up_ref(Session);
+        TTlsCachedSession Entry;
+        Entry.Session = Session;
+        Entry.Failures = Failures;
+        Entry.FailureDepth = FailureDepth;
+        Entry.Fingerprint = TlsSessionFingerprint(Session);
+        TlsSessionCache.insert(std::make_pair(Key, Entry));
+      }
+    }
+    else
+    {
+      // the same session, possibly verified again with different result
+      I->second.Failures = Failures;
+      I->second.FailureDepth = FailureDepth;
+    }
+  }
+}
+//---------------------------------------------------------------------------
+UnicodeString TlsSessionCacheStatistics()
+{
+  TGuard Guard(TlsSessionCacheSection.get());
+  return FORMAT(L"%d hits, %d misses", (TlsSessionCacheHits, TlsSessionCacheMisses));
+}
+//---------------------------------------------------------------------------
+void ClearTlsSessionCache()
+{
+  TGuard Guard(TlsSessionCacheSection.get());
+  ExpireTlsSessionCache(true);
+}
+//---------------------------------------------------------------------------
+static UnicodeString NeonTlsSessionCacheKey(ne_session * Session, TTerminal * Terminal)
+{
+  UnicodeString Server =
+    FORMAT(L"%s://%s", (StrFromNeon(ne_get_scheme(Session)), StrFromNeon(ne_get_server_hostport(Session))));
+  return TlsSessionCacheKey(Terminal->SessionData, Server);
+}
+//---------------------------------------------------------------------------
+extern "C"
+{
+
+SSL_SESSION * ne_ssl_cached_session(ne_session * Session, int * Failures)
+{
+  // Sessions created without terminal (like the update checks) are not cached
+  TTerminal * Terminal = static_cast<TTerminal *>(ne_get_session_private(Session, SESSION_TERMINAL_KEY));
+  SSL_SESSION * Result = NULL;
+  UnicodeString Key;
+  if (Terminal != NULL)
+  {
+    Key = NeonTlsSessionCacheKey(Session, Terminal);
+  }
+  if (!Key.IsEmpty())
+  {
+    int FailureDepth = 0;
+    UnicodeString Fingerprint;
+    Result = RetrieveTlsSession(Key, *Failures, FailureDepth, Fingerprint);
+    UnicodeString Message;
+    if (Result != NULL)
+    {
+      Message = FORMAT(L"Resuming cached TLS session of certificate %s", (Fingerprint));
+    }
+    else
+    {
+      Message = L"No cached TLS session";
+    }
+    Terminal->LogEvent(FORMAT(L"%s (TLS session cache: %s)", (Message, TlsSessionCacheStatistics())));
+  }
+  return Result;
+}
+
+void ne_ssl_cache_session(ne_session * Session, SSL_SESSION * SslSession, int Failures)
+{
+  TTerminal * Terminal = static_cast<TTerminal *>(ne_get_session_private(Session, SESSION_TERMINAL_KEY));
+  if (Terminal != NULL)
+  {
+    StoreTlsSession(NeonTlsSessionCacheKey(Session, Terminal), SslSession, Failures, 0);
+  }
+}
+
+} // extern "C"
+//---------------------------------------------------------------------------
 void UpdateNeonDebugMask()
 {
   // Other flags:
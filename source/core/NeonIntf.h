@@ -30,6 +30,7 @@ ne_session * CreateNeonSession(const ne_uri & uri);
 void InitNeonSession(ne_session * Session, TProxyMethod ProxyMethod, const UnicodeString & ProxyHost,
   int ProxyPort, const UnicodeString & ProxyUsername, const UnicodeString & ProxyPassword, TTerminal * Terminal);
 void DestroyNeonSession(ne_session * Session);
+void SetNeonSessionTerminal(ne_session * Session, TTerminal * Terminal);
 UnicodeString GetNeonError(ne_session * Session);
 void CheckNeonStatus(ne_session * Session, int NeonStatus,
   const UnicodeString & HostName, const UnicodeString & CustomError = L"");
@@ -55,5 +56,11 @@ struct TSessionInfo;
 UnicodeString __fastcall NeonTlsSessionInfo(
   ne_session * Session, TSessionInfo & FSessionInfo, UnicodeString & TlsVersionStr);
 void SetupSsl(ssl_st * Ssl, TTlsVersion MinTlsVersion, TTlsVersion MaxTlsVersion);
+UnicodeString TlsSessionCacheKey(TSessionData * Data, const UnicodeString & Server);
+struct ssl_session_st * RetrieveTlsSession(
+  const UnicodeString & Key, int & Failures, int & FailureDepth, UnicodeString & Fingerprint);
+void StoreTlsSession(const UnicodeString & Key, struct ssl_session_st * Session, int Failures, int FailureDepth);
+UnicodeString TlsSessionCacheStatistics();
+void ClearTlsSessionCache();
 //---------------------------------------------------------------------------
 #endif
@@ -898,6 +898,37 @@ UnicodeString __fastcall Sha256(const char * Data, size_t Size)
   return Result;
 }
 //---------------------------------------------------------------------------
+RawByteString __fastcall CalculateDigest(const UnicodeString & Alg, const void * Data, size_t Size)
+{
+  // Names as used by SFTP check-file extension
+  const ssh_hashalg * HashAlg;
+  if (SameText(Alg, L"md5"))
+  {
+    HashAlg = &ssh_md5;
+  }
+  else if (SameText(Alg, L"sha1"))
+  {
+    HashAlg = &ssh_sha1;
+  }
+  else if (SameText(Alg, L"sha256"))
+  {
+    HashAlg = &ssh_sha256;
+  }
+  else if (SameText(Alg, L"sha512"))
+  {
+    HashAlg = &ssh_sha512;
+  }
+  else
+  {
+    throw Exception(FORMAT(L"Unsupported hash algorithm \"%s\".", (Alg)));
+  }
+
+  RawByteString Result;
+  Result.SetLength(HashAlg->hlen);
+  hash_simple(HashAlg, make_ptrlen(Data, Size), Result.c_str());
+  return Result;
+}
+//---------------------------------------------------------------------------
 void __fastcall DllHijackingProtection()
 {
   dll_hijacking_protection();
@@ -31,6 +31,7 @@ UnicodeString __fastcall KeyTypeFromFingerprint(UnicodeString Fingerprint);
 UnicodeString __fastcall GetPuTTYVersion();
 //---------------------------------------------------------------------------
 UnicodeString __fastcall Sha256(const char * Data, size_t Size);
+RawByteString __fastcall CalculateDigest(const UnicodeString & Alg, const void * Data, size_t Size);
 //---------------------------------------------------------------------------
 void __fastcall DllHijackingProtection();
 //---------------------------------------------------------------------------
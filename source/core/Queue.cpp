@@ -253,8 +253,10 @@ protected:
   TUserAction * FUserAction;
   bool FCancel;
   bool FPause;
+  TDateTime FFreeSince;
 
   virtual void __fastcall ProcessEvent();
+  void __fastcall WarmUp();
   virtual bool __fastcall Finished();
   bool __fastcall WaitForUserAction(TQueueItem::TStatus ItemStatus, TUserAction * UserAction);
   bool __fastcall OverrideItemStatus(TQueueItem::TStatus & ItemStatus);
@@ -436,7 +438,8 @@ __fastcall TTerminalQueue::TTerminalQueue(TTerminal * Terminal,
   FTerminal(Terminal), FTransfersLimit(2), FKeepDoneItemsFor(0), FEnabled(true),
   FConfiguration(Configuration), FSessionData(NULL), FItems(NULL), FDoneItems(NULL),
   FTerminals(NULL), FItemsSection(NULL), FFreeTerminals(0),
-  FItemsInProcess(0), FTemporaryTerminals(0), FOverallTerminals(0)
+  FItemsInProcess(0), FTemporaryTerminals(0), FOverallTerminals(0), FWarmUpPending(false),
+  FListVersion(0), FChangeCounter(0)
 {
   FOnQueryUser = NULL;
   FOnPromptUser = NULL;
@@ -459,6 +462,13 @@ __fastcall TTerminalQueue::TTerminalQueue(TTerminal * Terminal,
   FItemsSection = new TCriticalSection();
 
   Start();
+
+  if (FSessionData->QueueWarmSessions > 0)
+  {
+    // Connect the background sessions in advance, so that the first transfers do not wait for them
+    FWarmUpPending = true;
+    TriggerEvent();
+  }
 }
 //---------------------------------------------------------------------------
 __fastcall TTerminalQueue::~TTerminalQueue()
@@ -556,6 +566,22 @@ bool __fastcall TTerminalQueue::TerminalFree(TTerminalItem * TerminalItem)
   return Result;
 }
 //---------------------------------------------------------------------------
+int __fastcall TTerminalQueue::GetWarmSessionsLimit()
+{
+  int Result = FSessionData->QueueWarmSessions;
+  if ((FTransfersLimit >= 0) && (Result > FTransfersLimit))
+  {
+    Result = FTransfersLimit;
+  }
+  return Result;
+}
+//---------------------------------------------------------------------------
+bool __fastcall TTerminalQueue::IsSessionIdleTooLong(TDateTime FreeSince)
+{
+  int Timeout = FSessionData->QueueSessionIdleTimeout;
+  return (Timeout > 0) && (IncSecond(FreeSince, Timeout) < Now());
+}
+//---------------------------------------------------------------------------
 int __fastcall TTerminalQueue::GetParallelDurationThreshold()
 {
   return FConfiguration->ParallelDurationThreshold;
@@ -571,7 +597,11 @@ void __fastcall TTerminalQueue::AddItem(TQueueItem * Item)
     TGuard Guard(FItemsSection);
 
     FItems->Add(Item);
+    FAllItems.insert(Item);
+    FListVersion++;
     Item->FQueue = this;
+    // Replenish the pool, if the idle sessions were retired meanwhile
+    FWarmUpPending = (FSessionData->QueueWarmSessions > 0);
   }
 
   DoListUpdate();
@@ -591,6 +621,7 @@ void __fastcall TTerminalQueue::RetryItem(TQueueItem * Item)
       DebugUsedParam(Index);
       FItemsInProcess--;
       FItems->Add(Item);
+      FListVersion++;
     }
 
     DoListUpdate();
@@ -616,6 +647,7 @@ void __fastcall TTerminalQueue::DeleteItem(TQueueItem * Item, bool CanKeep)
       DebugUsedParam(Index);
       FItemsInProcess--;
       FForcedItems->Remove(Item);
+      FListVersion++;
       // =0  do not keep
       // <0  infinity
       if ((FKeepDoneItemsFor != 0) && CanKeep && Item->Complete())
@@ -625,6 +657,7 @@ void __fastcall TTerminalQueue::DeleteItem(TQueueItem * Item, bool CanKeep)
       }
       else
       {
+        FAllItems.erase(Item);
         delete Item;
       }
 
@@ -663,61 +696,112 @@ TQueueItem * __fastcall TTerminalQueue::GetItem(int Index)
 }
 //---------------------------------------------------------------------------
 void __fastcall TTerminalQueue::UpdateStatusForList(
-  TTerminalQueueStatus * Status, TList * List, TTerminalQueueStatus * Current)
+  TTerminalQueueStatus * Status, TList * List, std::map<TQueueItem *, TQueueItemProxy *> & CurrentProxies)
 {
   TQueueItem * Item;
   TQueueItemProxy * ItemProxy;
   for (int Index = 0; Index < List->Count; Index++)
   {
     Item = GetItem(List, Index);
-    if (Current != NULL)
+    std::map<TQueueItem *, TQueueItemProxy *>::iterator I = CurrentProxies.find(Item);
+    if (I != CurrentProxies.end())
     {
-      ItemProxy = Current->FindByQueueItem(Item);
+      ItemProxy = I->second;
+      CurrentProxies.erase(I);
+      Status->Add(ItemProxy);
+      if ((Item->FChangeStamp > Status->FChangeStamp) ||
+          (ItemProxy->Status == TQueueItem::qsConnecting))
+      {
+        ItemProxy->Update();
+      }
     }
     else
     {
-      ItemProxy = NULL;
+      Status->Add(new TQueueItemProxy(this, Item));
     }
-
-    if (ItemProxy != NULL)
+  }
+}
+//---------------------------------------------------------------------------
+bool __fastcall TTerminalQueue::UpdateStatusItems(TTerminalQueueStatus * Status)
+{
+  bool Result = false;
+  for (int Index = 0; Index < Status->Count; Index++)
+  {
+    TQueueItemProxy * ItemProxy = Status->Items[Index];
+    // "connecting" is derived from the session state, not signaled by the item itself
+    if ((ItemProxy->FQueueItem->FChangeStamp > Status->FChangeStamp) ||
+        (ItemProxy->Status == TQueueItem::qsConnecting))
     {
-      Current->Delete(ItemProxy);
-      Status->Add(ItemProxy);
       ItemProxy->Update();
-    }
-    else
-    {
-      Status->Add(new TQueueItemProxy(this, Item));
+      Result = true;
     }
   }
+  return Result;
 }
 //---------------------------------------------------------------------------
 TTerminalQueueStatus * __fastcall TTerminalQueue::CreateStatus(TTerminalQueueStatus * Current)
 {
-  TTerminalQueueStatus * Status = new TTerminalQueueStatus();
-  try
+  // Read before looking at the items, so that a change made meanwhile is picked by the next call
+  unsigned int ChangeStamp = static_cast<unsigned int>(FChangeCounter);
+
+  TGuard Guard(FItemsSection);
+
+  TTerminalQueueStatus * Status;
+  if ((Current != NULL) && (Current->FListVersion == FListVersion))
   {
-    try
+    // The list structure has not changed, refresh only the items that have
+    if (UpdateStatusItems(Current))
     {
-      TGuard Guard(FItemsSection);
-
-      UpdateStatusForList(Status, FDoneItems, Current);
-      Status->SetDoneCount(Status->Count);
-      UpdateStatusForList(Status, FItems, Current);
+      Current->ResetStats();
     }
-    __finally
+    Status = Current;
+  }
+  else
+  {
+    std::map<TQueueItem *, TQueueItemProxy *> CurrentProxies;
+    Status = new TTerminalQueueStatus();
+    try
     {
-      if (Current != NULL)
+      try
       {
-        delete Current;
+        if (Current != NULL)
+        {
+          for (int Index = 0; Index < Current->Count; Index++)
+          {
+            TQueueItemProxy * ItemProxy = Current->Items[Index];
+            CurrentProxies.insert(std::make_pair(ItemProxy->FQueueItem, ItemProxy));
+          }
+          Status->FChangeStamp = Current->FChangeStamp;
+        }
+
+        UpdateStatusForList(Status, FDoneItems, CurrentProxies);
+        Status->SetDoneCount(Status->Count);
+        UpdateStatusForList(Status, FItems, CurrentProxies);
+      }
+      __finally
+      {
+        if (Current != NULL)
+        {
+          // The reused proxies are owned by the new status now, free only those of the removed items
+          Current->FList->Clear();
+          std::map<TQueueItem *, TQueueItemProxy *>::iterator I = CurrentProxies.begin();
+          while (I != CurrentProxies.end())
+          {
+            delete I->second;
+            I++;
+          }
+          delete Current;
+        }
       }
     }
+    catch(...)
+    {
+      delete Status;
+      throw;
+    }
+    Status->FListVersion = FListVersion;
   }
-  catch(...)
-  {
-    delete Status;
-    throw;
-  }
+  Status->FChangeStamp = ChangeStamp;
 
   return Status;
 }
@@ -731,7 +815,7 @@ bool __fastcall TTerminalQueue::ItemGetData(TQueueItem * Item,
   {
     TGuard Guard(FItemsSection);
 
-    Result = (FDoneItems->IndexOf(Item) >= 0) || (FItems->IndexOf(Item) >= 0);
+    Result = (FAllItems.find(Item) != FAllItems.end());
     if (Result)
     {
       Item->GetData(Proxy);
@@ -786,6 +870,7 @@ bool __fastcall TTerminalQueue::ItemMove(TQueueItem * Item, TQueueItem * BeforeI
       if (Result)
       {
         FItems->Move(Index, IndexDest);
+        FListVersion++;
       }
     }
 
@@ -817,6 +902,7 @@ bool __fastcall TTerminalQueue::ItemExecuteNow(TQueueItem * Item)
         if (Index > FItemsInProcess)
         {
           FItems->Move(Index, FItemsInProcess);
+          FListVersion++;
         }
 
         if ((FTransfersLimit >= 0) && (FTerminals->Count >= FTransfersLimit) &&
@@ -859,6 +945,8 @@ bool __fastcall TTerminalQueue::ItemDelete(TQueueItem * Item)
         if (Item->Status == TQueueItem::qsPending)
         {
           FItems->Delete(Index);
+          FAllItems.erase(Item);
+          FListVersion++;
           FForcedItems->Remove(Item);
           delete Item;
           UpdateList = true;
@@ -875,6 +963,8 @@ bool __fastcall TTerminalQueue::ItemDelete(TQueueItem * Item)
         if (Result)
         {
           FDoneItems->Delete(Index);
+          FAllItems.erase(Item);
+          FListVersion++;
           UpdateList = true;
         }
       }
@@ -1027,6 +1117,8 @@ void __fastcall TTerminalQueue::ProcessEvent()
           if (Item->FDoneAt <= RemoveDoneItemsBefore)
           {
             FDoneItems->Delete(Index);
+            FAllItems.erase(Item);
+            FListVersion++;
             delete Item;
             Index--;
             DoListUpdate();
@@ -1064,6 +1156,28 @@ void __fastcall TTerminalQueue::ProcessEvent()
             }
             FItemsInProcess++;
           }
+          else
+          {
+            Item = NULL;
+          }
+        }
+        else
+        {
+          Item = NULL;
+        }
+      }
+
+      if ((Item == NULL) && FWarmUpPending && FEnabled)
+      {
+        if (FTerminals->Count < GetWarmSessionsLimit())
+        {
+          FOverallTerminals++;
+          TerminalItem = new TTerminalItem(this, FOverallTerminals);
+          FTerminals->Add(TerminalItem);
+        }
+        else
+        {
+          FWarmUpPending = false;
         }
       }
     }
@@ -1078,6 +1192,8 @@ void __fastcall TTerminalQueue::ProcessEvent()
 //---------------------------------------------------------------------------
 void __fastcall TTerminalQueue::DoQueueItemUpdate(TQueueItem * Item)
 {
+  // Lets CreateStatus refresh only the items that have changed since the previous snapshot
+  Item->FChangeStamp = static_cast<unsigned int>(InterlockedIncrement(&FChangeCounter));
   if (OnQueueItemUpdate != NULL)
   {
     OnQueueItemUpdate(this, Item);
@@ -1229,6 +1345,7 @@ __fastcall TTerminalItem::TTerminalItem(TTerminalQueue * Queue, int Index) :
   FCriticalSection(NULL), FUserAction(NULL)
 {
   FCriticalSection = new TCriticalSection();
+  FFreeSince = Now();
 
   FTerminal = new TBackgroundTerminal(FQueue->FTerminal, Queue->FSessionData,
     FQueue->FConfiguration, this, FORMAT(L"Background %d", (Index)));
@@ -1276,6 +1393,12 @@ void __fastcall TTerminalItem::ProcessEvent()
 {
   TGuard Guard(FCriticalSection);
 
+  if (FItem == NULL)
+  {
+    WarmUp();
+    return;
+  }
+
   bool Retry = true;
 
   FCancel = false;
@@ -1336,6 +1459,29 @@ void __fastcall TTerminalItem::ProcessEvent()
     FQueue->DeleteItem(Item, !FCancel);
   }
 
+  FFreeSince = Now();
+  if (!FTerminal->Active ||
+      !FQueue->TerminalFree(this))
+  {
+    Terminate();
+  }
+}
+//---------------------------------------------------------------------------
+void __fastcall TTerminalItem::WarmUp()
+{
+  // No queue item to route prompts to, so this succeeds only when the session
+  // can be opened without user interaction (what is typical, as the credentials are taken from the main session)
+  try
+  {
+    FTerminal->LogEvent(L"Opening background session in advance.");
+    FTerminal->Open();
+  }
+  catch (Exception & E)
+  {
+    FTerminal->Log->AddException(&E);
+  }
+
+  FFreeSince = Now();
   if (!FTerminal->Active ||
       !FQueue->TerminalFree(this))
   {
@@ -1349,15 +1495,24 @@ void __fastcall TTerminalItem::Idle()
 
   DebugAssert(FTerminal->Active);
 
-  try
+  bool Retire = FQueue->IsSessionIdleTooLong(FFreeSince);
+  if (Retire)
   {
-    FTerminal->Idle();
+    FTerminal->LogEvent(L"Closing background session, as it was not used for too long.");
   }
-  catch(...)
+  else
   {
+    try
+    {
+      FTerminal->Idle();
+    }
+    catch(...)
+    {
+    }
   }
 
-  if (!FTerminal->Active ||
+  if (Retire ||
+      !FTerminal->Active ||
       !FQueue->TerminalFree(this))
   {
     Terminate();
@@ -1493,8 +1648,7 @@ void __fastcall TTerminalItem::TerminalPromptUser(TTerminal * Terminal,
 {
   if (FItem == NULL)
   {
-    // sanity, should not occur
-    DebugFail();
+    // Opening a session in advance, see WarmUp()
     Result = false;
   }
   else
@@ -1601,7 +1755,7 @@ bool __fastcall TTerminalItem::OverrideItemStatus(TQueueItem::TStatus & ItemStat
 __fastcall TQueueItem::TQueueItem() :
   FStatus(qsPending), FTerminalItem(NULL), FSection(NULL), FProgressData(NULL),
   FQueue(NULL), FInfo(NULL), FCompleteEvent(INVALID_HANDLE_VALUE),
-  FCPSLimit(-1)
+  FCPSLimit(-1), FChangeStamp(0)
 {
   FSection = new TCriticalSection();
   FInfo = new TInfo();
@@ -1890,7 +2044,7 @@ int __fastcall TQueueItemProxy::GetIndex()
 // TTerminalQueueStatus
 //---------------------------------------------------------------------------
 __fastcall TTerminalQueueStatus::TTerminalQueueStatus() :
-  FList(NULL)
+  FList(NULL), FListVersion(0), FChangeStamp(0)
 {
   FList = new TList();
   ResetStats();
@@ -2275,7 +2429,8 @@ void __fastcall TParallelTransferQueueItem::DoExecute(TTerminal * Terminal)
 
   OperationProgress.Start(
     // CPS limit inherited from parent OperationProgress.
-    // Count not known and won't be needed as we will always have TotalSize as  we always transfer a single file at a time.
+    // Count not known and won't be needed as we will always have TotalSize as we always transfer a single file
+    // (or a small batch of files from one directory) at a time.
     Operation, FParallelOperation->Side, -1, Temp, FParallelOperation->TargetDir, 0, odoIdle);
 
   try
@@ -2298,6 +2453,7 @@ void __fastcall TParallelTransferQueueItem::DoExecute(TTerminal * Terminal)
   __finally
   {
     OperationProgress.Stop();
+    Terminal->LogParallelTransferStatistics(FParallelOperation);
     FParallelOperation->RemoveClient();
   }
 }
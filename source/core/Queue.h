@@ -4,6 +4,8 @@
 //---------------------------------------------------------------------------
 #include "Terminal.h"
 #include "FileOperationProgress.h"
+#include <set>
+#include <map>
 //---------------------------------------------------------------------------
 class TSimpleThread
 {
@@ -118,12 +120,17 @@ protected:
   bool FEnabled;
   TDateTime FIdleInterval;
   TDateTime FLastIdle;
+  bool FWarmUpPending;
+  std::set<TQueueItem *> FAllItems;
+  unsigned int FListVersion;
+  long FChangeCounter;
 
   inline static TQueueItem * __fastcall GetItem(TList * List, int Index);
   inline TQueueItem * __fastcall GetItem(int Index);
   void __fastcall FreeItemsList(TList * List);
   void __fastcall UpdateStatusForList(
-    TTerminalQueueStatus * Status, TList * List, TTerminalQueueStatus * Current);
+    TTerminalQueueStatus * Status, TList * List, std::map<TQueueItem *, TQueueItemProxy *> & CurrentProxies);
+  bool __fastcall UpdateStatusItems(TTerminalQueueStatus * Status);
   bool __fastcall ItemGetData(TQueueItem * Item, TQueueItemProxy * Proxy);
   bool __fastcall ItemProcessUserAction(TQueueItem * Item, void * Arg);
   bool __fastcall ItemMove(TQueueItem * Item, TQueueItem * BeforeItem);
@@ -141,6 +148,8 @@ protected:
   void __fastcall TerminalFinished(TTerminalItem * TerminalItem);
   bool __fastcall TerminalFree(TTerminalItem * TerminalItem);
   int __fastcall GetParallelDurationThreshold();
+  int __fastcall GetWarmSessionsLimit();
+  bool __fastcall IsSessionIdleTooLong(TDateTime FreeSince);
 
   void __fastcall DoQueueItemUpdate(TQueueItem * Item);
   void __fastcall DoListUpdate();
@@ -193,6 +202,7 @@ protected:
   HANDLE FCompleteEvent;
   long FCPSLimit;
   TDateTime FDoneAt;
+  unsigned int FChangeStamp;
 
   __fastcall TQueueItem();
   virtual __fastcall ~TQueueItem();
@@ -289,6 +299,8 @@ private:
   int FActiveCount;
   int FActivePrimaryCount;
   int FActiveAndPendingPrimaryCount;
+  unsigned int FListVersion;
+  unsigned int FChangeStamp;
 
   int __fastcall GetCount();
   int __fastcall GetActiveCount();
@@ -8,6 +8,7 @@
 #include <SysUtils.hpp>
 #include <StrUtils.hpp>
 #include <DateUtils.hpp>
+#include <algorithm>
 
 #include "Exceptions.h"
 #include "Interface.h"
@@ -801,7 +802,6 @@ __fastcall TRemoteFile::TRemoteFile(TRemoteFile * ALinkedByFile):
   TPersistent()
 {
   FLinkedFile = NULL;
-  FRights = new TRights();
   FIconIndex = -1;
   FCyclicLink = false;
   FModificationFmt = mfFull;
@@ -814,7 +814,6 @@ __fastcall TRemoteFile::TRemoteFile(TRemoteFile * ALinkedByFile):
 //---------------------------------------------------------------------------
 __fastcall TRemoteFile::~TRemoteFile()
 {
-  delete FRights;
   delete FLinkedFile;
 }
 //---------------------------------------------------------------------------
@@ -829,7 +828,7 @@ TRemoteFile * __fastcall TRemoteFile::Duplicate(bool Standalone) const
       Result->FLinkedFile = FLinkedFile->Duplicate(true);
       Result->FLinkedFile->FLinkedByFile = Result;
     }
-    *Result->Rights = *FRights;
+    Result->FRights = FRights;
     #define COPY_FP(PROP) Result->F ## PROP = F ## PROP;
     COPY_FP(Terminal);
     COPY_FP(Owner);
@@ -863,6 +862,149 @@ TRemoteFile * __fastcall TRemoteFile::Duplicate(bool Standalone) const
   return Result;
 }
 //---------------------------------------------------------------------------
+static void __fastcall WriteCacheInt(TStream * Stream, int Value)
+{
+  Stream->WriteBuffer(&Value, sizeof(Value));
+}
+//---------------------------------------------------------------------------
+static int __fastcall ReadCacheInt(TStream * Stream)
+{
+  int Result;
+  Stream->ReadBuffer(&Result, sizeof(Result));
+  return Result;
+}
+//---------------------------------------------------------------------------
+static void __fastcall WriteCacheInt64(TStream * Stream, __int64 Value)
+{
+  Stream->WriteBuffer(&Value, sizeof(Value));
+}
+//---------------------------------------------------------------------------
+static __int64 __fastcall ReadCacheInt64(TStream * Stream)
+{
+  __int64 Result;
+  Stream->ReadBuffer(&Result, sizeof(Result));
+  return Result;
+}
+//---------------------------------------------------------------------------
+static void __fastcall WriteCacheDateTime(TStream * Stream, const TDateTime & Value)
+{
+  double D = Value.Val;
+  Stream->WriteBuffer(&D, sizeof(D));
+}
+//---------------------------------------------------------------------------
+static TDateTime __fastcall ReadCacheDateTime(TStream * Stream)
+{
+  double Result;
+  Stream->ReadBuffer(&Result, sizeof(Result));
+  return TDateTime(Result);
+}
+//---------------------------------------------------------------------------
+static void __fastcall WriteCacheString(TStream * Stream, const UnicodeString & Value)
+{
+  WriteCacheInt(Stream, Value.Length());
+  if (!Value.IsEmpty())
+  {
+    Stream->WriteBuffer(Value.c_str(), Value.Length() * sizeof(wchar_t));
+  }
+}
+//---------------------------------------------------------------------------
+static UnicodeString __fastcall ReadCacheString(TStream * Stream)
+{
+  int Length = ReadCacheInt(Stream);
+  if ((Length < 0) || (Length * sizeof(wchar_t) > static_cast<unsigned>(Stream->Size - Stream->Position)))
+  {
+    throw Exception(L"Invalid directory cache data");
+  }
+  UnicodeString Result;
+  if (Length > 0)
+  {
+    Result.SetLength(Length);
+    Stream->ReadBuffer(Result.c_str(), Length * sizeof(wchar_t));
+  }
+  return Result;
+}
+//---------------------------------------------------------------------------
+static void __fastcall WriteCacheToken(TStream * Stream, const TRemoteToken & Token)
+{
+  WriteCacheString(Stream, Token.Name);
+  WriteCacheInt(Stream, Token.IDValid ? 1 : 0);
+  WriteCacheInt(Stream, static_cast<int>(Token.ID));
+}
+//---------------------------------------------------------------------------
+static TRemoteToken __fastcall ReadCacheToken(TStream * Stream)
+{
+  TRemoteToken Result(ReadCacheString(Stream));
+  bool IDValid = (ReadCacheInt(Stream) != 0);
+  unsigned int ID = static_cast<unsigned int>(ReadCacheInt(Stream));
+  if (IDValid)
+  {
+    Result.ID = ID;
+  }
+  return Result;
+}
+//---------------------------------------------------------------------------
+void __fastcall TRemoteFile::SaveToStream(TStream * Stream) const
+{
+  WriteCacheString(Stream, FFileName);
+  WriteCacheString(Stream, FDisplayName);
+  WriteCacheInt(Stream, FType);
+  WriteCacheInt(Stream, FIsSymLink ? 1 : 0);
+  WriteCacheInt(Stream, FCyclicLink ? 1 : 0);
+  WriteCacheString(Stream, FLinkTo);
+  WriteCacheInt64(Stream, FSize);
+  WriteCacheInt(Stream, FINodeBlocks);
+  WriteCacheDateTime(Stream, FModification);
+  WriteCacheInt(Stream, FModificationFmt);
+  WriteCacheDateTime(Stream, FLastAccess);
+  WriteCacheInt(Stream, FRights.Unknown ? 1 : 0);
+  WriteCacheString(Stream, FRights.Unknown ? UnicodeString() : FRights.Text);
+  WriteCacheString(Stream, FHumanRights);
+  WriteCacheToken(Stream, FOwner);
+  WriteCacheToken(Stream, FGroup);
+  WriteCacheInt(Stream, FIsEncrypted ? 1 : 0);
+  WriteCacheInt(Stream, (FLinkedFile != NULL) ? 1 : 0);
+  if (FLinkedFile != NULL)
+  {
+    FLinkedFile->SaveToStream(Stream);
+  }
+}
+//---------------------------------------------------------------------------
+void __fastcall TRemoteFile::LoadFromStream(TStream * Stream)
+{
+  FFileName = ReadCacheString(Stream);
+  FDisplayName = ReadCacheString(Stream);
+  FType = static_cast<wchar_t>(ReadCacheInt(Stream));
+  FIsSymLink = (ReadCacheInt(Stream) != 0);
+  FCyclicLink = (ReadCacheInt(Stream) != 0);
+  FLinkTo = ReadCacheString(Stream);
+  FSize = ReadCacheInt64(Stream);
+  FINodeBlocks = ReadCacheInt(Stream);
+  FModification = ReadCacheDateTime(Stream);
+  int AModificationFmt = ReadCacheInt(Stream);
+  if ((AModificationFmt < mfNone) || (AModificationFmt > mfFull))
+  {
+    throw Exception(L"Invalid directory cache data");
+  }
+  FModificationFmt = static_cast<TModificationFmt>(AModificationFmt);
+  FLastAccess = ReadCacheDateTime(Stream);
+  bool RightsUnknown = (ReadCacheInt(Stream) != 0);
+  UnicodeString RightsText = ReadCacheString(Stream);
+  if (!RightsUnknown)
+  {
+    FRights.Text = RightsText;
+  }
+  FHumanRights = ReadCacheString(Stream);
+  FOwner = ReadCacheToken(Stream);
+  FGroup = ReadCacheToken(Stream);
+  FIsEncrypted = (ReadCacheInt(Stream) != 0);
+  if (ReadCacheInt(Stream) != 0)
+  {
+    DebugAssert(FLinkedFile == NULL);
+    FLinkedFile = new TRemoteFile(this);
+    FLinkedFile->LoadFromStream(Stream);
+  }
+}
+//---------------------------------------------------------------------------
 void __fastcall TRemoteFile::LoadTypeInfo()
 {
   /* TODO : If file is link: Should be attributes taken from linked file? */
@@ -1040,16 +1182,21 @@ UnicodeString __fastcall TRemoteFile::GetExtension()
   return UnixExtractFileExt(FFileName);
 }
 //---------------------------------------------------------------------------
+TRights * __fastcall TRemoteFile::GetRights()
+{
+  return &FRights;
+}
+//---------------------------------------------------------------------------
 void __fastcall TRemoteFile::SetRights(TRights * value)
 {
-  FRights->Assign(value);
+  FRights.Assign(value);
 }
 //---------------------------------------------------------------------------
 UnicodeString __fastcall TRemoteFile::GetRightsStr()
 {
   // note that HumanRights is typically an empty string
   // (with an exception of Perm-fact-only MLSD FTP listing)
-  return FRights->Unknown ? HumanRights : FRights->Text;
+  return FRights.Unknown ? HumanRights : FRights.Text;
 }
 //---------------------------------------------------------------------------
 void __fastcall TRemoteFile::SetListingStr(UnicodeString value)
@@ -1500,10 +1647,34 @@ __fastcall TRemoteFileList::TRemoteFileList():
 //---------------------------------------------------------------------------
 void __fastcall TRemoteFileList::AddFile(TRemoteFile * File)
 {
+  // Owner and group names (and MLSD rights) repeat across most files of a listing.
+  // Make the files share one instance of each string,
+  // to save memory and allocations with large listings.
+  if (!File->Owner.Name.IsEmpty())
+  {
+    TRemoteToken Owner = File->Owner;
+    Owner.Name = InternString(Owner.Name);
+    File->Owner = Owner;
+  }
+  if (!File->Group.Name.IsEmpty())
+  {
+    TRemoteToken Group = File->Group;
+    Group.Name = InternString(Group.Name);
+    File->Group = Group;
+  }
+  if (!File->HumanRights.IsEmpty())
+  {
+    File->HumanRights = InternString(File->HumanRights);
+  }
   Add(File);
   File->Directory = this;
 }
 //---------------------------------------------------------------------------
+UnicodeString __fastcall TRemoteFileList::InternString(const UnicodeString & S)
+{
+  return *FInternedStrings.insert(S).first;
+}
+//---------------------------------------------------------------------------
 TStrings * __fastcall TRemoteFileList::CloneStrings(TStrings * List)
 {
   std::unique_ptr<TStringList> Result(new TStringList());
@@ -1532,6 +1703,7 @@ void __fastcall TRemoteFileList::Reset()
 {
   FTimestamp = Now();
   Clear();
+  FInternedStrings.clear();
 }
 //---------------------------------------------------------------------------
 void __fastcall TRemoteFileList::SetDirectory(UnicodeString value)
@@ -1688,9 +1860,48 @@ void __fastcall TRemoteDirectory::SetIncludeThisDirectory(Boolean value)
   }
 }
 //===========================================================================
+// Total number of files in all cached listings, above which the least recently
+// used listings are dropped. The listings are trimmed to three quarters
+// of the budget, so that the scan for the least recently used ones does not repeat too often.
+static const int DirectoryCacheMaxFiles = 1000000;
+static const int DirectoryCacheSignature = 0x43445357; // "WSDC"
+static const int DirectoryCacheVersion = 1;
+//---------------------------------------------------------------------------
+// Cached listing is never modified. It is released only after the last reader,
+// which copies it outside of the cache lock, has finished.
+class TCachedFileList : public TObject
+{
+public:
+  __fastcall TCachedFileList(TRemoteFileList * AFileList)
+  {
+    FileList = AFileList;
+    References = 1;
+    LastUse = 0;
+    Restored = false;
+    DirectoryModificationFmt = mfNone;
+  }
+
+  virtual __fastcall ~TCachedFileList()
+  {
+    delete FileList;
+  }
+
+  TRemoteFileList * FileList;
+  int References;
+  unsigned int LastUse;
+  // Listing loaded from a previous session, not yet revalidated against a fresh listing of its parent.
+  // Modification of the directory itself, as seen in the parent listing, when the listing was saved.
+  bool Restored;
+  TDateTime DirectoryModification;
+  TModificationFmt DirectoryModificationFmt;
+};
+//---------------------------------------------------------------------------
 __fastcall TRemoteDirectoryCache::TRemoteDirectoryCache(): TStringList()
 {
   FSection = new TCriticalSection();
+  FFileCount = 0;
+  FUseCounter = 0;
+  FRestoredCount = 0;
   Sorted = true;
   Duplicates = Types::dupError;
   CaseSensitive = true;
@@ -1710,13 +1921,29 @@ void __fastcall TRemoteDirectoryCache::Clear()
   {
     for (int Index = 0; Index < Count; Index++)
     {
-      delete (TRemoteFileList *)Objects[Index];
+      ReleaseFileList(GetCachedFileList(Index));
       Objects[Index] = NULL;
     }
   }
   __finally
   {
     TStringList::Clear();
+    FFileCount = 0;
+    FRestoredCount = 0;
+  }
+}
+//---------------------------------------------------------------------------
+TCachedFileList * __fastcall TRemoteDirectoryCache::GetCachedFileList(int Index)
+{
+  return DebugNotNull(dynamic_cast<TCachedFileList *>(Objects[Index]));
+}
+//---------------------------------------------------------------------------
+void __fastcall TRemoteDirectoryCache::ReleaseFileList(TCachedFileList * CachedFileList)
+{
+  CachedFileList->References--;
+  if (CachedFileList->References == 0)
+  {
+    delete CachedFileList;
   }
 }
 //---------------------------------------------------------------------------
@@ -1743,7 +1970,7 @@ bool __fastcall TRemoteDirectoryCache::HasNewerFileList(const UnicodeString Dire
   int Index = IndexOf(UnixExcludeTrailingBackslash(Directory));
   if (Index >= 0)
   {
-    TRemoteFileList * FileList = dynamic_cast<TRemoteFileList *>(Objects[Index]);
+    TRemoteFileList * FileList = GetCachedFileList(Index)->FileList;
     if (FileList->Timestamp <= Timestamp)
     {
       Index = -1;
@@ -1755,14 +1982,32 @@ bool __fastcall TRemoteDirectoryCache::HasNewerFileList(const UnicodeString Dire
 bool __fastcall TRemoteDirectoryCache::GetFileList(const UnicodeString Directory,
   TRemoteFileList * FileList)
 {
-  TGuard Guard(FSection);
+  TCachedFileList * CachedFileList = NULL;
+  {
+    TGuard Guard(FSection);
 
-  int Index = IndexOf(UnixExcludeTrailingBackslash(Directory));
-  bool Result = (Index >= 0);
+    int Index = IndexOf(UnixExcludeTrailingBackslash(Directory));
+    if (Index >= 0)
+    {
+      CachedFileList = GetCachedFileList(Index);
+      CachedFileList->References++;
+      CachedFileList->LastUse = ++FUseCounter;
+    }
+  }
+
+  bool Result = (CachedFileList != NULL);
   if (Result)
   {
-    DebugAssert(Objects[Index] != NULL);
-    dynamic_cast<TRemoteFileList *>(Objects[Index])->DuplicateTo(FileList);
+    // Copying large listing takes time, do not block other threads meanwhile
+    try
+    {
+      CachedFileList->FileList->DuplicateTo(FileList);
+    }
+    __finally
+    {
+      TGuard Guard(FSection);
+      ReleaseFileList(CachedFileList);
+    }
   }
   return Result;
 }
@@ -1772,6 +2017,13 @@ void __fastcall TRemoteDirectoryCache::AddFileList(TRemoteFileList * FileList)
   DebugAssert(FileList);
   TRemoteFileList * Copy = new TRemoteFileList();
   FileList->DuplicateTo(Copy);
+  AdoptFileList(Copy);
+}
+//---------------------------------------------------------------------------
+void __fastcall TRemoteDirectoryCache::AdoptFileList(TRemoteFileList * FileList)
+{
+  DebugAssert(FileList);
+  TCachedFileList * CachedFileList = new TCachedFileList(FileList);
 
   {
     TGuard Guard(FSection);
@@ -1779,7 +2031,40 @@ void __fastcall TRemoteDirectoryCache::AddFileList(TRemoteFileList * FileList)
     // file list cannot be cached already with only one thread, but it can be
     // when directory is loaded by secondary terminal
     DoClearFileList(FileList->Directory, false);
-    AddObject(Copy->Directory, Copy);
+    if (FRestoredCount > 0)
+    {
+      RevalidateRestored(FileList);
+    }
+    CachedFileList->LastUse = ++FUseCounter;
+    AddObject(FileList->Directory, CachedFileList);
+    FFileCount += FileList->Count;
+    if (FFileCount > DirectoryCacheMaxFiles)
+    {
+      TrimToBudget();
+    }
+  }
+}
+//---------------------------------------------------------------------------
+void __fastcall TRemoteDirectoryCache::TrimToBudget()
+{
+  std::vector<std::pair<unsigned int, UnicodeString> > ByUse;
+  ByUse.reserve(Count);
+  for (int Index = 0; Index < Count; Index++)
+  {
+    ByUse.push_back(std::make_pair(GetCachedFileList(Index)->LastUse, Strings[Index]));
+  }
+  std::sort(ByUse.begin(), ByUse.end());
+
+  // Keep at least the listing just added, even if it alone exceeds the budget
+  size_t Pos = 0;
+  while ((FFileCount > DirectoryCacheMaxFiles / 4 * 3) && (Pos + 1 < ByUse.size()))
+  {
+    int Index = IndexOf(ByUse[Pos].second);
+    if (DebugAlwaysTrue(Index >= 0))
+    {
+      Delete(Index);
+    }
+    Pos++;
   }
 }
 //---------------------------------------------------------------------------
@@ -1814,10 +2099,223 @@ void __fastcall TRemoteDirectoryCache::DoClearFileList(UnicodeString Directory,
 //---------------------------------------------------------------------------
 void __fastcall TRemoteDirectoryCache::Delete(int Index)
 {
-  delete dynamic_cast<TRemoteFileList *>(Objects[Index]);
+  TCachedFileList * CachedFileList = GetCachedFileList(Index);
+  FFileCount -= CachedFileList->FileList->Count;
+  if (CachedFileList->Restored)
+  {
+    FRestoredCount--;
+  }
+  ReleaseFileList(CachedFileList);
   TStringList::Delete(Index);
 }
 //---------------------------------------------------------------------------
+void __fastcall TRemoteDirectoryCache::RevalidateRestored(TRemoteFileList * FileList)
+{
+  // Listings captured in this session are kept up to date by TTerminal::DirectoryModified.
+  // The restored ones can be checked only by a modification time of their directory,
+  // which changes whenever an entry is added, removed or renamed.
+  UnicodeString Prefix = UnixIncludeTrailingBackslash(FileList->Directory);
+  std::vector<std::pair<UnicodeString, bool> > Stale;
+  for (int Index = 0; Index < Count; Index++)
+  {
+    UnicodeString Directory = Strings[Index];
+    TCachedFileList * CachedFileList = GetCachedFileList(Index);
+    if (CachedFileList->Restored &&
+        (Directory.Length() > Prefix.Length()) &&
+        (Directory.SubString(1, Prefix.Length()) == Prefix))
+    {
+      UnicodeString Name = Directory.SubString(Prefix.Length() + 1, Directory.Length() - Prefix.Length());
+      if (Name.Pos(L"/") == 0)
+      {
+        TRemoteFile * File = FileList->FindFile(Name);
+        if ((File == NULL) || !File->IsDirectory)
+        {
+          // The directory is gone, and so are all its subdirectories
+          Stale.push_back(std::make_pair(Directory, true));
+        }
+        else if ((CachedFileList->DirectoryModificationFmt != mfNone) &&
+                 (File->IsSymLink ||
+                  (File->ModificationFmt != CachedFileList->DirectoryModificationFmt) ||
+                  (File->Modification != CachedFileList->DirectoryModification)))
+        {
+          Stale.push_back(std::make_pair(Directory, false));
+        }
+        else
+        {
+          // Either confirmed, or cannot be checked, in which case only the maximal age applies
+          CachedFileList->Restored = false;
+          FRestoredCount--;
+        }
+      }
+    }
+  }
+
+  for (size_t Index = 0; Index < Stale.size(); Index++)
+  {
+    DoClearFileList(Stale[Index].first, Stale[Index].second);
+  }
+}
+//---------------------------------------------------------------------------
+bool __fastcall TRemoteDirectoryCache::FindDirectoryModification(
+  const UnicodeString & Directory, TDateTime & Modification, TModificationFmt & ModificationFmt)
+{
+  bool Result = false;
+  if (!IsUnixRootPath(Directory))
+  {
+    int Index = IndexOf(UnixExcludeTrailingBackslash(UnixExtractFileDir(Directory)));
+    if (Index >= 0)
+    {
+      TRemoteFile * File = GetCachedFileList(Index)->FileList->FindFile(UnixExtractFileName(Directory));
+      if ((File != NULL) && File->IsDirectory && !File->IsSymLink &&
+          (File->ModificationFmt != mfNone))
+      {
+        Modification = File->Modification;
+        ModificationFmt = File->ModificationFmt;
+        Result = true;
+      }
+    }
+  }
+  return Result;
+}
+//---------------------------------------------------------------------------
+bool __fastcall TRemoteDirectoryCache::GetRestoredDirectoryModification(
+  const UnicodeString Directory, TDateTime & Modification, TModificationFmt & ModificationFmt)
+{
+  TGuard Guard(FSection);
+
+  bool Result = false;
+  if (FRestoredCount > 0)
+  {
+    int Index = IndexOf(UnixExcludeTrailingBackslash(Directory));
+    if (Index >= 0)
+    {
+      TCachedFileList * CachedFileList = GetCachedFileList(Index);
+      if (CachedFileList->Restored)
+      {
+        Modification = CachedFileList->DirectoryModification;
+        ModificationFmt = CachedFileList->DirectoryModificationFmt;
+        Result = true;
+      }
+    }
+  }
+  return Result;
+}
+//---------------------------------------------------------------------------
+void __fastcall TRemoteDirectoryCache::ConfirmRestored(const UnicodeString Directory)
+{
+  TGuard Guard(FSection);
+
+  int Index = IndexOf(UnixExcludeTrailingBackslash(Directory));
+  if (Index >= 0)
+  {
+    TCachedFileList * CachedFileList = GetCachedFileList(Index);
+    if (CachedFileList->Restored)
+    {
+      CachedFileList->Restored = false;
+      FRestoredCount--;
+    }
+  }
+}
+//---------------------------------------------------------------------------
+void __fastcall TRemoteDirectoryCache::Serialize(TStream * Stream)
+{
+  TGuard Guard(FSection);
+
+  WriteCacheInt(Stream, DirectoryCacheSignature);
+  WriteCacheInt(Stream, DirectoryCacheVersion);
+  WriteCacheInt(Stream, Count);
+  for (int Index = 0; Index < Count; Index++)
+  {
+    TCachedFileList * CachedFileList = GetCachedFileList(Index);
+    TRemoteFileList * FileList = CachedFileList->FileList;
+    TDateTime DirectoryModification;
+    TModificationFmt DirectoryModificationFmt;
+    if (CachedFileList->Restored)
+    {
+      DirectoryModification = CachedFileList->DirectoryModification;
+      DirectoryModificationFmt = CachedFileList->DirectoryModificationFmt;
+    }
+    else if (!FindDirectoryModification(Strings[Index], DirectoryModification, DirectoryModificationFmt))
+    {
+      DirectoryModification = TDateTime();
+      DirectoryModificationFmt = mfNone;
+    }
+    WriteCacheString(Stream, FileList->Directory);
+    WriteCacheDateTime(Stream, FileList->Timestamp);
+    WriteCacheDateTime(Stream, DirectoryModification);
+    WriteCacheInt(Stream, DirectoryModificationFmt);
+    WriteCacheInt(Stream, FileList->Count);
+    for (int FileIndex = 0; FileIndex < FileList->Count; FileIndex++)
+    {
+      FileList->Files[FileIndex]->SaveToStream(Stream);
+    }
+  }
+}
+//---------------------------------------------------------------------------
+void __fastcall TRemoteDirectoryCache::Deserialize(TStream * Stream, TTerminal * Terminal, TDateTime MinTimestamp)
+{
+  // Parse everything first, so that corrupted data leave the cache intact
+  std::unique_ptr<TObjectList> CachedFileLists(new TObjectList());
+  if ((ReadCacheInt(Stream) != DirectoryCacheSignature) ||
+      (ReadCacheInt(Stream) != DirectoryCacheVersion))
+  {
+    throw Exception(L"Invalid directory cache data");
+  }
+  int ListCount = ReadCacheInt(Stream);
+  for (int Index = 0; Index < ListCount; Index++)
+  {
+    std::unique_ptr<TRemoteFileList> FileList(new TRemoteFileList());
+    FileList->FDirectory = ReadCacheString(Stream);
+    TDateTime Timestamp = ReadCacheDateTime(Stream);
+    TDateTime DirectoryModification = ReadCacheDateTime(Stream);
+    int DirectoryModificationFmt = ReadCacheInt(Stream);
+    if ((DirectoryModificationFmt < mfNone) || (DirectoryModificationFmt > mfFull))
+    {
+      throw Exception(L"Invalid directory cache data");
+    }
+    int FileCount = ReadCacheInt(Stream);
+    for (int FileIndex = 0; FileIndex < FileCount; FileIndex++)
+    {
+      std::unique_ptr<TRemoteFile> File(new TRemoteFile());
+      File->LoadFromStream(Stream);
+      File->Terminal = Terminal;
+      FileList->AddFile(File.release());
+    }
+    FileList->FTimestamp = Timestamp;
+
+    if (Timestamp >= MinTimestamp)
+    {
+      TCachedFileList * CachedFileList = new TCachedFileList(FileList.release());
+      CachedFileList->Restored = true;
+      CachedFileList->DirectoryModification = DirectoryModification;
+      CachedFileList->DirectoryModificationFmt = static_cast<TModificationFmt>(DirectoryModificationFmt);
+      CachedFileLists->Add(CachedFileList);
+    }
+  }
+
+  TGuard Guard(FSection);
+  CachedFileLists->OwnsObjects = false;
+  for (int Index = 0; Index < CachedFileLists->Count; Index++)
+  {
+    TCachedFileList * CachedFileList = static_cast<TCachedFileList *>(CachedFileLists->Items[Index]);
+    // Listings loaded in this session so far take precedence
+    if (IndexOf(CachedFileList->FileList->Directory) >= 0)
+    {
+      delete CachedFileList;
+    }
+    else
+    {
+      AddObject(CachedFileList->FileList->Directory, CachedFileList);
+      FFileCount += CachedFileList->FileList->Count;
+      FRestoredCount++;
+    }
+  }
+  if (FFileCount > DirectoryCacheMaxFiles)
+  {
+    TrimToBudget();
+  }
+}
+//---------------------------------------------------------------------------
 //---------------------------------------------------------------------------
 __fastcall TRemoteDirectoryChangesCache::TRemoteDirectoryChangesCache(int MaxSize) :
   TStringList(),
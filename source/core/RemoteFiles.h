@@ -4,6 +4,7 @@
 //---------------------------------------------------------------------------
 #include <vector>
 #include <map>
+#include <set>
 //---------------------------------------------------------------------------
 enum TModificationFmt { mfNone, mfMDHM, mfMDY, mfFull };
 //---------------------------------------------------------------------------
@@ -15,10 +16,110 @@ enum TModificationFmt { mfNone, mfMDHM, mfMDY, mfFull };
 #define PARTIAL_EXT L".filepart"
 //---------------------------------------------------------------------------
 class TTerminal;
-class TRights;
 class TRemoteFileList;
 class THierarchicalStorage;
 //---------------------------------------------------------------------------
+class TRights
+{
+public:
+  static const int TextLen = 9;
+  static const wchar_t UndefSymbol = L'$';
+  static const wchar_t UnsetSymbol = L'-';
+  // Used by Win32-OpenSSH for permissions that are not applicable on Windows.
+  // See strmode() in contrib\win32\win32compat\misc.c
+  static const wchar_t UnsetSymbolWin = L'*';
+  static const wchar_t BasicSymbols[];
+  static const wchar_t CombinedSymbols[];
+  static const wchar_t ExtendedSymbols[];
+  static const wchar_t ModeGroups[];
+  enum TRight {
+    rrUserIDExec, rrGroupIDExec, rrStickyBit,
+    rrUserRead, rrUserWrite, rrUserExec,
+    rrGroupRead, rrGroupWrite, rrGroupExec,
+    rrOtherRead, rrOtherWrite, rrOtherExec,
+    rrFirst = rrUserIDExec, rrLast = rrOtherExec };
+  enum TFlag {
+    rfSetUID =    04000, rfSetGID =      02000, rfStickyBit = 01000,
+    rfUserRead =  00400, rfUserWrite =   00200, rfUserExec =  00100,
+    rfGroupRead = 00040, rfGroupWrite =  00020, rfGroupExec = 00010,
+    rfOtherRead = 00004, rfOtherWrite =  00002, rfOtherExec = 00001,
+    rfRead =      00444, rfWrite =       00222, rfExec =      00111,
+    rfNo =        00000, rfDefault =     00644, rfAll =       00777,
+    rfSpecials =  07000, rfAllSpecials = 07777 };
+  enum TUnsupportedFlag {
+    rfDirectory  = 040000 };
+  enum TState { rsNo, rsYes, rsUndef };
+
+public:
+  static TFlag __fastcall RightToFlag(TRight Right);
+
+  __fastcall TRights();
+  __fastcall TRights(const TRights & Source);
+  __fastcall TRights(unsigned short Number);
+  void __fastcall Assign(const TRights * Source);
+  void __fastcall AddExecute();
+  void __fastcall AllUndef();
+
+  bool __fastcall operator ==(const TRights & rhr) const;
+  bool __fastcall operator ==(unsigned short rhr) const;
+  bool __fastcall operator !=(const TRights & rhr) const;
+  TRights & __fastcall operator =(const TRights & rhr);
+  TRights & __fastcall operator =(unsigned short rhr);
+  TRights __fastcall operator ~() const;
+  TRights __fastcall operator &(unsigned short rhr) const;
+  TRights __fastcall operator &(const TRights & rhr) const;
+  TRights & __fastcall operator &=(unsigned short rhr);
+  TRights & __fastcall operator &=(const TRights & rhr);
+  TRights __fastcall operator |(unsigned short rhr) const;
+  TRights __fastcall operator |(const TRights & rhr) const;
+  TRights & __fastcall operator |=(unsigned short rhr);
+  TRights & __fastcall operator |=(const TRights & rhr);
+  __fastcall operator unsigned short() const;
+  __fastcall operator unsigned long() const;
+
+  __property bool AllowUndef = { read = FAllowUndef, write = SetAllowUndef };
+  __property bool IsUndef = { read = GetIsUndef };
+  __property UnicodeString ModeStr = { read = GetModeStr };
+  __property UnicodeString SimplestStr = { read = GetSimplestStr };
+  __property UnicodeString Octal = { read = GetOctal, write = SetOctal };
+  __property unsigned short Number = { read = GetNumber, write = SetNumber };
+  __property unsigned short NumberSet = { read = FSet };
+  __property unsigned short NumberUnset = { read = FUnset };
+  __property unsigned long NumberDecadic = { read = GetNumberDecadic };
+  __property bool ReadOnly = { read = GetReadOnly, write = SetReadOnly };
+  __property bool Right[TRight Right] = { read = GetRight, write = SetRight };
+  __property TState RightUndef[TRight Right] = { read = GetRightUndef, write = SetRightUndef };
+  __property UnicodeString Text = { read = GetText, write = SetText };
+  __property bool Unknown = { read = FUnknown };
+
+private:
+  bool FAllowUndef;
+  unsigned short FSet;
+  unsigned short FUnset;
+  UnicodeString FText;
+  bool FUnknown;
+
+  bool __fastcall GetIsUndef() const;
+  UnicodeString __fastcall GetModeStr() const;
+  UnicodeString __fastcall GetSimplestStr() const;
+  void __fastcall SetNumber(unsigned short value);
+  UnicodeString __fastcall GetText() const;
+  void __fastcall SetText(const UnicodeString & value);
+  void __fastcall SetOctal(UnicodeString value);
+  unsigned short __fastcall GetNumber() const;
+  unsigned short __fastcall GetNumberSet() const;
+  unsigned short __fastcall GetNumberUnset() const;
+  unsigned long __fastcall GetNumberDecadic() const;
+  UnicodeString __fastcall GetOctal() const;
+  bool __fastcall GetReadOnly();
+  bool __fastcall GetRight(TRight Right) const;
+  TState __fastcall GetRightUndef(TRight Right) const;
+  void __fastcall SetAllowUndef(bool value);
+  void __fastcall SetReadOnly(bool value);
+  void __fastcall SetRight(TRight Right, bool value);
+  void __fastcall SetRightUndef(TRight Right, TState value);
+};
+//---------------------------------------------------------------------------
 class TRemoteToken
 {
 public:
@@ -79,6 +180,7 @@ private:
 //---------------------------------------------------------------------------
 class TRemoteFile : public TPersistent
 {
+friend class TSFTPFileSystem;
 private:
   TRemoteFileList * FDirectory;
   TRemoteToken FOwner;
@@ -95,7 +197,7 @@ private:
   TRemoteFile * FLinkedFile;
   TRemoteFile * FLinkedByFile;
   UnicodeString FLinkTo;
-  TRights *FRights;
+  TRights FRights;
   UnicodeString FHumanRights;
   TTerminal *FTerminal;
   wchar_t FType;
@@ -116,6 +218,7 @@ private:
   wchar_t __fastcall GetType() const;
   void __fastcall SetType(wchar_t AType);
   void __fastcall SetTerminal(TTerminal * value);
+  TRights * __fastcall GetRights();
   void __fastcall SetRights(TRights * value);
   UnicodeString __fastcall GetFullFileName() const;
   bool __fastcall GetHaveFullFileName() const;
@@ -144,6 +247,8 @@ public:
   void __fastcall Complete();
   void __fastcall SetEncrypted();
   const TRemoteFile * __fastcall Resolve() const;
+  void __fastcall SaveToStream(TStream * Stream) const;
+  void __fastcall LoadFromStream(TStream * Stream);
 
   static bool __fastcall IsTimeShiftingApplicable(TModificationFmt ModificationFmt);
   static void __fastcall ShiftTimeInSeconds(TDateTime & DateTime, TModificationFmt ModificationFmt, __int64 Seconds);
@@ -168,7 +273,7 @@ public:
   __property const TRemoteFile * LinkedFile = { read = GetLinkedFile };
   __property UnicodeString LinkTo = { read = FLinkTo, write = FLinkTo };
   __property UnicodeString ListingStr = { read = GetListingStr, write = SetListingStr };
-  __property TRights * Rights = { read = FRights, write = SetRights };
+  __property TRights * Rights = { read = GetRights, write = SetRights };
   __property UnicodeString HumanRights = { read = FHumanRights, write = FHumanRights };
   __property TTerminal * Terminal = { read = FTerminal, write = SetTerminal };
   __property wchar_t Type = { read = GetType, write = SetType };
@@ -203,9 +308,12 @@ friend class TSFTPFileSystem;
 friend class TFTPFileSystem;
 friend class TWebDAVFileSystem;
 friend class TS3FileSystem;
+friend class TRemoteDirectoryCache;
 protected:
   UnicodeString FDirectory;
   TDateTime FTimestamp;
+  std::set<UnicodeString> FInternedStrings;
+  UnicodeString __fastcall InternString(const UnicodeString & S);
   TRemoteFile * __fastcall GetFiles(Integer Index);
   virtual void __fastcall SetDirectory(UnicodeString value);
   UnicodeString __fastcall GetFullDirectory();
@@ -260,6 +368,8 @@ public:
   __property TRemoteFile * ThisDirectory = { read = FThisDirectory };
 };
 //---------------------------------------------------------------------------
+class TCachedFileList;
+//---------------------------------------------------------------------------
 class TRemoteDirectoryCache : private TStringList
 {
 public:
@@ -270,16 +380,33 @@ public:
   bool __fastcall GetFileList(const UnicodeString Directory,
     TRemoteFileList * FileList);
   void __fastcall AddFileList(TRemoteFileList * FileList);
+  void __fastcall AdoptFileList(TRemoteFileList * FileList);
   void __fastcall ClearFileList(UnicodeString Directory, bool SubDirs);
   void __fastcall Clear();
 
+  bool __fastcall GetRestoredDirectoryModification(
+    const UnicodeString Directory, TDateTime & Modification, TModificationFmt & ModificationFmt);
+  void __fastcall ConfirmRestored(const UnicodeString Directory);
+
+  void __fastcall Serialize(TStream * Stream);
+  void __fastcall Deserialize(TStream * Stream, TTerminal * Terminal, TDateTime MinTimestamp);
+
   __property bool IsEmpty = { read = GetIsEmpty };
 protected:
   virtual void __fastcall Delete(int Index);
 private:
   TCriticalSection * FSection;
+  int FFileCount;
+  unsigned int FUseCounter;
+  int FRestoredCount;
   bool __fastcall GetIsEmpty() const;
+  TCachedFileList * __fastcall GetCachedFileList(int Index);
   void __fastcall DoClearFileList(UnicodeString Directory, bool SubDirs);
+  void __fastcall ReleaseFileList(TCachedFileList * CachedFileList);
+  void __fastcall TrimToBudget();
+  void __fastcall RevalidateRestored(TRemoteFileList * FileList);
+  bool __fastcall FindDirectoryModification(
+    const UnicodeString & Directory, TDateTime & Modification, TModificationFmt & ModificationFmt);
 };
 //---------------------------------------------------------------------------
 class TRemoteDirectoryChangesCache : private TStringList
@@ -310,107 +437,6 @@ private:
   int FMaxSize;
 };
 //---------------------------------------------------------------------------
-class TRights
-{
-public:
-  static const int TextLen = 9;
-  static const wchar_t UndefSymbol = L'$';
-  static const wchar_t UnsetSymbol = L'-';
-  // Used by Win32-OpenSSH for permissions that are not applicable on Windows.
-  // See strmode() in contrib\win32\win32compat\misc.c
-  static const wchar_t UnsetSymbolWin = L'*';
-  static const wchar_t BasicSymbols[];
-  static const wchar_t CombinedSymbols[];
-  static const wchar_t ExtendedSymbols[];
-  static const wchar_t ModeGroups[];
-  enum TRight {
-    rrUserIDExec, rrGroupIDExec, rrStickyBit,
-    rrUserRead, rrUserWrite, rrUserExec,
-    rrGroupRead, rrGroupWrite, rrGroupExec,
-    rrOtherRead, rrOtherWrite, rrOtherExec,
-    rrFirst = rrUserIDExec, rrLast = rrOtherExec };
-  enum TFlag {
-    rfSetUID =    04000, rfSetGID =      02000, rfStickyBit = 01000,
-    rfUserRead =  00400, rfUserWrite =   00200, rfUserExec =  00100,
-    rfGroupRead = 00040, rfGroupWrite =  00020, rfGroupExec = 00010,
-    rfOtherRead = 00004, rfOtherWrite =  00002, rfOtherExec = 00001,
-    rfRead =      00444, rfWrite =       00222, rfExec =      00111,
-    rfNo =        00000, rfDefault =     00644, rfAll =       00777,
-    rfSpecials =  07000, rfAllSpecials = 07777 };
-  enum TUnsupportedFlag {
-    rfDirectory  = 040000 };
-  enum TState { rsNo, rsYes, rsUndef };
-
-public:
-  static TFlag __fastcall RightToFlag(TRight Right);
-
-  __fastcall TRights();
-  __fastcall TRights(const TRights & Source);
-  __fastcall TRights(unsigned short Number);
-  void __fastcall Assign(const TRights * Source);
-  void __fastcall AddExecute();
-  void __fastcall AllUndef();
-
-  bool __fastcall operator ==(const TRights & rhr) const;
-  bool __fastcall operator ==(unsigned short rhr) const;
-  bool __fastcall operator !=(const TRights & rhr) const;
-  TRights & __fastcall operator =(const TRights & rhr);
-  TRights & __fastcall operator =(unsigned short rhr);
-  TRights __fastcall operator ~() const;
-  TRights __fastcall operator &(unsigned short rhr) const;
-  TRights __fastcall operator &(const TRights & rhr) const;
-  TRights & __fastcall operator &=(unsigned short rhr);
-  TRights & __fastcall operator &=(const TRights & rhr);
-  TRights __fastcall operator |(unsigned short rhr) const;
-  TRights __fastcall operator |(const TRights & rhr) const;
-  TRights & __fastcall operator |=(unsigned short rhr);
-  TRights & __fastcall operator |=(const TRights & rhr);
-  __fastcall operator unsigned short() const;
-  __fastcall operator unsigned long() const;
-
-  __property bool AllowUndef = { read = FAllowUndef, write = SetAllowUndef };
-  __property bool IsUndef = { read = GetIsUndef };
-  __property UnicodeString ModeStr = { read = GetModeStr };
-  __property UnicodeString SimplestStr = { read = GetSimplestStr };
-  __property UnicodeString Octal = { read = GetOctal, write = SetOctal };
-  __property unsigned short Number = { read = GetNumber, write = SetNumber };
-  __property unsigned short NumberSet = { read = FSet };
-  __property unsigned short NumberUnset = { read = FUnset };
-  __property unsigned long NumberDecadic = { read = GetNumberDecadic };
-  __property bool ReadOnly = { read = GetReadOnly, write = SetReadOnly };
-  __property bool Right[TRight Right] = { read = GetRight, write = SetRight };
-  __property TState RightUndef[TRight Right] = { read = GetRightUndef, write = SetRightUndef };
-  __property UnicodeString Text = { read = GetText, write = SetText };
-  __property bool Unknown = { read = FUnknown };
-
-private:
-  bool FAllowUndef;
-  unsigned short FSet;
-  unsigned short FUnset;
-  UnicodeString FText;
-  bool FUnknown;
-
-  bool __fastcall GetIsUndef() const;
-  UnicodeString __fastcall GetModeStr() const;
-  UnicodeString __fastcall GetSimplestStr() const;
-  void __fastcall SetNumber(unsigned short value);
-  UnicodeString __fastcall GetText() const;
-  void __fastcall SetText(const UnicodeString & value);
-  void __fastcall SetOctal(UnicodeString value);
-  unsigned short __fastcall GetNumber() const;
-  unsigned short __fastcall GetNumberSet() const;
-  unsigned short __fastcall GetNumberUnset() const;
-  unsigned long __fastcall GetNumberDecadic() const;
-  UnicodeString __fastcall GetOctal() const;
-  bool __fastcall GetReadOnly();
-  bool __fastcall GetRight(TRight Right) const;
-  TState __fastcall GetRightUndef(TRight Right) const;
-  void __fastcall SetAllowUndef(bool value);
-  void __fastcall SetReadOnly(bool value);
-  void __fastcall SetRight(TRight Right, bool value);
-  void __fastcall SetRightUndef(TRight Right, TState value);
-};
-//---------------------------------------------------------------------------
 enum TValidProperty { vpRights, vpGroup, vpOwner, vpModification, vpLastAccess, vpEncrypt };
 typedef Set<TValidProperty, vpRights, vpEncrypt> TValidProperties;
 class TRemoteProperties
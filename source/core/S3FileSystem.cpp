@@ -669,6 +669,7 @@ bool __fastcall TS3FileSystem::IsCapable(int Capability) const
     case fcResumeSupport:
     case fcChangePassword:
     case fcLocking:
+    case fcPipelinedChanges:
       return false;
 
     default:
@@ -939,6 +940,24 @@ void __fastcall TS3FileSystem::ReadDirectory(TRemoteFileList * FileList)
   ReadDirectoryInternal(FileList->Directory, FileList, 0, UnicodeString());
 }
 //---------------------------------------------------------------------------
+bool __fastcall TS3FileSystem::ReadDirectoryTree(const UnicodeString & /*Directory*/, TObjectList * /*FileLists*/)
+{
+  return false;
+}
+//---------------------------------------------------------------------------
+void __fastcall TS3FileSystem::ChangeFilesProperties(TStrings * FileList,
+  const TRemoteProperties * /*Properties*/, TStrings * FailedFiles)
+{
+  DebugFail();
+  FailedFiles->Assign(FileList);
+}
+//---------------------------------------------------------------------------
+void __fastcall TS3FileSystem::DeleteFiles(TStrings * FileList, TStrings * FailedFiles)
+{
+  DebugFail();
+  FailedFiles->Assign(FileList);
+}
+//---------------------------------------------------------------------------
 void __fastcall TS3FileSystem::ReadSymlink(TRemoteFile * /*SymlinkFile*/,
   TRemoteFile *& /*File*/)
 {
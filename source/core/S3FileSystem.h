@@ -51,6 +51,9 @@ public:
     const TRemoteFile * File, const TRemoteProperties * Properties,
     TChmodSessionAction & Action);
   virtual bool __fastcall LoadFilesProperties(TStrings * FileList);
+  virtual void __fastcall ChangeFilesProperties(TStrings * FileList,
+    const TRemoteProperties * Properties, TStrings * FailedFiles);
+  virtual void __fastcall DeleteFiles(TStrings * FileList, TStrings * FailedFiles);
   virtual void __fastcall CalculateFilesChecksum(const UnicodeString & Alg,
     TStrings * FileList, TStrings * Checksums,
     TCalculatedChecksumEvent OnCalculatedChecksum);
@@ -85,6 +88,7 @@ public:
   virtual void __fastcall LookupUsersGroups();
   virtual void __fastcall ReadCurrentDirectory();
   virtual void __fastcall ReadDirectory(TRemoteFileList * FileList);
+  virtual bool __fastcall ReadDirectoryTree(const UnicodeString & Directory, TObjectList * FileLists);
   virtual void __fastcall ReadFile(const UnicodeString FileName,
     TRemoteFile *& File);
   virtual void __fastcall ReadSymlink(TRemoteFile * SymLinkFile,
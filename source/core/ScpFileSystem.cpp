@@ -14,6 +14,7 @@
 #include <StrUtils.hpp>
 
 #include <stdio.h>
+#include <algorithm>
 //---------------------------------------------------------------------------
 #pragma package(smart_init)
 //---------------------------------------------------------------------------
@@ -37,7 +38,7 @@ DERIVE_EXT_EXCEPTION(EScpFileSkipped, ESkipFile);
 //===========================================================================
 #define MaxShellCommand fsLang
 #define ShellCommandCount MaxShellCommand + 1
-#define MaxCommandLen 40
+#define MaxCommandLen 120
 struct TCommandType
 {
   int MinLines;
@@ -103,6 +104,11 @@ const wchar_t NationalVars[NationalVarCount][15] =
   {L"LANG", L"LANGUAGE", L"LC_CTYPE", L"LC_COLLATE", L"LC_MONETARY", L"LC_NUMERIC",
    L"LC_TIME", L"LC_MESSAGES", L"LC_ALL", L"HUMAN_BLOCKS" };
 const wchar_t FullTimeOption[] = L"--full-time";
+// GNU find: ls-like mode, owner, group, size, modification time in seconds since epoch,
+// path relative to the listed directory and symlink target, each terminated by NUL,
+// so that the only thing that can break the record is a newline in the file name
+const wchar_t TreeListingFormat[] = L"'%M\\0%u\\0%g\\0%s\\0%T@\\0%P\\0%l\\0\\n'";
+const int TreeListingFields = 7;
 //---------------------------------------------------------------------------
 #define F false
 #define T true
@@ -119,9 +125,14 @@ const TCommandType DefaultCommandSet[ShellCommandCount] = {
 /*ListDirectory*/       { -1, -1, F, F, F, L"%s %s \"%s\"" /* listing command, options, directory */ },
 /*ListCurrentDirectory*/{ -1, -1, F, F, F, L"%s %s" /* listing command, options */ },
 /*ListFile*/            {  1,  1, F, F, F, L"%s -d %s \"%s\"" /* listing command, options, file/directory */ },
+/*ListDirectoryTree*/   { -1, -1, F, F, F, L"find \"%s\" %s -printf %s" /* directory, depth options, format */ },
 /*LookupUserGroups*/    {  0,  1, F, F, F, L"groups" },
 /*CopyToRemote*/        { -1, -1, T, F, T, L"scp -r %s -d -t \"%s\"" /* options, directory */ },
 /*CopyToLocal*/         { -1, -1, F, F, T, L"scp -r %s -d -f \"%s\"" /* options, file */ },
+// the first line is printed only once "head" is known to work, so that the archive never ends up in the shell,
+// the rest of the archive is drained even if tar fails, but the tar exit code is kept (must fit MaxCommandLen)
+/*TarCopyToRemote*/     { -1, -1, T, F, F, L"head -c 0 </dev/null && echo \"%s\" && head -c %s | ( tar -x %s -f - -C \"%s\" ; rc=$? ; cat > /dev/null ; exit $rc )" /* first line, archive size, options, directory */ },
+/*TarCopyToLocal*/      { -1, -1, F, F, T, L"tar -c -h -b 1 -f - -C \"%s\"%s" /* directory, files */ },
 /*DeleteFile*/          {  0,  0, T, F, F, L"rm -f -r \"%s\"" /* file/directory */},
 /*RenameFile*/          {  0,  0, T, F, F, L"mv -f \"%s\" \"%s\"" /* file/directory, new name*/},
 /*CreateDirectory*/     {  0,  0, T, F, F, L"mkdir \"%s\"" /* new directory */},
@@ -292,6 +303,7 @@ __fastcall TSCPFileSystem::TSCPFileSystem(TTerminal * ATerminal, TSecureShell *
   FSecureShell = SecureShell;
   FCommandSet = new TCommandSet(FTerminal->SessionData);
   FLsFullTime = FTerminal->SessionData->SCPLsFullTime;
+  FTreeListing = asAuto;
   FOutput = new TStringList();
   FProcessingCommand = false;
   FOnCaptureOutput = NULL;
@@ -462,6 +474,7 @@ bool __fastcall TSCPFileSystem::IsCapable(int Capability) const
     case fcResumeSupport:
     case fsSkipTransfer:
     case fsParallelTransfers: // does not implement cpNoRecurse
+    case fcPipelinedChanges:
       return false;
 
     case fcChangePassword:
@@ -1103,6 +1116,251 @@ void __fastcall TSCPFileSystem::ReadDirectory(TRemoteFileList * FileList)
   while (Again);
 }
 //---------------------------------------------------------------------------
+bool __fastcall TSCPFileSystem::DetectTreeListing()
+{
+  if (FTreeListing == asAuto)
+  {
+    // -printf is GNU extension, BSD and BusyBox find fail on it
+    ExecCommand(fsListDirectoryTree, ARRAYOFCONST((L".", L"-maxdepth 0", L"'%M\\n'")), 0);
+    bool Supported =
+      (ReturnCode == 0) && (FOutput->Count == 1) &&
+      (FOutput->Strings[0].Length() == 10) && (FOutput->Strings[0][1] == L'd');
+    if (Supported)
+    {
+      FTerminal->LogEvent(L"GNU find detected, will use it to list directory trees.");
+      FTreeListing = asOn;
+    }
+    else
+    {
+      FTerminal->LogEvent(L"GNU find not detected, directory trees will be listed directory by directory.");
+      FTreeListing = asOff;
+    }
+  }
+  return (FTreeListing == asOn);
+}
+//---------------------------------------------------------------------------
+TRemoteFile * __fastcall TSCPFileSystem::CreateTreeListingFile(const RawByteString & Record,
+  const UnicodeString & Path, TTreeListingDirectories & Directories, TObjectList * FileLists)
+{
+  UnicodeString Fields[TreeListingFields];
+  const char * P = Record.c_str();
+  for (int Index = 0; Index < TreeListingFields; Index++)
+  {
+    int Len = strlen(P);
+    Fields[Index] = FSecureShell->ConvertInput(RawByteString(P, Len));
+    P += Len + 1;
+  }
+
+  const UnicodeString & Mode = Fields[0];
+  const UnicodeString & Name = Fields[5];
+  // fractional part of %T@ is of no use to us
+  UnicodeString Seconds = Fields[4];
+  int Dot = Seconds.Pos(L".");
+  if (Dot > 0)
+  {
+    Seconds.SetLength(Dot - 1);
+  }
+  __int64 Size;
+  __int64 MTime;
+  // find lists each directory before its contents
+  int Slash = Name.LastDelimiter(L"/");
+  TTreeListingDirectories::iterator Parent = Directories.find(Name.SubString(1, Slash - 1));
+  if ((Mode.Length() != 10) ||
+      !TryStrToInt64(Fields[3], Size) ||
+      !TryStrToInt64(Seconds, MTime) ||
+      (Slash == Name.Length()) ||
+      (Parent == Directories.end()))
+  {
+    return NULL;
+  }
+
+  TRemoteFile * File = new TRemoteFile();
+  try
+  {
+    File->Terminal = FTerminal;
+    File->Type = Mode[1];
+    File->Rights->AllowUndef = True;
+    File->Rights->Text = Mode.SubString(2, 9);
+    File->Owner.Name = Fields[1];
+    File->Group.Name = Fields[2];
+    File->Size = Size;
+    // The epoch time is absolute, the time difference applies to ls wall-clock times only
+    File->Modification = UnixToDateTime(MTime, FTerminal->SessionData->DSTMode);
+    File->ModificationFmt = mfFull;
+    File->LastAccess = File->Modification;
+    File->FileName = Name.SubString(Slash + 1, Name.Length() - Slash);
+    if (File->IsSymLink)
+    {
+      File->LinkTo = Fields[6];
+    }
+  }
+  catch(...)
+  {
+    delete File;
+    throw;
+  }
+  Parent->second->AddFile(File);
+
+  if (towupper(File->Type) == FILETYPE_DIRECTORY)
+  {
+    TRemoteFileList * FileList = new TRemoteFileList();
+    FileList->Directory = UnixIncludeTrailingBackslash(Path) + Name;
+    FileList->AddFile(new TRemoteParentDirectory(FTerminal));
+    FileLists->Add(FileList);
+    Directories[Name] = FileList;
+  }
+
+  return File;
+}
+//---------------------------------------------------------------------------
+bool __fastcall TSCPFileSystem::ReadDirectoryTree(const UnicodeString & Directory, TObjectList * FileLists)
+{
+  bool Result =
+    FTerminal->SessionData->SCPTreeListing &&
+    DetectTreeListing();
+
+  if (Result)
+  {
+    UnicodeString Path = UnixExcludeTrailingBackslash(AbsolutePath(Directory, false));
+    FTerminal->LogEvent(FORMAT(L"Listing directory tree \"%s\".", (Path)));
+
+    TRemoteFileList * FileList = new TRemoteFileList();
+    FileList->Directory = Path;
+    FileList->AddFile(new TRemoteParentDirectory(FTerminal));
+    FileLists->Add(FileList);
+    TTreeListingDirectories Directories;
+    Directories[UnicodeString()] = FileList;
+
+    TOperationVisualizer Visualizer(FTerminal->UseBusyCursor);
+    UnicodeString Command =
+      FCommandSet->Command(fsListDirectoryTree, ARRAYOFCONST((DelimitStr(Path), L"-mindepth 1", TreeListingFormat)));
+    SendCommand(
+      FCommandSet->FullCommand(fsListDirectoryTree, ARRAYOFCONST((DelimitStr(Path), L"-mindepth 1", TreeListingFormat))));
+
+    // The records are parsed straight from the stream, without logging
+    // and collecting the output, as the listing can be huge.
+    // Whatever happens, the output has to be read up to the last line,
+    // so that the shell stays in sync.
+    std::vector<TRemoteFile *> Symlinks;
+    UnicodeString Error;
+    bool Cancelled = false;
+    int Total = 0;
+    RawByteString Record;
+    bool IsLast = false;
+    do
+    {
+      RawByteString Line = FSecureShell->ReceiveRawLine();
+      if (Record.IsEmpty() && (memchr(Line.c_str(), '\0', Line.Length()) == NULL))
+      {
+        UnicodeString Str = FSecureShell->ConvertInput(Line);
+        IsLast = IsLastLine(Str);
+        // tolerate empty lines, as ReadDirectory does
+        if (!Str.IsEmpty() && Error.IsEmpty())
+        {
+          Error = FMTLOAD(LIST_LINE_ERROR, (Str));
+        }
+      }
+      else
+      {
+        if (!Record.IsEmpty())
+        {
+          // the newline was part of a file name
+          Record += "\n";
+        }
+        Record += Line;
+
+        int Terminators = 0;
+        for (int Index = 1; Index <= Record.Length(); Index++)
+        {
+          if (Record[Index] == '\0')
+          {
+            Terminators++;
+          }
+        }
+
+        if (Terminators >= TreeListingFields)
+        {
+          if (!Cancelled && Error.IsEmpty())
+          {
+            TRemoteFile * File = NULL;
+            if ((Terminators == TreeListingFields) && (Record[Record.Length()] == '\0'))
+            {
+              File = CreateTreeListingFile(Record, Path, Directories, FileLists);
+            }
+
+            if (File == NULL)
+            {
+              Error = FMTLOAD(LIST_LINE_ERROR, (FSecureShell->ConvertInput(Record)));
+            }
+            else
+            {
+              if (File->IsSymLink)
+              {
+                Symlinks.push_back(File);
+              }
+
+              Total++;
+              if (Total % 100 == 0)
+              {
+                bool Cancel = false;
+                FTerminal->DoReadDirectoryProgress(Total, 0, Cancel);
+                if (Cancel ||
+                    ((FTerminal->OperationProgress != NULL) && (FTerminal->OperationProgress->Cancel != csContinue)))
+                {
+                  FTerminal->LogEvent(L"Listing directory tree cancelled.");
+                  Cancelled = true;
+                }
+              }
+            }
+          }
+          Record = RawByteString();
+        }
+      }
+    }
+    while (!IsLast);
+
+    // Any directory that find cannot read makes it fail, while its listing would look empty,
+    // so rather let the caller read the tree directory by directory.
+    ReadCommandOutput(coRaiseExcept, &Command);
+
+    if (!Error.IsEmpty())
+    {
+      throw Exception(Error);
+    }
+
+    if (Cancelled)
+    {
+      FileLists->Clear();
+      Result = false;
+    }
+    else
+    {
+      // Resolving needs the shell, so it cannot be done while reading the listing
+      for (size_t Index = 0; Index < Symlinks.size(); Index++)
+      {
+        Symlinks[Index]->Complete();
+      }
+
+      FTerminal->LogEvent(FORMAT(L"Listing directory tree of \"%s\" returned %d directories.", (Path, FileLists->Count)));
+    }
+  }
+
+  return Result;
+}
+//---------------------------------------------------------------------------
+void __fastcall TSCPFileSystem::ChangeFilesProperties(TStrings * FileList,
+  const TRemoteProperties * /*Properties*/, TStrings * FailedFiles)
+{
+  DebugFail();
+  FailedFiles->Assign(FileList);
+}
+//---------------------------------------------------------------------------
+void __fastcall TSCPFileSystem::DeleteFiles(TStrings * FileList, TStrings * FailedFiles)
+{
+  DebugFail();
+  FailedFiles->Assign(FileList);
+}
+//---------------------------------------------------------------------------
 void __fastcall TSCPFileSystem::ReadSymlink(TRemoteFile * SymlinkFile,
   TRemoteFile *& File)
 {
@@ -1486,6 +1744,66 @@ void __fastcall TSCPFileSystem::SCPResponse(bool * GotLastLine)
   }
 }
 //---------------------------------------------------------------------------
+bool __fastcall TSCPFileSystem::ConfirmCopyToRemote(
+  const UnicodeString & FileName, const UnicodeString & FileNameOnly,
+  const TCopyParamType * CopyParam, int Params, TFileOperationProgressType * OperationProgress)
+{
+  bool Result = true;
+  // previously there was assertion on FTerminal->FFiles->Loaded, but it
+  // fails for scripting, if 'ls' is not issued before.
+  // formally we should call CheckRemoteFile here but as checking is for
+  // free here (almost) ...
+  TRemoteFile * File = FTerminal->FFiles->FindFile(FileNameOnly);
+  if (File != NULL)
+  {
+    unsigned int Answer;
+    if (File->IsDirectory)
+    {
+      UnicodeString Message = FMTLOAD(DIRECTORY_OVERWRITE, (FileNameOnly));
+      TQueryParams QueryParams(qpNeverAskAgainCheck);
+
+      TSuspendFileOperationProgress Suspend(OperationProgress);
+      Answer = FTerminal->ConfirmFileOverwrite(
+        FileName, FileNameOnly, NULL,
+        qaYes | qaNo | qaCancel | qaYesToAll | qaNoToAll,
+        &QueryParams, osRemote, CopyParam, Params, OperationProgress, Message);
+    }
+    else
+    {
+      __int64 MTime;
+      TOverwriteFileParams FileParams;
+      FTerminal->OpenLocalFile(FileName, GENERIC_READ,
+        NULL, NULL, NULL, &MTime, NULL,
+        &FileParams.SourceSize);
+      FileParams.SourceTimestamp = UnixToDateTime(MTime,
+        FTerminal->SessionData->DSTMode);
+      FileParams.DestSize = File->Size;
+      FileParams.DestTimestamp = File->Modification;
+
+      Answer = ConfirmOverwrite(FileName, FileNameOnly, osRemote,
+        &FileParams, CopyParam, Params, OperationProgress);
+    }
+
+    switch (Answer)
+    {
+      case qaYes:
+        Result = true;
+        break;
+
+      case qaCancel:
+        OperationProgress->SetCancelAtLeast(csCancel);
+      case qaNo:
+        Result = false;
+        break;
+
+      default:
+        DebugFail();
+        break;
+    }
+  }
+  return Result;
+}
+//---------------------------------------------------------------------------
 void __fastcall TSCPFileSystem::CopyToRemote(TStrings * FilesToCopy,
   const UnicodeString TargetDir, const TCopyParamType * CopyParam,
   int Params, TFileOperationProgressType * OperationProgress,
@@ -1494,6 +1812,12 @@ void __fastcall TSCPFileSystem::CopyToRemote(TStrings * FilesToCopy,
   // scp.c: source(), toremote()
   DebugAssert(FilesToCopy && OperationProgress);
 
+  if (UseTarTransfer(CopyParam, Params, osLocal))
+  {
+    TarCopyToRemote(FilesToCopy, TargetDir, CopyParam, Params, OperationProgress, OnceDoneOperation);
+    return;
+  }
+
   Params &= ~(cpAppend | cpResume);
   UnicodeString Options = L"";
   bool CheckExistence = UnixSamePath(TargetDir, FTerminal->CurrentDirectory) &&
@@ -1550,62 +1874,7 @@ void __fastcall TSCPFileSystem::CopyToRemote(TStrings * FilesToCopy,
 
       if (CheckExistence)
       {
-        // previously there was assertion on FTerminal->FFiles->Loaded, but it
-        // fails for scripting, if 'ls' is not issued before.
-        // formally we should call CheckRemoteFile here but as checking is for
-        // free here (almost) ...
-        TRemoteFile * File = FTerminal->FFiles->FindFile(FileNameOnly);
-        if (File != NULL)
-        {
-          unsigned int Answer;
-          if (File->IsDirectory)
-          {
-            UnicodeString Message = FMTLOAD(DIRECTORY_OVERWRITE, (FileNameOnly));
-            TQueryParams QueryParams(qpNeverAskAgainCheck);
-
-            TSuspendFileOperationProgress Suspend(OperationProgress);
-            Answer = FTerminal->ConfirmFileOverwrite(
-              FileName, FileNameOnly, NULL,
-              qaYes | qaNo | qaCancel | qaYesToAll | qaNoToAll,
-              &QueryParams, osRemote, CopyParam, Params, OperationProgress, Message);
-          }
-          else
-          {
-            __int64 MTime;
-            TOverwriteFileParams FileParams;
-            FTerminal->OpenLocalFile(FileName, GENERIC_READ,
-              NULL, NULL, NULL, &MTime, NULL,
-              &FileParams.SourceSize);
-            FileParams.SourceTimestamp = UnixToDateTime(MTime,
-              FTerminal->SessionData->DSTMode);
-            FileParams.DestSize = File->Size;
-            FileParams.DestTimestamp = File->Modification;
-
-            Answer = ConfirmOverwrite(FileName, FileNameOnly, osRemote,
-              &FileParams, CopyParam, Params, OperationProgress);
-          }
-
-          switch (Answer)
-          {
-            case qaYes:
-              CanProceed = true;
-              break;
-
-            case qaCancel:
-              OperationProgress->SetCancelAtLeast(csCancel);
-            case qaNo:
-              CanProceed = false;
-              break;
-
-            default:
-              DebugFail();
-              break;
-          }
-        }
-        else
-        {
-          CanProceed = true;
-        }
+        CanProceed = ConfirmCopyToRemote(FileName, FileNameOnly, CopyParam, Params, OperationProgress);
       }
       else
       {
@@ -1705,25 +1974,192 @@ void __fastcall TSCPFileSystem::CopyToRemote(TStrings * FilesToCopy,
   }
 }
 //---------------------------------------------------------------------------
-void __fastcall TSCPFileSystem::Source(
-  TLocalFileHandle & /*Handle*/, const UnicodeString & /*TargetDir*/, UnicodeString & /*DestFileName*/,
-  const TCopyParamType * /*CopyParam*/, int /*Params*/,
-  TFileOperationProgressType * /*OperationProgress*/, unsigned int /*Flags*/,
-  TUploadSessionAction & /*Action*/, bool & /*ChildError*/)
+const int TarBlockSize = 512;
+// Largest size the ustar header can hold in its 11 octal digits
+const __int64 TarMaxOctalSize = 077777777777LL;
+// Archives are streamed in batches, so that the transfer can be cancelled
+// between them and an error of the remote tar affects one batch only
+const __int64 TarBatchSize = 64 * 1024 * 1024;
+const int TarMaxFileListLength = 16 * 1024;
+//---------------------------------------------------------------------------
+struct TTarEntry
 {
-  DebugFail();
+  UnicodeString FileName;
+  UnicodeString ArchiveName;
+  int Item;
+  bool Directory;
+  __int64 Size;
+  __int64 MTime;
+  unsigned short Mode;
+};
+//---------------------------------------------------------------------------
+struct TTarSinkEntry
+{
+  UnicodeString FullFileName;
+  UnicodeString DestFileName;
+  UnicodeString LinkFileName;
+  bool Directory;
+  __int64 Size;
+  __int64 MTime;
+  unsigned short Mode;
+};
+//---------------------------------------------------------------------------
+static int __fastcall TarPadding(__int64 Size)
+{
+  return static_cast<int>((TarBlockSize - (Size % TarBlockSize)) % TarBlockSize);
 }
 //---------------------------------------------------------------------------
-void __fastcall TSCPFileSystem::SCPSource(const UnicodeString FileName,
-  const UnicodeString TargetDir, const TCopyParamType * CopyParam, int Params,
-  TFileOperationProgressType * OperationProgress, int Level)
+static RawByteString __fastcall TarZeros(int Length)
 {
-  UnicodeString DestFileName =
-    FTerminal->ChangeFileName(
-      CopyParam, ExtractFileName(FileName), osLocal, Level == 0);
+  RawByteString Result;
+  Result.SetLength(Length);
+  if (Length > 0)
+  {
+    memset(Result.c_str(), 0, Length);
+  }
+  return Result;
+}
+//---------------------------------------------------------------------------
+static void __fastcall TarPutOctal(char * Field, int Length, __int64 Value)
+{
+  // zero padded and NUL terminated, as ustar requires
+  for (int Index = Length - 2; Index >= 0; Index--)
+  {
+    Field[Index] = static_cast<char>('0' + (Value & 7));
+    Value >>= 3;
+  }
+  Field[Length - 1] = '\0';
+}
+//---------------------------------------------------------------------------
+static __int64 __fastcall TarGetNumber(const char * Field, int Length)
+{
+  __int64 Result = 0;
+  if (FLAGSET(static_cast<unsigned char>(Field[0]), 0x80))
+  {
+    // GNU base-256 encoding of numbers that do not fit the octal field
+    Result = static_cast<unsigned char>(Field[0]) & 0x7F;
+    for (int Index = 1; Index < Length; Index++)
+    {
+      Result = (Result << 8) | static_cast<unsigned char>(Field[Index]);
+    }
+  }
+  else
+  {
+    int Index = 0;
+    while ((Index < Length) && (Field[Index] == ' '))
+    {
+      Index++;
+    }
+    while ((Index < Length) && (Field[Index] >= '0') && (Field[Index] <= '7'))
+    {
+      Result = (Result << 3) | (Field[Index] - '0');
+      Index++;
+    }
+  }
+  return Result;
+}
+//---------------------------------------------------------------------------
+static RawByteString __fastcall TarGetString(const char * Field, int Length)
+{
+  int Len = 0;
+  while ((Len < Length) && (Field[Len] != '\0'))
+  {
+    Len++;
+  }
+  return RawByteString(Field, Len);
+}
+//---------------------------------------------------------------------------
+static unsigned int __fastcall TarChecksum(const char * Header)
+{
+  unsigned int Result = 0;
+  for (int Index = 0; Index < TarBlockSize; Index++)
+  {
+    // the checksum field itself is summed as if filled with spaces
+    bool ChecksumField = (Index >= 148) && (Index < 156);
+    Result += (ChecksumField ? ' ' : static_cast<unsigned char>(Header[Index]));
+  }
+  return Result;
+}
+//---------------------------------------------------------------------------
+static RawByteString __fastcall TarHeader(
+  const RawByteString & Name, char Type, __int64 Size, __int64 MTime, unsigned short Mode)
+{
+  RawByteString Result = TarZeros(TarBlockSize);
+  char * Header = Result.c_str();
+  memcpy(Header, Name.c_str(), std::min(Name.Length(), 100));
+  TarPutOctal(Header + 100, 8, Mode);
+  TarPutOctal(Header + 108, 8, 0);
+  TarPutOctal(Header + 116, 8, 0);
+  TarPutOctal(Header + 124, 12, Size);
+  TarPutOctal(Header + 136, 12, std::max(MTime, __int64(0)));
+  Header[156] = Type;
+  memcpy(Header + 257, "ustar", 6);
+  memcpy(Header + 263, "00", 2);
+  TarPutOctal(Header + 148, 7, TarChecksum(Header));
+  Header[155] = ' ';
+  return Result;
+}
+//---------------------------------------------------------------------------
+static RawByteString __fastcall TarPaxRecord(const RawByteString & Key, const RawByteString & Value)
+{
+  RawByteString Record = RawByteString(" ") + Key + "=" + Value + "\n";
+  // the length prefix counts its own digits too
+  int Length = Record.Length();
+  int Total = Length + IntToStr(Length).Length();
+  if (IntToStr(Total).Length() > IntToStr(Length).Length())
+  {
+    Total++;
+  }
+  return RawByteString(AnsiString(IntToStr(Total))) + Record;
+}
+//---------------------------------------------------------------------------
+bool __fastcall TSCPFileSystem::UseTarTransfer(const TCopyParamType * CopyParam, int Params, TOperationSide Side)
+{
+  // Line endings cannot be converted in the archive.
+  // And we cannot tell which files the remote tar has actually processed,
+  // so we do not delete nor clear archive attribute of the sources.
+  return
+    FTerminal->SessionData->SCPTarTransfer &&
+    (CopyParam->TransferMode == tmBinary) &&
+    FLAGCLEAR(Params, cpDelete) &&
+    ((Side == osRemote) || !CopyParam->ClearArchive);
+}
+//---------------------------------------------------------------------------
+RawByteString __fastcall TSCPFileSystem::TarEntryHeader(const TTarEntry & Entry)
+{
+  RawByteString Name = FSecureShell->ConvertOutput(Entry.ArchiveName);
+  if (Entry.Directory)
+  {
+    Name += "/";
+  }
 
-  FTerminal->LogEvent(FORMAT(L"File: \"%s\"", (FileName)));
+  // What does not fit ustar header goes to POSIX extended header
+  RawByteString Records;
+  if (Name.Length() > 100)
+  {
+    Records += TarPaxRecord("path", Name);
+  }
+  bool LargeSize = (Entry.Size > TarMaxOctalSize);
+  if (LargeSize)
+  {
+    Records += TarPaxRecord("size", RawByteString(AnsiString(IntToStr(Entry.Size))));
+  }
 
+  RawByteString Result;
+  if (!Records.IsEmpty())
+  {
+    Result += TarHeader("././@PaxHeader", 'x', Records.Length(), Entry.MTime, 0644);
+    Result += Records + TarZeros(TarPadding(Records.Length()));
+  }
+  Result +=
+    TarHeader(Name, (Entry.Directory ? '5' : '0'), (LargeSize ? 0 : Entry.Size), Entry.MTime, Entry.Mode);
+  return Result;
+}
+//---------------------------------------------------------------------------
+void __fastcall TSCPFileSystem::TarCollectSource(const UnicodeString & FileName,
+  const UnicodeString & ArchiveName, int Item, const TCopyParamType * CopyParam,
+  TFileOperationProgressType * OperationProgress, TTarEntries & Entries)
+{
   OperationProgress->SetFile(FileName, false);
 
   if (!FTerminal->AllowLocalFileTransfer(FileName, NULL, CopyParam, OperationProgress))
@@ -1734,28 +2170,383 @@ void __fastcall TSCPFileSystem::SCPSource(const UnicodeString FileName,
   TLocalFileHandle Handle;
   FTerminal->OpenLocalFile(FileName, GENERIC_READ, Handle);
 
-  OperationProgress->SetFileInProgress();
+  TTarEntry Entry;
+  Entry.FileName = FileName;
+  Entry.ArchiveName = ArchiveName;
+  Entry.Item = Item;
+  Entry.Directory = Handle.Directory;
+  Entry.Size = (Handle.Directory ? 0 : Handle.Size);
+  Entry.MTime = Handle.MTime;
+  Entry.Mode = CopyParam->RemoteFileRights(Handle.Attrs).Number;
+  Entries.push_back(Entry);
 
-  if (Handle.Directory)
-  {
-    SCPDirectorySource(FileName, TargetDir, CopyParam, Params, OperationProgress, Level);
-  }
-  else
+  Handle.Release();
+
+  if (Entry.Directory)
   {
-    UnicodeString AbsoluteFileName = FTerminal->AbsolutePath(TargetDir + DestFileName, false);
+    TSearchRecOwned SearchRec;
+    bool FindOK = FTerminal->LocalFindFirstLoop(IncludeTrailingBackslash(FileName) + L"*.*", SearchRec);
 
-    DebugAssert(Handle.Handle);
-    std::unique_ptr<TStream> Stream(new TSafeHandleStream((THandle)Handle.Handle));
+    while (FindOK && !OperationProgress->Cancel)
+    {
+      if (SearchRec.IsRealFile())
+      {
+        UnicodeString ChildFileName = IncludeTrailingBackslash(FileName) + SearchRec.Name;
+        UnicodeString ChildArchiveName =
+          ArchiveName + L"/" + FTerminal->ChangeFileName(CopyParam, SearchRec.Name, osLocal, false);
+        try
+        {
+          TarCollectSource(ChildFileName, ChildArchiveName, Item, CopyParam, OperationProgress, Entries);
+        }
+        catch (ESkipFile &E)
+        {
+          // If ESkipFile occurs, just log it and continue with next file
+          TSuspendFileOperationProgress Suspend(OperationProgress);
+          if (!FTerminal->HandleException(&E))
+          {
+            throw;
+          }
+        }
+      }
 
-    // File is regular file (not directory)
-    FTerminal->LogEvent(FORMAT(L"Copying \"%s\" to remote directory started.", (FileName)));
+      FindOK = FTerminal->LocalFindNextLoop(SearchRec);
+    }
+  }
+}
+//---------------------------------------------------------------------------
+UnicodeString __fastcall TSCPFileSystem::TarStartCopyToRemote(
+  __int64 ArchiveSize, const UnicodeString & TargetDir, const TCopyParamType * CopyParam)
+{
+  UnicodeString Options;
+  if (CopyParam->PreserveRights) AddToList(Options, L"-p", L" ");
+  if (!CopyParam->PreserveTime) AddToList(Options, L"-m", L" ");
 
-    OperationProgress->SetLocalSize(Handle.Size);
+  UnicodeString DelimitedTargetDir = DelimitStr(UnixExcludeTrailingBackslash(TargetDir));
+  UnicodeString FirstLine = FCommandSet->FirstLine;
+  UnicodeString Size = IntToStr(ArchiveSize);
+  SendCommand(FCommandSet->FullCommand(fsTarCopyToRemote,
+    ARRAYOFCONST((FirstLine, Size, Options, DelimitedTargetDir))));
 
-    // Suppose same data size to transfer as to read
-    // (not true with ASCII transfer)
-    OperationProgress->SetTransferSize(OperationProgress->LocalSize);
-    OperationProgress->SetTransferringFile(false);
+  UnicodeString Line = FSecureShell->ReceiveLine();
+  if (IsLastLine(Line))
+  {
+    // The archive was not sent yet, so it cannot have ended up in the shell
+    try
+    {
+      ReadCommandOutput(coRaiseExcept | coOnlyReturnCode);
+      throw Exception(L"");
+    }
+    catch (Exception & E)
+    {
+      if (FTerminal->Active)
+      {
+        FTerminal->TerminalError(&E, LoadStr(TAR_INIT_ERROR));
+      }
+      else
+      {
+        throw;
+      }
+    }
+  }
+  else if (Line != FirstLine)
+  {
+    FTerminal->TerminalError(NULL, FMTLOAD(FIRST_LINE_EXPECTED, (Line)));
+  }
+
+  return FCommandSet->Command(fsTarCopyToRemote,
+    ARRAYOFCONST((FirstLine, Size, Options, DelimitedTargetDir)));
+}
+//---------------------------------------------------------------------------
+void __fastcall TSCPFileSystem::TarSource(const TTarEntry & Entry,
+  const UnicodeString & TargetDir, const TCopyParamType * CopyParam,
+  TFileOperationProgressType * OperationProgress)
+{
+  RawByteString Header = TarEntryHeader(Entry);
+
+  if (Entry.Directory)
+  {
+    OperationProgress->SetFile(Entry.FileName);
+    FSecureShell->Send(reinterpret_cast<const unsigned char *>(Header.c_str()), Header.Length());
+  }
+  else
+  {
+    UnicodeString AbsoluteFileName = FTerminal->AbsolutePath(TargetDir + Entry.ArchiveName, false);
+
+    FTerminal->LogEvent(FORMAT(L"File: \"%s\"", (Entry.FileName)));
+    OperationProgress->SetFile(Entry.FileName);
+
+    TUploadSessionAction Action(FTerminal->ActionLog);
+    Action.FileName(ExpandUNCFileName(Entry.FileName));
+    Action.Destination(AbsoluteFileName);
+
+    try
+    {
+      TLocalFileHandle Handle;
+      FTerminal->OpenLocalFile(Entry.FileName, GENERIC_READ, Handle);
+      std::unique_ptr<TStream> Stream(new TSafeHandleStream((THandle)Handle.Handle));
+
+      // The size was announced already, when the archive size was calculated
+      OperationProgress->SetLocalSize(Entry.Size);
+      OperationProgress->SetTransferSize(Entry.Size);
+      OperationProgress->SetTransferringFile(true);
+
+      FSecureShell->Send(reinterpret_cast<const unsigned char *>(Header.c_str()), Header.Length());
+
+      while (!OperationProgress->IsTransferDone())
+      {
+        TFileBuffer BlockBuf;
+        unsigned long BlockSize = OperationProgress->TransferBlockSize();
+
+        FILE_OPERATION_LOOP_BEGIN
+        {
+          BlockBuf.LoadStream(Stream.get(), BlockSize, false);
+        }
+        FILE_OPERATION_LOOP_END_EX(FMTLOAD(READ_ERROR, (Entry.FileName)), folNone);
+
+        if (static_cast<unsigned long>(BlockBuf.Size) < BlockSize)
+        {
+          // The file shrank since it was collected, the same what tar itself does
+          FTerminal->LogEvent(FORMAT(L"File \"%s\" shrank while being read, padding it with zeros.", (Entry.FileName)));
+          int Read = BlockBuf.Size;
+          BlockBuf.Size = BlockSize;
+          memset(BlockBuf.Data + Read, 0, BlockSize - Read);
+        }
+
+        OperationProgress->AddLocallyUsed(BlockBuf.Size);
+        FSecureShell->Send(reinterpret_cast<const unsigned char *>(BlockBuf.Data), BlockBuf.Size);
+        OperationProgress->AddTransferred(BlockBuf.Size);
+
+        if (OperationProgress->Cancel == csCancelTransfer)
+        {
+          throw Exception(MainInstructions(LoadStr(USER_TERMINATED)));
+        }
+      }
+
+      RawByteString Padding = TarZeros(TarPadding(Entry.Size));
+      FSecureShell->Send(reinterpret_cast<const unsigned char *>(Padding.c_str()), Padding.Length());
+      OperationProgress->SetTransferringFile(false);
+    }
+    catch (Exception & E)
+    {
+      FTerminal->RollbackAction(Action, OperationProgress, &E);
+      // The remote tar expects the announced number of bytes, every error is fatal
+      FTerminal->FatalError(&E, FMTLOAD(COPY_FATAL, (Entry.FileName)));
+    }
+
+    if (CopyParam->PreserveTime)
+    {
+      TTouchSessionAction(FTerminal->ActionLog, AbsoluteFileName,
+        UnixToDateTime(Entry.MTime, FTerminal->SessionData->DSTMode));
+    }
+    if (CopyParam->PreserveRights)
+    {
+      TChmodSessionAction(FTerminal->ActionLog, AbsoluteFileName, TRights(Entry.Mode));
+    }
+
+    FTerminal->LogFileDone(OperationProgress, AbsoluteFileName);
+  }
+}
+//---------------------------------------------------------------------------
+void __fastcall TSCPFileSystem::TarCopyToRemote(TStrings * FilesToCopy,
+  const UnicodeString & TargetDir, const TCopyParamType * CopyParam,
+  int Params, TFileOperationProgressType * OperationProgress,
+  TOnceDoneOperation & OnceDoneOperation)
+{
+  FTerminal->LogEvent(FORMAT(L"Copying %d files/directories to remote directory "
+    "\"%s\" using tar", (FilesToCopy->Count, TargetDir)));
+
+  bool CheckExistence = UnixSamePath(TargetDir, FTerminal->CurrentDirectory) &&
+    (FTerminal->FFiles != NULL) && FTerminal->FFiles->Loaded;
+  UnicodeString TargetDirFull = UnixIncludeTrailingBackslash(TargetDir);
+
+  // Size of the archive has to be known before it is streamed,
+  // so all files are collected first
+  TTarEntries Entries;
+  std::vector<int> FirstEntry(FilesToCopy->Count, -1);
+  std::vector<int> LastEntry(FilesToCopy->Count, -1);
+  std::vector<bool> Failed(FilesToCopy->Count, false);
+  std::vector<bool> Finished(FilesToCopy->Count, false);
+  size_t Sent = 0;
+
+  try
+  {
+    for (int IFile = 0; (IFile < FilesToCopy->Count) &&
+      !OperationProgress->Cancel; IFile++)
+    {
+      UnicodeString FileName = FilesToCopy->Strings[IFile];
+      UnicodeString FileNameOnly =
+        FTerminal->ChangeFileName(
+          CopyParam, ExtractFileName(FileName), osLocal, true);
+
+      if (!CheckExistence ||
+          ConfirmCopyToRemote(FileName, FileNameOnly, CopyParam, Params, OperationProgress))
+      {
+        if (FTerminal->SessionData->CacheDirectories)
+        {
+          FTerminal->DirectoryModified(TargetDir, false);
+
+          if (DirectoryExists(ApiPath(FileName)))
+          {
+            FTerminal->DirectoryModified(TargetDirFull + FileNameOnly, true);
+          }
+        }
+
+        int Count = Entries.size();
+        try
+        {
+          TarCollectSource(FileName, FileNameOnly, IFile, CopyParam, OperationProgress, Entries);
+        }
+        catch (ESkipFile & E)
+        {
+          Entries.resize(Count);
+          Finished[IFile] = true;
+          FTerminal->OperationFinish(OperationProgress, FilesToCopy->Objects[IFile], FileName, false, OnceDoneOperation);
+
+          TSuspendFileOperationProgress Suspend(OperationProgress);
+          // If ESkipFile occurs, just log it and continue with next file
+          if (!FTerminal->HandleException(&E))
+          {
+            throw;
+          }
+        }
+
+        if (static_cast<int>(Entries.size()) > Count)
+        {
+          FirstEntry[IFile] = Count;
+          LastEntry[IFile] = Entries.size() - 1;
+        }
+      }
+    }
+
+    while ((Sent < Entries.size()) && !OperationProgress->Cancel)
+    {
+      size_t Start = Sent;
+      __int64 ArchiveSize = 0;
+      do
+      {
+        const TTarEntry & Entry = Entries[Sent];
+        ArchiveSize += TarEntryHeader(Entry).Length() + Entry.Size + TarPadding(Entry.Size);
+        Sent++;
+      }
+      while ((Sent < Entries.size()) && (ArchiveSize < TarBatchSize));
+      // end of archive
+      ArchiveSize += 2 * TarBlockSize;
+
+      FTerminal->LogEvent(FORMAT(L"Streaming %d files/directories in %s bytes long archive.",
+        (int(Sent - Start), IntToStr(ArchiveSize))));
+      UnicodeString Command = TarStartCopyToRemote(ArchiveSize, TargetDirFull, CopyParam);
+
+      bool Success = false;
+      try
+      {
+        for (size_t Index = Start; Index < Sent; Index++)
+        {
+          TarSource(Entries[Index], TargetDirFull, CopyParam, OperationProgress);
+        }
+
+        RawByteString EndOfArchive = TarZeros(2 * TarBlockSize);
+        FSecureShell->Send(reinterpret_cast<const unsigned char *>(EndOfArchive.c_str()), EndOfArchive.Length());
+
+        ReadCommandOutput(coExpectNoOutput | coWaitForLastLine | coRaiseExcept, &Command);
+        Success = true;
+      }
+      catch (ETerminal & E)
+      {
+        TQueryParams QueryParams(qpAllowContinueOnError);
+        TSuspendFileOperationProgress Suspend(OperationProgress);
+
+        if (FTerminal->QueryUserException(FMTLOAD(COPY_ERROR, (Entries[Start].FileName)), &E,
+              qaOK | qaAbort, &QueryParams, qtError) == qaAbort)
+        {
+          OperationProgress->SetCancel(csCancel);
+        }
+        if (!FTerminal->HandleException(&E))
+        {
+          throw;
+        }
+      }
+
+      for (int IFile = 0; IFile < FilesToCopy->Count; IFile++)
+      {
+        if ((LastEntry[IFile] >= static_cast<int>(Start)) && (FirstEntry[IFile] < static_cast<int>(Sent)))
+        {
+          Failed[IFile] = Failed[IFile] || !Success;
+          if (LastEntry[IFile] < static_cast<int>(Sent))
+          {
+            Finished[IFile] = true;
+            FTerminal->OperationFinish(
+              OperationProgress, FilesToCopy->Objects[IFile], FilesToCopy->Strings[IFile], !Failed[IFile],
+              OnceDoneOperation);
+          }
+        }
+      }
+    }
+  }
+  __finally
+  {
+    // Files that were sent partially only
+    for (int IFile = 0; IFile < FilesToCopy->Count; IFile++)
+    {
+      if (!Finished[IFile] && (FirstEntry[IFile] >= 0) && (FirstEntry[IFile] < static_cast<int>(Sent)))
+      {
+        FTerminal->OperationFinish(
+          OperationProgress, FilesToCopy->Objects[IFile], FilesToCopy->Strings[IFile], false, OnceDoneOperation);
+      }
+    }
+  }
+}
+//---------------------------------------------------------------------------
+void __fastcall TSCPFileSystem::Source(
+  TLocalFileHandle & /*Handle*/, const UnicodeString & /*TargetDir*/, UnicodeString & /*DestFileName*/,
+  const TCopyParamType * /*CopyParam*/, int /*Params*/,
+  TFileOperationProgressType * /*OperationProgress*/, unsigned int /*Flags*/,
+  TUploadSessionAction & /*Action*/, bool & /*ChildError*/)
+{
+  DebugFail();
+}
+//---------------------------------------------------------------------------
+void __fastcall TSCPFileSystem::SCPSource(const UnicodeString FileName,
+  const UnicodeString TargetDir, const TCopyParamType * CopyParam, int Params,
+  TFileOperationProgressType * OperationProgress, int Level)
+{
+  UnicodeString DestFileName =
+    FTerminal->ChangeFileName(
+      CopyParam, ExtractFileName(FileName), osLocal, Level == 0);
+
+  FTerminal->LogEvent(FORMAT(L"File: \"%s\"", (FileName)));
+
+  OperationProgress->SetFile(FileName, false);
+
+  if (!FTerminal->AllowLocalFileTransfer(FileName, NULL, CopyParam, OperationProgress))
+  {
+    throw ESkipFile();
+  }
+
+  TLocalFileHandle Handle;
+  FTerminal->OpenLocalFile(FileName, GENERIC_READ, Handle);
+
+  OperationProgress->SetFileInProgress();
+
+  if (Handle.Directory)
+  {
+    SCPDirectorySource(FileName, TargetDir, CopyParam, Params, OperationProgress, Level);
+  }
+  else
+  {
+    UnicodeString AbsoluteFileName = FTerminal->AbsolutePath(TargetDir + DestFileName, false);
+
+    DebugAssert(Handle.Handle);
+    std::unique_ptr<TStream> Stream(new TSafeHandleStream((THandle)Handle.Handle));
+
+    // File is regular file (not directory)
+    FTerminal->LogEvent(FORMAT(L"Copying \"%s\" to remote directory started.", (FileName)));
+
+    OperationProgress->SetLocalSize(Handle.Size);
+
+    // Suppose same data size to transfer as to read
+    // (not true with ASCII transfer)
+    OperationProgress->SetTransferSize(OperationProgress->LocalSize);
+    OperationProgress->SetTransferringFile(false);
 
     if (Handle.Size > 512*1024*1024)
     {
@@ -2101,6 +2892,12 @@ void __fastcall TSCPFileSystem::CopyToLocal(TStrings * FilesToCopy,
   int Params, TFileOperationProgressType * OperationProgress,
   TOnceDoneOperation & OnceDoneOperation)
 {
+  if (UseTarTransfer(CopyParam, Params, osRemote))
+  {
+    TarCopyToLocal(FilesToCopy, TargetDir, CopyParam, Params, OperationProgress, OnceDoneOperation);
+    return;
+  }
+
   bool CloseSCP = False;
   Params &= ~(cpAppend | cpResume);
   UnicodeString Options = L"";
@@ -2222,6 +3019,606 @@ void __fastcall TSCPFileSystem::CopyToLocal(TStrings * FilesToCopy,
   }
 }
 //---------------------------------------------------------------------------
+void __fastcall TSCPFileSystem::TarReceive(char * Buf, int Len)
+{
+  FSecureShell->Receive(reinterpret_cast<unsigned char *>(Buf), Len);
+}
+//---------------------------------------------------------------------------
+void __fastcall TSCPFileSystem::TarDiscard(__int64 Len, TFileOperationProgressType * OperationProgress)
+{
+  char Buf[32 * 1024];
+  while (Len > 0)
+  {
+    int BlockLen = static_cast<int>(std::min(Len, static_cast<__int64>(sizeof(Buf))));
+    TarReceive(Buf, BlockLen);
+    Len -= BlockLen;
+
+    if (OperationProgress->Cancel == csCancelTransfer)
+    {
+      throw Exception(MainInstructions(LoadStr(USER_TERMINATED)));
+    }
+  }
+}
+//---------------------------------------------------------------------------
+RawByteString __fastcall TSCPFileSystem::TarReceiveData(__int64 Size, TFileOperationProgressType * OperationProgress)
+{
+  // Long names and extended headers only, anything large means we lost sync
+  if ((Size < 0) || (Size > 1024 * 1024))
+  {
+    FTerminal->FatalError(NULL, LoadStr(TAR_INVALID_HEADER));
+  }
+  RawByteString Result;
+  Result.SetLength(static_cast<int>(Size));
+  if (Size > 0)
+  {
+    TarReceive(Result.c_str(), Result.Length());
+  }
+  TarDiscard(TarPadding(Size), OperationProgress);
+  return Result;
+}
+//---------------------------------------------------------------------------
+UnicodeString __fastcall TSCPFileSystem::TarEntryName(const RawByteString & Name)
+{
+  UnicodeString Result = FSecureShell->ConvertInput(Name);
+  // we ask for "./name" to be safe from names starting with dash
+  while (StartsStr(L"./", Result))
+  {
+    Result.Delete(1, 2);
+  }
+  while (EndsStr(L"/", Result))
+  {
+    Result.SetLength(Result.Length() - 1);
+  }
+  return Result;
+}
+//---------------------------------------------------------------------------
+void __fastcall TSCPFileSystem::TarSink(const TTarSinkEntry & Entry,
+  const UnicodeString & TargetDir, const TCopyParamType * CopyParam, int Params,
+  TFileOperationProgressType * OperationProgress, UnicodeString & ExcludedDir,
+  TTarExtractedFiles & Extracted)
+{
+  TFileMasks::TParams MaskParams;
+  MaskParams.Size = Entry.Size;
+  MaskParams.Modification = UnixToDateTime(Entry.MTime, FTerminal->SessionData->DSTMode);
+
+  UnicodeString BaseFileName = FTerminal->GetBaseFileName(Entry.FullFileName);
+  if (!CopyParam->AllowTransfer(BaseFileName, osRemote, Entry.Directory, MaskParams, IsUnixHiddenFile(BaseFileName)))
+  {
+    FTerminal->LogEvent(FORMAT(L"File \"%s\" excluded from transfer", (Entry.FullFileName)));
+    if (Entry.Directory)
+    {
+      ExcludedDir = UnixIncludeTrailingBackslash(Entry.FullFileName);
+    }
+    TarDiscard(Entry.Size + TarPadding(Entry.Size), OperationProgress);
+    return;
+  }
+
+  if (CopyParam->SkipTransfer(Entry.FullFileName, Entry.Directory))
+  {
+    OperationProgress->AddSkippedFileSize(Entry.Size);
+    if (Entry.Directory)
+    {
+      ExcludedDir = UnixIncludeTrailingBackslash(Entry.FullFileName);
+    }
+    TarDiscard(Entry.Size + TarPadding(Entry.Size), OperationProgress);
+    return;
+  }
+
+  OperationProgress->SetFile(Entry.FullFileName);
+  OperationProgress->SetTransferSize(Entry.Size);
+  FTerminal->LogFileDetails(Entry.FullFileName, MaskParams.Modification, Entry.Size);
+
+  UnicodeString DestFileName = Entry.DestFileName;
+  int Attrs = FileGetAttrFix(ApiPath(DestFileName));
+  // If getting attrs fails, we suppose, that file/folder doesn't exists
+  bool Exists = (Attrs != -1);
+
+  if (Entry.Directory)
+  {
+    if (Exists && FLAGCLEAR(Attrs, faDirectory))
+    {
+      throw Exception(FMTLOAD(NOT_DIRECTORY_ERROR, (DestFileName)));
+    }
+
+    if (!Exists)
+    {
+      FILE_OPERATION_LOOP_BEGIN
+      {
+        THROWOSIFFALSE(ForceDirectories(ApiPath(DestFileName)));
+      }
+      FILE_OPERATION_LOOP_END(FMTLOAD(CREATE_DIR_ERROR, (DestFileName)));
+    }
+    return;
+  }
+
+  if (Exists)
+  {
+    __int64 MTime;
+    TOverwriteFileParams FileParams;
+    FileParams.SourceSize = Entry.Size;
+    FileParams.SourceTimestamp = MaskParams.Modification;
+    FTerminal->OpenLocalFile(DestFileName, GENERIC_READ,
+      NULL, NULL, NULL, &MTime, NULL,
+      &FileParams.DestSize);
+    FileParams.DestTimestamp = UnixToDateTime(MTime,
+      FTerminal->SessionData->DSTMode);
+
+    unsigned int Answer =
+      ConfirmOverwrite(OperationProgress->FileName, ExtractFileName(DestFileName), osLocal,
+        &FileParams, CopyParam, Params, OperationProgress);
+
+    switch (Answer)
+    {
+      case qaCancel:
+        OperationProgress->SetCancel(csCancel); // continue on next case
+      case qaNo:
+        throw ESkipFile();
+    }
+  }
+
+  TDownloadSessionAction Action(FTerminal->ActionLog);
+  Action.FileName(FTerminal->AbsolutePath(Entry.FullFileName, true));
+  Action.Destination(DestFileName);
+
+  if (!Entry.LinkFileName.IsEmpty())
+  {
+    // Hard link to a file extracted before, the archive holds no data for it
+    TTarExtractedFiles::const_iterator I = Extracted.find(Entry.LinkFileName);
+    if (I == Extracted.end())
+    {
+      Action.Cancel();
+      throw Exception(FMTLOAD(FILE_NOT_EXISTS, (Entry.LinkFileName)));
+    }
+    FILE_OPERATION_LOOP_BEGIN
+    {
+      THROWOSIFFALSE(::CopyFile(ApiPath(I->second).c_str(), ApiPath(DestFileName).c_str(), FALSE));
+    }
+    FILE_OPERATION_LOOP_END(FMTLOAD(COPY_ERROR, (Entry.FullFileName)));
+  }
+  else
+  {
+    HANDLE File = NULL;
+    if (!FTerminal->CreateLocalFile(DestFileName, OperationProgress,
+           &File, FLAGSET(Params, cpNoConfirmation)))
+    {
+      Action.Cancel();
+      throw ESkipFile();
+    }
+
+    try
+    {
+      // From now we need to read whole file from the archive, if not it's fatal error
+      OperationProgress->SetTransferringFile(true);
+      OperationProgress->SetLocalSize(Entry.Size);
+
+      try
+      {
+        std::unique_ptr<TStream> FileStream(new TSafeHandleStream((THandle)File));
+        TFileBuffer BlockBuf;
+
+        while (!OperationProgress->IsTransferDone())
+        {
+          BlockBuf.Size = OperationProgress->TransferBlockSize();
+          BlockBuf.Position = 0;
+
+          TarReceive(BlockBuf.Data, BlockBuf.Size);
+          OperationProgress->AddTransferred(BlockBuf.Size);
+
+          FILE_OPERATION_LOOP_BEGIN
+          {
+            BlockBuf.WriteToStream(FileStream.get(), BlockBuf.Size);
+          }
+          FILE_OPERATION_LOOP_END_EX(FMTLOAD(WRITE_ERROR, (DestFileName)), folNone);
+
+          OperationProgress->AddLocallyUsed(BlockBuf.Size);
+
+          if (OperationProgress->Cancel == csCancelTransfer)
+          {
+            throw Exception(MainInstructions(LoadStr(USER_TERMINATED)));
+          }
+        }
+
+        TarDiscard(TarPadding(Entry.Size), OperationProgress);
+      }
+      catch (Exception & E)
+      {
+        FTerminal->RollbackAction(Action, OperationProgress, &E);
+        // Every exception during file transfer is fatal
+        FTerminal->FatalError(&E, FMTLOAD(COPY_FATAL, (Entry.FullFileName)));
+      }
+
+      OperationProgress->SetTransferringFile(false);
+
+      if (CopyParam->PreserveTime)
+      {
+        FTerminal->UpdateTargetTime(File, MaskParams.Modification, FTerminal->SessionData->DSTMode);
+      }
+    }
+    __finally
+    {
+      CloseHandle(File);
+    }
+  }
+
+  Extracted[Entry.FullFileName] = DestFileName;
+
+  if (!Exists) Attrs = faArchive;
+  int NewAttrs = CopyParam->LocalFileAttrs(TRights(Entry.Mode));
+  if ((NewAttrs & Attrs) != NewAttrs)
+  {
+    FILE_OPERATION_LOOP_BEGIN
+    {
+      THROWOSIFFALSE(FileSetAttr(ApiPath(DestFileName), Attrs | NewAttrs) == 0);
+    }
+    FILE_OPERATION_LOOP_END(FMTLOAD(CANT_SET_ATTRS, (DestFileName)));
+  }
+
+  FTerminal->LogFileDone(OperationProgress, DestFileName);
+}
+//---------------------------------------------------------------------------
+bool __fastcall TSCPFileSystem::TarSinkArchive(TStrings * FilesToCopy, int Start, int End,
+  const UnicodeString & SourceDir, const UnicodeString & TargetDir,
+  const TCopyParamType * CopyParam, int Params, TFileOperationProgressType * OperationProgress,
+  std::vector<bool> & Seen, std::vector<bool> & Failed)
+{
+  TTarExtractedFiles Extracted;
+  UnicodeString ExcludedDir;
+  UnicodeString FullFileName = SourceDir;
+  // overrides from GNU long name and POSIX extended headers
+  RawByteString LongName;
+  RawByteString LongLinkName;
+  __int64 PaxSize = -1;
+  __int64 PaxMTime = -1;
+  bool First = true;
+
+  try
+  {
+    while (true)
+    {
+      char Header[TarBlockSize];
+      if (First)
+      {
+        // If tar fails to start, we get the last line only,
+        // so we cannot wait for whole block
+        int Received = 0;
+        while (Received < TarBlockSize)
+        {
+          TarReceive(Header + Received, 1);
+          Received++;
+          if (Header[Received - 1] == '\n')
+          {
+            UnicodeString Line = FSecureShell->ConvertInput(RawByteString(Header, Received - 1));
+            if (IsLastLine(Line))
+            {
+              return false;
+            }
+          }
+        }
+        First = false;
+      }
+      else
+      {
+        TarReceive(Header, TarBlockSize);
+      }
+
+      bool Zero = true;
+      for (int Index = 0; Zero && (Index < TarBlockSize); Index++)
+      {
+        Zero = (Header[Index] == '\0');
+      }
+      if (Zero)
+      {
+        // end of archive is marked by two zero blocks
+        TarReceive(Header, TarBlockSize);
+        break;
+      }
+
+      if (TarGetNumber(Header + 148, 8) != TarChecksum(Header))
+      {
+        FTerminal->FatalError(NULL, LoadStr(TAR_INVALID_HEADER));
+      }
+
+      RawByteString Name = TarGetString(Header, 100);
+      // POSIX ustar only, GNU format uses the prefix field for other purposes
+      if (memcmp(Header + 257, "ustar", 6) == 0)
+      {
+        RawByteString Prefix = TarGetString(Header + 345, 155);
+        if (!Prefix.IsEmpty())
+        {
+          Name = Prefix + "/" + Name;
+        }
+      }
+      RawByteString LinkName = TarGetString(Header + 157, 100);
+      char Type = Header[156];
+      __int64 Size = TarGetNumber(Header + 124, 12);
+      __int64 MTime = TarGetNumber(Header + 136, 12);
+      unsigned short Mode = static_cast<unsigned short>(TarGetNumber(Header + 100, 8) & 07777);
+
+      if (Type == 'L')
+      {
+        LongName = TarReceiveData(Size, OperationProgress);
+        LongName = TarGetString(LongName.c_str(), LongName.Length());
+        continue;
+      }
+      else if (Type == 'K')
+      {
+        LongLinkName = TarReceiveData(Size, OperationProgress);
+        LongLinkName = TarGetString(LongLinkName.c_str(), LongLinkName.Length());
+        continue;
+      }
+      else if ((Type == 'x') || (Type == 'g'))
+      {
+        RawByteString Records = TarReceiveData(Size, OperationProgress);
+        // global headers apply to all following entries, but neither GNU tar
+        // nor bsdtar use them for anything we care about
+        while ((Type == 'x') && !Records.IsEmpty())
+        {
+          int P = Records.Pos(" ");
+          int Length = StrToIntDef(UnicodeString(Records.SubString(1, P - 1)), 0);
+          if ((P <= 0) || (Length <= P) || (Length > Records.Length()))
+          {
+            FTerminal->FatalError(NULL, LoadStr(TAR_INVALID_HEADER));
+          }
+          RawByteString Record = Records.SubString(P + 1, Length - P - 1);
+          Records.Delete(1, Length);
+          int Eq = Record.Pos("=");
+          RawByteString Key = Record.SubString(1, Eq - 1);
+          RawByteString Value = Record.SubString(Eq + 1, Record.Length() - Eq);
+          if (Key == "path")
+          {
+            LongName = Value;
+          }
+          else if (Key == "linkpath")
+          {
+            LongLinkName = Value;
+          }
+          else if (Key == "size")
+          {
+            PaxSize = StrToInt64Def(UnicodeString(Value), -1);
+          }
+          else if (Key == "mtime")
+          {
+            // may have a fractional part
+            PaxMTime = StrToInt64Def(UnicodeString(CopyToChar(UnicodeString(Value), L'.', false)), -1);
+          }
+        }
+        continue;
+      }
+
+      if (!LongName.IsEmpty()) Name = LongName;
+      if (!LongLinkName.IsEmpty()) LinkName = LongLinkName;
+      if (PaxSize >= 0) Size = PaxSize;
+      if (PaxMTime >= 0) MTime = PaxMTime;
+      LongName = RawByteString();
+      LongLinkName = RawByteString();
+      PaxSize = -1;
+      PaxMTime = -1;
+
+      UnicodeString Path = TarEntryName(Name);
+      FullFileName = SourceDir + Path;
+
+      // Some tars store data even for hard links
+      bool Regular = (Type == '0') || (Type == '\0') || (Type == '7') || ((Type == '1') && (Size > 0));
+      bool HardLink = (Type == '1') && !Regular;
+
+      TTarSinkEntry Entry;
+      Entry.FullFileName = FullFileName;
+      Entry.Directory = (Type == '5');
+      Entry.Size = (Regular ? Size : 0);
+      Entry.MTime = MTime;
+      Entry.Mode = Mode;
+      if (HardLink)
+      {
+        Entry.LinkFileName = SourceDir + TarEntryName(LinkName);
+      }
+
+      // Security: ensure the file ends up where we asked for it
+      // (accept relative paths within the requested files only)
+      int Item = -1;
+      UnicodeString DestFileName = ExcludeTrailingBackslash(TargetDir);
+      bool Valid = !Path.IsEmpty() && !StartsStr(L"/", Path);
+      UnicodeString Rest = Path;
+      int Level = 0;
+      while (Valid && !Rest.IsEmpty())
+      {
+        UnicodeString Component = CutToChar(Rest, L'/', false);
+        Valid = !Component.IsEmpty() && (Component != L".") && (Component != L"..");
+        if (Valid && (Level == 0))
+        {
+          for (int Index = Start; (Item < 0) && (Index < End); Index++)
+          {
+            if (Component == UnixExtractFileName(UnixExcludeTrailingBackslash(FilesToCopy->Strings[Index])))
+            {
+              Item = Index;
+            }
+          }
+          Valid = (Item >= 0);
+        }
+        DestFileName +=
+          L"\\" + FTerminal->ChangeFileName(CopyParam, Component, osRemote, (Level == 0));
+        Level++;
+      }
+      Entry.DestFileName = DestFileName;
+
+      if (!Regular && !HardLink && !Entry.Directory)
+      {
+        // symlinks are dereferenced by tar already, devices and fifos make no sense here
+        FTerminal->LogEvent(FORMAT(L"Skipping \"%s\" of unsupported type '%s'.", (FullFileName, UnicodeString(Type))));
+        TarDiscard(Size + TarPadding(Size), OperationProgress);
+      }
+      else if (!Valid)
+      {
+        FTerminal->LogEvent(FORMAT(L"Warning: Remote host sent unrequested file '%s', skipping it.", (Path)));
+        TarDiscard(Entry.Size + TarPadding(Entry.Size), OperationProgress);
+      }
+      else if (!ExcludedDir.IsEmpty() && StartsStr(ExcludedDir, FullFileName))
+      {
+        TarDiscard(Entry.Size + TarPadding(Entry.Size), OperationProgress);
+      }
+      else if (OperationProgress->Cancel)
+      {
+        // we have to read the rest of the archive anyway
+        Seen[Item - Start] = true;
+        Failed[Item - Start] = true;
+        TarDiscard(Entry.Size + TarPadding(Entry.Size), OperationProgress);
+      }
+      else
+      {
+        Seen[Item - Start] = true;
+        ExcludedDir = L"";
+        try
+        {
+          TarSink(Entry, TargetDir, CopyParam, Params, OperationProgress, ExcludedDir, Extracted);
+        }
+        catch (EFatal & E)
+        {
+          throw;
+        }
+        catch (ESkipFile & E)
+        {
+          Failed[Item - Start] = true;
+          if (Entry.Directory)
+          {
+            ExcludedDir = UnixIncludeTrailingBackslash(FullFileName);
+          }
+          TarDiscard(Entry.Size + TarPadding(Entry.Size), OperationProgress);
+          TSuspendFileOperationProgress Suspend(OperationProgress);
+          if (!FTerminal->HandleException(&E))
+          {
+            throw;
+          }
+        }
+        catch (Exception & E)
+        {
+          Failed[Item - Start] = true;
+          if (Entry.Directory)
+          {
+            ExcludedDir = UnixIncludeTrailingBackslash(FullFileName);
+          }
+          TarDiscard(Entry.Size + TarPadding(Entry.Size), OperationProgress);
+          TSuspendFileOperationProgress Suspend(OperationProgress);
+          TQueryParams QueryParams(qpAllowContinueOnError);
+          if (FTerminal->QueryUserException(FMTLOAD(COPY_ERROR, (FullFileName)),
+                &E, qaOK | qaAbort, &QueryParams, qtError) == qaAbort)
+          {
+            OperationProgress->SetCancel(csCancel);
+          }
+          FTerminal->Log->AddException(&E);
+        }
+      }
+    }
+  }
+  catch (EFatal & E)
+  {
+    throw;
+  }
+  catch (Exception & E)
+  {
+    // We cannot find where the next entry starts
+    FTerminal->FatalError(&E, FMTLOAD(COPY_FATAL, (FullFileName)));
+  }
+  return true;
+}
+//---------------------------------------------------------------------------
+void __fastcall TSCPFileSystem::TarCopyToLocal(TStrings * FilesToCopy,
+  const UnicodeString & TargetDir, const TCopyParamType * CopyParam,
+  int Params, TFileOperationProgressType * OperationProgress,
+  TOnceDoneOperation & OnceDoneOperation)
+{
+  FTerminal->LogEvent(FORMAT(L"Copying %d files/directories to local directory "
+    "\"%s\" using tar", (FilesToCopy->Count, TargetDir)));
+  FTerminal->LogEvent(0, CopyParam->LogStr);
+
+  int Start = 0;
+  while ((Start < FilesToCopy->Count) && !OperationProgress->Cancel)
+  {
+    // Files of the same directory are archived by one tar,
+    // unless the command line would get too long
+    UnicodeString SourceDir =
+      UnixExtractFilePath(UnixExcludeTrailingBackslash(FilesToCopy->Strings[Start]));
+    UnicodeString FileList;
+    int End = Start;
+    do
+    {
+      UnicodeString FileName = UnixExtractFileName(UnixExcludeTrailingBackslash(FilesToCopy->Strings[End]));
+      FileList += FORMAT(L" \"./%s\"", (::DelimitStr(FileName, L"\\`$\"")));
+      End++;
+    }
+    while ((End < FilesToCopy->Count) &&
+           (UnixExtractFilePath(UnixExcludeTrailingBackslash(FilesToCopy->Strings[End])) == SourceDir) &&
+           (FileList.Length() < TarMaxFileListLength));
+
+    std::vector<bool> Seen(End - Start, false);
+    std::vector<bool> Failed(End - Start, false);
+    bool Success = false;
+
+    try
+    {
+      UnicodeString DelimitedSourceDir = DelimitStr(UnixExcludeTrailingBackslash(SourceDir));
+      UnicodeString Command =
+        FCommandSet->Command(fsTarCopyToLocal, ARRAYOFCONST((DelimitedSourceDir, FileList)));
+      SendCommand(FCommandSet->FullCommand(fsTarCopyToLocal, ARRAYOFCONST((DelimitedSourceDir, FileList))));
+      SkipFirstLine();
+
+      if (!TarSinkArchive(FilesToCopy, Start, End, SourceDir, TargetDir, CopyParam, Params,
+             OperationProgress, Seen, Failed))
+      {
+        try
+        {
+          ReadCommandOutput(coRaiseExcept, &Command);
+          throw Exception(L"");
+        }
+        catch (Exception & E)
+        {
+          if (FTerminal->Active)
+          {
+            FTerminal->TerminalError(&E, LoadStr(TAR_INIT_ERROR));
+          }
+          else
+          {
+            throw;
+          }
+        }
+      }
+
+      try
+      {
+        ReadCommandOutput(coExpectNoOutput | coWaitForLastLine | coRaiseExcept, &Command);
+        Success = true;
+      }
+      catch (ETerminal & E)
+      {
+        TQueryParams QueryParams(qpAllowContinueOnError);
+        TSuspendFileOperationProgress Suspend(OperationProgress);
+
+        if (FTerminal->QueryUserException(FMTLOAD(COPY_ERROR, (FilesToCopy->Strings[Start])), &E,
+              qaOK | qaAbort, &QueryParams, qtError) == qaAbort)
+        {
+          OperationProgress->SetCancel(csCancel);
+        }
+        if (!FTerminal->HandleException(&E))
+        {
+          throw;
+        }
+      }
+    }
+    __finally
+    {
+      for (int IFile = Start; IFile < End; IFile++)
+      {
+        // tar does not tell which of the files it failed to archive
+        bool FileSuccess =
+          Success && Seen[IFile - Start] && !Failed[IFile - Start] && !OperationProgress->Cancel;
+        FTerminal->OperationFinish(
+          OperationProgress, FilesToCopy->Objects[IFile], FilesToCopy->Strings[IFile], FileSuccess,
+          OnceDoneOperation);
+      }
+    }
+
+    Start = End;
+  }
+}
+//---------------------------------------------------------------------------
 void __fastcall TSCPFileSystem::Sink(
   const UnicodeString & /*FileName*/, const TRemoteFile * /*File*/,
   const UnicodeString & /*TargetDir*/, UnicodeString & /*DestFileName*/, int /*Attrs*/,
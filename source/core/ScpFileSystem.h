@@ -4,10 +4,17 @@
 
 #include <FileSystems.h>
 #include <CopyParam.h>
+#include <vector>
+#include <map>
 //---------------------------------------------------------------------------
 class TCommandSet;
 class TSecureShell;
 struct TOverwriteFileParams;
+struct TTarEntry;
+struct TTarSinkEntry;
+typedef std::vector<TTarEntry> TTarEntries;
+typedef std::map<UnicodeString, UnicodeString> TTarExtractedFiles;
+typedef std::map<UnicodeString, TRemoteFileList *> TTreeListingDirectories;
 //---------------------------------------------------------------------------
 class TSCPFileSystem : public TCustomFileSystem
 {
@@ -30,6 +37,9 @@ public:
     const TRemoteFile * File, const TRemoteProperties * Properties,
     TChmodSessionAction & Action);
   virtual bool __fastcall LoadFilesProperties(TStrings * FileList);
+  virtual void __fastcall ChangeFilesProperties(TStrings * FileList,
+    const TRemoteProperties * Properties, TStrings * FailedFiles);
+  virtual void __fastcall DeleteFiles(TStrings * FileList, TStrings * FailedFiles);
   virtual void __fastcall CalculateFilesChecksum(const UnicodeString & Alg,
     TStrings * FileList, TStrings * Checksums,
     TCalculatedChecksumEvent OnCalculatedChecksum);
@@ -63,6 +73,7 @@ public:
   virtual void __fastcall LookupUsersGroups();
   virtual void __fastcall ReadCurrentDirectory();
   virtual void __fastcall ReadDirectory(TRemoteFileList * FileList);
+  virtual bool __fastcall ReadDirectoryTree(const UnicodeString & Directory, TObjectList * FileLists);
   virtual void __fastcall ReadFile(const UnicodeString FileName,
     TRemoteFile *& File);
   virtual void __fastcall ReadSymlink(TRemoteFile * SymlinkFile,
@@ -101,6 +112,7 @@ private:
   UnicodeString FCachedDirectoryChange;
   bool FProcessingCommand;
   int FLsFullTime;
+  int FTreeListing;
   TCaptureOutputEvent FOnCaptureOutput;
   bool FScpFatalError;
 
@@ -138,6 +150,9 @@ private:
   void __fastcall UnsetNationalVars();
   TRemoteFile * __fastcall CreateRemoteFile(const UnicodeString & ListingStr,
     TRemoteFile * LinkedByFile = NULL);
+  bool __fastcall DetectTreeListing();
+  TRemoteFile * __fastcall CreateTreeListingFile(const RawByteString & Record,
+    const UnicodeString & Path, TTreeListingDirectories & Directories, TObjectList * FileLists);
   void __fastcall CaptureOutput(const UnicodeString & AddedLine, TCaptureOutputType OutputType);
   void __fastcall ChangeFileToken(const UnicodeString & DelimitedName,
     const TRemoteToken & Token, TFSCommand Cmd, const UnicodeString & RecursiveStr);
@@ -146,6 +161,39 @@ private:
     TOperationSide Side,
     const TOverwriteFileParams * FileParams, const TCopyParamType * CopyParam,
     int Params, TFileOperationProgressType * OperationProgress);
+  bool __fastcall ConfirmCopyToRemote(
+    const UnicodeString & FileName, const UnicodeString & FileNameOnly,
+    const TCopyParamType * CopyParam, int Params, TFileOperationProgressType * OperationProgress);
+  bool __fastcall UseTarTransfer(const TCopyParamType * CopyParam, int Params, TOperationSide Side);
+  RawByteString __fastcall TarEntryHeader(const TTarEntry & Entry);
+  void __fastcall TarCollectSource(const UnicodeString & FileName,
+    const UnicodeString & ArchiveName, int Item, const TCopyParamType * CopyParam,
+    TFileOperationProgressType * OperationProgress, TTarEntries & Entries);
+  UnicodeString __fastcall TarStartCopyToRemote(
+    __int64 ArchiveSize, const UnicodeString & TargetDir, const TCopyParamType * CopyParam);
+  void __fastcall TarSource(const TTarEntry & Entry,
+    const UnicodeString & TargetDir, const TCopyParamType * CopyParam,
+    TFileOperationProgressType * OperationProgress);
+  void __fastcall TarCopyToRemote(TStrings * FilesToCopy,
+    const UnicodeString & TargetDir, const TCopyParamType * CopyParam,
+    int Params, TFileOperationProgressType * OperationProgress,
+    TOnceDoneOperation & OnceDoneOperation);
+  void __fastcall TarReceive(char * Buf, int Len);
+  void __fastcall TarDiscard(__int64 Len, TFileOperationProgressType * OperationProgress);
+  RawByteString __fastcall TarReceiveData(__int64 Size, TFileOperationProgressType * OperationProgress);
+  UnicodeString __fastcall TarEntryName(const RawByteString & Name);
+  void __fastcall TarSink(const TTarSinkEntry & Entry,
+    const UnicodeString & TargetDir, const TCopyParamType * CopyParam, int Params,
+    TFileOperationProgressType * OperationProgress, UnicodeString & ExcludedDir,
+    TTarExtractedFiles & Extracted);
+  bool __fastcall TarSinkArchive(TStrings * FilesToCopy, int Start, int End,
+    const UnicodeString & SourceDir, const UnicodeString & TargetDir,
+    const TCopyParamType * CopyParam, int Params, TFileOperationProgressType * OperationProgress,
+    std::vector<bool> & Seen, std::vector<bool> & Failed);
+  void __fastcall TarCopyToLocal(TStrings * FilesToCopy,
+    const UnicodeString & TargetDir, const TCopyParamType * CopyParam,
+    int Params, TFileOperationProgressType * OperationProgress,
+    TOnceDoneOperation & OnceDoneOperation);
 
   static bool __fastcall RemoveLastLine(UnicodeString & Line,
     int & ReturnCode, UnicodeString LastLine = L"");
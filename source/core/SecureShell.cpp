@@ -1136,7 +1136,7 @@ Integer __fastcall TSecureShell::Receive(unsigned char * Buf, Integer Len)
   return Len;
 }
 //---------------------------------------------------------------------------
-UnicodeString __fastcall TSecureShell::ReceiveLine()
+RawByteString __fastcall TSecureShell::ReceiveRawLine()
 {
   unsigned Index;
   RawByteString Line;
@@ -1174,7 +1174,12 @@ UnicodeString __fastcall TSecureShell::ReceiveLine()
   // We don't want end-of-line character
   Line.SetLength(Line.Length()-1);
 
-  UnicodeString Result = ConvertInput(Line);
+  return Line;
+}
+//---------------------------------------------------------------------------
+UnicodeString __fastcall TSecureShell::ReceiveLine()
+{
+  UnicodeString Result = ConvertInput(ReceiveRawLine());
   CaptureOutput(llOutput, Result);
 
   return Result;
@@ -1194,6 +1199,20 @@ UnicodeString __fastcall TSecureShell::ConvertInput(const RawByteString & Input)
   return Result;
 }
 //---------------------------------------------------------------------------
+RawByteString __fastcall TSecureShell::ConvertOutput(const UnicodeString & Output)
+{
+  RawByteString Result;
+  if (UtfStrings)
+  {
+    Result = RawByteString(UTF8String(Output));
+  }
+  else
+  {
+    Result = RawByteString(AnsiString(Output));
+  }
+  return Result;
+}
+//---------------------------------------------------------------------------
 void __fastcall TSecureShell::SendSpecial(int Code)
 {
   if (Configuration->ActualLogProtocol >= 0)
@@ -1334,15 +1353,7 @@ void __fastcall TSecureShell::SendNull()
 void __fastcall TSecureShell::SendLine(const UnicodeString & Line)
 {
   CheckConnection();
-  RawByteString Buf;
-  if (UtfStrings)
-  {
-    Buf = RawByteString(UTF8String(Line));
-  }
-  else
-  {
-    Buf = RawByteString(AnsiString(Line));
-  }
+  RawByteString Buf = ConvertOutput(Line);
   Buf += "\n";
 
   FLog->Add(llInput, Line);
@@ -100,7 +100,6 @@ private:
   void __fastcall SendBuffer(unsigned int & Result);
   unsigned int __fastcall TimeoutPrompt(TQueryParamsTimerEvent PoolEvent);
   bool __fastcall TryFtp();
-  UnicodeString __fastcall ConvertInput(const RawByteString & Input);
   void __fastcall GetRealHost(UnicodeString & Host, int & Port);
   UnicodeString __fastcall RetrieveHostKey(UnicodeString Host, int Port, const UnicodeString KeyType);
 
@@ -128,6 +127,9 @@ public:
   int __fastcall Receive(unsigned char * Buf, int Len);
   bool __fastcall Peek(unsigned char *& Buf, int Len);
   UnicodeString __fastcall ReceiveLine();
+  RawByteString __fastcall ReceiveRawLine();
+  UnicodeString __fastcall ConvertInput(const RawByteString & Input);
+  RawByteString __fastcall ConvertOutput(const UnicodeString & Output);
   void __fastcall Send(const unsigned char * Buf, int Len);
   void __fastcall SendSpecial(int Code);
   void __fastcall Idle(unsigned int MSec = 0);
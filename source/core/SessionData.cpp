@@ -202,6 +202,10 @@ void __fastcall TSessionData::DefaultSettings()
   CacheDirectories = true;
   CacheDirectoryChanges = true;
   PreserveDirectoryChanges = true;
+  PreserveDirectoryCache = false;
+  PreserveDirectoryCacheMaxAge = 24;
+  QueueWarmSessions = 0;
+  QueueSessionIdleTimeout = 0;
   LockInHome = false;
   ResolveSymlinks = true;
   FollowDirectorySymlinks = false;
@@ -224,6 +228,8 @@ void __fastcall TSessionData::DefaultSettings()
   ListingCommand = L"ls -la";
   IgnoreLsWarnings = true;
   Scp1Compatibility = false;
+  SCPTarTransfer = false;
+  SCPTreeListing = false;
   TimeDifference = 0;
   TimeDifferenceAuto = true;
   SCPLsFullTime = asAuto;
@@ -237,6 +243,9 @@ void __fastcall TSessionData::DefaultSettings()
   SFTPDownloadQueue = 32;
   SFTPUploadQueue = 32;
   SFTPListingQueue = 2;
+  // The tree walker reads excluded directories too, so it is opt-in
+  SFTPTreeListingQueue = 0;
+  SFTPDeltaTransfer = false;
   SFTPMaxVersion = ::SFTPMaxVersion;
   SFTPMaxPacketSize = 0;
 
@@ -267,6 +276,7 @@ void __fastcall TSessionData::DefaultSettings()
   MinTlsVersion = tls10;
   MaxTlsVersion = tls13;
   FtpListAll = asAuto;
+  FtpListRecursive = false;
   FtpHost = asAuto;
   FtpDeleteFromCwd = asAuto;
   SslSessionReuse = true;
@@ -300,6 +310,7 @@ void __fastcall TSessionData::NonPersistant()
 {
   UpdateDirectories = false;
   PreserveDirectoryChanges = false;
+  PreserveDirectoryCache = false;
 }
 //---------------------------------------------------------------------
 #define PROPERTY(P) PROPERTY_HANDLER(P, )
@@ -349,6 +360,10 @@ void __fastcall TSessionData::NonPersistant()
   PROPERTY(CacheDirectories); \
   PROPERTY(CacheDirectoryChanges); \
   PROPERTY(PreserveDirectoryChanges); \
+  PROPERTY(PreserveDirectoryCache); \
+  PROPERTY(PreserveDirectoryCacheMaxAge); \
+  PROPERTY(QueueWarmSessions); \
+  PROPERTY(QueueSessionIdleTimeout); \
   \
   PROPERTY(ResolveSymlinks); \
   PROPERTY(FollowDirectorySymlinks); \
@@ -364,6 +379,8 @@ void __fastcall TSessionData::NonPersistant()
   PROPERTY(Shell); \
   PROPERTY(ClearAliases); \
   PROPERTY(Scp1Compatibility); \
+  PROPERTY(SCPTarTransfer); \
+  PROPERTY(SCPTreeListing); \
   PROPERTY(UnsetNationalVars); \
   PROPERTY(ListingCommand); \
   PROPERTY(IgnoreLsWarnings); \
@@ -407,6 +424,8 @@ void __fastcall TSessionData::NonPersistant()
   PROPERTY(SFTPDownloadQueue); \
   PROPERTY(SFTPUploadQueue); \
   PROPERTY(SFTPListingQueue); \
+  PROPERTY(SFTPTreeListingQueue); \
+  PROPERTY(SFTPDeltaTransfer); \
   PROPERTY(SFTPMaxVersion); \
   PROPERTY(SFTPMaxPacketSize); \
   \
@@ -433,6 +452,7 @@ void __fastcall TSessionData::NonPersistant()
   PROPERTY(FtpPingType); \
   PROPERTY(FtpTransferActiveImmediately); \
   PROPERTY(FtpListAll); \
+  PROPERTY(FtpListRecursive); \
   PROPERTY(FtpHost); \
   PROPERTY(FtpDeleteFromCwd); \
   PROPERTY(SslSessionReuse); \
@@ -684,6 +704,10 @@ void __fastcall TSessionData::DoLoad(THierarchicalStorage * Storage, bool PuttyI
   CacheDirectories = Storage->ReadBool(L"CacheDirectories", CacheDirectories);
   CacheDirectoryChanges = Storage->ReadBool(L"CacheDirectoryChanges", CacheDirectoryChanges);
   PreserveDirectoryChanges = Storage->ReadBool(L"PreserveDirectoryChanges", PreserveDirectoryChanges);
+  PreserveDirectoryCache = Storage->ReadBool(L"PreserveDirectoryCache", PreserveDirectoryCache);
+  PreserveDirectoryCacheMaxAge = Storage->ReadInteger(L"PreserveDirectoryCacheMaxAge", PreserveDirectoryCacheMaxAge);
+  QueueWarmSessions = Storage->ReadInteger(L"QueueWarmSessions", QueueWarmSessions);
+  QueueSessionIdleTimeout = Storage->ReadInteger(L"QueueSessionIdleTimeout", QueueSessionIdleTimeout);
 
   ResolveSymlinks = Storage->ReadBool(L"ResolveSymlinks", ResolveSymlinks);
   FollowDirectorySymlinks = Storage->ReadBool(L"FollowDirectorySymlinks", FollowDirectorySymlinks);
@@ -698,6 +722,8 @@ void __fastcall TSessionData::DoLoad(THierarchicalStorage * Storage, bool PuttyI
   IgnoreLsWarnings = Storage->ReadBool(L"IgnoreLsWarnings", IgnoreLsWarnings);
   SCPLsFullTime = TAutoSwitch(Storage->ReadInteger(L"SCPLsFullTime", SCPLsFullTime));
   Scp1Compatibility = Storage->ReadBool(L"Scp1Compatibility", Scp1Compatibility);
+  SCPTarTransfer = Storage->ReadBool(L"SCPTarTransfer", SCPTarTransfer);
+  SCPTreeListing = Storage->ReadBool(L"SCPTreeListing", SCPTreeListing);
   TimeDifference = Storage->ReadFloat(L"TimeDifference", TimeDifference);
   TimeDifferenceAuto = Storage->ReadBool(L"TimeDifferenceAuto", (TimeDifference == TDateTime()));
   DeleteToRecycleBin = Storage->ReadBool(L"DeleteToRecycleBin", DeleteToRecycleBin);
@@ -787,6 +813,8 @@ void __fastcall TSessionData::DoLoad(THierarchicalStorage * Storage, bool PuttyI
   SFTPDownloadQueue = Storage->ReadInteger(L"SFTPDownloadQueue", SFTPDownloadQueue);
   SFTPUploadQueue = Storage->ReadInteger(L"SFTPUploadQueue", SFTPUploadQueue);
   SFTPListingQueue = Storage->ReadInteger(L"SFTPListingQueue", SFTPListingQueue);
+  SFTPTreeListingQueue = Storage->ReadInteger(L"SFTPTreeListingQueue", SFTPTreeListingQueue);
+  SFTPDeltaTransfer = Storage->ReadBool(L"SFTPDeltaTransfer", SFTPDeltaTransfer);
 
   Color = Storage->ReadInteger(L"Color", Color);
 
@@ -825,6 +853,7 @@ void __fastcall TSessionData::DoLoad(THierarchicalStorage * Storage, bool PuttyI
   FtpTransferActiveImmediately = static_cast<TAutoSwitch>(Storage->ReadInteger(L"FtpTransferActiveImmediately2", FtpTransferActiveImmediately));
   Ftps = static_cast<TFtps>(Storage->ReadInteger(L"Ftps", Ftps));
   FtpListAll = TAutoSwitch(Storage->ReadInteger(L"FtpListAll", FtpListAll));
+  FtpListRecursive = Storage->ReadBool(L"FtpListRecursive", FtpListRecursive);
   FtpHost = TAutoSwitch(Storage->ReadInteger(L"FtpHost", FtpHost));
   FtpDeleteFromCwd = TAutoSwitch(Storage->ReadInteger(L"FtpDeleteFromCwd", FtpDeleteFromCwd));
   SslSessionReuse = Storage->ReadBool(L"SslSessionReuse", SslSessionReuse);
@@ -1046,6 +1075,10 @@ void __fastcall TSessionData::DoSave(THierarchicalStorage * Storage,
     WRITE_DATA(Bool, CacheDirectories);
     WRITE_DATA(Bool, CacheDirectoryChanges);
     WRITE_DATA(Bool, PreserveDirectoryChanges);
+    WRITE_DATA(Bool, PreserveDirectoryCache);
+    WRITE_DATA(Integer, PreserveDirectoryCacheMaxAge);
+    WRITE_DATA(Integer, QueueWarmSessions);
+    WRITE_DATA(Integer, QueueSessionIdleTimeout);
 
     WRITE_DATA(Bool, ResolveSymlinks);
     WRITE_DATA(Bool, FollowDirectorySymlinks);
@@ -1062,6 +1095,8 @@ void __fastcall TSessionData::DoSave(THierarchicalStorage * Storage,
     WRITE_DATA(Bool, IgnoreLsWarnings);
     WRITE_DATA(Integer, SCPLsFullTime);
     WRITE_DATA(Bool, Scp1Compatibility);
+    WRITE_DATA(Bool, SCPTarTransfer);
+    WRITE_DATA(Bool, SCPTreeListing);
     // TimeDifferenceAuto is valid for FTP protocol only.
     // For other protocols it's typically true (default value),
     // but ignored so TimeDifference is still taken into account (SCP only actually)
@@ -1154,6 +1189,8 @@ void __fastcall TSessionData::DoSave(THierarchicalStorage * Storage,
     WRITE_DATA(Integer, SFTPDownloadQueue);
     WRITE_DATA(Integer, SFTPUploadQueue);
     WRITE_DATA(Integer, SFTPListingQueue);
+    WRITE_DATA(Integer, SFTPTreeListingQueue);
+    WRITE_DATA(Bool, SFTPDeltaTransfer);
 
     WRITE_DATA(Integer, Color);
 
@@ -1173,6 +1210,7 @@ void __fastcall TSessionData::DoSave(THierarchicalStorage * Storage,
     WRITE_DATA_EX(Integer, L"FtpTransferActiveImmediately2", FtpTransferActiveImmediately, );
     WRITE_DATA(Integer, Ftps);
     WRITE_DATA(Integer, FtpListAll);
+    WRITE_DATA(Bool, FtpListRecursive);
     WRITE_DATA(Integer, FtpHost);
     WRITE_DATA(Integer, FtpDeleteFromCwd);
     WRITE_DATA(Bool, SslSessionReuse);
@@ -3618,6 +3656,26 @@ void __fastcall TSessionData::SetPreserveDirectoryChanges(bool value)
   SET_SESSION_PROPERTY(PreserveDirectoryChanges);
 }
 //---------------------------------------------------------------------
+void __fastcall TSessionData::SetPreserveDirectoryCache(bool value)
+{
+  SET_SESSION_PROPERTY(PreserveDirectoryCache);
+}
+//---------------------------------------------------------------------
+void __fastcall TSessionData::SetPreserveDirectoryCacheMaxAge(int value)
+{
+  SET_SESSION_PROPERTY(PreserveDirectoryCacheMaxAge);
+}
+//---------------------------------------------------------------------
+void __fastcall TSessionData::SetQueueWarmSessions(int value)
+{
+  SET_SESSION_PROPERTY(QueueWarmSessions);
+}
+//---------------------------------------------------------------------
+void __fastcall TSessionData::SetQueueSessionIdleTimeout(int value)
+{
+  SET_SESSION_PROPERTY(QueueSessionIdleTimeout);
+}
+//---------------------------------------------------------------------
 void __fastcall TSessionData::SetResolveSymlinks(bool value)
 {
   SET_SESSION_PROPERTY(ResolveSymlinks);
@@ -3668,6 +3726,16 @@ void __fastcall TSessionData::SetScp1Compatibility(bool value)
   SET_SESSION_PROPERTY(Scp1Compatibility);
 }
 //---------------------------------------------------------------------
+void __fastcall TSessionData::SetSCPTarTransfer(bool value)
+{
+  SET_SESSION_PROPERTY(SCPTarTransfer);
+}
+//---------------------------------------------------------------------
+void __fastcall TSessionData::SetSCPTreeListing(bool value)
+{
+  SET_SESSION_PROPERTY(SCPTreeListing);
+}
+//---------------------------------------------------------------------
 void __fastcall TSessionData::SetTcpNoDelay(bool value)
 {
   SET_SESSION_PROPERTY(TcpNoDelay);
@@ -3786,6 +3854,16 @@ void __fastcall TSessionData::SetSFTPListingQueue(int value)
   SET_SESSION_PROPERTY(SFTPListingQueue);
 }
 //---------------------------------------------------------------------
+void __fastcall TSessionData::SetSFTPTreeListingQueue(int value)
+{
+  SET_SESSION_PROPERTY(SFTPTreeListingQueue);
+}
+//---------------------------------------------------------------------
+void __fastcall TSessionData::SetSFTPDeltaTransfer(bool value)
+{
+  SET_SESSION_PROPERTY(SFTPDeltaTransfer);
+}
+//---------------------------------------------------------------------
 void __fastcall TSessionData::SetSFTPMaxVersion(int value)
 {
   SET_SESSION_PROPERTY(SFTPMaxVersion);
@@ -3968,6 +4046,11 @@ void __fastcall TSessionData::SetFtpListAll(TAutoSwitch value)
   SET_SESSION_PROPERTY(FtpListAll);
 }
 //---------------------------------------------------------------------
+void __fastcall TSessionData::SetFtpListRecursive(bool value)
+{
+  SET_SESSION_PROPERTY(FtpListRecursive);
+}
+//---------------------------------------------------------------------
 void __fastcall TSessionData::SetFtpHost(TAutoSwitch value)
 {
   SET_SESSION_PROPERTY(FtpHost);
@@ -146,11 +146,17 @@ private:
   bool FCacheDirectories;
   bool FCacheDirectoryChanges;
   bool FPreserveDirectoryChanges;
+  bool FPreserveDirectoryCache;
+  int FPreserveDirectoryCacheMaxAge;
+  int FQueueWarmSessions;
+  int FQueueSessionIdleTimeout;
   bool FSelected;
   TAutoSwitch FLookupUserGroups;
   UnicodeString FReturnVar;
   bool FExitCode1IsError;
   bool FScp1Compatibility;
+  bool FSCPTarTransfer;
+  bool FSCPTreeListing;
   UnicodeString FShell;
   UnicodeString FSftpServer;
   int FTimeout;
@@ -181,6 +187,8 @@ private:
   int FSFTPDownloadQueue;
   int FSFTPUploadQueue;
   int FSFTPListingQueue;
+  int FSFTPTreeListingQueue;
+  bool FSFTPDeltaTransfer;
   int FSFTPMaxVersion;
   unsigned long FSFTPMaxPacketSize;
   TDSTMode FDSTMode;
@@ -191,6 +199,7 @@ private:
   UnicodeString FPostLoginCommands;
   TAutoSwitch FSCPLsFullTime;
   TAutoSwitch FFtpListAll;
+  bool FFtpListRecursive;
   TAutoSwitch FFtpHost;
   TAutoSwitch FFtpDeleteFromCwd;
   bool FSslSessionReuse;
@@ -296,6 +305,10 @@ private:
   void __fastcall SetCacheDirectories(bool value);
   void __fastcall SetCacheDirectoryChanges(bool value);
   void __fastcall SetPreserveDirectoryChanges(bool value);
+  void __fastcall SetPreserveDirectoryCache(bool value);
+  void __fastcall SetPreserveDirectoryCacheMaxAge(int value);
+  void __fastcall SetQueueWarmSessions(int value);
+  void __fastcall SetQueueSessionIdleTimeout(int value);
   void __fastcall SetLockInHome(bool value);
   void __fastcall SetSpecial(bool value);
   UnicodeString __fastcall GetInfoTip();
@@ -311,6 +324,8 @@ private:
   void __fastcall SetReturnVar(UnicodeString value);
   void __fastcall SetExitCode1IsError(bool value);
   void __fastcall SetScp1Compatibility(bool value);
+  void __fastcall SetSCPTarTransfer(bool value);
+  void __fastcall SetSCPTreeListing(bool value);
   void __fastcall SetShell(UnicodeString value);
   void __fastcall SetSftpServer(UnicodeString value);
   void __fastcall SetTimeout(int value);
@@ -352,12 +367,15 @@ private:
   void __fastcall SetSFTPDownloadQueue(int value);
   void __fastcall SetSFTPUploadQueue(int value);
   void __fastcall SetSFTPListingQueue(int value);
+  void __fastcall SetSFTPTreeListingQueue(int value);
+  void __fastcall SetSFTPDeltaTransfer(bool value);
   void __fastcall SetSFTPMaxVersion(int value);
   void __fastcall SetSFTPMaxPacketSize(unsigned long value);
   void __fastcall SetSFTPBug(TSftpBug Bug, TAutoSwitch value);
   TAutoSwitch __fastcall GetSFTPBug(TSftpBug Bug) const;
   void __fastcall SetSCPLsFullTime(TAutoSwitch value);
   void __fastcall SetFtpListAll(TAutoSwitch value);
+  void __fastcall SetFtpListRecursive(bool value);
   void __fastcall SetFtpHost(TAutoSwitch value);
   void __fastcall SetFtpDeleteFromCwd(TAutoSwitch value);
   void __fastcall SetSslSessionReuse(bool value);
@@ -569,6 +587,10 @@ public:
   __property bool CacheDirectories = { read=FCacheDirectories, write=SetCacheDirectories };
   __property bool CacheDirectoryChanges = { read=FCacheDirectoryChanges, write=SetCacheDirectoryChanges };
   __property bool PreserveDirectoryChanges = { read=FPreserveDirectoryChanges, write=SetPreserveDirectoryChanges };
+  __property bool PreserveDirectoryCache = { read=FPreserveDirectoryCache, write=SetPreserveDirectoryCache };
+  __property int PreserveDirectoryCacheMaxAge = { read=FPreserveDirectoryCacheMaxAge, write=SetPreserveDirectoryCacheMaxAge };
+  __property int QueueWarmSessions = { read=FQueueWarmSessions, write=SetQueueWarmSessions };
+  __property int QueueSessionIdleTimeout = { read=FQueueSessionIdleTimeout, write=SetQueueSessionIdleTimeout };
   __property bool LockInHome = { read=FLockInHome, write=SetLockInHome };
   __property bool Special = { read=FSpecial, write=SetSpecial };
   __property bool Selected  = { read=FSelected, write=FSelected };
@@ -581,6 +603,8 @@ public:
   __property UnicodeString ReturnVar = { read = FReturnVar, write = SetReturnVar };
   __property bool ExitCode1IsError = { read = FExitCode1IsError, write = SetExitCode1IsError };
   __property bool Scp1Compatibility = { read = FScp1Compatibility, write = SetScp1Compatibility };
+  __property bool SCPTarTransfer = { read = FSCPTarTransfer, write = SetSCPTarTransfer };
+  __property bool SCPTreeListing = { read = FSCPTreeListing, write = SetSCPTreeListing };
   __property UnicodeString Shell = { read = FShell, write = SetShell };
   __property UnicodeString SftpServer = { read = FSftpServer, write = SetSftpServer };
   __property int Timeout = { read = FTimeout, write = SetTimeout };
@@ -616,11 +640,14 @@ public:
   __property int SFTPDownloadQueue = { read = FSFTPDownloadQueue, write = SetSFTPDownloadQueue };
   __property int SFTPUploadQueue = { read = FSFTPUploadQueue, write = SetSFTPUploadQueue };
   __property int SFTPListingQueue = { read = FSFTPListingQueue, write = SetSFTPListingQueue };
+  __property int SFTPTreeListingQueue = { read = FSFTPTreeListingQueue, write = SetSFTPTreeListingQueue };
+  __property bool SFTPDeltaTransfer = { read = FSFTPDeltaTransfer, write = SetSFTPDeltaTransfer };
   __property int SFTPMaxVersion = { read = FSFTPMaxVersion, write = SetSFTPMaxVersion };
   __property unsigned long SFTPMaxPacketSize = { read = FSFTPMaxPacketSize, write = SetSFTPMaxPacketSize };
   __property TAutoSwitch SFTPBug[TSftpBug Bug]  = { read=GetSFTPBug, write=SetSFTPBug };
   __property TAutoSwitch SCPLsFullTime = { read = FSCPLsFullTime, write = SetSCPLsFullTime };
   __property TAutoSwitch FtpListAll = { read = FFtpListAll, write = SetFtpListAll };
+  __property bool FtpListRecursive = { read = FFtpListRecursive, write = SetFtpListRecursive };
   __property TAutoSwitch FtpHost = { read = FFtpHost, write = SetFtpHost };
   __property TAutoSwitch FtpDeleteFromCwd = { read = FFtpDeleteFromCwd, write = SetFtpDeleteFromCwd };
   __property bool SslSessionReuse = { read = FSslSessionReuse, write = SetSslSessionReuse };
@@ -14,6 +14,8 @@
 #include "TextsCore.h"
 #include "CoreMain.h"
 #include "Script.h"
+#include "Queue.h"
+#include "FileOperationProgress.h"
 #include <System.IOUtils.hpp>
 //---------------------------------------------------------------------------
 #pragma package(smart_init)
@@ -108,6 +110,65 @@ UnicodeString __fastcall XmlAttributeEscape(UnicodeString Str)
   return DoXmlEscape(Str, true);
 }
 //---------------------------------------------------------------------------
+static UnicodeString __fastcall JsonString(const UnicodeString & Str)
+{
+  UnicodeString Result = L"\"";
+  for (int Index = 1; Index <= Str.Length(); Index++)
+  {
+    wchar_t C = Str[Index];
+    switch (C)
+    {
+      case L'"':
+        Result += L"\\\"";
+        break;
+      case L'\\':
+        Result += L"\\\\";
+        break;
+      case L'\n':
+        Result += L"\\n";
+        break;
+      case L'\r':
+        Result += L"\\r";
+        break;
+      case L'\t':
+        Result += L"\\t";
+        break;
+      default:
+        if (C < L' ')
+        {
+          Result += FORMAT(L"\\u%4.4x", (int(C)));
+        }
+        else
+        {
+          Result += C;
+        }
+        break;
+    }
+  }
+  Result += L"\"";
+  return Result;
+}
+//---------------------------------------------------------------------------
+static UnicodeString __fastcall JsonStringArray(TStrings * Strings)
+{
+  UnicodeString Result;
+  for (int Index = 0; Index < Strings->Count; Index++)
+  {
+    AddToList(Result, JsonString(Strings->Strings[Index]), L",");
+  }
+  return L"[" + Result + L"]";
+}
+//---------------------------------------------------------------------------
+// Json is expected to start with "{"
+static void __fastcall AddJsonMember(UnicodeString & Json, const UnicodeString & Name, const UnicodeString & Value)
+{
+  if (Json.Length() > 1)
+  {
+    Json += L",";
+  }
+  Json += JsonString(Name) + L":" + Value;
+}
+//---------------------------------------------------------------------------
 //---------------------------------------------------------------------------
 #pragma warn -inl
 class TSessionActionRecord
@@ -210,6 +271,10 @@ public:
         }
         FLog->AddIndented(FORMAT(L"</%s>", (Name)));
       }
+      if (FLog->FEventFeed && (FState != Cancelled))
+      {
+        FLog->AddEvent(EventJson());
+      }
       delete this;
     }
     return Result;
@@ -429,6 +494,70 @@ protected:
     FLog->AddIndented(Indent + L"</file>");
   }
 
+  UnicodeString __fastcall FileJson(TRemoteFile * File)
+  {
+    UnicodeString Json = L"{";
+    AddJsonMember(Json, L"filename", JsonString(File->FileName));
+    AddJsonMember(Json, L"type", JsonString(UnicodeString(static_cast<wchar_t>(towupper(File->Type)))));
+    if (!File->IsDirectory)
+    {
+      AddJsonMember(Json, L"size", IntToStr(File->Size));
+    }
+    if (File->ModificationFmt != mfNone)
+    {
+      AddJsonMember(Json, L"modification", JsonString(StandardTimestamp(File->Modification)));
+    }
+    if (!File->Rights->Unknown)
+    {
+      AddJsonMember(Json, L"permissions", JsonString(File->Rights->Text));
+    }
+    if (File->Owner.IsSet)
+    {
+      AddJsonMember(Json, L"owner", JsonString(File->Owner.DisplayText));
+    }
+    if (File->Group.IsSet)
+    {
+      AddJsonMember(Json, L"group", JsonString(File->Group.DisplayText));
+    }
+    Json += L"}";
+    return Json;
+  }
+
+  UnicodeString __fastcall EventJson()
+  {
+    UnicodeString Json = L"{";
+    AddJsonMember(Json, L"event", JsonString(ActionName()));
+    AddJsonMember(Json, L"time", JsonString(StandardTimestamp()));
+    AddJsonMember(Json, L"success", ((FState == RolledBack) ? L"false" : L"true"));
+    if (FRecursive)
+    {
+      AddJsonMember(Json, L"recursive", L"true");
+    }
+    for (int Index = 0; Index < FNames->Count; Index++)
+    {
+      AddJsonMember(Json, FNames->Strings[Index], JsonString(FValues->Strings[Index]));
+    }
+    if (FFileList != NULL)
+    {
+      UnicodeString Files;
+      for (int Index = 0; Index < FFileList->Count; Index++)
+      {
+        AddToList(Files, FileJson(FFileList->Files[Index]), L",");
+      }
+      AddJsonMember(Json, L"files", L"[" + Files + L"]");
+    }
+    if (FFile != NULL)
+    {
+      AddJsonMember(Json, L"file", FileJson(FFile));
+    }
+    if (FErrorMessages != NULL)
+    {
+      AddJsonMember(Json, L"messages", JsonStringArray(FErrorMessages));
+    }
+    Json += L"}";
+    return Json;
+  }
+
   void __fastcall SynchronizeChecklistItemFileInfo(
     const UnicodeString & AFileName, bool IsDirectory, const TSynchronizeChecklist::TItem::TFileInfo FileInfo)
   {
@@ -460,7 +589,7 @@ private:
 //---------------------------------------------------------------------------
 __fastcall TSessionAction::TSessionAction(TActionLog * Log, TLogAction Action)
 {
-  if (Log->FLogging)
+  if (Log->FLogging || Log->FEventFeed)
   {
     FRecord = new TSessionActionRecord(Log, Action);
   }
@@ -768,6 +897,113 @@ FILE * __fastcall OpenFile(UnicodeString LogFileName, TDateTime Started, TSessio
 }
 //---------------------------------------------------------------------------
 //---------------------------------------------------------------------------
+// Writes log lines to the file on a background thread, so that the threads
+// producing the log (e.g. transfers with debug logging) do not wait for the disk.
+// Lines are collected in a buffer and written in batches.
+// Lines that may precede a crash (errors) are written synchronously.
+class TLogWriter : public TSignalThread
+{
+public:
+  __fastcall TLogWriter(FILE * File);
+  virtual __fastcall ~TLogWriter();
+
+  void __fastcall Write(const char * Data, int Length, bool Sync = false);
+  void __fastcall Flush();
+  bool __fastcall Failed();
+
+protected:
+  virtual void __fastcall ProcessEvent();
+
+private:
+  FILE * FFile;
+  TCriticalSection * FSection;
+  TCriticalSection * FWriteSection;
+  RawByteString FPending;
+  bool FFailed;
+
+  void __fastcall DoWrite(const char * Data, int Length);
+};
+//---------------------------------------------------------------------------
+// When the writer cannot keep up with the producers, they write synchronously
+// rather than dropping lines or growing the buffer indefinitely
+static const int LogWriterMaxPending = 1024 * 1024;
+//---------------------------------------------------------------------------
+__fastcall TLogWriter::TLogWriter(FILE * File) :
+  TSignalThread(false),
+  FFile(File), FFailed(false)
+{
+  FSection = new TCriticalSection();
+  FWriteSection = new TCriticalSection();
+  Start();
+}
+//---------------------------------------------------------------------------
+__fastcall TLogWriter::~TLogWriter()
+{
+  Close();
+  Flush();
+  delete FWriteSection;
+  delete FSection;
+}
+//---------------------------------------------------------------------------
+void __fastcall TLogWriter::Write(const char * Data, int Length, bool Sync)
+{
+  bool Direct;
+  {
+    TGuard Guard(FSection);
+    Direct = Sync || (FPending.Length() + Length > LogWriterMaxPending);
+    if (!Direct)
+    {
+      FPending += RawByteString(Data, Length);
+    }
+  }
+
+  if (Direct)
+  {
+    TGuard WriteGuard(FWriteSection);
+    // Keep the order of the lines
+    Flush();
+    DoWrite(Data, Length);
+  }
+  else
+  {
+    TriggerEvent();
+  }
+}
+//---------------------------------------------------------------------------
+void __fastcall TLogWriter::Flush()
+{
+  TGuard WriteGuard(FWriteSection);
+  RawByteString Data;
+  {
+    TGuard Guard(FSection);
+    Data = FPending;
+    FPending = RawByteString();
+  }
+  if (!Data.IsEmpty())
+  {
+    DoWrite(Data.c_str(), Data.Length());
+  }
+}
+//---------------------------------------------------------------------------
+void __fastcall TLogWriter::DoWrite(const char * Data, int Length)
+{
+  if (fwrite(Data, 1, Length, FFile) != static_cast<size_t>(Length))
+  {
+    FFailed = true;
+  }
+}
+//---------------------------------------------------------------------------
+bool __fastcall TLogWriter::Failed()
+{
+  return FFailed;
+}
+//---------------------------------------------------------------------------
+void __fastcall TLogWriter::ProcessEvent()
+{
+  Flush();
+}
+//---------------------------------------------------------------------------
+//---------------------------------------------------------------------------
 const wchar_t *LogLineMarks = L"<>!.*";
 __fastcall TSessionLog::TSessionLog(TSessionUI* UI, TDateTime Started, TSessionData * SessionData,
   TConfiguration * Configuration)
@@ -780,6 +1016,7 @@ __fastcall TSessionLog::TSessionLog(TSessionUI* UI, TDateTime Started, TSessionD
   FSessionData = SessionData;
   FStarted = Started;
   FFile = NULL;
+  FWriter = NULL;
   FCurrentLogFileName = L"";
   FCurrentFileName = L"";
   FClosed = false;
@@ -828,7 +1065,10 @@ void __fastcall TSessionLog::DoAddToSelf(TLogLineType Type, const UnicodeString
       }
       int Writting = UtfLine.Length();
       CheckSize(Writting);
-      FCurrentFileSize += fwrite(UtfLine.c_str(), 1, Writting, (FILE *)FFile);
+      // The file is not buffered, so errors are on the disk before a possible crash
+      bool Sync = (Type == llException) || (Type == llStdError);
+      FWriter->Write(UtfLine.c_str(), Writting, Sync);
+      FCurrentFileSize += Writting;
     }
   }
 }
@@ -975,6 +1215,9 @@ void __fastcall TSessionLog::CloseLogFile()
 {
   if (FFile != NULL)
   {
+    // flushes the pending lines
+    delete FWriter;
+    FWriter = NULL;
     fclose((FILE *)FFile);
     FFile = NULL;
   }
@@ -990,6 +1233,7 @@ void __fastcall TSessionLog::OpenLogFile()
     DebugAssert(FConfiguration != NULL);
     FCurrentLogFileName = FConfiguration->LogFileName;
     FFile = OpenFile(FCurrentLogFileName, FStarted, FSessionData, FConfiguration->LogFileAppend, FCurrentFileName);
+    FWriter = new TLogWriter((FILE *)FFile);
     TSearchRec SearchRec;
     if (FileSearchRec(FCurrentFileName, SearchRec))
     {
@@ -1342,11 +1586,12 @@ void __fastcall TSessionLog::DoAddStartupInfo(TSessionData * Data)
       }
       ADF(L"FTPS: %s [Client certificate: %s]",
         (Ftps, LogSensitive(Data->TlsCertificateFile)));
-      ADF(L"FTP: Passive: %s [Force IP: %s]; MLSD: %s [List all: %s]; HOST: %s",
+      ADF(L"FTP: Passive: %s [Force IP: %s]; MLSD: %s [List all: %s; Recursive: %s]; HOST: %s",
         (BooleanToEngStr(Data->FtpPasvMode),
          EnumName(Data->FtpForcePasvIp, AutoSwitchNames),
          EnumName(Data->FtpUseMlsd, AutoSwitchNames),
          EnumName(Data->FtpListAll, AutoSwitchNames),
+         BooleanToEngStr(Data->FtpListRecursive),
          EnumName(Data->FtpHost, AutoSwitchNames)));
     }
     if (Data->FSProtocol == fsWebDAV)
@@ -1381,6 +1626,15 @@ void __fastcall TSessionLog::DoAddStartupInfo(TSessionData * Data)
     ADF(L"Cache directory changes: %s, Permanent: %s",
       (BooleanToEngStr(Data->CacheDirectoryChanges),
        BooleanToEngStr(Data->PreserveDirectoryChanges)));
+    if (Data->PreserveDirectoryCache)
+    {
+      ADF(L"Permanent directory cache, Max age: %d h", (Data->PreserveDirectoryCacheMaxAge));
+    }
+    if ((Data->QueueWarmSessions > 0) || (Data->QueueSessionIdleTimeout > 0))
+    {
+      ADF(L"Background sessions kept warm: %d, Idle timeout: %d s",
+        (Data->QueueWarmSessions, Data->QueueSessionIdleTimeout));
+    }
     ADF(L"Recycle bin: Delete to: %s, Overwritten to: %s, Bin path: %s",
       (BooleanToEngStr(Data->DeleteToRecycleBin),
        BooleanToEngStr(Data->OverwrittenToRecycleBin),
@@ -1455,6 +1709,7 @@ void __fastcall TActionLog::Init(TSessionUI * UI, TDateTime Started, TSessionDat
   FSessionData = SessionData;
   FStarted = Started;
   FFile = NULL;
+  FWriter = NULL;
   FCurrentLogFileName = L"";
   FCurrentFileName = L"";
   FLogging = false;
@@ -1464,6 +1719,11 @@ void __fastcall TActionLog::Init(TSessionUI * UI, TDateTime Started, TSessionDat
   FIndent = L"  ";
   FInGroup = false;
   FEnabled = true;
+  FEventFeed = false;
+  FEventFeedFailed = false;
+  FEventFile = NULL;
+  FEventWriter = NULL;
+  FLastProgressEvent = 0;
 }
 //---------------------------------------------------------------------------
 __fastcall TActionLog::~TActionLog()
@@ -1473,6 +1733,7 @@ __fastcall TActionLog::~TActionLog()
   FClosed = true;
   ReflectSettings();
   DebugAssert(FFile == NULL);
+  DebugAssert(FEventFile == NULL);
   delete FCriticalSection;
 }
 //---------------------------------------------------------------------------
@@ -1491,21 +1752,13 @@ void __fastcall TActionLog::Add(const UnicodeString & Line)
     {
       try
       {
-        UTF8String UtfLine = UTF8String(Line);
-        size_t Written =
-          fwrite(UtfLine.c_str(), 1, UtfLine.Length(), (FILE *)FFile);
-        if (Written != static_cast<size_t>(UtfLine.Length()))
-        {
-          throw ECRTExtException(L"");
-        }
-        #ifdef _DEBUG
-        #endif
-        Written =
-          fwrite("\n", 1, 1, (FILE *)FFile);
-        if (Written != 1)
+        // Failure of a previous asynchronous write
+        if (FWriter->Failed())
         {
           throw ECRTExtException(L"");
         }
+        UTF8String UtfLine = UTF8String(Line + L"\n");
+        FWriter->Write(UtfLine.c_str(), UtfLine.Length());
       }
       catch (Exception &E)
       {
@@ -1582,6 +1835,32 @@ void __fastcall TActionLog::ReflectSettings()
 {
   TGuard Guard(FCriticalSection);
 
+  bool AEventFeed =
+    !FClosed && Enabled && !FEventFeedFailed && !FConfiguration->EventFeedFileName.IsEmpty();
+
+  if (AEventFeed && !FEventFeed)
+  {
+    OpenEventFeed();
+    if (FEventFeed)
+    {
+      UnicodeString Json = L"{";
+      AddJsonMember(Json, L"event", JsonString(L"session"));
+      AddJsonMember(Json, L"time", JsonString(StandardTimestamp()));
+      AddJsonMember(Json, L"name", JsonString((FSessionData != NULL) ? FSessionData->SessionName : UnicodeString()));
+      Json += L"}";
+      AddEvent(Json);
+    }
+  }
+  else if (!AEventFeed && FEventFeed)
+  {
+    UnicodeString Json = L"{";
+    AddJsonMember(Json, L"event", JsonString(L"sessionend"));
+    AddJsonMember(Json, L"time", JsonString(StandardTimestamp()));
+    Json += L"}";
+    AddEvent(Json);
+    CloseEventFeed();
+  }
+
   bool ALogging =
     !FClosed && FConfiguration->LogActions && Enabled;
 
@@ -1615,6 +1894,9 @@ void __fastcall TActionLog::CloseLogFile()
 {
   if (FFile != NULL)
   {
+    // flushes the pending lines
+    delete FWriter;
+    FWriter = NULL;
     fclose((FILE *)FFile);
     FFile = NULL;
   }
@@ -1630,6 +1912,7 @@ void __fastcall TActionLog::OpenLogFile()
     DebugAssert(FConfiguration != NULL);
     FCurrentLogFileName = FConfiguration->ActionsLogFileName;
     FFile = OpenFile(FCurrentLogFileName, FStarted, FSessionData, false, FCurrentFileName);
+    FWriter = new TLogWriter((FILE *)FFile);
   }
   catch (Exception & E)
   {
@@ -1660,6 +1943,93 @@ void __fastcall TActionLog::OpenLogFile()
   }
 }
 //---------------------------------------------------------------------------
+void __fastcall TActionLog::OpenEventFeed()
+{
+  try
+  {
+    DebugAssert(FEventFile == NULL);
+    UnicodeString FeedFileName;
+    // Appending, so that multiple sessions of the same script feed a single stream
+    FEventFile = OpenFile(FConfiguration->EventFeedFileName, FStarted, FSessionData, true, FeedFileName);
+    FEventWriter = new TLogWriter((FILE *)FEventFile);
+    FEventFeed = true;
+  }
+  catch (Exception & E)
+  {
+    FEventFeedFailed = true;
+    try
+    {
+      throw ExtException(&E, LoadStr(LOG_GEN_ERROR));
+    }
+    catch (Exception & E)
+    {
+      if (FUI != NULL)
+      {
+        TUnguard Unguard(FCriticalSection);
+        FUI->HandleExtendedException(&E);
+      }
+    }
+  }
+}
+//---------------------------------------------------------------------------
+void __fastcall TActionLog::CloseEventFeed()
+{
+  if (FEventFile != NULL)
+  {
+    // flushes the pending events
+    delete FEventWriter;
+    FEventWriter = NULL;
+    fclose((FILE *)FEventFile);
+    FEventFile = NULL;
+  }
+  FEventFeed = false;
+}
+//---------------------------------------------------------------------------
+void __fastcall TActionLog::AddEvent(const UnicodeString & Event)
+{
+  TGuard Guard(FCriticalSection);
+  if (FEventWriter != NULL)
+  {
+    if (FEventWriter->Failed())
+    {
+      // Most likely the consumer has gone away, do not try to feed it anymore
+      FEventFeedFailed = true;
+      CloseEventFeed();
+    }
+    else
+    {
+      UTF8String UtfLine = UTF8String(Event + L"\n");
+      FEventWriter->Write(UtfLine.c_str(), UtfLine.Length());
+    }
+  }
+}
+//---------------------------------------------------------------------------
+void __fastcall TActionLog::AddProgress(TFileOperationProgressType & ProgressData)
+{
+  if (FEventFeed &&
+      ((ProgressData.Operation == foCopy) || (ProgressData.Operation == foMove)))
+  {
+    DWORD Now = GetTickCount();
+    if (Now - FLastProgressEvent >= 1000)
+    {
+      FLastProgressEvent = Now;
+      UnicodeString Json = L"{";
+      AddJsonMember(Json, L"event", JsonString(L"progress"));
+      AddJsonMember(Json, L"time", JsonString(StandardTimestamp()));
+      AddJsonMember(Json, L"operation", JsonString((ProgressData.Side == osLocal) ? L"upload" : L"download"));
+      AddJsonMember(Json, L"filename", JsonString(ProgressData.FullFileName));
+      AddJsonMember(Json, L"transferred", IntToStr(ProgressData.TotalTransferred));
+      if (ProgressData.TotalSizeSet)
+      {
+        AddJsonMember(Json, L"total", IntToStr(ProgressData.TotalSize));
+      }
+      AddJsonMember(Json, L"cps", IntToStr(static_cast<__int64>(ProgressData.CPS())));
+      Json += L"}";
+      AddEvent(Json);
+    }
+  }
+}
+//---------------------------------------------------------------------------
 void __fastcall TActionLog::AddPendingAction(TSessionActionRecord * Action)
 {
   FPendingActions->Add(Action);
@@ -45,6 +45,7 @@ enum TFSCapability { fcUserGroupListing, fcModeChanging, fcGroupChanging,
   fcSecondaryShell, fcRemoveCtrlZUpload, fcRemoveBOMUpload, fcMoveToQueue,
   fcLocking, fcPreservingTimestampDirs, fcResumeSupport,
   fcChangePassword, fsSkipTransfer, fsParallelTransfers, fsBackgroundTransfers,
+  fcPipelinedChanges,
   fcCount };
 //---------------------------------------------------------------------------
 struct TFileSystemInfo
@@ -234,6 +235,9 @@ public:
   __fastcall TDifferenceSessionAction(TActionLog * Log, const TSynchronizeChecklist::TItem * Item);
 };
 //---------------------------------------------------------------------------
+class TLogWriter;
+class TFileOperationProgressType;
+//---------------------------------------------------------------------------
 class TSessionLog
 {
 public:
@@ -264,6 +268,7 @@ private:
   TCriticalSection * FCriticalSection;
   bool FLogging;
   void * FFile;
+  TLogWriter * FWriter;
   UnicodeString FCurrentLogFileName;
   UnicodeString FCurrentFileName;
   __int64 FCurrentFileSize;
@@ -306,6 +311,7 @@ public:
   void __fastcall AddFailure(TStrings * Messages);
   void __fastcall BeginGroup(UnicodeString Name);
   void __fastcall EndGroup();
+  void __fastcall AddProgress(TFileOperationProgressType & ProgressData);
 
   __property UnicodeString CurrentFileName = { read = FCurrentFileName };
   __property bool Enabled = { read = FEnabled, write = SetEnabled };
@@ -317,6 +323,7 @@ protected:
   void __fastcall Add(const UnicodeString & Line);
   void __fastcall AddIndented(const UnicodeString & Line);
   void __fastcall AddMessages(UnicodeString Indent, TStrings * Messages);
+  void __fastcall AddEvent(const UnicodeString & Event);
   void __fastcall Init(TSessionUI * UI, TDateTime Started, TSessionData * SessionData,
     TConfiguration * Configuration);
 
@@ -325,6 +332,7 @@ private:
   TCriticalSection * FCriticalSection;
   bool FLogging;
   void * FFile;
+  TLogWriter * FWriter;
   UnicodeString FCurrentLogFileName;
   UnicodeString FCurrentFileName;
   TSessionUI * FUI;
@@ -336,8 +344,15 @@ private:
   bool FInGroup;
   UnicodeString FIndent;
   bool FEnabled;
+  bool FEventFeed;
+  bool FEventFeedFailed;
+  void * FEventFile;
+  TLogWriter * FEventWriter;
+  DWORD FLastProgressEvent;
 
   void __fastcall OpenLogFile();
+  void __fastcall OpenEventFeed();
+  void __fastcall CloseEventFeed();
   UnicodeString __fastcall GetLogFileName();
   void __fastcall SetEnabled(bool value);
 };
@@ -17,6 +17,10 @@
 #include <limits>
 
 #include <memory>
+#include <list>
+#include <set>
+#include <vector>
+#include <algorithm>
 //---------------------------------------------------------------------------
 #pragma package(smart_init)
 //---------------------------------------------------------------------------
@@ -152,6 +156,12 @@
 #define SFTP_EXT_HARDLINK "hardlink@openssh.com"
 #define SFTP_EXT_HARDLINK_VALUE_V1 L"1"
 #define SFTP_EXT_COPY_FILE "copy-file"
+#define SFTP_EXT_COPY_DATA "copy-data"
+#define SFTP_EXT_COPY_DATA_VALUE_V1 L"1"
+#define SFTP_EXT_LIMITS "limits@openssh.com"
+#define SFTP_EXT_LIMITS_VALUE_V1 L"1"
+#define SFTP_EXT_USERS_GROUPS_BY_ID "users-groups-by-id@openssh.com"
+#define SFTP_EXT_USERS_GROUPS_BY_ID_VALUE_V1 L"1"
 //---------------------------------------------------------------------------
 #define OGQ_LIST_OWNERS 0x01
 #define OGQ_LIST_GROUPS 0x02
@@ -327,6 +337,25 @@ public:
     Add(Data, ALength);
   }
 
+  // Returns room for data of up to ALength bytes to be filled in place
+  // (e.g. read from a file straight to the packet), complete with DataAdded
+  unsigned char * ReserveData(int ALength)
+  {
+    AddCardinal(ALength);
+    if (Length + ALength > Capacity)
+    {
+      Capacity = Length + ALength;
+    }
+    return FData + Length;
+  }
+
+  void DataAdded(int ALength)
+  {
+    unsigned char * LengthBuf = FData + Length - 4;
+    PUT_32BIT(LengthBuf, ALength);
+    FLength += ALength;
+  }
+
   void AddString(const RawByteString & Value)
   {
     AddCardinal(Value.Length());
@@ -1118,6 +1147,25 @@ private:
 //---------------------------------------------------------------------------
 int TSFTPPacket::FMessageCounter = 0;
 //---------------------------------------------------------------------------
+static void __fastcall CompleteOwnerGroup(TRemoteProperties & Properties, const TRemoteFile * File)
+{
+  // SFTP can change owner and group at the same time only, not individually.
+  // Fortunately we know current owner/group, so if only one is present,
+  // we can supplement the other.
+  if (Properties.Valid.Contains(vpGroup) &&
+      !Properties.Valid.Contains(vpOwner))
+  {
+    Properties.Owner = File->Owner;
+    Properties.Valid << vpOwner;
+  }
+  else if (Properties.Valid.Contains(vpOwner) &&
+           !Properties.Valid.Contains(vpGroup))
+  {
+    Properties.Group = File->Group;
+    Properties.Valid << vpGroup;
+  }
+}
+//---------------------------------------------------------------------------
 class TSFTPQueue
 {
 public:
@@ -1541,17 +1589,38 @@ protected:
 
     if (Result)
     {
-      FILE_OPERATION_LOOP_BEGIN
+      // Data that need no conversion are read straight to the packet,
+      // without going through the block buffer
+      bool Direct = !OperationProgress->AsciiTransfer && (FEncryption == NULL);
+      int DataLen = 0;
+      if (Direct)
+      {
+        Request->ChangeType(SSH_FXP_WRITE);
+        Request->AddString(FHandle);
+        Request->AddInt64(FTransferred);
+        unsigned char * Data = Request->ReserveData(BlockSize);
+        FILE_OPERATION_LOOP_BEGIN
+        {
+          DataLen = FStream->Read(Data, BlockSize);
+        }
+        FILE_OPERATION_LOOP_END(FMTLOAD(READ_ERROR, (FFileName)));
+        Request->DataAdded(DataLen);
+      }
+      else
       {
-        BlockBuf.LoadStream(FStream, BlockSize, false);
+        FILE_OPERATION_LOOP_BEGIN
+        {
+          BlockBuf.LoadStream(FStream, BlockSize, false);
+        }
+        FILE_OPERATION_LOOP_END(FMTLOAD(READ_ERROR, (FFileName)));
+        DataLen = BlockBuf.Size;
       }
-      FILE_OPERATION_LOOP_END(FMTLOAD(READ_ERROR, (FFileName)));
 
-      FEnd = (BlockBuf.Size == 0);
+      FEnd = (DataLen == 0);
       Result = !FEnd;
       if (Result)
       {
-        OperationProgress->AddLocallyUsed(BlockBuf.Size);
+        OperationProgress->AddLocallyUsed(DataLen);
 
         // We do ASCII transfer: convert EOL of current block
         if (OperationProgress->AsciiTransfer)
@@ -1562,26 +1631,31 @@ protected:
           // update transfer size with difference arised from EOL conversion
           OperationProgress->ChangeTransferSize(OperationProgress->TransferSize -
             PrevBufSize + BlockBuf.Size);
+          DataLen = BlockBuf.Size;
         }
 
         if (FFileSystem->FTerminal->Configuration->ActualLogProtocol >= 1)
         {
           FFileSystem->FTerminal->LogEvent(FORMAT(L"Write request offset: %d, len: %d",
-            (int(FTransferred), int(BlockBuf.Size))));
+            (int(FTransferred), DataLen)));
         }
 
         if (FEncryption != NULL)
         {
           FEncryption->Encrypt(BlockBuf, (FStream->Position >= FStream->Size));
+          DataLen = BlockBuf.Size;
         }
 
-        Request->ChangeType(SSH_FXP_WRITE);
-        Request->AddString(FHandle);
-        Request->AddInt64(FTransferred);
-        Request->AddData(BlockBuf.Data, BlockBuf.Size);
-        FLastBlockSize = BlockBuf.Size;
+        if (!Direct)
+        {
+          Request->ChangeType(SSH_FXP_WRITE);
+          Request->AddString(FHandle);
+          Request->AddInt64(FTransferred);
+          Request->AddData(BlockBuf.Data, BlockBuf.Size);
+        }
+        FLastBlockSize = DataLen;
 
-        FTransferred += BlockBuf.Size;
+        FTransferred += DataLen;
       }
     }
 
@@ -1732,19 +1806,19 @@ private:
   int FIndex;
 };
 //---------------------------------------------------------------------------
-class TSFTPCalculateFilesChecksumQueue : public TSFTPFixedLenQueue
+class TSFTPResolveSymlinksQueue : public TSFTPFixedLenQueue
 {
 public:
-  TSFTPCalculateFilesChecksumQueue(TSFTPFileSystem * AFileSystem) :
+  TSFTPResolveSymlinksQueue(TSFTPFileSystem * AFileSystem) :
     TSFTPFixedLenQueue(AFileSystem)
   {
     FIndex = 0;
+    FStat = false;
   }
-  virtual __fastcall ~TSFTPCalculateFilesChecksumQueue(){}
+  virtual __fastcall ~TSFTPResolveSymlinksQueue(){}
 
-  bool __fastcall Init(int QueueLen, const UnicodeString & Alg, TStrings * FileList)
+  bool __fastcall Init(int QueueLen, TStrings * FileList)
   {
-    FAlg = Alg;
     FFileList = FileList;
 
     return TSFTPFixedLenQueue::Init(QueueLen);
@@ -1753,238 +1827,955 @@ public:
   bool __fastcall ReceivePacket(TSFTPPacket * Packet, TRemoteFile *& File)
   {
     void * Token;
-    bool Result;
-    try
-    {
-      Result = TSFTPFixedLenQueue::ReceivePacket(Packet, SSH_FXP_EXTENDED_REPLY, asNo, &Token);
-    }
-    __finally
-    {
-      File = static_cast<TRemoteFile *>(Token);
-    }
+    bool Result = TSFTPFixedLenQueue::ReceivePacket(Packet, -1, asAll, &Token);
+    File = static_cast<TRemoteFile *>(Token);
     return Result;
   }
 
 protected:
   virtual bool __fastcall InitRequest(TSFTPQueuePacket * Request)
   {
-    bool Result = false;
-    while (!Result && (FIndex < FFileList->Count))
+    bool Result = (FIndex < FFileList->Count);
+    if (Result)
     {
-      TRemoteFile * File = static_cast<TRemoteFile *>(FFileList->Objects[FIndex]);
-      DebugAssert(File != NULL);
-      FIndex++;
-
-      Result = !File->IsDirectory;
-      if (Result)
+      // READLINK and STAT of each link are sent in pairs,
+      // the responses are received in the same order
+      UnicodeString FileName = FFileList->Strings[FIndex];
+      Request->Token = FFileList->Objects[FIndex];
+      if (!FStat)
       {
-        DebugAssert(IsRealFile(File->FileName));
-
-        Request->ChangeType(SSH_FXP_EXTENDED);
-        Request->AddString(SFTP_EXT_CHECK_FILE_NAME);
-        FFileSystem->AddPathString(*Request, FFileSystem->LocalCanonify(File->FullFileName));
-        Request->AddString(FAlg);
-        Request->AddInt64(0); // offset
-        Request->AddInt64(0); // length (0 = till end)
-        Request->AddCardinal(0); // block size (0 = no blocks or "one block")
-
-        Request->Token = File;
+        Request->ChangeType(SSH_FXP_READLINK);
+        FFileSystem->AddPathString(*Request, FileName);
       }
+      else
+      {
+        Request->ChangeType(SSH_FXP_STAT);
+        FFileSystem->AddPathString(*Request, FileName);
+        if (FFileSystem->FVersion >= 4)
+        {
+          Request->AddCardinal(SSH_FILEXFER_ATTR_COMMON);
+        }
+        FIndex++;
+      }
+      FStat = !FStat;
     }
 
     return Result;
   }
 
-  virtual bool __fastcall SendRequest()
-  {
-    bool Result =
-      (FIndex < FFileList->Count) &&
-      TSFTPFixedLenQueue::SendRequest();
-    return Result;
-  }
-
   virtual bool __fastcall End(TSFTPPacket * /*Response*/)
   {
     return (FRequests->Count == 0);
   }
 
 private:
-  UnicodeString FAlg;
   TStrings * FFileList;
   int FIndex;
+  bool FStat;
 };
 //---------------------------------------------------------------------------
-#pragma warn .inl
-//---------------------------------------------------------------------------
-class TSFTPBusy
+class TSFTPReadDirectoryTreeQueue : public TSFTPQueue
 {
 public:
-  __fastcall TSFTPBusy(TSFTPFileSystem * FileSystem)
+  TSFTPReadDirectoryTreeQueue(TSFTPFileSystem * AFileSystem) :
+    TSFTPQueue(AFileSystem)
   {
-    FFileSystem = FileSystem;
-    DebugAssert(FFileSystem != NULL);
-    FFileSystem->BusyStart();
+    FQueueLen = 0;
+    FOpen = 0;
   }
 
-  __fastcall ~TSFTPBusy()
+  virtual __fastcall ~TSFTPReadDirectoryTreeQueue()
   {
-    FFileSystem->BusyEnd();
+    std::set<TDirectory *>::iterator I = FDirectories.begin();
+    while (I != FDirectories.end())
+    {
+      delete *I;
+      ++I;
+    }
   }
 
-private:
-  TSFTPFileSystem * FFileSystem;
-};
-//===========================================================================
-struct TOpenRemoteFileParams
-{
-  UnicodeString FileName;
-  UnicodeString RemoteFileName;
-  TFileOperationProgressType * OperationProgress;
-  const TCopyParamType * CopyParam;
-  int Params;
-  bool Resume;
-  bool Resuming;
-  TSFTPOverwriteMode OverwriteMode;
-  __int64 DestFileSize; // output
-  RawByteString RemoteFileHandle; // output
-  TOverwriteFileParams * FileParams;
-  bool Confirmed;
-  bool DontRecycle;
-};
-//===========================================================================
-__fastcall TSFTPFileSystem::TSFTPFileSystem(TTerminal * ATerminal,
-  TSecureShell * SecureShell):
-  TCustomFileSystem(ATerminal)
-{
-  FSecureShell = SecureShell;
-  FPacketReservations = new TList();
-  FPacketNumbers = VarArrayCreate(OPENARRAY(int, (0, 1)), varLongWord);
-  FPreviousLoggedPacket = 0;
-  FNotLoggedPackets = 0;
-  FBusy = 0;
-  FAvoidBusy = false;
-  FUtfStrings = asOff;
-  FUtfDisablingAnnounced = true;
-  FSignedTS = false;
-  FSupport = new TSFTPSupport();
-  FExtensions = new TStringList();
-  FFixedPaths = NULL;
-  FFileSystemInfoValid = false;
-
-  FChecksumAlgs.reset(new TStringList());
-  FChecksumSftpAlgs.reset(new TStringList());
-  // List as defined by draft-ietf-secsh-filexfer-extensions-00
-  // MD5 moved to the back
-  RegisterChecksumAlg(Sha1ChecksumAlg, L"sha1");
-  RegisterChecksumAlg(Sha224ChecksumAlg, L"sha224");
-  RegisterChecksumAlg(Sha256ChecksumAlg, L"sha256");
-  RegisterChecksumAlg(Sha384ChecksumAlg, L"sha384");
-  RegisterChecksumAlg(Sha512ChecksumAlg, L"sha512");
-  RegisterChecksumAlg(Md5ChecksumAlg, L"md5");
-  RegisterChecksumAlg(Crc32ChecksumAlg, L"crc32");
-}
-//---------------------------------------------------------------------------
-__fastcall TSFTPFileSystem::~TSFTPFileSystem()
-{
-  delete FSupport;
-  ResetConnection();
-  delete FPacketReservations;
-  delete FExtensions;
-  delete FFixedPaths;
-  delete FSecureShell;
-}
-//---------------------------------------------------------------------------
-void __fastcall TSFTPFileSystem::Open()
-{
-  // this is used for reconnects only
-  FSecureShell->Open();
-}
-//---------------------------------------------------------------------------
-void __fastcall TSFTPFileSystem::Close()
-{
-  FSecureShell->Close();
-}
-//---------------------------------------------------------------------------
-bool __fastcall TSFTPFileSystem::GetActive()
-{
-  return FSecureShell->Active;
-}
-//---------------------------------------------------------------------------
-void __fastcall TSFTPFileSystem::CollectUsage()
-{
-  FSecureShell->CollectUsage();
-
-  UnicodeString VersionCounter;
-  switch (FVersion)
+  bool __fastcall Init(int QueueLen, const UnicodeString & Directory)
   {
-    case 0:
-      VersionCounter = L"OpenedSessionsSFTP0";
-      break;
-    case 1:
-      VersionCounter = L"OpenedSessionsSFTP1";
-      break;
-    case 2:
-      VersionCounter = L"OpenedSessionsSFTP2";
-      break;
-    case 3:
-      VersionCounter = L"OpenedSessionsSFTP3";
-      break;
-    case 4:
-      VersionCounter = L"OpenedSessionsSFTP4";
-      break;
-    case 5:
-      VersionCounter = L"OpenedSessionsSFTP5";
-      break;
-    case 6:
-      VersionCounter = L"OpenedSessionsSFTP6";
-      break;
-    default:
-      DebugFail();
+    FQueueLen = QueueLen;
+    AddDirectory(Directory);
+    return TSFTPQueue::Init();
   }
-  FTerminal->Configuration->Usage->Inc(VersionCounter);
-}
-//---------------------------------------------------------------------------
-const TSessionInfo & __fastcall TSFTPFileSystem::GetSessionInfo()
-{
-  return FSecureShell->GetSessionInfo();
-}
-//---------------------------------------------------------------------------
-const TFileSystemInfo & __fastcall TSFTPFileSystem::GetFileSystemInfo(bool /*Retrieve*/)
-{
-  if (!FFileSystemInfoValid)
+
+  virtual void __fastcall Dispose(int ExpectedType, int AllowStatus)
   {
-    FFileSystemInfo.AdditionalInfo = L"";
+    TSFTPQueue::Dispose(ExpectedType, AllowStatus);
 
-    if (!IsCapable(fcRename))
+    // close directories that were being read, when the walk was interrupted
+    std::set<TDirectory *>::iterator I = FDirectories.begin();
+    while (I != FDirectories.end())
     {
-      FFileSystemInfo.AdditionalInfo += LoadStr(FS_RENAME_NOT_SUPPORTED) + L"\r\n\r\n";
+      CloseDirectory(*I);
+      ++I;
     }
+  }
 
-    if (FExtensions->Count > 0)
+  // Processes a response to one of the pending requests.
+  // Once a directory is read completely, its listing is handed over to the caller,
+  // otherwise FileList is NULL. Returns false, when the whole tree was walked.
+  bool __fastcall ReceiveListing(TRemoteFileList *& FileList)
+  {
+    FileList = NULL;
+    TSFTPPacket Packet;
+    void * Token;
+    TSFTPQueue::ReceivePacket(&Packet, -1, -1, &Token);
+    TDirectory * Directory = DebugNotNull(static_cast<TDirectory *>(Token));
+    TTerminal * Terminal = FFileSystem->FTerminal;
+
+    bool Done = false;
+    bool Failed = false;
+    Terminal->ExceptionOnFail = true;
+    try
     {
-      UnicodeString Name;
-      UnicodeString Value;
-      UnicodeString Line;
-      FFileSystemInfo.AdditionalInfo += LoadStr(SFTP_EXTENSION_INFO) + L"\r\n";
-      for (int Index = 0; Index < FExtensions->Count; Index++)
+      try
       {
-        UnicodeString Name = FExtensions->Names[Index];
-        UnicodeString Value = FExtensions->Values[Name];
-        UnicodeString Line;
-        if (Value.IsEmpty())
+        if (Directory->Handle.IsEmpty())
         {
-          Line = Name;
+          if (Packet.Type == SSH_FXP_STATUS)
+          {
+            FFileSystem->GotStatusPacket(&Packet, asNo);
+          }
+          else if (Packet.Type != SSH_FXP_HANDLE)
+          {
+            Terminal->FatalError(NULL, FMTLOAD(SFTP_INVALID_TYPE, ((int)Packet.Type)));
+          }
+          Directory->Handle = Packet.GetFileHandle();
+        }
+        else if (Packet.Type == SSH_FXP_NAME)
+        {
+          Done = LoadListing(Directory, &Packet);
+        }
+        else if (Packet.Type == SSH_FXP_STATUS)
+        {
+          FFileSystem->GotStatusPacket(&Packet, asEOF);
+          Done = true;
         }
         else
         {
-          Line = FORMAT(L"%s=%s", (Name, Value));
+          Terminal->FatalError(NULL, FMTLOAD(SFTP_INVALID_TYPE, ((int)Packet.Type)));
         }
-        FFileSystemInfo.AdditionalInfo += FORMAT(L"  %s\r\n", (Line));
+      }
+      __finally
+      {
+        Terminal->ExceptionOnFail = false;
       }
     }
-    else
+    catch (Exception & E)
     {
-      FFileSystemInfo.AdditionalInfo += LoadStr(SFTP_NO_EXTENSION_INFO) + L"\r\n";
+      if (E.InheritsFrom(__classid(EFatal)))
+      {
+        throw;
+      }
+      // the directory will be read individually, reporting the error the usual way
+      ExtException ListError(&E, FMTLOAD(LIST_DIR_ERROR, (Directory->FileList->Directory)));
+      Terminal->Log->AddException(&ListError);
+      Done = true;
+      Failed = true;
+    }
+
+    if (!Done)
+    {
+      FReady.push_back(Directory);
+    }
+    else
+    {
+      CloseDirectory(Directory);
+      FOpen--;
+      if (!Failed)
+      {
+        // Unlike ReadDirectory, we do not try to read ".." of an empty directory,
+        // as that is needed to detect an unreadable directory only,
+        // but the directory was listed fine here.
+        if (!Directory->HasParentDirectory)
+        {
+          Directory->FileList->AddFile(new TRemoteParentDirectory(Terminal));
+        }
+        FileList = Directory->FileList;
+        Directory->FileList = NULL;
+      }
+      FDirectories.erase(Directory);
+      delete Directory;
+    }
+
+    SendRequests();
+    return (FRequests->Count > 0);
+  }
+
+protected:
+  virtual bool __fastcall InitRequest(TSFTPQueuePacket * Request)
+  {
+    TDirectory * Directory = NULL;
+    // continue reading already opened directories first,
+    // so that the number of open handles is kept within the limit
+    if (!FReady.empty())
+    {
+      Directory = FReady.front();
+      FReady.pop_front();
+      Request->ChangeType(SSH_FXP_READDIR);
+      Request->AddString(Directory->Handle);
+    }
+    else if ((FOpen < FQueueLen) && !FPending.empty())
+    {
+      Directory = FPending.front();
+      FPending.pop_front();
+      FOpen++;
+      Request->ChangeType(SSH_FXP_OPENDIR);
+      FFileSystem->AddPathString(*Request, UnixExcludeTrailingBackslash(Directory->FileList->Directory));
+    }
+    Request->Token = Directory;
+    return (Directory != NULL);
+  }
+
+  // sends as many requests as allowed by implementation
+  virtual bool SendRequests()
+  {
+    // Each directory being read has exactly one request pending,
+    // what is sent, is decided by InitRequest
+    bool Result = false;
+    while (SendRequest())
+    {
+      Result = true;
+    }
+    return Result;
+  }
+
+  virtual bool __fastcall End(TSFTPPacket * /*Response*/)
+  {
+    // the walk ends once there are no more directories to read, see ReceiveListing
+    return false;
+  }
+
+private:
+  struct TDirectory
+  {
+    TDirectory()
+    {
+      FileList = NULL;
+      HasParentDirectory = false;
+    }
+
+    ~TDirectory()
+    {
+      delete FileList;
+    }
+
+    TRemoteFileList * FileList;
+    RawByteString Handle;
+    bool HasParentDirectory;
+  };
+
+  std::set<TDirectory *> FDirectories;
+  std::list<TDirectory *> FPending;
+  std::list<TDirectory *> FReady;
+  int FQueueLen;
+  int FOpen;
+
+  void __fastcall AddDirectory(const UnicodeString & Path)
+  {
+    TDirectory * Directory = new TDirectory();
+    FDirectories.insert(Directory);
+    Directory->FileList = new TRemoteFileList();
+    Directory->FileList->Directory = Path;
+    FPending.push_back(Directory);
+  }
+
+  void __fastcall CloseDirectory(TDirectory * Directory)
+  {
+    if (!Directory->Handle.IsEmpty() && FFileSystem->FTerminal->Active)
+    {
+      TSFTPPacket Packet(SSH_FXP_CLOSE);
+      Packet.AddString(Directory->Handle);
+      FFileSystem->SendPacket(&Packet);
+      // we are not interested in the response, do not wait for it
+      FFileSystem->ReserveResponse(&Packet, NULL);
+    }
+    Directory->Handle = RawByteString();
+  }
+
+  bool __fastcall LoadListing(TDirectory * Directory, TSFTPPacket * Packet)
+  {
+    TTerminal * Terminal = FFileSystem->FTerminal;
+    TRemoteFileList * FileList = Directory->FileList;
+    UnicodeString Path = UnixIncludeTrailingBackslash(FileList->Directory);
+    unsigned int Count = Packet->GetCardinal();
+
+    for (unsigned long Index = 0; Index < Count; Index++)
+    {
+      // symlinks are resolved by the caller, once the directory is complete
+      TRemoteFile * File = FFileSystem->LoadFile(Packet, NULL, L"", FileList, false);
+      FileList->AddFile(File);
+      if (Terminal->Configuration->ActualLogProtocol >= 1)
+      {
+        Terminal->LogEvent(FORMAT(L"Read file '%s' from listing", (File->FileName)));
+      }
+      if (File->IsParentDirectory)
+      {
+        Directory->HasParentDirectory = true;
+      }
+      else if (File->IsDirectory && !File->IsSymLink && IsRealFile(File->FileName))
+      {
+        AddDirectory(Path + File->FileName);
+      }
+    }
+
+    bool Result = false;
+    if ((FFileSystem->FVersion >= 6) &&
+        // see ReadDirectory
+        (FFileSystem->FSecureShell->SshImplementation != sshiCerberus) &&
+        Packet->CanGetBool())
+    {
+      Result = Packet->GetBool();
+    }
+
+    if (Count == 0)
+    {
+      Terminal->LogEvent(L"Empty directory listing packet. Aborting directory reading.");
+      Result = true;
+    }
+    return Result;
+  }
+};
+//---------------------------------------------------------------------------
+class TSFTPChangeFilesQueue : public TSFTPFixedLenQueue
+{
+public:
+  TSFTPChangeFilesQueue(TSFTPFileSystem * AFileSystem) :
+    TSFTPFixedLenQueue(AFileSystem)
+  {
+    FIndex = 0;
+    FReceived = 0;
+    FProperties = NULL;
+    FStopped = false;
+  }
+
+  virtual __fastcall ~TSFTPChangeFilesQueue()
+  {
+    // the outcome of the requests whose responses were not processed is unknown
+    while (!FActions.empty())
+    {
+      FActions.front()->Cancel();
+      delete FActions.front();
+      FActions.pop_front();
+    }
+  }
+
+  bool __fastcall Init(int QueueLen, TStrings * FileList, const TRemoteProperties * Properties)
+  {
+    FFileList = FileList;
+    FProperties = Properties;
+
+    return TSFTPFixedLenQueue::Init(QueueLen);
+  }
+
+  // No more requests are sent, the responses to those sent already are still received
+  void __fastcall StopSending()
+  {
+    FStopped = true;
+  }
+
+  int __fastcall GetSent()
+  {
+    return FIndex;
+  }
+
+  // Responses come in the order of the requests,
+  // the caller takes over the action of the file
+  bool __fastcall ReceivePacket(TSFTPPacket * Packet, int & Index, TFileSessionAction *& Action)
+  {
+    Index = FReceived;
+    FReceived++;
+    Action = FActions.front();
+    FActions.pop_front();
+    bool Result;
+    try
+    {
+      Result = TSFTPFixedLenQueue::ReceivePacket(Packet);
+    }
+    catch (...)
+    {
+      Action->Cancel();
+      delete Action;
+      Action = NULL;
+      throw;
+    }
+    return Result;
+  }
+
+protected:
+  virtual bool __fastcall InitRequest(TSFTPQueuePacket * Request)
+  {
+    bool Result = !FStopped && (FIndex < FFileList->Count);
+    if (Result)
+    {
+      UnicodeString RealFileName = FFileSystem->LocalCanonify(FFileList->Strings[FIndex]);
+      const TRemoteFile * File = static_cast<const TRemoteFile *>(FFileList->Objects[FIndex]);
+      TActionLog * ActionLog = FFileSystem->FTerminal->ActionLog;
+      if (FProperties == NULL)
+      {
+        // see TTerminal::DeleteContentsIfDirectory
+        Request->ChangeType((File->IsDirectory && !File->IsSymLink) ? SSH_FXP_RMDIR : SSH_FXP_REMOVE);
+        FFileSystem->AddPathString(*Request, RealFileName);
+        FActions.push_back(new TRmSessionAction(ActionLog, RealFileName));
+      }
+      else
+      {
+        TChmodSessionAction * Action = new TChmodSessionAction(ActionLog, RealFileName);
+        FActions.push_back(Action);
+        TRemoteProperties Properties(*FProperties);
+        CompleteOwnerGroup(Properties, File);
+        Request->ChangeType(SSH_FXP_SETSTAT);
+        FFileSystem->AddPathString(*Request, RealFileName);
+        Request->AddProperties(&Properties, *File->Rights, File->IsDirectory, FFileSystem->FVersion, FFileSystem->FUtfStrings, Action);
+      }
+      FIndex++;
+    }
+
+    return Result;
+  }
+
+  virtual bool __fastcall End(TSFTPPacket * /*Response*/)
+  {
+    return (FRequests->Count == 0);
+  }
+
+private:
+  TStrings * FFileList;
+  const TRemoteProperties * FProperties;
+  std::list<TFileSessionAction *> FActions;
+  int FIndex;
+  int FReceived;
+  bool FStopped;
+};
+//---------------------------------------------------------------------------
+class TSFTPCalculateFilesChecksumQueue : public TSFTPFixedLenQueue
+{
+public:
+  TSFTPCalculateFilesChecksumQueue(TSFTPFileSystem * AFileSystem) :
+    TSFTPFixedLenQueue(AFileSystem)
+  {
+    FIndex = 0;
+  }
+  virtual __fastcall ~TSFTPCalculateFilesChecksumQueue(){}
+
+  bool __fastcall Init(int QueueLen, const UnicodeString & Alg, TStrings * FileList)
+  {
+    FAlg = Alg;
+    FFileList = FileList;
+
+    return TSFTPFixedLenQueue::Init(QueueLen);
+  }
+
+  bool __fastcall ReceivePacket(TSFTPPacket * Packet, TRemoteFile *& File)
+  {
+    void * Token;
+    bool Result;
+    try
+    {
+      Result = TSFTPFixedLenQueue::ReceivePacket(Packet, SSH_FXP_EXTENDED_REPLY, asNo, &Token);
+    }
+    __finally
+    {
+      File = static_cast<TRemoteFile *>(Token);
+    }
+    return Result;
+  }
+
+protected:
+  virtual bool __fastcall InitRequest(TSFTPQueuePacket * Request)
+  {
+    bool Result = false;
+    while (!Result && (FIndex < FFileList->Count))
+    {
+      TRemoteFile * File = static_cast<TRemoteFile *>(FFileList->Objects[FIndex]);
+      DebugAssert(File != NULL);
+      FIndex++;
+
+      Result = !File->IsDirectory;
+      if (Result)
+      {
+        DebugAssert(IsRealFile(File->FileName));
+
+        Request->ChangeType(SSH_FXP_EXTENDED);
+        Request->AddString(SFTP_EXT_CHECK_FILE_NAME);
+        FFileSystem->AddPathString(*Request, FFileSystem->LocalCanonify(File->FullFileName));
+        Request->AddString(FAlg);
+        Request->AddInt64(0); // offset
+        Request->AddInt64(0); // length (0 = till end)
+        Request->AddCardinal(0); // block size (0 = no blocks or "one block")
+
+        Request->Token = File;
+      }
+    }
+
+    return Result;
+  }
+
+  virtual bool __fastcall SendRequest()
+  {
+    bool Result =
+      (FIndex < FFileList->Count) &&
+      TSFTPFixedLenQueue::SendRequest();
+    return Result;
+  }
+
+  virtual bool __fastcall End(TSFTPPacket * /*Response*/)
+  {
+    return (FRequests->Count == 0);
+  }
+
+private:
+  UnicodeString FAlg;
+  TStrings * FFileList;
+  int FIndex;
+};
+//---------------------------------------------------------------------------
+typedef std::vector<std::pair<__int64, __int64> > TSFTPDeltaRanges; // offset, length
+//---------------------------------------------------------------------------
+static void __fastcall AddDeltaRange(TSFTPDeltaRanges & Ranges, __int64 Offset, __int64 Length)
+{
+  if (!Ranges.empty() && (Ranges.back().first + Ranges.back().second == Offset))
+  {
+    Ranges.back().second += Length;
+  }
+  else
+  {
+    Ranges.push_back(std::make_pair(Offset, Length));
+  }
+}
+//---------------------------------------------------------------------------
+class TSFTPBlockChecksumQueue : public TSFTPFixedLenQueue
+{
+public:
+  TSFTPBlockChecksumQueue(TSFTPFileSystem * AFileSystem) :
+    TSFTPFixedLenQueue(AFileSystem)
+  {
+    FSize = 0;
+    FOffset = 0;
+    FBlockSize = 0;
+    FRequestSize = 0;
+  }
+  virtual __fastcall ~TSFTPBlockChecksumQueue(){}
+
+  bool __fastcall Init(int QueueLen, const UnicodeString & FileName, const UnicodeString & Algs,
+    __int64 Size, unsigned long BlockSize, int BlocksPerRequest)
+  {
+    FFileName = FileName;
+    FAlgs = Algs;
+    FSize = Size;
+    FBlockSize = BlockSize;
+    FRequestSize = static_cast<__int64>(BlockSize) * BlocksPerRequest;
+
+    return TSFTPFixedLenQueue::Init(QueueLen);
+  }
+
+  bool __fastcall ReceivePacket(TSFTPPacket * Packet, __int64 & Offset, __int64 & Length)
+  {
+    // responses come in the order of requests
+    DebugAssert(!FRanges.empty());
+    Offset = FRanges.front().first;
+    Length = FRanges.front().second;
+    FRanges.pop_front();
+    return TSFTPFixedLenQueue::ReceivePacket(Packet, SSH_FXP_EXTENDED_REPLY, asNo);
+  }
+
+protected:
+  virtual bool __fastcall InitRequest(TSFTPQueuePacket * Request)
+  {
+    bool Result = (FOffset < FSize);
+    if (Result)
+    {
+      __int64 Length = std::min(FSize - FOffset, FRequestSize);
+
+      Request->ChangeType(SSH_FXP_EXTENDED);
+      Request->AddString(SFTP_EXT_CHECK_FILE_NAME);
+      FFileSystem->AddPathString(*Request, FFileName);
+      Request->AddString(FAlgs);
+      Request->AddInt64(FOffset);
+      Request->AddInt64(Length);
+      Request->AddCardinal(FBlockSize);
+
+      FRanges.push_back(std::make_pair(FOffset, Length));
+      FOffset += Length;
+    }
+
+    return Result;
+  }
+
+  virtual bool __fastcall End(TSFTPPacket * /*Response*/)
+  {
+    return (FRequests->Count == 0) && (FOffset >= FSize);
+  }
+
+private:
+  UnicodeString FFileName;
+  UnicodeString FAlgs;
+  __int64 FSize;
+  __int64 FOffset;
+  unsigned long FBlockSize;
+  __int64 FRequestSize;
+  std::list<std::pair<__int64, __int64> > FRanges;
+};
+//---------------------------------------------------------------------------
+class TSFTPDeltaDataQueue : public TSFTPFixedLenQueue
+{
+public:
+  TSFTPDeltaDataQueue(TSFTPFileSystem * AFileSystem) :
+    TSFTPFixedLenQueue(AFileSystem)
+  {
+    FUpload = false;
+    FStream = NULL;
+    FRanges = NULL;
+    FRange = 0;
+    FRangeOffset = 0;
+    OperationProgress = NULL;
+  }
+  virtual __fastcall ~TSFTPDeltaDataQueue(){}
+
+  bool __fastcall Init(int QueueLen, bool Upload, const RawByteString & AHandle,
+    TStream * Stream, const UnicodeString & LocalFileName, const TSFTPDeltaRanges * Ranges,
+    TFileOperationProgressType * AOperationProgress)
+  {
+    FUpload = Upload;
+    FHandle = AHandle;
+    FStream = Stream;
+    FLocalFileName = LocalFileName;
+    FRanges = Ranges;
+    OperationProgress = AOperationProgress;
+
+    return TSFTPFixedLenQueue::Init(QueueLen);
+  }
+
+  bool __fastcall ReceivePacket(TSFTPPacket * Packet, __int64 & Offset, unsigned long & Size)
+  {
+    // responses come in the order of requests
+    DebugAssert(!FBlocks.empty());
+    Offset = FBlocks.front().first;
+    Size = FBlocks.front().second;
+    FBlocks.pop_front();
+    return TSFTPFixedLenQueue::ReceivePacket(Packet, (FUpload ? SSH_FXP_STATUS : SSH_FXP_DATA));
+  }
+
+protected:
+  virtual bool __fastcall InitRequest(TSFTPQueuePacket * Request)
+  {
+    bool Result = (FRange < FRanges->size());
+    if (Result)
+    {
+      const std::pair<__int64, __int64> & Range = (*FRanges)[FRange];
+      __int64 Offset = Range.first + FRangeOffset;
+      unsigned long BlockSize =
+        FUpload ?
+          FFileSystem->UploadBlockSize(FHandle, OperationProgress) :
+          FFileSystem->DownloadBlockSize(OperationProgress);
+      unsigned long Size =
+        static_cast<unsigned long>(std::min(Range.second - FRangeOffset, static_cast<__int64>(BlockSize)));
+
+      if (FUpload)
+      {
+        TTerminal * FTerminal = FFileSystem->FTerminal;
+        // Buffer for one block of data
+        TFileBuffer BlockBuf;
+
+        FILE_OPERATION_LOOP_BEGIN
+        {
+          FStream->Position = Offset;
+          BlockBuf.LoadStream(FStream, Size, true);
+        }
+        FILE_OPERATION_LOOP_END(FMTLOAD(READ_ERROR, (FLocalFileName)));
+
+        OperationProgress->AddLocallyUsed(BlockBuf.Size);
+
+        Request->ChangeType(SSH_FXP_WRITE);
+        Request->AddString(FHandle);
+        Request->AddInt64(Offset);
+        Request->AddData(BlockBuf.Data, BlockBuf.Size);
+      }
+      else
+      {
+        Request->ChangeType(SSH_FXP_READ);
+        Request->AddString(FHandle);
+        Request->AddInt64(Offset);
+        Request->AddCardinal(Size);
+      }
+
+      FBlocks.push_back(std::make_pair(Offset, Size));
+      FRangeOffset += Size;
+      if (FRangeOffset >= Range.second)
+      {
+        FRange++;
+        FRangeOffset = 0;
+      }
+    }
+
+    return Result;
+  }
+
+  virtual bool __fastcall End(TSFTPPacket * /*Response*/)
+  {
+    return (FRequests->Count == 0) && (FRange >= FRanges->size());
+  }
+
+private:
+  TFileOperationProgressType * OperationProgress;
+  bool FUpload;
+  RawByteString FHandle;
+  TStream * FStream;
+  UnicodeString FLocalFileName;
+  const TSFTPDeltaRanges * FRanges;
+  size_t FRange;
+  __int64 FRangeOffset;
+  std::list<std::pair<__int64, unsigned long> > FBlocks;
+};
+//---------------------------------------------------------------------------
+class TSFTPCopyDataQueue : public TSFTPFixedLenQueue
+{
+public:
+  TSFTPCopyDataQueue(TSFTPFileSystem * AFileSystem) :
+    TSFTPFixedLenQueue(AFileSystem)
+  {
+    FSize = 0;
+    FOffset = 0;
+    FRangeSize = 0;
+    FAllSent = false;
+  }
+  virtual __fastcall ~TSFTPCopyDataQueue(){}
+
+  bool __fastcall Init(int QueueLen, const RawByteString & SourceHandle,
+    const RawByteString & DestHandle, __int64 Size, __int64 RangeSize)
+  {
+    FSourceHandle = SourceHandle;
+    FDestHandle = DestHandle;
+    FSize = Size;
+    FRangeSize = RangeSize;
+
+    return TSFTPFixedLenQueue::Init(QueueLen);
+  }
+
+protected:
+  virtual bool __fastcall InitRequest(TSFTPQueuePacket * Request)
+  {
+    bool Result = !FAllSent;
+    if (Result)
+    {
+      __int64 Length;
+      if (FSize - FOffset > FRangeSize)
+      {
+        Length = FRangeSize;
+      }
+      else
+      {
+        // The last range is copied till the end of the file,
+        // in case the file has grown since it was listed
+        Length = 0;
+        FAllSent = true;
+      }
+
+      Request->ChangeType(SSH_FXP_EXTENDED);
+      Request->AddString(SFTP_EXT_COPY_DATA);
+      Request->AddString(FSourceHandle);
+      Request->AddInt64(FOffset);
+      Request->AddInt64(Length);
+      Request->AddString(FDestHandle);
+      Request->AddInt64(FOffset);
+
+      FOffset += Length;
+    }
+
+    return Result;
+  }
+
+  virtual bool __fastcall End(TSFTPPacket * /*Response*/)
+  {
+    return (FRequests->Count == 0) && FAllSent;
+  }
+
+private:
+  RawByteString FSourceHandle;
+  RawByteString FDestHandle;
+  __int64 FSize;
+  __int64 FOffset;
+  __int64 FRangeSize;
+  bool FAllSent;
+};
+//---------------------------------------------------------------------------
+#pragma warn .inl
+//---------------------------------------------------------------------------
+class TSFTPBusy
+{
+public:
+  __fastcall TSFTPBusy(TSFTPFileSystem * FileSystem)
+  {
+    FFileSystem = FileSystem;
+    DebugAssert(FFileSystem != NULL);
+    FFileSystem->BusyStart();
+  }
+
+  __fastcall ~TSFTPBusy()
+  {
+    FFileSystem->BusyEnd();
+  }
+
+private:
+  TSFTPFileSystem * FFileSystem;
+};
+//===========================================================================
+struct TOpenRemoteFileParams
+{
+  UnicodeString FileName;
+  UnicodeString RemoteFileName;
+  TFileOperationProgressType * OperationProgress;
+  const TCopyParamType * CopyParam;
+  int Params;
+  bool Resume;
+  bool Resuming;
+  bool Delta;
+  TSFTPOverwriteMode OverwriteMode;
+  __int64 DestFileSize; // output
+  RawByteString RemoteFileHandle; // output
+  TOverwriteFileParams * FileParams;
+  bool Confirmed;
+  bool DontRecycle;
+};
+//===========================================================================
+__fastcall TSFTPFileSystem::TSFTPFileSystem(TTerminal * ATerminal,
+  TSecureShell * SecureShell):
+  TCustomFileSystem(ATerminal)
+{
+  FSecureShell = SecureShell;
+  FPacketReservations = new TList();
+  FPacketNumbers = VarArrayCreate(OPENARRAY(int, (0, 1)), varLongWord);
+  FPreviousLoggedPacket = 0;
+  FNotLoggedPackets = 0;
+  FBusy = 0;
+  FAvoidBusy = false;
+  FUtfStrings = asOff;
+  FUtfDisablingAnnounced = true;
+  FSignedTS = false;
+  FSupport = new TSFTPSupport();
+  FExtensions = new TStringList();
+  FFixedPaths = NULL;
+  FFileSystemInfoValid = false;
+
+  FChecksumAlgs.reset(new TStringList());
+  FChecksumSftpAlgs.reset(new TStringList());
+  FUsersByID.reset(new TRemoteTokenList());
+  FGroupsByID.reset(new TRemoteTokenList());
+  // List as defined by draft-ietf-secsh-filexfer-extensions-00
+  // MD5 moved to the back
+  RegisterChecksumAlg(Sha1ChecksumAlg, L"sha1");
+  RegisterChecksumAlg(Sha224ChecksumAlg, L"sha224");
+  RegisterChecksumAlg(Sha256ChecksumAlg, L"sha256");
+  RegisterChecksumAlg(Sha384ChecksumAlg, L"sha384");
+  RegisterChecksumAlg(Sha512ChecksumAlg, L"sha512");
+  RegisterChecksumAlg(Md5ChecksumAlg, L"md5");
+  RegisterChecksumAlg(Crc32ChecksumAlg, L"crc32");
+}
+//---------------------------------------------------------------------------
+__fastcall TSFTPFileSystem::~TSFTPFileSystem()
+{
+  delete FSupport;
+  ResetConnection();
+  delete FPacketReservations;
+  delete FExtensions;
+  delete FFixedPaths;
+  delete FSecureShell;
+}
+//---------------------------------------------------------------------------
+void __fastcall TSFTPFileSystem::Open()
+{
+  // this is used for reconnects only
+  FSecureShell->Open();
+}
+//---------------------------------------------------------------------------
+void __fastcall TSFTPFileSystem::Close()
+{
+  FSecureShell->Close();
+}
+//---------------------------------------------------------------------------
+bool __fastcall TSFTPFileSystem::GetActive()
+{
+  return FSecureShell->Active;
+}
+//---------------------------------------------------------------------------
+void __fastcall TSFTPFileSystem::CollectUsage()
+{
+  FSecureShell->CollectUsage();
+
+  UnicodeString VersionCounter;
+  switch (FVersion)
+  {
+    case 0:
+      VersionCounter = L"OpenedSessionsSFTP0";
+      break;
+    case 1:
+      VersionCounter = L"OpenedSessionsSFTP1";
+      break;
+    case 2:
+      VersionCounter = L"OpenedSessionsSFTP2";
+      break;
+    case 3:
+      VersionCounter = L"OpenedSessionsSFTP3";
+      break;
+    case 4:
+      VersionCounter = L"OpenedSessionsSFTP4";
+      break;
+    case 5:
+      VersionCounter = L"OpenedSessionsSFTP5";
+      break;
+    case 6:
+      VersionCounter = L"OpenedSessionsSFTP6";
+      break;
+    default:
+      DebugFail();
+  }
+  FTerminal->Configuration->Usage->Inc(VersionCounter);
+}
+//---------------------------------------------------------------------------
+const TSessionInfo & __fastcall TSFTPFileSystem::GetSessionInfo()
+{
+  return FSecureShell->GetSessionInfo();
+}
+//---------------------------------------------------------------------------
+const TFileSystemInfo & __fastcall TSFTPFileSystem::GetFileSystemInfo(bool /*Retrieve*/)
+{
+  if (!FFileSystemInfoValid)
+  {
+    FFileSystemInfo.AdditionalInfo = L"";
+
+    if (!IsCapable(fcRename))
+    {
+      FFileSystemInfo.AdditionalInfo += LoadStr(FS_RENAME_NOT_SUPPORTED) + L"\r\n\r\n";
+    }
+
+    if (FExtensions->Count > 0)
+    {
+      UnicodeString Name;
+      UnicodeString Value;
+      UnicodeString Line;
+      FFileSystemInfo.AdditionalInfo += LoadStr(SFTP_EXTENSION_INFO) + L"\r\n";
+      for (int Index = 0; Index < FExtensions->Count; Index++)
+      {
+        UnicodeString Name = FExtensions->Names[Index];
+        UnicodeString Value = FExtensions->Values[Name];
+        UnicodeString Line;
+        if (Value.IsEmpty())
+        {
+          Line = Name;
+        }
+        else
+        {
+          Line = FORMAT(L"%s=%s", (Name, Value));
+        }
+        FFileSystemInfo.AdditionalInfo += FORMAT(L"  %s\r\n", (Line));
+      }
+    }
+    else
+    {
+      FFileSystemInfo.AdditionalInfo += LoadStr(SFTP_NO_EXTENSION_INFO) + L"\r\n";
     }
 
     FFileSystemInfo.ProtocolBaseName = L"SFTP";
@@ -2148,7 +2939,9 @@ bool __fastcall TSFTPFileSystem::IsCapable(int Capability) const
       return
         SupportsExtension(SFTP_EXT_COPY_FILE) ||
         // see above
-        (FSecureShell->SshImplementation == sshiBitvise);
+        (FSecureShell->SshImplementation == sshiBitvise) ||
+        // Copying the tree ourselves would need the encrypted names to be handled
+        (FSupportsCopyData && !FTerminal->IsEncryptingFiles());
 
     case fcHardLink:
       return
@@ -2161,6 +2954,9 @@ bool __fastcall TSFTPFileSystem::IsCapable(int Capability) const
     case fcChangePassword:
       return FSecureShell->CanChangePassword();
 
+    case fcPipelinedChanges:
+      return true;
+
     default:
       DebugFail();
       return false;
@@ -2263,7 +3059,12 @@ unsigned long __fastcall TSFTPFileSystem::UploadBlockSize(const RawByteString &
   // handle length + offset + data size
   const unsigned long UploadPacketOverhead =
     sizeof(unsigned long) + sizeof(__int64) + sizeof(unsigned long);
-  return TransferBlockSize(UploadPacketOverhead + Handle.Length(), OperationProgress);
+  unsigned long Result = TransferBlockSize(UploadPacketOverhead + Handle.Length(), OperationProgress);
+  if ((FLimitMaxWriteLength > 0) && (Result > FLimitMaxWriteLength))
+  {
+    Result = FLimitMaxWriteLength;
+  }
+  return Result;
 }
 //---------------------------------------------------------------------------
 unsigned long __fastcall TSFTPFileSystem::DownloadBlockSize(
@@ -2275,6 +3076,10 @@ unsigned long __fastcall TSFTPFileSystem::DownloadBlockSize(
   {
     Result = FSupport->MaxReadSize;
   }
+  if ((FLimitMaxReadLength > 0) && (Result > FLimitMaxReadLength))
+  {
+    Result = FLimitMaxReadLength;
+  }
   return Result;
 }
 //---------------------------------------------------------------------------
@@ -2971,6 +3776,13 @@ void __fastcall TSFTPFileSystem::DoStartup()
   FSupport->Loaded = false;
   FSupportsStatVfsV2 = false;
   FSupportsHardlink = false;
+  FSupportsLimits = false;
+  FSupportsCopyData = false;
+  FSupportsUsersGroupsByID = false;
+  FLimitMaxPacketLength = 0;
+  FLimitMaxReadLength = 0;
+  FLimitMaxWriteLength = 0;
+  FLimitMaxOpenHandles = 0;
   SAFE_DESTROY(FFixedPaths);
 
   if (FVersion >= 3)
@@ -3146,6 +3958,45 @@ void __fastcall TSFTPFileSystem::DoStartup()
           FTerminal->LogEvent(FORMAT(L"Unsupported %s extension version %s", (ExtensionName, ExtensionDisplayData)));
         }
       }
+      else if (ExtensionName == SFTP_EXT_COPY_DATA)
+      {
+        UnicodeString CopyDataVersion = AnsiToString(ExtensionData);
+        if (CopyDataVersion == SFTP_EXT_COPY_DATA_VALUE_V1)
+        {
+          FSupportsCopyData = true;
+          FTerminal->LogEvent(FORMAT(L"Supports %s extension version %s", (ExtensionName, ExtensionDisplayData)));
+        }
+        else
+        {
+          FTerminal->LogEvent(FORMAT(L"Unsupported %s extension version %s", (ExtensionName, ExtensionDisplayData)));
+        }
+      }
+      else if (ExtensionName == SFTP_EXT_LIMITS)
+      {
+        UnicodeString LimitsVersion = AnsiToString(ExtensionData);
+        if (LimitsVersion == SFTP_EXT_LIMITS_VALUE_V1)
+        {
+          FSupportsLimits = true;
+          FTerminal->LogEvent(FORMAT(L"Supports %s extension version %s", (ExtensionName, ExtensionDisplayData)));
+        }
+        else
+        {
+          FTerminal->LogEvent(FORMAT(L"Unsupported %s extension version %s", (ExtensionName, ExtensionDisplayData)));
+        }
+      }
+      else if (ExtensionName == SFTP_EXT_USERS_GROUPS_BY_ID)
+      {
+        UnicodeString UsersGroupsByIDVersion = AnsiToString(ExtensionData);
+        if (UsersGroupsByIDVersion == SFTP_EXT_USERS_GROUPS_BY_ID_VALUE_V1)
+        {
+          FSupportsUsersGroupsByID = true;
+          FTerminal->LogEvent(FORMAT(L"Supports %s extension version %s", (ExtensionName, ExtensionDisplayData)));
+        }
+        else
+        {
+          FTerminal->LogEvent(FORMAT(L"Unsupported %s extension version %s", (ExtensionName, ExtensionDisplayData)));
+        }
+      }
       else
       {
         FTerminal->LogEvent(0, FORMAT(L"Unknown server extension %s=%s", (ExtensionName, ExtensionDisplayData)));
@@ -3166,6 +4017,11 @@ void __fastcall TSFTPFileSystem::DoStartup()
       ReceiveResponse(&Packet, &Packet);
       //ReserveResponse(&Packet, NULL);
     }
+
+    if (FSupportsLimits)
+    {
+      ReadLimits();
+    }
   }
 
   if (FVersion < 4)
@@ -3224,7 +4080,13 @@ void __fastcall TSFTPFileSystem::DoStartup()
   FMaxPacketSize = FTerminal->SessionData->SFTPMaxPacketSize;
   if (FMaxPacketSize == 0)
   {
-    if ((FSecureShell->SshImplementation == sshiOpenSSH) && (FVersion == 3) && !FSupport->Loaded)
+    if (FLimitMaxPacketLength > 0)
+    {
+      FMaxPacketSize = 4 + FLimitMaxPacketLength; // len + payload
+      FTerminal->LogEvent(FORMAT(L"Limiting packet size to server limit of %d bytes",
+        (int(FMaxPacketSize))));
+    }
+    else if ((FSecureShell->SshImplementation == sshiOpenSSH) && (FVersion == 3) && !FSupport->Loaded)
     {
       FMaxPacketSize = 4 + (256 * 1024); // len + 256kB payload
       FTerminal->LogEvent(FORMAT(L"Limiting packet size to OpenSSH sftp-server limit of %d bytes",
@@ -3241,6 +4103,33 @@ void __fastcall TSFTPFileSystem::DoStartup()
   }
 }
 //---------------------------------------------------------------------------
+static unsigned long __fastcall LimitToCardinal(__int64 Limit)
+{
+  // 0 = no limit
+  return ((Limit < 0) || (Limit > std::numeric_limits<unsigned long>::max())) ? 0 : static_cast<unsigned long>(Limit);
+}
+//---------------------------------------------------------------------------
+void __fastcall TSFTPFileSystem::ReadLimits()
+{
+  TSFTPPacket Packet(SSH_FXP_EXTENDED);
+  Packet.AddString(SFTP_EXT_LIMITS);
+  SendPacketAndReceiveResponse(&Packet, &Packet, SSH_FXP_EXTENDED_REPLY, asAll);
+  if (Packet.Type != SSH_FXP_EXTENDED_REPLY)
+  {
+    FTerminal->LogEvent(FORMAT(L"Failed to query %s extension", (SFTP_EXT_LIMITS)));
+  }
+  else
+  {
+    FLimitMaxPacketLength = LimitToCardinal(Packet.GetInt64());
+    FLimitMaxReadLength = LimitToCardinal(Packet.GetInt64());
+    FLimitMaxWriteLength = LimitToCardinal(Packet.GetInt64());
+    FLimitMaxOpenHandles = LimitToCardinal(Packet.GetInt64());
+    FTerminal->LogEvent(
+      FORMAT(L"Server limits: Max packet length: %d, Max read length: %d, Max write length: %d, Max open handles: %d (0 = no limit)",
+        (int(FLimitMaxPacketLength), int(FLimitMaxReadLength), int(FLimitMaxWriteLength), int(FLimitMaxOpenHandles))));
+  }
+}
+//---------------------------------------------------------------------------
 char * __fastcall TSFTPFileSystem::GetEOL() const
 {
   if (FVersion >= 4)
@@ -3304,6 +4193,109 @@ void __fastcall TSFTPFileSystem::LookupUsersGroups()
   }
 }
 //---------------------------------------------------------------------------
+void __fastcall TSFTPFileSystem::ResolveUsersGroups(const std::vector<TRemoteFileList *> & FileLists)
+{
+  // SFTP-3 gives numeric IDs only, names come from parsing the long name,
+  // what fails with some servers and is not available for SSH_FXP_ATTRS at all.
+  std::set<unsigned int> UIDs;
+  std::set<unsigned int> GIDs;
+  bool AnyMissing = false;
+  for (size_t ListIndex = 0; ListIndex < FileLists.size(); ListIndex++)
+  {
+    TRemoteFileList * FileList = FileLists[ListIndex];
+    for (int Index = 0; Index < FileList->Count; Index++)
+    {
+      TRemoteFile * File = FileList->Files[Index];
+      if (File->Owner.IDValid && !File->Owner.NameValid)
+      {
+        AnyMissing = true;
+        if (FUsersByID->Find(File->Owner.ID) == NULL)
+        {
+          UIDs.insert(File->Owner.ID);
+        }
+      }
+      if (File->Group.IDValid && !File->Group.NameValid)
+      {
+        AnyMissing = true;
+        if (FGroupsByID->Find(File->Group.ID) == NULL)
+        {
+          GIDs.insert(File->Group.ID);
+        }
+      }
+    }
+  }
+
+  if (FSupportsUsersGroupsByID && (!UIDs.empty() || !GIDs.empty()))
+  {
+    FTerminal->LogEvent(FORMAT(L"Looking up %d user and %d group names.", (int(UIDs.size()), int(GIDs.size()))));
+
+    // Both lists of IDs are sent as strings of packed uint32 values
+    TSFTPPacket UIDsData;
+    for (std::set<unsigned int>::const_iterator I = UIDs.begin(); I != UIDs.end(); I++)
+    {
+      UIDsData.AddCardinal(*I);
+    }
+    TSFTPPacket GIDsData;
+    for (std::set<unsigned int>::const_iterator I = GIDs.begin(); I != GIDs.end(); I++)
+    {
+      GIDsData.AddCardinal(*I);
+    }
+
+    TSFTPPacket Packet(SSH_FXP_EXTENDED);
+    Packet.AddString(SFTP_EXT_USERS_GROUPS_BY_ID);
+    Packet.AddString(RawByteString(reinterpret_cast<const char *>(UIDsData.Data), UIDsData.Length));
+    Packet.AddString(RawByteString(reinterpret_cast<const char *>(GIDsData.Data), GIDsData.Length));
+    SendPacketAndReceiveResponse(&Packet, &Packet, SSH_FXP_EXTENDED_REPLY, asAll);
+    if (Packet.Type != SSH_FXP_EXTENDED_REPLY)
+    {
+      FTerminal->LogEvent(FORMAT(L"Failed to query %s extension, not using it anymore", (SFTP_EXT_USERS_GROUPS_BY_ID)));
+      FSupportsUsersGroupsByID = false;
+    }
+    else
+    {
+      // The names come in the order of the IDs, empty for IDs that cannot be resolved.
+      // Those are remembered too, so that they are not asked for again.
+      TSFTPPacket UserNames(Packet.GetRawByteString());
+      TSFTPPacket GroupNames(Packet.GetRawByteString());
+      for (std::set<unsigned int>::const_iterator I = UIDs.begin(); I != UIDs.end(); I++)
+      {
+        TRemoteToken Token(UserNames.GetString(FUtfStrings));
+        Token.ID = *I;
+        FUsersByID->Add(Token);
+      }
+      for (std::set<unsigned int>::const_iterator I = GIDs.begin(); I != GIDs.end(); I++)
+      {
+        TRemoteToken Token(GroupNames.GetString(FUtfStrings));
+        Token.ID = *I;
+        FGroupsByID->Add(Token);
+      }
+    }
+  }
+
+  if (AnyMissing)
+  {
+    for (size_t ListIndex = 0; ListIndex < FileLists.size(); ListIndex++)
+    {
+      TRemoteFileList * FileList = FileLists[ListIndex];
+      for (int Index = 0; Index < FileList->Count; Index++)
+      {
+        TRemoteFile * File = FileList->Files[Index];
+        const TRemoteToken * Token;
+        if (File->Owner.IDValid && !File->Owner.NameValid &&
+            ((Token = FUsersByID->Find(File->Owner.ID)) != NULL) && Token->NameValid)
+        {
+          File->Owner.Name = Token->Name;
+        }
+        if (File->Group.IDValid && !File->Group.NameValid &&
+            ((Token = FGroupsByID->Find(File->Group.ID)) != NULL) && Token->NameValid)
+        {
+          File->Group.Name = Token->Name;
+        }
+      }
+    }
+  }
+}
+//---------------------------------------------------------------------------
 void __fastcall TSFTPFileSystem::ReadCurrentDirectory()
 {
   if (!FDirectoryToChangeTo.IsEmpty())
@@ -3411,6 +4403,7 @@ void __fastcall TSFTPFileSystem::ReadDirectory(TRemoteFileList * FileList)
     int Total = 0;
     bool HasParentDirectory = false;
     TRemoteFile * File;
+    std::unique_ptr<TStringList> Symlinks(new TStringList());
 
     Packet.ChangeType(SSH_FXP_READDIR);
     Packet.AddString(Handle);
@@ -3432,11 +4425,15 @@ void __fastcall TSFTPFileSystem::ReadDirectory(TRemoteFileList * FileList)
 
         unsigned int Count = ListingPacket.GetCardinal();
 
-        int ResolvedLinks = 0;
         for (unsigned long Index = 0; !isEOF && (Index < Count); Index++)
         {
-          File = LoadFile(&ListingPacket, NULL, L"", FileList);
+          // symlinks are resolved all at once below
+          File = LoadFile(&ListingPacket, NULL, L"", FileList, false);
           FileList->AddFile(File);
+          if (File->IsSymLink && FTerminal->ResolvingSymlinks)
+          {
+            Symlinks->AddObject(LocalCanonify(File->HaveFullFileName ? File->FullFileName : File->FileName), File);
+          }
           if (FTerminal->IsEncryptingFiles() && // optimization
               IsRealFile(File->FileName))
           {
@@ -3452,10 +4449,6 @@ void __fastcall TSFTPFileSystem::ReadDirectory(TRemoteFileList * FileList)
           {
             FTerminal->LogEvent(FORMAT(L"Read file '%s' from listing", (File->FileName)));
           }
-          if (File->LinkedFile != NULL)
-          {
-            ResolvedLinks++;
-          }
           if (File->IsParentDirectory)
           {
             HasParentDirectory = true;
@@ -3464,7 +4457,7 @@ void __fastcall TSFTPFileSystem::ReadDirectory(TRemoteFileList * FileList)
 
           if (Total % 10 == 0)
           {
-            FTerminal->DoReadDirectoryProgress(Total, ResolvedLinks, isEOF);
+            FTerminal->DoReadDirectoryProgress(Total, 0, isEOF);
             if (isEOF)
             {
               FTerminal->DoReadDirectoryProgress(-2, 0, isEOF);
@@ -3498,6 +4491,13 @@ void __fastcall TSFTPFileSystem::ReadDirectory(TRemoteFileList * FileList)
     }
     while (!isEOF);
 
+    if (Symlinks->Count > 0)
+    {
+      ResolveSymlinks(Symlinks.get(), Total);
+    }
+
+    ResolveUsersGroups(std::vector<TRemoteFileList *>(1, FileList));
+
     if (Total == 0)
     {
       bool Failure = false;
@@ -3576,6 +4576,190 @@ void __fastcall TSFTPFileSystem::ReadDirectory(TRemoteFileList * FileList)
   }
 }
 //---------------------------------------------------------------------------
+void __fastcall TSFTPFileSystem::ResolveSymlinks(TStrings * Symlinks, int Total)
+{
+  // Equivalent to TRemoteFile::FindLinkedFile/ReadSymlink for each link,
+  // but with many READLINK/STAT requests in flight at once.
+  // Cycles cannot occur on this level, as the listed files are not linked by any other file.
+  // Links of the linked files (if any) are resolved by LoadFile, as before.
+  FTerminal->LogEvent(FORMAT(L"Resolving %d symlinks.", (Symlinks->Count)));
+  static int ResolveSymlinksQueueLen = 64;
+  TSFTPResolveSymlinksQueue Queue(this);
+  try
+  {
+    if (Queue.Init(ResolveSymlinksQueueLen, Symlinks))
+    {
+      TSFTPPacket Packet;
+      bool Next;
+      bool Stat = false;
+      bool Failed = false;
+      int ResolvedLinks = 0;
+      int Processed = 0;
+      bool Cancel = false;
+      do
+      {
+        TRemoteFile * File;
+        Next = Queue.ReceivePacket(&Packet, File);
+        DebugAssert(File != NULL);
+
+        if (!Stat)
+        {
+          FTerminal->LogEvent(FORMAT(L"Reading symlink \"%s\".", (File->FileName)));
+          Failed = false;
+        }
+
+        if (!Failed)
+        {
+          FTerminal->ExceptionOnFail = true;
+          try
+          {
+            try
+            {
+              if (Packet.Type == SSH_FXP_STATUS)
+              {
+                GotStatusPacket(&Packet, asNo);
+              }
+              else if (!Stat)
+              {
+                if (Packet.Type != SSH_FXP_NAME)
+                {
+                  FTerminal->FatalError(NULL, FMTLOAD(SFTP_INVALID_TYPE, ((int)Packet.Type)));
+                }
+                if (Packet.GetCardinal() != 1)
+                {
+                  FTerminal->FatalError(NULL, LoadStr(SFTP_NON_ONE_FXP_NAME_PACKET));
+                }
+                File->LinkTo = FTerminal->DecryptFileName(Packet.GetPathString(FUtfStrings));
+                FTerminal->LogEvent(FORMAT(L"Link resolved to \"%s\".", (File->LinkTo)));
+              }
+              else
+              {
+                if (Packet.Type != SSH_FXP_ATTRS)
+                {
+                  FTerminal->FatalError(NULL, FMTLOAD(SFTP_INVALID_TYPE, ((int)Packet.Type)));
+                }
+                File->FLinkedFile = LoadFile(&Packet, File, UnixExtractFileName(File->LinkTo));
+                ResolvedLinks++;
+              }
+            }
+            __finally
+            {
+              FTerminal->ExceptionOnFail = false;
+            }
+          }
+          catch (Exception & E)
+          {
+            if (E.InheritsFrom(__classid(EFatal)))
+            {
+              throw;
+            }
+            else
+            {
+              ExtException ReadError(&E, FMTLOAD(READ_SYMLINK_ERROR, (File->FileName)));
+              FTerminal->Log->AddException(&ReadError);
+              // ignore the STAT response, if READLINK failed
+              Failed = true;
+            }
+          }
+        }
+
+        if (Stat && (++Processed % 10 == 0))
+        {
+          FTerminal->DoReadDirectoryProgress(Total, ResolvedLinks, Cancel);
+          if (Cancel)
+          {
+            Next = false;
+          }
+        }
+
+        Stat = !Stat;
+      }
+      while (Next);
+    }
+  }
+  __finally
+  {
+    Queue.DisposeSafe();
+  }
+}
+//---------------------------------------------------------------------------
+bool __fastcall TSFTPFileSystem::ReadDirectoryTree(const UnicodeString & Directory, TObjectList * FileLists)
+{
+  // Decrypting the file names would need the encrypted paths to be tracked separately
+  int QueueLen = FTerminal->SessionData->SFTPTreeListingQueue;
+  bool Result = (QueueLen > 0) && !FTerminal->IsEncryptingFiles();
+  // Each directory being read holds a handle, keep one spare for other operations
+  if (Result && (FLimitMaxOpenHandles > 0) && (static_cast<unsigned long>(QueueLen) >= FLimitMaxOpenHandles))
+  {
+    QueueLen = std::max(static_cast<int>(FLimitMaxOpenHandles) - 1, 1);
+  }
+  if (Result)
+  {
+    UnicodeString Path = UnixExcludeTrailingBackslash(LocalCanonify(Directory));
+    FTerminal->LogEvent(FORMAT(L"Listing directory tree \"%s\", reading up to %d directories at once.", (Path, QueueLen)));
+
+    TSFTPReadDirectoryTreeQueue Queue(this);
+    try
+    {
+      if (Queue.Init(QueueLen, Path))
+      {
+        bool Next;
+        bool Cancel = false;
+        do
+        {
+          TRemoteFileList * FileList;
+          Next = Queue.ReceiveListing(FileList);
+          if (FileList != NULL)
+          {
+            FileLists->Add(FileList);
+
+            if (FTerminal->ResolvingSymlinks)
+            {
+              std::unique_ptr<TStringList> Symlinks(new TStringList());
+              for (int Index = 0; Index < FileList->Count; Index++)
+              {
+                TRemoteFile * File = FileList->Files[Index];
+                if (File->IsSymLink)
+                {
+                  Symlinks->AddObject(LocalCanonify(File->FullFileName), File);
+                }
+              }
+              if (Symlinks->Count > 0)
+              {
+                ResolveSymlinks(Symlinks.get(), FileList->Count);
+              }
+            }
+
+            FTerminal->DoReadDirectoryProgress(FileLists->Count, 0, Cancel);
+            if (Cancel ||
+                ((FTerminal->OperationProgress != NULL) && (FTerminal->OperationProgress->Cancel != csContinue)))
+            {
+              FTerminal->LogEvent(L"Listing directory tree cancelled.");
+              Next = false;
+            }
+          }
+        }
+        while (Next);
+      }
+    }
+    __finally
+    {
+      Queue.DisposeSafe();
+    }
+
+    // all the IDs of the tree at once
+    std::vector<TRemoteFileList *> Lists;
+    for (int Index = 0; Index < FileLists->Count; Index++)
+    {
+      Lists.push_back(static_cast<TRemoteFileList *>(FileLists->Items[Index]));
+    }
+    ResolveUsersGroups(Lists);
+
+    FTerminal->LogEvent(FORMAT(L"Listing directory tree of \"%s\" returned %d directories.", (Path, FileLists->Count)));
+  }
+  return Result;
+}
+//---------------------------------------------------------------------------
 void __fastcall TSFTPFileSystem::ReadSymlink(TRemoteFile * SymlinkFile,
   TRemoteFile *& File)
 {
@@ -3730,31 +4914,194 @@ void __fastcall TSFTPFileSystem::RenameFile(const UnicodeString FileName, const
     // rename case (TTerminal::RenameFile)
     TargetName = UnixExtractFilePath(RealName) + NewName;
   }
-  else
+  else
+  {
+    TargetName = LocalCanonify(NewName);
+  }
+  AddPathString(Packet, TargetName, Encrypted);
+  if (FVersion >= 5)
+  {
+    Packet.AddCardinal(0);
+  }
+  SendPacketAndReceiveResponse(&Packet, &Packet, SSH_FXP_STATUS);
+}
+//---------------------------------------------------------------------------
+void __fastcall TSFTPFileSystem::CopyFile(const UnicodeString FileName, const TRemoteFile * File,
+  const UnicodeString NewName)
+{
+  // Implemented by ProFTPD/mod_sftp and Bitvise WinSSHD (without announcing it)
+  if (SupportsExtension(SFTP_EXT_COPY_FILE) || (FSecureShell->SshImplementation == sshiBitvise))
+  {
+    TSFTPPacket Packet(SSH_FXP_EXTENDED);
+    Packet.AddString(SFTP_EXT_COPY_FILE);
+    UnicodeString RealName = Canonify(FileName);
+    bool Encrypted = FTerminal->IsFileEncrypted(RealName);
+    AddPathString(Packet, RealName);
+    AddPathString(Packet, Canonify(NewName), Encrypted);
+    Packet.AddBool(false);
+    SendPacketAndReceiveResponse(&Packet, &Packet, SSH_FXP_STATUS);
+  }
+  else
+  {
+    // Implemented by OpenSSH 9.0 and newer
+    DebugAssert(FSupportsCopyData);
+    UnicodeString RealName = Canonify(FileName);
+    std::unique_ptr<TRemoteFile> OwnedFile;
+    if (File == NULL)
+    {
+      TRemoteFile * AFile;
+      ReadFile(RealName, AFile);
+      OwnedFile.reset(AFile);
+      File = AFile;
+    }
+    UnicodeString TargetName = Canonify(NewName);
+    // We walk the tree ourselves, copying a folder into its own subtree would never end
+    if (File->IsDirectory && !File->IsSymLink && UnixIsChildPath(RealName, TargetName))
+    {
+      throw Exception(FMTLOAD(COPY_INTO_ITSELF, (RealName)));
+    }
+    CopyData(RealName, File, TargetName);
+  }
+}
+//---------------------------------------------------------------------------
+void __fastcall TSFTPFileSystem::CopyData(const UnicodeString & FileName, const TRemoteFile * File,
+  const UnicodeString & NewName)
+{
+  // The copy-data extension copies data between two open handles,
+  // so (unlike with the copy-file extension) we have to walk directory trees ourselves.
+  // Like cp -R -p, symbolic links are copied as links, and
+  // permissions (of files subject to server's umask) and modification times are preserved.
+  TFileOperationProgressType * OperationProgress = FTerminal->OperationProgress;
+  if ((OperationProgress != NULL) && (OperationProgress->Cancel != csContinue))
+  {
+    Abort();
+  }
+
+  unsigned short Rights = File->Rights->NumberSet;
+  if (File->IsSymLink)
+  {
+    FTerminal->LogEvent(FORMAT(L"Copying symbolic link \"%s\".", (FileName)));
+    UnicodeString LinkTo = File->LinkTo;
+    if (LinkTo.IsEmpty())
+    {
+      // Listing does not always include the link target
+      TSFTPPacket Packet(SSH_FXP_READLINK);
+      AddPathString(Packet, FileName);
+      SendPacketAndReceiveResponse(&Packet, &Packet, SSH_FXP_NAME);
+      if (Packet.GetCardinal() != 1)
+      {
+        FTerminal->FatalError(NULL, LoadStr(SFTP_NON_ONE_FXP_NAME_PACKET));
+      }
+      LinkTo = Packet.GetPathString(FUtfStrings);
+    }
+    CreateLink(NewName, LinkTo, true);
+  }
+  else if (File->IsDirectory)
+  {
+    FTerminal->LogEvent(FORMAT(L"Copying directory \"%s\".", (FileName)));
+    // Create the directory writable for us, so that its contents can be copied
+    // even if the source directory is read-only. Its own permissions are applied at the end.
+    unsigned short CreateRights =
+      static_cast<unsigned short>(Rights | TRights::rfUserRead | TRights::rfUserWrite | TRights::rfUserExec);
+    TSFTPPacket Packet(SSH_FXP_MKDIR);
+    AddPathString(Packet, NewName);
+    Packet.AddProperties(&CreateRights, NULL, NULL, NULL, NULL, NULL, true, FVersion, FUtfStrings);
+    SendPacketAndReceiveResponse(&Packet, &Packet, SSH_FXP_STATUS);
+
+    std::unique_ptr<TRemoteFileList> FileList(new TRemoteFileList());
+    FileList->Directory = FileName;
+    ReadDirectory(FileList.get());
+    for (int Index = 0; Index < FileList->Count; Index++)
+    {
+      TRemoteFile * SubFile = FileList->Files[Index];
+      if (IsRealFile(SubFile->FileName))
+      {
+        CopyData(
+          UnixCombinePaths(FileName, SubFile->FileName), SubFile,
+          UnixCombinePaths(NewName, SubFile->FileName));
+      }
+    }
+
+    // Copying the contents has updated the modification time
+    SetCopiedFileProperties(NewName, File, &Rights);
+  }
+  else
+  {
+    static __int64 CopyDataRangeSize = 64 * 1024 * 1024;
+    static int CopyDataQueueLen = 4;
+
+    RawByteString SourceHandle = SFTPOpenRemoteFile(FileName, SSH_FXF_READ);
+    try
+    {
+      RawByteString DestHandle =
+        SFTPOpenRemoteFile(NewName, SSH_FXF_WRITE | SSH_FXF_CREAT | SSH_FXF_TRUNC, false, File->Size, &Rights);
+      try
+      {
+        // Large files are split to ranges copied by concurrent requests,
+        // so that we can check for cancellation while the server is copying
+        TSFTPCopyDataQueue Queue(this);
+        try
+        {
+          if (Queue.Init(CopyDataQueueLen, SourceHandle, DestHandle, File->Size, CopyDataRangeSize))
+          {
+            while (Queue.Next(SSH_FXP_STATUS))
+            {
+              if ((OperationProgress != NULL) && (OperationProgress->Cancel != csContinue))
+              {
+                Abort();
+              }
+            }
+          }
+        }
+        __finally
+        {
+          Queue.DisposeSafe();
+        }
+      }
+      __finally
+      {
+        if (FTerminal->Active)
+        {
+          TSFTPPacket Packet(SSH_FXP_CLOSE);
+          Packet.AddString(DestHandle);
+          SendPacketAndReceiveResponse(&Packet, &Packet, SSH_FXP_STATUS);
+        }
+      }
+    }
+    __finally
+    {
+      if (FTerminal->Active)
+      {
+        TSFTPPacket Packet(SSH_FXP_CLOSE);
+        Packet.AddString(SourceHandle);
+        SendPacketAndReceiveResponse(&Packet, &Packet, SSH_FXP_STATUS, asAll);
+      }
+    }
+
+    // Permissions were set when creating the file
+    SetCopiedFileProperties(NewName, File, NULL);
+  }
+}
+//---------------------------------------------------------------------------
+void __fastcall TSFTPFileSystem::SetCopiedFileProperties(
+  const UnicodeString & NewName, const TRemoteFile * File, unsigned short * Rights)
+{
+  __int64 MTime = 0;
+  bool HasMTime = (File->ModificationFmt != mfNone);
+  if (HasMTime)
   {
-    TargetName = LocalCanonify(NewName);
+    TDSTMode DSTMode = FTerminal->SessionData->DSTMode;
+    MTime = ConvertTimestampToUnix(DateTimeToFileTime(File->Modification, DSTMode), DSTMode);
   }
-  AddPathString(Packet, TargetName, Encrypted);
-  if (FVersion >= 5)
+
+  if ((Rights != NULL) || HasMTime)
   {
-    Packet.AddCardinal(0);
+    TSFTPPacket Packet(SSH_FXP_SETSTAT);
+    AddPathString(Packet, NewName);
+    Packet.AddProperties(
+      Rights, NULL, NULL, (HasMTime ? &MTime : NULL), NULL, NULL, File->IsDirectory, FVersion, FUtfStrings);
+    SendPacketAndReceiveResponse(&Packet, &Packet, SSH_FXP_STATUS);
   }
-  SendPacketAndReceiveResponse(&Packet, &Packet, SSH_FXP_STATUS);
-}
-//---------------------------------------------------------------------------
-void __fastcall TSFTPFileSystem::CopyFile(const UnicodeString FileName, const TRemoteFile * /*File*/,
-  const UnicodeString NewName)
-{
-  // Implemented by ProFTPD/mod_sftp and Bitvise WinSSHD (without announcing it)
-  DebugAssert(SupportsExtension(SFTP_EXT_COPY_FILE) || (FSecureShell->SshImplementation == sshiBitvise));
-  TSFTPPacket Packet(SSH_FXP_EXTENDED);
-  Packet.AddString(SFTP_EXT_COPY_FILE);
-  UnicodeString RealName = Canonify(FileName);
-  bool Encrypted = FTerminal->IsFileEncrypted(RealName);
-  AddPathString(Packet, RealName);
-  AddPathString(Packet, Canonify(NewName), Encrypted);
-  Packet.AddBool(false);
-  SendPacketAndReceiveResponse(&Packet, &Packet, SSH_FXP_STATUS);
 }
 //---------------------------------------------------------------------------
 void __fastcall TSFTPFileSystem::CreateDirectory(const UnicodeString & DirName, bool Encrypt)
@@ -3887,8 +5234,7 @@ void __fastcall TSFTPFileSystem::ChangeFileProperties(const UnicodeString FileNa
     {
       try
       {
-        FTerminal->ProcessDirectory(FileName, FTerminal->ChangeFileProperties,
-          (void*)AProperties);
+        FTerminal->ChangeDirectoryContentsProperties(FileName, AProperties);
       }
       catch(...)
       {
@@ -3897,22 +5243,8 @@ void __fastcall TSFTPFileSystem::ChangeFileProperties(const UnicodeString FileNa
       }
     }
 
-    // SFTP can change owner and group at the same time only, not individually.
-    // Fortunately we know current owner/group, so if only one is present,
-    // we can supplement the other.
     TRemoteProperties Properties(*AProperties);
-    if (Properties.Valid.Contains(vpGroup) &&
-        !Properties.Valid.Contains(vpOwner))
-    {
-      Properties.Owner = File->Owner;
-      Properties.Valid << vpOwner;
-    }
-    else if (Properties.Valid.Contains(vpOwner) &&
-             !Properties.Valid.Contains(vpGroup))
-    {
-      Properties.Group = File->Group;
-      Properties.Valid << vpGroup;
-    }
+    CompleteOwnerGroup(Properties, File);
 
     TSFTPPacket Packet(SSH_FXP_SETSTAT);
     AddPathString(Packet, RealFileName);
@@ -3925,6 +5257,103 @@ void __fastcall TSFTPFileSystem::ChangeFileProperties(const UnicodeString FileNa
   }
 }
 //---------------------------------------------------------------------------
+void __fastcall TSFTPFileSystem::ChangeFilesProperties(TStrings * FileList,
+  const TRemoteProperties * Properties, TStrings * FailedFiles)
+{
+  // The missing owner or group would be taken from the listing,
+  // but some servers do not include them there, see fcLoadingAdditionalProperties.
+  // ChangeFileProperties reads each file instead.
+  if (Properties->Valid.Contains(vpOwner) != Properties->Valid.Contains(vpGroup))
+  {
+    FailedFiles->Assign(FileList);
+  }
+  else
+  {
+    ChangeFiles(FileList, Properties, FailedFiles);
+  }
+}
+//---------------------------------------------------------------------------
+void __fastcall TSFTPFileSystem::DeleteFiles(TStrings * FileList, TStrings * FailedFiles)
+{
+  ChangeFiles(FileList, NULL, FailedFiles);
+}
+//---------------------------------------------------------------------------
+void __fastcall TSFTPFileSystem::ChangeFiles(TStrings * FileList,
+  const TRemoteProperties * Properties, TStrings * FailedFiles)
+{
+  FTerminal->LogEvent(FORMAT(L"Sending requests for %d files at once.", (FileList->Count)));
+  static int ChangeFilesQueueLen = 256;
+  TSFTPChangeFilesQueue Queue(this);
+  int Sent = 0;
+  try
+  {
+    if (Queue.Init(ChangeFilesQueueLen, FileList, Properties))
+    {
+      TSFTPPacket Packet;
+      bool Next;
+      do
+      {
+        int Index;
+        TFileSessionAction * Action;
+        Next = Queue.ReceivePacket(&Packet, Index, Action);
+        // the action is committed, unless the request failed
+        std::unique_ptr<TFileSessionAction> ActionOwner(Action);
+
+        FTerminal->ExceptionOnFail = true;
+        try
+        {
+          try
+          {
+            if (Packet.Type != SSH_FXP_STATUS)
+            {
+              FTerminal->FatalError(NULL, FMTLOAD(SFTP_INVALID_TYPE, ((int)Packet.Type)));
+            }
+            GotStatusPacket(&Packet, asOK);
+          }
+          __finally
+          {
+            FTerminal->ExceptionOnFail = false;
+          }
+        }
+        catch (Exception & E)
+        {
+          if (E.InheritsFrom(__classid(EFatal)))
+          {
+            throw;
+          }
+          // the caller processes the file individually then, reporting the error
+          FTerminal->Log->AddException(&E);
+          Action->Cancel();
+          FailedFiles->AddObject(FileList->Strings[Index], FileList->Objects[Index]);
+        }
+
+        TFileOperationProgressType * OperationProgress = FTerminal->OperationProgress;
+        if (OperationProgress != NULL)
+        {
+          OperationProgress->SetFile(FileList->Strings[Index]);
+          if (OperationProgress->Cancel != csContinue)
+          {
+            // The server may have processed the requests sent already, collect their outcome
+            Queue.StopSending();
+          }
+        }
+      }
+      while (Next);
+    }
+    Sent = Queue.GetSent();
+  }
+  __finally
+  {
+    Queue.DisposeSafe();
+  }
+
+  // When cancelled, the files not even requested are left to the caller, which will abort
+  for (int Index = Sent; Index < FileList->Count; Index++)
+  {
+    FailedFiles->AddObject(FileList->Strings[Index], FileList->Objects[Index]);
+  }
+}
+//---------------------------------------------------------------------------
 bool __fastcall TSFTPFileSystem::LoadFilesProperties(TStrings * FileList)
 {
   bool Result = false;
@@ -4488,6 +5917,14 @@ void __fastcall TSFTPFileSystem::Source(
     IsCapable(fcRename) &&
     !FTerminal->IsEncryptingFiles();
 
+  // Delta transfer reads and writes raw remote blocks, bypassing the encryption
+  bool Delta =
+    FTerminal->SessionData->SFTPDeltaTransfer &&
+    FLAGCLEAR(Flags, tfNewDirectory) &&
+    !OperationProgress->AsciiTransfer &&
+    IsCapable(fcCalculatingChecksum) &&
+    !FTerminal->IsEncryptingFiles();
+
   TOpenRemoteFileParams OpenParams;
   OpenParams.OverwriteMode = omOverwrite;
 
@@ -4541,6 +5978,12 @@ void __fastcall TSFTPFileSystem::Source(
           FTerminal->LogEvent(
             FORMAT(L"Existing file is owned by another user [%s], not doing resumable transfer.", (File->Owner.Name)));
         }
+        // Resumable transfer would replace the file, while delta transfer updates it in place.
+        else if (Delta)
+        {
+          ResumeAllowed = false;
+          FTerminal->LogEvent(L"Existing file will be updated using delta transfer, not doing resumable transfer.");
+        }
 
         delete File;
         File = NULL;
@@ -4602,12 +6045,14 @@ void __fastcall TSFTPFileSystem::Source(
 
   // will the transfer be resumable?
   bool DoResume = (ResumeAllowed && (OpenParams.OverwriteMode == omOverwrite));
+  Delta = Delta && !DoResume;
 
   UnicodeString RemoteFileName = DoResume ? DestPartialFullName : DestFullName;
   OpenParams.FileName = Handle.FileName;
   OpenParams.RemoteFileName = RemoteFileName;
   OpenParams.Resume = DoResume;
   OpenParams.Resuming = ResumeTransfer;
+  OpenParams.Delta = Delta;
   OpenParams.OperationProgress = OperationProgress;
   OpenParams.CopyParam = CopyParam;
   OpenParams.Params = Params;
@@ -4687,25 +6132,35 @@ void __fastcall TSFTPFileSystem::Source(
     TSFTPUploadQueue Queue(this, (Encrypt ? &Encryption : NULL));
     try
     {
-      int ConvertParams =
-        FLAGMASK(CopyParam->RemoveCtrlZ, cpRemoveCtrlZ) |
-        FLAGMASK(CopyParam->RemoveBOM, cpRemoveBOM);
-      Queue.Init(Handle.FileName, Handle.Handle, OperationProgress,
-        OpenParams.RemoteFileHandle,
-        DestWriteOffset + OperationProgress->TransferredSize,
-        ConvertParams);
-
-      while (Queue.Continue())
+      if (Delta && (OpenParams.OverwriteMode == omOverwrite))
+      {
+        FTerminal->LogEvent(L"Updating file using delta transfer.");
+        TSafeHandleStream LocalStream((THandle)Handle.Handle);
+        SFTPDeltaTransfer(true, DestFullName, OpenParams.RemoteFileHandle,
+          &LocalStream, Handle.FileName, OperationProgress);
+      }
+      else
       {
-        if (OperationProgress->Cancel)
+        int ConvertParams =
+          FLAGMASK(CopyParam->RemoveCtrlZ, cpRemoveCtrlZ) |
+          FLAGMASK(CopyParam->RemoveBOM, cpRemoveBOM);
+        Queue.Init(Handle.FileName, Handle.Handle, OperationProgress,
+          OpenParams.RemoteFileHandle,
+          DestWriteOffset + OperationProgress->TransferredSize,
+          ConvertParams);
+
+        while (Queue.Continue())
         {
-          if (OperationProgress->ClearCancelFile())
-          {
-            throw ESkipFile();
-          }
-          else
+          if (OperationProgress->Cancel)
           {
-            Abort();
+            if (OperationProgress->ClearCancelFile())
+            {
+              throw ESkipFile();
+            }
+            else
+            {
+              Abort();
+            }
           }
         }
       }
@@ -4874,7 +6329,8 @@ void __fastcall TSFTPFileSystem::Source(
 }
 //---------------------------------------------------------------------------
 RawByteString __fastcall TSFTPFileSystem::SFTPOpenRemoteFile(
-  const UnicodeString & FileName, unsigned int OpenType, bool EncryptNewFiles, __int64 Size)
+  const UnicodeString & FileName, unsigned int OpenType, bool EncryptNewFiles, __int64 Size,
+  unsigned short * Rights)
 {
   TSFTPPacket Packet(SSH_FXP_OPEN);
 
@@ -4925,7 +6381,7 @@ RawByteString __fastcall TSFTPFileSystem::SFTPOpenRemoteFile(
     // It's actually not with VShell. But VShell supports the SSH_FILEXFER_ATTR_ALLOCATION_SIZE.
     // All servers should support SSH_FILEXFER_ATTR_SIZE (SFTP < 6)
     (!FSupport->Loaded || FLAGSET(FSupport->AttributeMask, Packet.AllocationSizeAttribute(FVersion)));
-  Packet.AddProperties(NULL, NULL, NULL, NULL, NULL,
+  Packet.AddProperties(Rights, NULL, NULL, NULL, NULL,
     SendSize ? &Size : NULL, false, FVersion, FUtfStrings);
 
   SendPacketAndReceiveResponse(&Packet, &Packet, SSH_FXP_HANDLE);
@@ -4959,7 +6415,8 @@ int __fastcall TSFTPFileSystem::SFTPOpenRemote(void * AOpenParams, void * /*Para
       {
         OpenType |= SSH_FXF_EXCL;
       }
-      if (!OpenParams->Resuming && (OpenParams->OverwriteMode == omOverwrite))
+      // with delta transfer, the existing file is updated in place
+      if (!OpenParams->Resuming && !OpenParams->Delta && (OpenParams->OverwriteMode == omOverwrite))
       {
         OpenType |= SSH_FXF_TRUNC;
       }
@@ -5208,6 +6665,229 @@ void __fastcall TSFTPFileSystem::DirectorySunk(
   }
 }
 //---------------------------------------------------------------------------
+void __fastcall TSFTPFileSystem::SFTPDeltaTransfer(bool Upload, const UnicodeString & RemoteFileName,
+  const RawByteString & RemoteHandle, TStream * LocalStream, const UnicodeString & LocalFileName,
+  TFileOperationProgressType * OperationProgress)
+{
+  // The destination file is updated in place. The server calculates checksums
+  // of the remote file blocks (check-file extension), we compare them with checksums
+  // of the local file blocks, while the server is already working on the next ones,
+  // and only the differing blocks are transferred.
+  static unsigned long DeltaBlockSize = 128 * 1024;
+  static int DeltaBlocksPerRequest = 64;
+  static int DeltaChecksumQueueLen = 4;
+
+  TSFTPPacket Packet(SSH_FXP_FSTAT);
+  Packet.AddString(RemoteHandle);
+  SendCustomReadFile(&Packet, &Packet, SSH_FILEXFER_ATTR_SIZE);
+  ReceiveResponse(&Packet, &Packet, SSH_FXP_ATTRS);
+  __int64 RemoteSize;
+  {
+    // load file, avoid completion (resolving symlinks) as we do not need that
+    std::unique_ptr<TRemoteFile> RemoteFile(
+      LoadFile(&Packet, NULL, UnixExtractFileName(RemoteFileName), NULL, false));
+    RemoteSize = RemoteFile->Size;
+  }
+  __int64 LocalSize = LocalStream->Size;
+  __int64 SourceSize = (Upload ? LocalSize : RemoteSize);
+  __int64 CommonSize = std::min(RemoteSize, LocalSize);
+
+  FTerminal->LogEvent(FORMAT(L"Comparing blocks of remote file (%s bytes) and local file (%s bytes).",
+    (IntToStr(RemoteSize), IntToStr(LocalSize))));
+
+  TSFTPDeltaRanges Ranges;
+  __int64 Compared = 0;
+  try
+  {
+    TSFTPBlockChecksumQueue Queue(this);
+    try
+    {
+      // The server uses the first algorithm it supports
+      if (Queue.Init(DeltaChecksumQueueLen, RemoteFileName, L"sha256,sha1,md5",
+            CommonSize, DeltaBlockSize, DeltaBlocksPerRequest))
+      {
+        // Buffer for one block of data
+        TFileBuffer BlockBuf;
+        bool Next;
+        do
+        {
+          __int64 Offset;
+          __int64 Length;
+          Next = Queue.ReceivePacket(&Packet, Offset, Length);
+          DebugAssert(Offset == Compared);
+
+          UnicodeString Alg = Packet.GetAnsiString();
+          int HashLen = CalculateDigest(Alg, NULL, 0).Length();
+          int Blocks = static_cast<int>((Length + DeltaBlockSize - 1) / DeltaBlockSize);
+          if (Packet.RemainingLength != Blocks * HashLen)
+          {
+            throw Exception(FORMAT(L"Unexpected length of %s block checksums.", (Alg)));
+          }
+
+          for (int Block = 0; Block < Blocks; Block++)
+          {
+            __int64 BlockOffset = Offset + static_cast<__int64>(Block) * DeltaBlockSize;
+            unsigned long BlockLen =
+              static_cast<unsigned long>(std::min(Offset + Length - BlockOffset, static_cast<__int64>(DeltaBlockSize)));
+
+            FILE_OPERATION_LOOP_BEGIN
+            {
+              LocalStream->Position = BlockOffset;
+              BlockBuf.LoadStream(LocalStream, BlockLen, true);
+            }
+            FILE_OPERATION_LOOP_END(FMTLOAD(READ_ERROR, (LocalFileName)));
+
+            RawByteString LocalHash = CalculateDigest(Alg, BlockBuf.Data, BlockBuf.Size);
+            if (memcmp(LocalHash.c_str(), Packet.GetNextData(HashLen), HashLen) == 0)
+            {
+              OperationProgress->AddResumed(BlockLen);
+            }
+            else
+            {
+              AddDeltaRange(Ranges, BlockOffset, BlockLen);
+            }
+            Packet.DataConsumed(HashLen);
+          }
+          Compared = Offset + Length;
+
+          if (OperationProgress->Cancel != csContinue)
+          {
+            if (OperationProgress->ClearCancelFile())
+            {
+              throw ESkipFile();
+            }
+            else
+            {
+              Abort();
+            }
+          }
+        }
+        while (Next);
+      }
+    }
+    __finally
+    {
+      Queue.DisposeSafe();
+    }
+  }
+  catch (Exception & E)
+  {
+    if (!FTerminal->Active ||
+        E.InheritsFrom(__classid(EFatal)) ||
+        E.InheritsFrom(__classid(ESkipFile)) ||
+        E.InheritsFrom(__classid(EAbort)))
+    {
+      throw;
+    }
+    // Typically the server does not support the check-file extension or any of our algorithms
+    FTerminal->LogEvent(FORMAT(L"Cannot compare file blocks, transferring the rest of the file from offset %s.",
+      (IntToStr(Compared))));
+    FTerminal->Log->AddException(&E);
+  }
+
+  if (SourceSize > Compared)
+  {
+    AddDeltaRange(Ranges, Compared, SourceSize - Compared);
+  }
+
+  __int64 DeltaSize = 0;
+  for (size_t Index = 0; Index < Ranges.size(); Index++)
+  {
+    DeltaSize += Ranges[Index].second;
+  }
+  FTerminal->LogEvent(FORMAT(L"Transferring %s of %s bytes in %d ranges.",
+    (IntToStr(DeltaSize), IntToStr(SourceSize), int(Ranges.size()))));
+
+  TSFTPDeltaDataQueue Queue(this);
+  try
+  {
+    int QueueLen =
+      Upload ? FTerminal->SessionData->SFTPUploadQueue : FTerminal->SessionData->SFTPDownloadQueue;
+    if (Queue.Init(std::max(QueueLen, 1), Upload, RemoteHandle, LocalStream, LocalFileName, &Ranges, OperationProgress))
+    {
+      bool Next;
+      do
+      {
+        __int64 Offset;
+        unsigned long Size;
+        Next = Queue.ReceivePacket(&Packet, Offset, Size);
+
+        if (!Upload)
+        {
+          // Buffer for one block of data
+          TFileBuffer BlockBuf;
+
+          unsigned long DataLen = Packet.GetCardinal();
+          BlockBuf.Insert(0, reinterpret_cast<const char *>(Packet.GetNextData(DataLen)), DataLen);
+          while ((DataLen > 0) && (static_cast<unsigned long>(BlockBuf.Size) < Size))
+          {
+            // the server returned less data than requested, ask for the rest
+            TSFTPPacket GapPacket(SSH_FXP_READ);
+            GapPacket.AddString(RemoteHandle);
+            GapPacket.AddInt64(Offset + BlockBuf.Size);
+            GapPacket.AddCardinal(Size - BlockBuf.Size);
+            SendPacketAndReceiveResponse(&GapPacket, &GapPacket, SSH_FXP_DATA);
+            DataLen = GapPacket.GetCardinal();
+            BlockBuf.Insert(BlockBuf.Size, reinterpret_cast<const char *>(GapPacket.GetNextData(DataLen)), DataLen);
+          }
+
+          if (static_cast<unsigned long>(BlockBuf.Size) != Size)
+          {
+            FTerminal->LogEvent(FORMAT(L"Received incomplete data, offset: %s, size: %d, requested: %d",
+              (IntToStr(Offset), BlockBuf.Size, int(Size))));
+            FTerminal->TerminalError(NULL, LoadStr(SFTP_INCOMPLETE_BEFORE_EOF));
+          }
+
+          LocalStream->Position = Offset;
+          WriteLocalFile(LocalStream, BlockBuf, LocalFileName, OperationProgress);
+        }
+        OperationProgress->AddTransferred(Size);
+
+        if (OperationProgress->Cancel != csContinue)
+        {
+          if (OperationProgress->ClearCancelFile())
+          {
+            throw ESkipFile();
+          }
+          else
+          {
+            Abort();
+          }
+        }
+      }
+      while (Next);
+    }
+  }
+  __finally
+  {
+    Queue.DisposeSafe();
+  }
+
+  if (Upload && (RemoteSize > LocalSize))
+  {
+    FTerminal->LogEvent(L"Truncating remote file.");
+    // Not using AddProperties, as it sends allocation size with SFTP-6
+    TSFTPPacket SizePacket(SSH_FXP_FSETSTAT);
+    SizePacket.AddString(RemoteHandle);
+    SizePacket.AddCardinal(SSH_FILEXFER_ATTR_SIZE);
+    if (FVersion >= 4)
+    {
+      SizePacket.AddByte(SSH_FILEXFER_TYPE_REGULAR);
+    }
+    SizePacket.AddInt64(LocalSize);
+    SendPacketAndReceiveResponse(&SizePacket, &SizePacket, SSH_FXP_STATUS);
+  }
+  else if (!Upload && (LocalSize > RemoteSize))
+  {
+    FTerminal->LogEvent(L"Truncating local file.");
+    FILE_OPERATION_LOOP_BEGIN
+    {
+      LocalStream->Size = RemoteSize;
+    }
+    FILE_OPERATION_LOOP_END(FMTLOAD(WRITE_ERROR, (LocalFileName)));
+  }
+}
+//---------------------------------------------------------------------------
 void __fastcall TSFTPFileSystem::WriteLocalFile(
   TStream * FileStream, TFileBuffer & BlockBuf, const UnicodeString & LocalFileName,
   TFileOperationProgressType * OperationProgress)
@@ -5221,6 +6901,26 @@ void __fastcall TSFTPFileSystem::WriteLocalFile(
   OperationProgress->AddLocallyUsed(BlockBuf.Size);
 }
 //---------------------------------------------------------------------------
+void __fastcall TSFTPFileSystem::WriteLocalFile(
+  TStream * FileStream, const void * Data, int Len, const UnicodeString & LocalFileName,
+  TFileOperationProgressType * OperationProgress)
+{
+  FILE_OPERATION_LOOP_BEGIN
+  {
+    try
+    {
+      FileStream->WriteBuffer(Data, Len);
+    }
+    catch(EWriteError &)
+    {
+      RaiseLastOSError();
+    }
+  }
+  FILE_OPERATION_LOOP_END(FMTLOAD(WRITE_ERROR, (LocalFileName)));
+
+  OperationProgress->AddLocallyUsed(Len);
+}
+//---------------------------------------------------------------------------
 void __fastcall TSFTPFileSystem::Sink(
   const UnicodeString & FileName, const TRemoteFile * File,
   const UnicodeString & TargetDir, UnicodeString & DestFileName, int Attrs,
@@ -5234,6 +6934,21 @@ void __fastcall TSFTPFileSystem::Sink(
     CopyParam->AllowResume(OperationProgress->TransferSize) &&
     !FTerminal->IsEncryptingFiles();
 
+  // Delta transfer reads and writes raw remote blocks, bypassing the encryption
+  bool Delta =
+    FTerminal->SessionData->SFTPDeltaTransfer &&
+    (Attrs >= 0) &&
+    FLAGCLEAR(Params, cpTemporary) &&
+    !OperationProgress->AsciiTransfer &&
+    IsCapable(fcCalculatingChecksum) &&
+    !FTerminal->IsEncryptingFiles();
+  // Resumable transfer would replace the file, while delta transfer updates it in place.
+  if (Delta && ResumeAllowed)
+  {
+    ResumeAllowed = false;
+    FTerminal->LogEvent(L"Existing file will be updated using delta transfer, not doing resumable transfer.");
+  }
+
   HANDLE LocalHandle = NULL;
   TStream * FileStream = NULL;
   bool DeleteLocalFile = false;
@@ -5334,7 +7049,7 @@ void __fastcall TSFTPFileSystem::Sink(
       __int64 DestFileSize;
       __int64 MTime;
       FTerminal->OpenLocalFile(
-        DestFullName, GENERIC_WRITE, NULL, &LocalHandle, NULL, &MTime, NULL, &DestFileSize, false);
+        DestFullName, GENERIC_WRITE | FLAGMASK(Delta, GENERIC_READ), NULL, &LocalHandle, NULL, &MTime, NULL, &DestFileSize, false);
 
       FTerminal->LogEvent(L"Confirming overwriting of file.");
       TOverwriteFileParams FileParams;
@@ -5367,10 +7082,13 @@ void __fastcall TSFTPFileSystem::Sink(
         }
       }
 
+      // the handle is for the original file only
+      Delta = Delta && (OverwriteMode == omOverwrite) && (LocalHandle != NULL) && (PrevDestFileName == DestFileName);
+
       if (OverwriteMode == omOverwrite)
       {
         // is NULL when overwriting read-only file
-        if (LocalHandle)
+        if (LocalHandle && !Delta)
         {
           CloseHandle(LocalHandle);
           LocalHandle = NULL;
@@ -5416,6 +7134,14 @@ void __fastcall TSFTPFileSystem::Sink(
 
     FileStream = new TSafeHandleStream((THandle)LocalHandle);
 
+    if (Delta)
+    {
+      FTerminal->LogEvent(L"Updating file using delta transfer.");
+      SFTPDeltaTransfer(false, FileName, RemoteHandle, FileStream, LocalFileName, OperationProgress);
+      SFTPCloseRemote(RemoteHandle, DestFileName, OperationProgress, true, true, NULL);
+      RemoteHandle = L""; // do not close file again in __finally block
+    }
+    else
     // at end of this block queue is discarded
     {
       TSFTPDownloadQueue Queue(this);
@@ -5515,7 +7241,14 @@ void __fastcall TSFTPFileSystem::Sink(
             }
 
             DebugAssert(DataLen <= BlockSize);
-            BlockBuf.Insert(0, reinterpret_cast<const char *>(DataPacket.GetNextData(DataLen)), DataLen);
+            const unsigned char * Data = DataPacket.GetNextData(DataLen);
+            // Data that need no conversion are written straight from the packet,
+            // without going through the block buffer
+            bool Direct = !OperationProgress->AsciiTransfer && !Decrypt;
+            if (!Direct)
+            {
+              BlockBuf.Insert(0, reinterpret_cast<const char *>(Data), DataLen);
+            }
             DataPacket.DataConsumed(DataLen);
             OperationProgress->AddTransferred(DataLen);
 
@@ -5524,21 +7257,28 @@ void __fastcall TSFTPFileSystem::Sink(
               Eof = DataPacket.GetBool();
             }
 
-            if (OperationProgress->AsciiTransfer)
+            if (Direct)
             {
-              DebugAssert(!ResumeTransfer && !ResumeAllowed);
-
-              unsigned int PrevBlockSize = BlockBuf.Size;
-              BlockBuf.Convert(GetEOL(), FTerminal->Configuration->LocalEOLType, 0, ConvertToken);
-              OperationProgress->SetLocalSize(OperationProgress->LocalSize - PrevBlockSize + BlockBuf.Size);
+              WriteLocalFile(FileStream, Data, DataLen, LocalFileName, OperationProgress);
             }
-
-            if (Decrypt)
+            else
             {
-              Encryption.Decrypt(BlockBuf);
-            }
+              if (OperationProgress->AsciiTransfer)
+              {
+                DebugAssert(!ResumeTransfer && !ResumeAllowed);
 
-            WriteLocalFile(FileStream, BlockBuf, LocalFileName, OperationProgress);
+                unsigned int PrevBlockSize = BlockBuf.Size;
+                BlockBuf.Convert(GetEOL(), FTerminal->Configuration->LocalEOLType, 0, ConvertToken);
+                OperationProgress->SetLocalSize(OperationProgress->LocalSize - PrevBlockSize + BlockBuf.Size);
+              }
+
+              if (Decrypt)
+              {
+                Encryption.Decrypt(BlockBuf);
+              }
+
+              WriteLocalFile(FileStream, BlockBuf, LocalFileName, OperationProgress);
+            }
           }
 
           if (OperationProgress->Cancel != csContinue)
@@ -5660,7 +7400,8 @@ void __fastcall TSFTPFileSystem::UpdateFromMain(TCustomFileSystem * /*MainFileSy
 //---------------------------------------------------------------------------
 void __fastcall TSFTPFileSystem::ClearCaches()
 {
-  // noop
+  FUsersByID->Clear();
+  FGroupsByID->Clear();
 }
 //---------------------------------------------------------------------------
 void TSFTPFileSystem::AddPathString(TSFTPPacket & Packet, const UnicodeString & Value, bool EncryptNewFiles)
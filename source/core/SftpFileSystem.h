@@ -9,6 +9,7 @@ class TOverwriteFileParams;
 struct TSFTPSupport;
 class TSecureShell;
 class TEncryption;
+class TRemoteTokenList;
 //---------------------------------------------------------------------------
 enum TSFTPOverwriteMode { omOverwrite, omAppend, omResume };
 extern const int SFTPMaxVersion;
@@ -22,6 +23,12 @@ friend class TSFTPUploadQueue;
 friend class TSFTPDownloadQueue;
 friend class TSFTPLoadFilesPropertiesQueue;
 friend class TSFTPCalculateFilesChecksumQueue;
+friend class TSFTPResolveSymlinksQueue;
+friend class TSFTPReadDirectoryTreeQueue;
+friend class TSFTPChangeFilesQueue;
+friend class TSFTPBlockChecksumQueue;
+friend class TSFTPDeltaDataQueue;
+friend class TSFTPCopyDataQueue;
 friend class TSFTPBusy;
 public:
   __fastcall TSFTPFileSystem(TTerminal * ATerminal, TSecureShell * SecureShell);
@@ -42,6 +49,9 @@ public:
     const TRemoteFile * File, const TRemoteProperties * Properties,
     TChmodSessionAction & Action);
   virtual bool __fastcall LoadFilesProperties(TStrings * FileList);
+  virtual void __fastcall ChangeFilesProperties(TStrings * FileList,
+    const TRemoteProperties * Properties, TStrings * FailedFiles);
+  virtual void __fastcall DeleteFiles(TStrings * FileList, TStrings * FailedFiles);
   virtual void __fastcall CalculateFilesChecksum(const UnicodeString & Alg,
     TStrings * FileList, TStrings * Checksums,
     TCalculatedChecksumEvent OnCalculatedChecksum);
@@ -78,6 +88,7 @@ public:
   virtual void __fastcall LookupUsersGroups();
   virtual void __fastcall ReadCurrentDirectory();
   virtual void __fastcall ReadDirectory(TRemoteFileList * FileList);
+  virtual bool __fastcall ReadDirectoryTree(const UnicodeString & Directory, TObjectList * FileLists);
   virtual void __fastcall ReadFile(const UnicodeString FileName,
     TRemoteFile *& File);
   virtual void __fastcall ReadSymlink(TRemoteFile * SymlinkFile,
@@ -125,8 +136,17 @@ protected:
   unsigned long FMaxPacketSize;
   bool FSupportsStatVfsV2;
   bool FSupportsHardlink;
+  bool FSupportsLimits;
+  bool FSupportsCopyData;
+  bool FSupportsUsersGroupsByID;
+  unsigned long FLimitMaxPacketLength;
+  unsigned long FLimitMaxReadLength;
+  unsigned long FLimitMaxWriteLength;
+  unsigned long FLimitMaxOpenHandles;
   std::unique_ptr<TStringList> FChecksumAlgs;
   std::unique_ptr<TStringList> FChecksumSftpAlgs;
+  std::unique_ptr<TRemoteTokenList> FUsersByID;
+  std::unique_ptr<TRemoteTokenList> FGroupsByID;
 
   void __fastcall SendCustomReadFile(TSFTPPacket * Packet, TSFTPPacket * Response,
     unsigned long Flags);
@@ -141,6 +161,9 @@ protected:
     TRemoteFileList * TempFileList = NULL, bool Complete = true);
   void __fastcall LoadFile(TRemoteFile * File, TSFTPPacket * Packet,
     bool Complete = true);
+  void __fastcall ResolveSymlinks(TStrings * Symlinks, int Total);
+  void __fastcall ChangeFiles(TStrings * FileList,
+    const TRemoteProperties * Properties, TStrings * FailedFiles);
   UnicodeString __fastcall LocalCanonify(const UnicodeString & Path);
   UnicodeString __fastcall Canonify(UnicodeString Path);
   UnicodeString __fastcall RealPath(const UnicodeString Path);
@@ -173,11 +196,15 @@ protected:
     TFileOperationProgressType * OperationProgress, unsigned int Flags,
     TUploadSessionAction & Action, bool & ChildError);
   RawByteString __fastcall SFTPOpenRemoteFile(const UnicodeString & FileName,
-    unsigned int OpenType, bool EncryptNewFiles = false, __int64 Size = -1);
+    unsigned int OpenType, bool EncryptNewFiles = false, __int64 Size = -1,
+    unsigned short * Rights = NULL);
   int __fastcall SFTPOpenRemote(void * AOpenParams, void * Param2);
   void __fastcall SFTPCloseRemote(const RawByteString Handle,
     const UnicodeString FileName, TFileOperationProgressType * OperationProgress,
     bool TransferFinished, bool Request, TSFTPPacket * Packet);
+  void __fastcall SFTPDeltaTransfer(bool Upload, const UnicodeString & RemoteFileName,
+    const RawByteString & RemoteHandle, TStream * LocalStream, const UnicodeString & LocalFileName,
+    TFileOperationProgressType * OperationProgress);
   void __fastcall SFTPConfirmOverwrite(const UnicodeString & FullFileName, UnicodeString & FileName,
     const TCopyParamType * CopyParam, int Params, TFileOperationProgressType * OperationProgress,
     TSFTPOverwriteMode & Mode, const TOverwriteFileParams * FileParams);
@@ -198,7 +225,15 @@ protected:
   void __fastcall WriteLocalFile(
     TStream * FileStream, TFileBuffer & BlockBuf, const UnicodeString & LocalFileName,
     TFileOperationProgressType * OperationProgress);
+  void __fastcall WriteLocalFile(
+    TStream * FileStream, const void * Data, int Len, const UnicodeString & LocalFileName,
+    TFileOperationProgressType * OperationProgress);
   bool __fastcall DoesFileLookLikeSymLink(TRemoteFile * File);
+  void __fastcall ReadLimits();
+  void __fastcall ResolveUsersGroups(const std::vector<TRemoteFileList *> & FileLists);
+  void __fastcall SetCopiedFileProperties(const UnicodeString & NewName, const TRemoteFile * File, unsigned short * Rights);
+  void __fastcall CopyData(const UnicodeString & FileName, const TRemoteFile * File,
+    const UnicodeString & NewName);
 };
 //---------------------------------------------------------------------------
 #endif // SftpFileSystemH
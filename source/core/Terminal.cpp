@@ -8,6 +8,7 @@
 #include <FileCtrl.hpp>
 #include <StrUtils.hpp>
 #include <System.IOUtils.hpp>
+#include <algorithm>
 
 #include "Common.h"
 #include "PuttyTools.h"
@@ -592,13 +593,14 @@ TCollectedFileList::TCollectedFileList()
 {
 }
 //---------------------------------------------------------------------------
-int TCollectedFileList::Add(const UnicodeString & FileName, TObject * Object, bool Dir)
+int TCollectedFileList::Add(const UnicodeString & FileName, TObject * Object, bool Dir, __int64 Size)
 {
   TFileData Data;
   Data.FileName = FileName;
   Data.Object = Object;
   Data.Dir = Dir;
   Data.Recursed = true;
+  Data.Size = Size;
   FList.push_back(Data);
   return Count() - 1;
 }
@@ -638,6 +640,48 @@ bool TCollectedFileList::IsRecursed(int Index) const
   return FList[Index].Recursed;
 }
 //---------------------------------------------------------------------------
+__int64 TCollectedFileList::GetSize(int Index) const
+{
+  return FList[Index].Size;
+}
+//---------------------------------------------------------------------------
+void TCollectedFileList::SortForParallelTransfer(__int64 LargeFileSize)
+{
+  // Directories go first, in the original order, so that parents are still created before their contents.
+  // Then large files, the largest first, so that no connection ends up alone with a large file at the end.
+  // Small files last, in the original order, so that files of the same directory can be batched.
+  TFileDataList Directories, LargeFiles, SmallFiles;
+  for (TFileDataList::const_iterator I = FList.begin(); I != FList.end(); ++I)
+  {
+    if (I->Dir)
+    {
+      Directories.push_back(*I);
+    }
+    else if (I->Size >= LargeFileSize)
+    {
+      LargeFiles.push_back(*I);
+    }
+    else
+    {
+      SmallFiles.push_back(*I);
+    }
+  }
+  std::stable_sort(LargeFiles.begin(), LargeFiles.end(), LargerFileData);
+  FList.swap(Directories);
+  FList.insert(FList.end(), LargeFiles.begin(), LargeFiles.end());
+  FList.insert(FList.end(), SmallFiles.begin(), SmallFiles.end());
+}
+//---------------------------------------------------------------------------
+bool TCollectedFileList::LargerFileData(const TFileData & Data1, const TFileData & Data2)
+{
+  return (Data1.Size > Data2.Size);
+}
+//---------------------------------------------------------------------------
+//---------------------------------------------------------------------------
+// Files smaller than this are handed to connections in batches of files from the same directory,
+// larger files are handed out one by one, the largest first.
+static const __int64 ParallelLargeFileSize = 1024 * 1024;
+static const int ParallelBatchMaxFiles = 16;
 //---------------------------------------------------------------------------
 TParallelOperation::TParallelOperation(TOperationSide Side)
 {
@@ -666,6 +710,11 @@ void TParallelOperation::Init(
   FMainOperationProgress = MainOperationProgress;
   FMainName = MainName;
   FIndex = 0;
+  for (int Index = 0; Index < FFileList->Count; Index++)
+  {
+    TCollectedFileList * Files = DebugNotNull(dynamic_cast<TCollectedFileList *>(FFileList->Objects[Index]));
+    Files->SortForParallelTransfer(ParallelLargeFileSize);
+  }
 }
 //---------------------------------------------------------------------------
 TParallelOperation::~TParallelOperation()
@@ -796,6 +845,36 @@ void TParallelOperation::Done(const UnicodeString & FileName, bool Dir, bool Suc
   }
 }
 //---------------------------------------------------------------------------
+void TParallelOperation::AddBusyTime(TTerminal * Terminal, unsigned int Ticks)
+{
+  TGuard Guard(FSection.get());
+  TClientsStatistics::iterator StatisticsIterator = FClientsStatistics.find(Terminal);
+  if (DebugAlwaysTrue(StatisticsIterator != FClientsStatistics.end()))
+  {
+    StatisticsIterator->second.Busy += Ticks;
+  }
+}
+//---------------------------------------------------------------------------
+UnicodeString TParallelOperation::GetClientStatistics(TTerminal * Terminal)
+{
+  UnicodeString Result;
+  if (FSection.get() != NULL)
+  {
+    TGuard Guard(FSection.get());
+    TClientsStatistics::const_iterator StatisticsIterator = FClientsStatistics.find(Terminal);
+    if (StatisticsIterator != FClientsStatistics.end())
+    {
+      const TClientStatistics & Statistics = StatisticsIterator->second;
+      unsigned int Elapsed = std::max(GetTickCount() - Statistics.Started, 1ul);
+      int Utilization = static_cast<int>((static_cast<__int64>(std::min(Statistics.Busy, Elapsed)) * 100) / Elapsed);
+      Result =
+        FORMAT(L"%d files, %s, busy %d%% of %d s",
+          (Statistics.Files, FormatSize(Statistics.Size), Utilization, static_cast<int>(Elapsed / MSecsPerSec)));
+    }
+  }
+  return Result;
+}
+//---------------------------------------------------------------------------
 bool TParallelOperation::CheckEnd(TCollectedFileList * Files)
 {
   bool Result = (FIndex >= Files->Count());
@@ -807,7 +886,8 @@ bool TParallelOperation::CheckEnd(TCollectedFileList * Files)
   return Result;
 }
 //---------------------------------------------------------------------------
-int TParallelOperation::GetNext(TTerminal * Terminal, UnicodeString & FileName, TObject *& Object, UnicodeString & TargetDir, bool & Dir, bool & Recursed)
+int TParallelOperation::GetNext(
+  TTerminal * Terminal, TStrings * FilesToCopy, UnicodeString & TargetDir, bool & Dir, bool & Recursed)
 {
   TGuard Guard(FSection.get());
   int Result = 1;
@@ -835,8 +915,8 @@ int TParallelOperation::GetNext(TTerminal * Terminal, UnicodeString & FileName,
   {
     UnicodeString RootPath = FFileList->Strings[0];
 
-    FileName = Files->GetFileName(FIndex);
-    Object = Files->GetObject(FIndex);
+    UnicodeString FileName = Files->GetFileName(FIndex);
+    TObject * Object = Files->GetObject(FIndex);
     Dir = Files->IsDir(FIndex);
     Recursed = Files->IsRecursed(FIndex);
     UnicodeString DirPath;
@@ -904,7 +984,45 @@ int TParallelOperation::GetNext(TTerminal * Terminal, UnicodeString & FileName,
         FDirectories.insert(std::make_pair(FileName, DirectoryData));
       }
 
+      FilesToCopy->AddObject(FileName, Object);
+      __int64 Size = Files->GetSize(FIndex);
       FIndex++;
+
+      // Small files of the same directory are given out together, to save the per-call overhead
+      if (!Dir && (Size < ParallelLargeFileSize))
+      {
+        __int64 BatchSize = Size;
+        while ((FIndex < Files->Count()) &&
+               (FilesToCopy->Count < ParallelBatchMaxFiles) &&
+               !Files->IsDir(FIndex) &&
+               (BatchSize + Files->GetSize(FIndex) < ParallelLargeFileSize))
+        {
+          UnicodeString NextFileName = Files->GetFileName(FIndex);
+          UnicodeString NextDirPath = (FSide == osLocal) ? ExtractFileDir(NextFileName) : UnixExtractFileDir(NextFileName);
+          if (NextDirPath != DirPath)
+          {
+            break;
+          }
+          FilesToCopy->AddObject(NextFileName, Files->GetObject(FIndex));
+          BatchSize += Files->GetSize(FIndex);
+          FIndex++;
+        }
+        Size = BatchSize;
+      }
+
+      TClientsStatistics::iterator StatisticsIterator = FClientsStatistics.find(Terminal);
+      if (StatisticsIterator == FClientsStatistics.end())
+      {
+        TClientStatistics Statistics;
+        Statistics.Files = 0;
+        Statistics.Size = 0;
+        Statistics.Started = GetTickCount();
+        Statistics.Busy = 0;
+        StatisticsIterator = FClientsStatistics.insert(std::make_pair(Terminal, Statistics)).first;
+      }
+      StatisticsIterator->second.Files += FilesToCopy->Count;
+      StatisticsIterator->second.Size += Size;
+
       CheckEnd(Files);
     }
   }
@@ -951,6 +1069,9 @@ __fastcall TTerminal::TTerminal(TSessionData * SessionData,
   FUseBusyCursor = True;
   FLockDirectory = L"";
   FDirectoryCache = new TRemoteDirectoryCache();
+  FPersistDirectoryCache = true;
+  FPrefetchDirectoryTree = false;
+  FPrefetchedDirectories = NULL;
   FDirectoryChangesCache = NULL;
   FFSProtocol = cfsUnknown;
   FCommandSession = NULL;
@@ -992,12 +1113,26 @@ __fastcall TTerminal::~TTerminal()
       FDirectoryChangesCache);
   }
 
+  if (FPersistDirectoryCache && SessionData->CacheDirectories && SessionData->PreserveDirectoryCache &&
+      !FDirectoryCache->IsEmpty)
+  {
+    try
+    {
+      Configuration->SaveDirectoryCache(SessionData->SessionKey, FDirectoryCache);
+    }
+    catch (Exception & E)
+    {
+      Log->AddException(&E);
+    }
+  }
+
   SAFE_DESTROY_EX(TCustomFileSystem, FFileSystem);
   SAFE_DESTROY_EX(TSessionLog, FLog);
   SAFE_DESTROY_EX(TActionLog, FActionLog);
   delete FFiles;
   delete FDirectoryCache;
   delete FDirectoryChangesCache;
+  DebugAssert(FPrefetchedDirectories == NULL);
   SAFE_DESTROY(FSessionData);
 }
 //---------------------------------------------------------------------------
@@ -1303,6 +1438,24 @@ void __fastcall TTerminal::Open()
           }
         }
 
+        if (FPersistDirectoryCache && SessionData->CacheDirectories && SessionData->PreserveDirectoryCache)
+        {
+          TDateTime MinTimestamp = Now() - TDateTime(double(SessionData->PreserveDirectoryCacheMaxAge) / HoursPerDay);
+          try
+          {
+            Configuration->LoadDirectoryCache(SessionData->SessionKey, FDirectoryCache, this, MinTimestamp);
+            if (!FDirectoryCache->IsEmpty)
+            {
+              LogEvent(L"Restored directory cache from previous session.");
+            }
+          }
+          catch (Exception & E)
+          {
+            // The cache is only a hint, a damaged file should not prevent connecting
+            Log->AddException(&E);
+          }
+        }
+
         DoStartup();
 
         if (FCollectFileSystemUsage)
@@ -1882,6 +2035,8 @@ void __fastcall TTerminal::DoProgress(TFileOperationProgressType & ProgressData)
     }
   }
 
+  FActionLog->AddProgress(ProgressData);
+
   if (ProgressData.TransferredSize > 0)
   {
     FFileTransferAny = true;
@@ -2296,6 +2451,7 @@ TRemoteFileList * __fastcall TTerminal::DirectoryFileList(const UnicodeString Pa
   }
   else
   {
+    RevalidateRestoredFileList(Path);
     if (FDirectoryCache->HasNewerFileList(Path, Timestamp))
     {
       Result = new TRemoteFileList();
@@ -3215,6 +3371,11 @@ void __fastcall TTerminal::ReadDirectory(bool ReloadOnly, bool ForceCache)
 {
   bool LoadedFromCache = false;
 
+  if (SessionData->CacheDirectories)
+  {
+    RevalidateRestoredFileList(CurrentDirectory);
+  }
+
   if (SessionData->CacheDirectories && FDirectoryCache->HasFileList(CurrentDirectory))
   {
     if (ReloadOnly && !ForceCache)
@@ -3491,12 +3652,47 @@ TRemoteFileList * __fastcall TTerminal::CustomReadDirectoryListing(UnicodeString
   return FileList;
 }
 //---------------------------------------------------------------------------
+void __fastcall TTerminal::RevalidateRestoredFileList(const UnicodeString & Directory)
+{
+  // A listing restored from a previous session is served only once the directory
+  // is confirmed not to have changed since. Its modification time changes
+  // whenever an entry is added, removed or renamed.
+  TDateTime Modification;
+  TModificationFmt ModificationFmt;
+  if (FDirectoryCache->GetRestoredDirectoryModification(Directory, Modification, ModificationFmt))
+  {
+    bool Valid = false;
+    TRemoteFile * File = NULL;
+    if ((ModificationFmt != mfNone) && FileExists(Directory, &File))
+    {
+      Valid =
+        File->IsDirectory && !File->IsSymLink &&
+        (File->ModificationFmt == ModificationFmt) && (File->Modification == Modification);
+      delete File;
+    }
+
+    if (Valid)
+    {
+      FDirectoryCache->ConfirmRestored(Directory);
+    }
+    else
+    {
+      LogEvent(FORMAT(L"Directory \"%s\" may have changed since its listing was cached, discarding.", (Directory)));
+      FDirectoryCache->ClearFileList(Directory, false);
+    }
+  }
+}
+//---------------------------------------------------------------------------
 TRemoteFileList * __fastcall TTerminal::DoReadDirectoryListing(UnicodeString Directory, bool UseCache)
 {
   TRemoteFileList * FileList = new TRemoteFileList();
   try
   {
     bool Cache = UseCache && SessionData->CacheDirectories;
+    if (Cache)
+    {
+      RevalidateRestoredFileList(Directory);
+    }
     bool LoadedFromCache = Cache && FDirectoryCache->HasFileList(Directory);
     if (LoadedFromCache)
     {
@@ -3531,6 +3727,75 @@ TRemoteFileList * __fastcall TTerminal::DoReadDirectoryListing(UnicodeString Dir
   return FileList;
 }
 //---------------------------------------------------------------------------
+bool __fastcall TTerminal::DoReadDirectoryTree(const UnicodeString & Directory, TObjectList * FileLists)
+{
+  bool Result;
+  try
+  {
+    LogEvent(FORMAT(L"Reading directory tree \"%s\".", (Directory)));
+    Result = FFileSystem->ReadDirectoryTree(Directory, FileLists);
+  }
+  catch (Exception & E)
+  {
+    if (!Active)
+    {
+      throw;
+    }
+    LogEvent(FORMAT(L"Reading directory tree failed, will read directories one by one: %s", (E.Message)));
+    FileLists->Clear();
+    Result = false;
+  }
+  return Result;
+}
+//---------------------------------------------------------------------------
+void __fastcall TTerminal::PrefetchDirectoryTree(const UnicodeString & Directory)
+{
+  // Listings of the subtree of a recursive operation,
+  // each is handed over to ProcessDirectory once and then discarded.
+  // The list is created even if the file system cannot read the tree,
+  // so that the subdirectories do not try again.
+  DebugAssert(FPrefetchedDirectories == NULL);
+  FPrefetchedDirectories = new TStringList();
+  FPrefetchedDirectories->OwnsObjects = true;
+  FPrefetchedDirectories->Sorted = true;
+  FPrefetchedDirectories->CaseSensitive = true;
+
+  std::unique_ptr<TObjectList> FileLists(new TObjectList());
+  if (DoReadDirectoryTree(Directory, FileLists.get()))
+  {
+    while (FileLists->Count > 0)
+    {
+      TRemoteFileList * FileList = static_cast<TRemoteFileList *>(FileLists->Extract(FileLists->First()));
+      UnicodeString Path = UnixExcludeTrailingBackslash(AbsolutePath(FileList->Directory, true));
+      if (FPrefetchedDirectories->IndexOf(Path) >= 0)
+      {
+        delete FileList;
+      }
+      else
+      {
+        FPrefetchedDirectories->AddObject(Path, FileList);
+      }
+    }
+  }
+}
+//---------------------------------------------------------------------------
+TRemoteFileList * __fastcall TTerminal::ExtractPrefetchedFileList(const UnicodeString & Directory)
+{
+  TRemoteFileList * Result = NULL;
+  if ((FPrefetchedDirectories != NULL) && (FPrefetchedDirectories->Count > 0))
+  {
+    int Index = FPrefetchedDirectories->IndexOf(UnixExcludeTrailingBackslash(AbsolutePath(Directory, true)));
+    if (Index >= 0)
+    {
+      Result = static_cast<TRemoteFileList *>(FPrefetchedDirectories->Objects[Index]);
+      FPrefetchedDirectories->OwnsObjects = false;
+      FPrefetchedDirectories->Delete(Index);
+      FPrefetchedDirectories->OwnsObjects = true;
+    }
+  }
+  return Result;
+}
+//---------------------------------------------------------------------------
 bool __fastcall TTerminal::DeleteContentsIfDirectory(
   const UnicodeString & FileName, const TRemoteFile * File, int Params, TRmSessionAction & Action)
 {
@@ -3540,7 +3805,14 @@ bool __fastcall TTerminal::DeleteContentsIfDirectory(
   {
     try
     {
-      ProcessDirectory(FileName, DeleteFile, &Params);
+      if (IsCapable[fcPipelinedChanges] && !RecycleOnDelete(Params))
+      {
+        DeleteDirectoryContents(FileName, Params);
+      }
+      else
+      {
+        ProcessDirectory(FileName, DeleteFile, &Params);
+      }
     }
     catch(...)
     {
@@ -3551,59 +3823,159 @@ bool __fastcall TTerminal::DeleteContentsIfDirectory(
   return Dir && !File->IsSymLink;
 }
 //---------------------------------------------------------------------------
-void __fastcall TTerminal::ProcessDirectory(const UnicodeString DirName,
-  TProcessFileEvent CallBackFunc, void * Param, bool UseCache, bool IgnoreErrors)
+struct TBatchChangeParams
 {
-  TRemoteFileList * FileList = NULL;
-  if (IgnoreErrors)
-  {
-    ExceptionOnFail = true;
-    try
-    {
-      try
-      {
-        FileList = CustomReadDirectoryListing(DirName, UseCache);
+  TStringList * Files;
+  int Params;
+  const TRemoteProperties * Properties;
+};
+//---------------------------------------------------------------------------
+void __fastcall TTerminal::DeleteDirectoryContents(const UnicodeString & DirName, int Params)
+{
+  // Files and emptied subdirectories are collected and then removed all at once,
+  // still before the directory itself is removed by the caller.
+  std::unique_ptr<TStringList> Files(new TStringList());
+  Files->OwnsObjects = true;
+  TBatchChangeParams BatchParams;
+  BatchParams.Files = Files.get();
+  BatchParams.Params = Params;
+  BatchParams.Properties = NULL;
+  ProcessDirectory(DirName, CollectFileToDelete, &BatchParams);
+
+  if (Files->Count > 0)
+  {
+    std::unique_ptr<TStringList> FailedFiles(new TStringList());
+    FFileSystem->DeleteFiles(Files.get(), FailedFiles.get());
+
+    // Failed files are in the same order as in the batch
+    bool Cancelled = false;
+    int FailedIndex = 0;
+    for (int Index = 0; Index < Files->Count; Index++)
+    {
+      UnicodeString FileName = Files->Strings[Index];
+      TRemoteFile * File = static_cast<TRemoteFile *>(Files->Objects[Index]);
+      if ((FailedIndex < FailedFiles->Count) && (FailedFiles->Objects[FailedIndex] == File))
+      {
+        FailedIndex++;
+        Cancelled = (OperationProgress != NULL) && (OperationProgress->Cancel != csContinue);
+        // Once again individually, to report the error the usual way, unless cancelled.
+        // The contents of the failed directories were processed already.
+        if (!Cancelled)
+        {
+          StartOperationWithFile(FileName, foDelete);
+          DoDeleteFile(FileName, File, Params | dfNoRecursive);
+          FEncryptedFileNames.erase(AbsolutePath(FileName, true));
+        }
       }
-      catch(...)
+      else
       {
-        if (!Active)
+        if ((OperationProgress != NULL) && (OperationProgress->Operation == foDelete))
         {
-          throw;
+          OperationProgress->Succeeded();
         }
+        FEncryptedFileNames.erase(AbsolutePath(FileName, true));
       }
     }
-    __finally
+    ReactOnCommand(fsDeleteFile);
+
+    if (Cancelled)
     {
-      ExceptionOnFail = false;
+      Abort();
     }
   }
-  else
+}
+//---------------------------------------------------------------------------
+void __fastcall TTerminal::CollectFileToDelete(UnicodeString FileName,
+  const TRemoteFile * File, void * Param)
+{
+  TBatchChangeParams * BatchParams = static_cast<TBatchChangeParams *>(Param);
+  StartOperationWithFile(FileName, foDelete);
+  // see DeleteContentsIfDirectory
+  if (File->IsDirectory && CanRecurseToDirectory(File))
+  {
+    DeleteDirectoryContents(FileName, BatchParams->Params);
+  }
+  LogEvent(FORMAT(L"Deleting file \"%s\".", (FileName)));
+  FileModified(File, FileName, true);
+  // the listing is released before the batch is processed
+  BatchParams->Files->AddObject(FileName, File->Duplicate());
+}
+//---------------------------------------------------------------------------
+void __fastcall TTerminal::ProcessDirectory(const UnicodeString DirName,
+  TProcessFileEvent CallBackFunc, void * Param, bool UseCache, bool IgnoreErrors)
+{
+  // The top-level directory of a recursive operation reads its whole subtree upfront,
+  // if the file system can do that faster than directory by directory.
+  bool PrefetchRoot = FPrefetchDirectoryTree && (FPrefetchedDirectories == NULL);
+  if (PrefetchRoot)
   {
-    FileList = CustomReadDirectoryListing(DirName, UseCache);
+    PrefetchDirectoryTree(DirName);
   }
 
-  // skip if directory listing fails and user selects "skip"
-  if (FileList)
+  try
   {
-    try
+    TRemoteFileList * FileList = ExtractPrefetchedFileList(DirName);
+    if (FileList != NULL)
     {
-      UnicodeString Directory = UnixIncludeTrailingBackslash(DirName);
+      // listed along with the top-level directory
+    }
+    else if (IgnoreErrors)
+    {
+      ExceptionOnFail = true;
+      try
+      {
+        try
+        {
+          FileList = CustomReadDirectoryListing(DirName, UseCache);
+        }
+        catch(...)
+        {
+          if (!Active)
+          {
+            throw;
+          }
+        }
+      }
+      __finally
+      {
+        ExceptionOnFail = false;
+      }
+    }
+    else
+    {
+      FileList = CustomReadDirectoryListing(DirName, UseCache);
+    }
 
-      TRemoteFile * File;
-      for (int Index = 0; Index < FileList->Count; Index++)
+    // skip if directory listing fails and user selects "skip"
+    if (FileList)
+    {
+      try
       {
-        File = FileList->Files[Index];
-        if (IsRealFile(File->FileName))
+        UnicodeString Directory = UnixIncludeTrailingBackslash(DirName);
+
+        TRemoteFile * File;
+        for (int Index = 0; Index < FileList->Count; Index++)
         {
-          CallBackFunc(Directory + File->FileName, File, Param);
-          // We should catch ESkipFile here as we do in ProcessFiles.
-          // Now we have to handle ESkipFile in every callback implementation.
+          File = FileList->Files[Index];
+          if (IsRealFile(File->FileName))
+          {
+            CallBackFunc(Directory + File->FileName, File, Param);
+            // We should catch ESkipFile here as we do in ProcessFiles.
+            // Now we have to handle ESkipFile in every callback implementation.
+          }
         }
       }
+      __finally
+      {
+        delete FileList;
+      }
     }
-    __finally
+  }
+  __finally
+  {
+    if (PrefetchRoot)
     {
-      delete FileList;
+      SAFE_DESTROY(FPrefetchedDirectories);
     }
   }
 }
@@ -3723,6 +4095,7 @@ void __fastcall TTerminal::OperationStart(
     Progress.Restore(*FOperationProgressPersistence);
   }
   Progress.Start(Operation, Side, Count, Temp, Directory, CPSLimit, OnceDoneOperation);
+  Progress.SetBandwidthHost(SessionData->HostNameExpanded);
   DebugAssert(FOperationProgress == NULL);
   FOperationProgress = &Progress;
 }
@@ -3970,11 +4343,7 @@ void __fastcall TTerminal::DeleteFile(UnicodeString FileName,
   }
   StartOperationWithFile(FileName, foDelete);
   int Params = (AParams != NULL) ? *((int*)AParams) : 0;
-  bool Recycle =
-    FLAGCLEAR(Params, dfForceDelete) &&
-    (SessionData->DeleteToRecycleBin != FLAGSET(Params, dfAlternative)) &&
-    !SessionData->RecycleBinPath.IsEmpty();
-  if (Recycle && !IsRecycledFile(FileName))
+  if (RecycleOnDelete(Params) && !IsRecycledFile(FileName))
   {
     RecycleFile(FileName, File);
   }
@@ -3989,6 +4358,14 @@ void __fastcall TTerminal::DeleteFile(UnicodeString FileName,
   }
 }
 //---------------------------------------------------------------------------
+bool __fastcall TTerminal::RecycleOnDelete(int Params)
+{
+  return
+    FLAGCLEAR(Params, dfForceDelete) &&
+    (SessionData->DeleteToRecycleBin != FLAGSET(Params, dfAlternative)) &&
+    !SessionData->RecycleBinPath.IsEmpty();
+}
+//---------------------------------------------------------------------------
 void __fastcall TTerminal::DoDeleteFile(const UnicodeString FileName,
   const TRemoteFile * File, int Params)
 {
@@ -4018,6 +4395,8 @@ bool __fastcall TTerminal::DeleteFiles(TStrings * FilesToDelete, int Params)
 {
   TValueRestorer<bool> UseBusyCursorRestorer(FUseBusyCursor);
   FUseBusyCursor = false;
+  TValueRestorer<bool> PrefetchDirectoryTreeRestorer(FPrefetchDirectoryTree);
+  FPrefetchDirectoryTree = FLAGCLEAR(Params, dfNoRecursive);
 
   // TODO: avoid resolving symlinks while reading subdirectories.
   // Resolving does not work anyway for relative symlinks in subdirectories
@@ -4176,38 +4555,115 @@ void __fastcall TTerminal::ChangeFileProperties(UnicodeString FileName,
     FileName = File->FileName;
   }
   StartOperationWithFile(FileName, foSetProperties);
+  LogChangeFileProperties(FileName, RProperties);
+  FileModified(File, FileName);
+  DoChangeFileProperties(FileName, File, RProperties);
+  ReactOnCommand(fsChangeProperties);
+}
+//---------------------------------------------------------------------------
+void __fastcall TTerminal::LogChangeFileProperties(const UnicodeString & FileName, const TRemoteProperties * Properties)
+{
   if (Log->Logging)
   {
     LogEvent(FORMAT(L"Changing properties of \"%s\" (%s)",
-      (FileName, BooleanToEngStr(RProperties->Recursive))));
-    if (RProperties->Valid.Contains(vpRights))
+      (FileName, BooleanToEngStr(Properties->Recursive))));
+    if (Properties->Valid.Contains(vpRights))
     {
-      LogEvent(FORMAT(L" - mode: \"%s\"", (RProperties->Rights.ModeStr)));
+      LogEvent(FORMAT(L" - mode: \"%s\"", (Properties->Rights.ModeStr)));
     }
-    if (RProperties->Valid.Contains(vpGroup))
+    if (Properties->Valid.Contains(vpGroup))
     {
-      LogEvent(FORMAT(L" - group: %s", (RProperties->Group.LogText)));
+      LogEvent(FORMAT(L" - group: %s", (Properties->Group.LogText)));
     }
-    if (RProperties->Valid.Contains(vpOwner))
+    if (Properties->Valid.Contains(vpOwner))
     {
-      LogEvent(FORMAT(L" - owner: %s", (RProperties->Owner.LogText)));
+      LogEvent(FORMAT(L" - owner: %s", (Properties->Owner.LogText)));
     }
-    if (RProperties->Valid.Contains(vpModification))
+    if (Properties->Valid.Contains(vpModification))
     {
       LogEvent(FORMAT(L" - modification: \"%s\"",
         (FormatDateTime(L"dddddd tt",
-           UnixToDateTime(RProperties->Modification, SessionData->DSTMode)))));
+           UnixToDateTime(Properties->Modification, SessionData->DSTMode)))));
     }
-    if (RProperties->Valid.Contains(vpLastAccess))
+    if (Properties->Valid.Contains(vpLastAccess))
     {
       LogEvent(FORMAT(L" - last access: \"%s\"",
         (FormatDateTime(L"dddddd tt",
-           UnixToDateTime(RProperties->LastAccess, SessionData->DSTMode)))));
+           UnixToDateTime(Properties->LastAccess, SessionData->DSTMode)))));
+    }
+  }
+}
+//---------------------------------------------------------------------------
+void __fastcall TTerminal::ChangeDirectoryContentsProperties(const UnicodeString & DirName,
+  const TRemoteProperties * Properties)
+{
+  if (!IsCapable[fcPipelinedChanges])
+  {
+    ProcessDirectory(DirName, ChangeFileProperties, const_cast<TRemoteProperties *>(Properties));
+  }
+  else
+  {
+    // As with DeleteDirectoryContents, the subdirectories are changed after their contents
+    std::unique_ptr<TStringList> Files(new TStringList());
+    Files->OwnsObjects = true;
+    TBatchChangeParams BatchParams;
+    BatchParams.Files = Files.get();
+    BatchParams.Params = 0;
+    BatchParams.Properties = Properties;
+    ProcessDirectory(DirName, CollectFileToChange, &BatchParams);
+
+    if (Files->Count > 0)
+    {
+      std::unique_ptr<TStringList> FailedFiles(new TStringList());
+      FFileSystem->ChangeFilesProperties(Files.get(), Properties, FailedFiles.get());
+
+      // The contents of the failed directories were processed already
+      TRemoteProperties FailedProperties(*Properties);
+      FailedProperties.Recursive = false;
+      int FailedIndex = 0;
+      for (int Index = 0; (Index < Files->Count) && (FailedIndex < FailedFiles->Count); Index++)
+      {
+        TRemoteFile * File = static_cast<TRemoteFile *>(Files->Objects[Index]);
+        if (FailedFiles->Objects[FailedIndex] == File)
+        {
+          FailedIndex++;
+          // After cancel, the failed and the not processed files are not retried
+          if ((OperationProgress != NULL) && (OperationProgress->Cancel != csContinue))
+          {
+            ReactOnCommand(fsChangeProperties);
+            Abort();
+          }
+          UnicodeString FileName = Files->Strings[Index];
+          StartOperationWithFile(FileName, foSetProperties);
+          DoChangeFileProperties(FileName, File, &FailedProperties);
+        }
+      }
+      ReactOnCommand(fsChangeProperties);
     }
   }
-  FileModified(File, FileName);
-  DoChangeFileProperties(FileName, File, RProperties);
-  ReactOnCommand(fsChangeProperties);
+}
+//---------------------------------------------------------------------------
+void __fastcall TTerminal::CollectFileToChange(UnicodeString FileName,
+  const TRemoteFile * File, void * Param)
+{
+  TBatchChangeParams * BatchParams = static_cast<TBatchChangeParams *>(Param);
+  // Changing a symlink changes its target, whose properties are not known from the listing
+  if (File->IsSymLink)
+  {
+    ChangeFileProperties(FileName, File, const_cast<TRemoteProperties *>(BatchParams->Properties));
+  }
+  else
+  {
+    StartOperationWithFile(FileName, foSetProperties);
+    LogChangeFileProperties(FileName, BatchParams->Properties);
+    if (File->IsDirectory && BatchParams->Properties->Recursive)
+    {
+      ChangeDirectoryContentsProperties(FileName, BatchParams->Properties);
+    }
+    FileModified(File, FileName);
+    // the listing is released before the batch is processed
+    BatchParams->Files->AddObject(FileName, File->Duplicate());
+  }
 }
 //---------------------------------------------------------------------------
 void __fastcall TTerminal::DoChangeFileProperties(const UnicodeString FileName,
@@ -4235,6 +4691,8 @@ void __fastcall TTerminal::ChangeFilesProperties(TStrings * FileList,
 {
   TValueRestorer<bool> UseBusyCursorRestorer(FUseBusyCursor);
   FUseBusyCursor = false;
+  TValueRestorer<bool> PrefetchDirectoryTreeRestorer(FPrefetchDirectoryTree);
+  FPrefetchDirectoryTree = Properties->Recursive;
 
   AnnounceFileListOperation();
   ProcessFiles(FileList, foSetProperties, ChangeFileProperties, (void *)Properties);
@@ -4310,7 +4768,8 @@ void __fastcall TTerminal::CalculateFileSize(UnicodeString FileName,
     if (AParams->Files != NULL)
     {
       UnicodeString FullFileName = UnixExcludeTrailingBackslash(File->FullFileName);
-      CollectionIndex = AParams->Files->Add(FullFileName, File->Duplicate(), File->IsDirectory);
+      __int64 Size = (File->IsDirectory ? 0 : File->Resolve()->Size);
+      CollectionIndex = AParams->Files->Add(FullFileName, File->Duplicate(), File->IsDirectory, Size);
     }
 
     if (File->IsDirectory)
@@ -4411,6 +4870,9 @@ bool __fastcall TTerminal::CalculateFilesSize(TStrings * FileList,
 
   TValueRestorer<bool> UseBusyCursorRestorer(FUseBusyCursor);
   FUseBusyCursor = false;
+  // Not worth it, when we only check if the directories are empty
+  TValueRestorer<bool> PrefetchDirectoryTreeRestorer(FPrefetchDirectoryTree);
+  FPrefetchDirectoryTree = FLAGCLEAR(Params, csStopOnFirstFile);
 
   TCalculateSizeParams Param;
   Param.Params = Params;
@@ -5302,7 +5764,8 @@ void __fastcall TTerminal::CalculateLocalFileSize(
         if (AParams->Files != NULL)
         {
           UnicodeString FullFileName = ::ExpandFileName(FileName);
-          CollectionIndex = AParams->Files->Add(FullFileName, NULL, Rec.IsDirectory());
+          __int64 Size = (Rec.IsDirectory() ? 0 : Rec.Size);
+          CollectionIndex = AParams->Files->Add(FullFileName, NULL, Rec.IsDirectory(), Size);
         }
 
         if (!Rec.IsDirectory())
@@ -5445,6 +5908,11 @@ TSynchronizeChecklist * __fastcall TTerminal::SynchronizeCollect(const UnicodeSt
   TValueRestorer<bool> UseBusyCursorRestorer(FUseBusyCursor);
   FUseBusyCursor = false;
 
+  // The remote tree is read upfront only for recursive comparison,
+  // the listings serve the walk once and do not end up in the directory cache
+  TValueRestorer<bool> PrefetchDirectoryTreeRestorer(FPrefetchDirectoryTree);
+  FPrefetchDirectoryTree = FLAGCLEAR(Params, spNoRecurse) && FLAGCLEAR(Params, spTimestamp);
+
   TSynchronizeChecklist * Checklist = new TSynchronizeChecklist();
   try
   {
@@ -6408,6 +6876,9 @@ void __fastcall TTerminal::FilesFind(UnicodeString Directory, const TFileMasks &
 
   Params.LoopDetector.RecordVisitedDirectory(Directory);
 
+  TValueRestorer<bool> PrefetchDirectoryTreeRestorer(FPrefetchDirectoryTree);
+  FPrefetchDirectoryTree = true;
+
   DoFilesFind(Directory, Params, Directory);
 }
 //---------------------------------------------------------------------------
@@ -6571,18 +7042,14 @@ bool __fastcall TTerminal::GetStoredCredentialsTried()
 //---------------------------------------------------------------------------
 int __fastcall TTerminal::CopyToParallel(TParallelOperation * ParallelOperation, TFileOperationProgressType * OperationProgress)
 {
-  UnicodeString FileName;
-  TObject * Object;
+  std::unique_ptr<TStrings> FilesToCopy(new TStringList());
   UnicodeString TargetDir;
   bool Dir;
   bool Recursed;
 
-  int Result = ParallelOperation->GetNext(this, FileName, Object, TargetDir, Dir, Recursed);
+  int Result = ParallelOperation->GetNext(this, FilesToCopy.get(), TargetDir, Dir, Recursed);
   if (Result > 0)
   {
-    std::unique_ptr<TStrings> FilesToCopy(new TStringList());
-    FilesToCopy->AddObject(FileName, Object);
-
     if (ParallelOperation->Side == osLocal)
     {
       TargetDir = TranslateLockedPath(TargetDir, false);
@@ -6600,6 +7067,7 @@ int __fastcall TTerminal::CopyToParallel(TParallelOperation * ParallelOperation,
     int Prev = OperationProgress->FilesFinishedSuccessfully;
     DebugAssert((FOperationProgress == OperationProgress) || (FOperationProgress == NULL));
     TFileOperationProgressType * PrevOperationProgress = FOperationProgress;
+    unsigned int Started = GetTickCount();
     try
     {
       FOperationProgress = OperationProgress;
@@ -6616,8 +7084,13 @@ int __fastcall TTerminal::CopyToParallel(TParallelOperation * ParallelOperation,
     }
     __finally
     {
+      // Batches consist of files only, for which the result does not matter
       bool Success = (Prev < OperationProgress->FilesFinishedSuccessfully);
-      ParallelOperation->Done(FileName, Dir, Success);
+      for (int Index = 0; Index < FilesToCopy->Count; Index++)
+      {
+        ParallelOperation->Done(FilesToCopy->Strings[Index], Dir, Success);
+      }
+      ParallelOperation->AddBusyTime(this, GetTickCount() - Started);
       // Not to fail an assertion in OperationStop when called from CopyToRemote or CopyToLocal,
       // when FOperationProgress is already OperationProgress.
       FOperationProgress = PrevOperationProgress;
@@ -6662,6 +7135,7 @@ void __fastcall TTerminal::CopyParallel(TParallelOperation * ParallelOperation,
   {
     OperationProgress->SetDone();
     ParallelOperation->WaitFor();
+    LogParallelTransferStatistics(ParallelOperation);
   }
 }
 //---------------------------------------------------------------------------
@@ -6672,6 +7146,15 @@ void __fastcall TTerminal::LogParallelTransfer(TParallelOperation * ParallelOper
     (ParallelOperation->MainName)));
 }
 //---------------------------------------------------------------------------
+void __fastcall TTerminal::LogParallelTransferStatistics(TParallelOperation * ParallelOperation)
+{
+  UnicodeString Statistics = ParallelOperation->GetClientStatistics(this);
+  if (!Statistics.IsEmpty())
+  {
+    LogEvent(FORMAT(L"Parallel transfer on this connection: %s", (Statistics)));
+  }
+}
+//---------------------------------------------------------------------------
 void __fastcall TTerminal::LogTotalTransferDetails(
   const UnicodeString TargetDir, const TCopyParamType * CopyParam,
   TFileOperationProgressType * OperationProgress, bool Parallel, TStrings * Files)
@@ -8001,6 +8484,9 @@ __fastcall TSecondaryTerminal::TSecondaryTerminal(TTerminal * MainTerminal,
   Log->SetParent(FMainTerminal->Log, Name);
   ActionLog->Enabled = false;
   SessionData->NonPersistant();
+  // Modifications are tracked in the main terminal cache only (see DirectoryModified),
+  // a copy persisted here would overwrite it with stale listings
+  FPersistDirectoryCache = false;
   DebugAssert(FMainTerminal != NULL);
   if (!FMainTerminal->UserName.IsEmpty())
   {
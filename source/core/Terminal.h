@@ -183,6 +183,9 @@ private:
   TFileOperationProgressType * FOperationProgress;
   bool FUseBusyCursor;
   TRemoteDirectoryCache * FDirectoryCache;
+  bool FPersistDirectoryCache;
+  bool FPrefetchDirectoryTree;
+  TStringList * FPrefetchedDirectories;
   TRemoteDirectoryChangesCache * FDirectoryChangesCache;
   TSecureShell * FSecureShell;
   UnicodeString FLastDirectoryChange;
@@ -299,10 +302,22 @@ protected:
     bool IgnoreErrors = false);
   bool __fastcall DeleteContentsIfDirectory(
     const UnicodeString & FileName, const TRemoteFile * File, int Params, TRmSessionAction & Action);
+  bool __fastcall RecycleOnDelete(int Params);
+  void __fastcall DeleteDirectoryContents(const UnicodeString & DirName, int Params);
+  void __fastcall CollectFileToDelete(UnicodeString FileName,
+    const TRemoteFile * File, /*TBatchChangeParams*/ void * Param);
+  void __fastcall ChangeDirectoryContentsProperties(const UnicodeString & DirName,
+    const TRemoteProperties * Properties);
+  void __fastcall CollectFileToChange(UnicodeString FileName,
+    const TRemoteFile * File, /*TBatchChangeParams*/ void * Param);
+  void __fastcall LogChangeFileProperties(const UnicodeString & FileName, const TRemoteProperties * Properties);
   void __fastcall AnnounceFileListOperation();
   UnicodeString __fastcall TranslateLockedPath(UnicodeString Path, bool Lock);
   void __fastcall ReadDirectory(TRemoteFileList * FileList);
   void __fastcall CustomReadDirectory(TRemoteFileList * FileList);
+  bool __fastcall DoReadDirectoryTree(const UnicodeString & Directory, TObjectList * FileLists);
+  void __fastcall PrefetchDirectoryTree(const UnicodeString & Directory);
+  TRemoteFileList * __fastcall ExtractPrefetchedFileList(const UnicodeString & Directory);
   void __fastcall DoCreateLink(const UnicodeString FileName, const UnicodeString PointTo, bool Symbolic);
   bool __fastcall CreateLocalFile(const UnicodeString FileName,
     TFileOperationProgressType * OperationProgress, HANDLE * AHandle,
@@ -416,6 +431,7 @@ protected:
   void __fastcall DoAnyCommand(const UnicodeString Command, TCaptureOutputEvent OutputEvent,
     TCallSessionAction * Action);
   TRemoteFileList * __fastcall DoReadDirectoryListing(UnicodeString Directory, bool UseCache);
+  void __fastcall RevalidateRestoredFileList(const UnicodeString & Directory);
   RawByteString __fastcall EncryptPassword(const UnicodeString & Password);
   UnicodeString __fastcall DecryptPassword(const RawByteString & Password);
   UnicodeString __fastcall GetRemoteFileInfo(TRemoteFile * File);
@@ -525,6 +541,7 @@ public:
     TParallelOperation * ParallelOperation);
   int __fastcall CopyToParallel(TParallelOperation * ParallelOperation, TFileOperationProgressType * OperationProgress);
   void __fastcall LogParallelTransfer(TParallelOperation * ParallelOperation);
+  void __fastcall LogParallelTransferStatistics(TParallelOperation * ParallelOperation);
   void __fastcall CreateDirectory(const UnicodeString & DirName, const TRemoteProperties * Properties);
   void __fastcall CreateLink(const UnicodeString FileName, const UnicodeString PointTo, bool Symbolic);
   void __fastcall DeleteFile(UnicodeString FileName,
@@ -803,15 +820,17 @@ class TCollectedFileList : public TObject
 {
 public:
   TCollectedFileList();
-  int Add(const UnicodeString & FileName, TObject * Object, bool Dir);
+  int Add(const UnicodeString & FileName, TObject * Object, bool Dir, __int64 Size);
   void DidNotRecurse(int Index);
   void Delete(int Index);
+  void SortForParallelTransfer(__int64 LargeFileSize);
 
   int Count() const;
   UnicodeString GetFileName(int Index) const;
   TObject * GetObject(int Index) const;
   bool IsDir(int Index) const;
   bool IsRecursed(int Index) const;
+  __int64 GetSize(int Index) const;
 
 private:
   struct TFileData
@@ -820,9 +839,12 @@ private:
     TObject * Object;
     bool Dir;
     bool Recursed;
+    __int64 Size;
   };
   typedef std::vector<TFileData> TFileDataList;
   TFileDataList FList;
+
+  static bool LargerFileData(const TFileData & Data1, const TFileData & Data2);
 };
 //---------------------------------------------------------------------------
 class TParallelOperation
@@ -841,9 +863,10 @@ public:
   void AddClient();
   void RemoveClient();
   int GetNext(
-    TTerminal * Terminal, UnicodeString & FileName, TObject *& Object, UnicodeString & TargetDir,
-    bool & Dir, bool & Recursed);
+    TTerminal * Terminal, TStrings * Files, UnicodeString & TargetDir, bool & Dir, bool & Recursed);
   void Done(const UnicodeString & FileName, bool Dir, bool Success);
+  void AddBusyTime(TTerminal * Terminal, unsigned int Ticks);
+  UnicodeString GetClientStatistics(TTerminal * Terminal);
 
   __property TOperationSide Side = { read = FSide };
   __property const TCopyParamType * CopyParam = { read = FCopyParam };
@@ -859,10 +882,20 @@ private:
     bool Exists;
   };
 
+  struct TClientStatistics
+  {
+    int Files;
+    __int64 Size;
+    unsigned int Started;
+    unsigned int Busy;
+  };
+
   std::unique_ptr<TStrings> FFileList;
   int FIndex;
   typedef std::map<UnicodeString, TDirectoryData> TDirectories;
   TDirectories FDirectories;
+  typedef std::map<TTerminal *, TClientStatistics> TClientsStatistics;
+  TClientsStatistics FClientsStatistics;
   UnicodeString FTargetDir;
   const TCopyParamType * FCopyParam;
   int FParams;
@@ -31,8 +31,10 @@
 #include "HelpCore.h"
 #include "CoreMain.h"
 #include "Security.h"
+#include "Cryptography.h"
 #include <StrUtils.hpp>
 #include <NeonIntf.h>
+#include <list>
 //---------------------------------------------------------------------------
 #pragma package(smart_init)
 //---------------------------------------------------------------------------
@@ -53,6 +55,7 @@ static const int HttpUnauthorized = 401;
 #define PROP_EXECUTABLE "executable"
 #define PROP_OWNER "owner"
 #define PROP_DISPLAY_NAME "displayname"
+#define PROP_LOCK_DISCOVERY "lockdiscovery"
 //------------------------------------------------------------------------------
 //---------------------------------------------------------------------------
 // ne_path_escape returns 7-bit string, so it does not really matter if we use
@@ -81,6 +84,45 @@ static UTF8String PathUnescape(const char * Path)
 static bool NeonInitialized = false;
 static bool NeonSspiInitialized = false;
 //---------------------------------------------------------------------------
+// Idle sessions parked by closed file systems, so that queue and parallel
+// transfer connections to the same site can take over the open keep-alive
+// connection, together with its TLS session and authentication state.
+struct TWebDAVPooledSession
+{
+  UnicodeString Key;
+  ne_session * Session;
+  unsigned int Parked;
+  UnicodeString UserName;
+  RawByteString Password;
+  RawByteString PasswordVerifier;
+  TSessionInfo SessionInfo;
+  UnicodeString TlsVersionStr;
+};
+typedef std::list<TWebDAVPooledSession> TWebDAVSessionPool;
+static const size_t WebDAVSessionPoolMax = 8;
+static const unsigned int WebDAVSessionPoolIdleTimeout = 30 * MSecsPerSec;
+static std::unique_ptr<TCriticalSection> WebDAVSessionPoolSection(TraceInitPtr(new TCriticalSection()));
+static TWebDAVSessionPool WebDAVSessionPool;
+//---------------------------------------------------------------------------
+static void __fastcall ExpireWebDAVSessionPool(bool All)
+{
+  TGuard Guard(WebDAVSessionPoolSection.get());
+  unsigned int Ticks = GetTickCount();
+  TWebDAVSessionPool::iterator I = WebDAVSessionPool.begin();
+  while (I != WebDAVSessionPool.end())
+  {
+    if (All || (Ticks - I->Parked >= WebDAVSessionPoolIdleTimeout))
+    {
+      DestroyNeonSession(I->Session);
+      I = WebDAVSessionPool.erase(I);
+    }
+    else
+    {
+      ++I;
+    }
+  }
+}
+//---------------------------------------------------------------------------
 void __fastcall NeonInitialize()
 {
   // Even if this fails, we do not want to interrupt WinSCP starting for that.
@@ -108,6 +150,8 @@ void __fastcall NeonInitialize()
 //---------------------------------------------------------------------------
 void __fastcall NeonFinalize()
 {
+  ExpireWebDAVSessionPool(true);
+  ClearTlsSessionCache();
   if (NeonInitialized)
   {
     ne_sock_exit();
@@ -152,6 +196,7 @@ TWebDAVFileSystem::TWebDAVFileSystem(TTerminal * ATerminal) :
   FUploading(false),
   FDownloading(false),
   FInitialHandshake(false),
+  FAllPropListing(false),
   FIgnoreAuthenticationFailure(iafNo)
 {
   FFileSystemInfo.ProtocolBaseName = CONST_WEBDAV_PROTOCOL_BASE_NAME;
@@ -267,7 +312,7 @@ void TWebDAVFileSystem::NeonClientOpenSessionInternal(UnicodeString & CorrectedU
   CorrectedUrl = Url;
 }
 //---------------------------------------------------------------------------
-void __fastcall TWebDAVFileSystem::SetSessionTls(ne_session_s * Session, bool Aux)
+void __fastcall TWebDAVFileSystem::SetSessionTls(ne_session_s * Session, bool Aux, bool TrustDefaultCA)
 {
   SetNeonTlsInit(Session, InitSslSession);
 
@@ -277,16 +322,28 @@ void __fastcall TWebDAVFileSystem::SetSessionTls(ne_session_s * Session, bool Au
   ne_ssl_verify_fn Callback = Aux ? NeonServerSSLCallbackAux : NeonServerSSLCallbackMain;
   ne_ssl_set_verify(Session, Callback, this);
 
-  ne_ssl_trust_default_ca(Session);
+  if (TrustDefaultCA)
+  {
+    ne_ssl_trust_default_ca(Session);
+  }
 }
 //---------------------------------------------------------------------------
-void __fastcall TWebDAVFileSystem::InitSession(ne_session_s * Session)
+void __fastcall TWebDAVFileSystem::InitSession(ne_session_s * Session, bool Pooled)
 {
   TSessionData * Data = FTerminal->SessionData;
 
-  InitNeonSession(
-    Session, Data->ProxyMethod, Data->ProxyHost, Data->ProxyPort,
-    Data->ProxyUsername, Data->ProxyPassword, FTerminal);
+  // A pooled session keeps its proxy and redirect setup (the proxy is part of the pool key),
+  // registering them again would duplicate the hooks
+  if (!Pooled)
+  {
+    InitNeonSession(
+      Session, Data->ProxyMethod, Data->ProxyHost, Data->ProxyPort,
+      Data->ProxyUsername, Data->ProxyPassword, FTerminal);
+  }
+  else
+  {
+    SetNeonSessionTerminal(Session, FTerminal);
+  }
 
   ne_set_read_timeout(Session, Data->Timeout);
 
@@ -313,9 +370,14 @@ void TWebDAVFileSystem::NeonOpen(UnicodeString & CorrectedUrl, const UnicodeStri
     FTerminal->LogEvent(FORMAT(L"Warning: %s", (LoadStr(UNENCRYPTED_REDIRECT))));
   }
 
+  FCurrentUrl = Url;
   DebugAssert(FNeonSession == NULL);
-  FNeonSession = CreateNeonSession(uri);
-  InitSession(FNeonSession);
+  bool Pooled = AcquirePooledSession(Url);
+  if (!Pooled)
+  {
+    FNeonSession = CreateNeonSession(uri);
+  }
+  InitSession(FNeonSession, Pooled);
 
   UTF8String Path = uri.path;
   ne_uri_free(&uri);
@@ -327,7 +389,7 @@ void TWebDAVFileSystem::NeonOpen(UnicodeString & CorrectedUrl, const UnicodeStri
 
   if (Ssl)
   {
-    SetSessionTls(FNeonSession, false);
+    SetSessionTls(FNeonSession, false, !Pooled);
 
     ne_ssl_provide_clicert(FNeonSession, NeonProvideClientCert, this);
   }
@@ -354,7 +416,7 @@ void TWebDAVFileSystem::NeonAuxRequestInit(ne_session * Session, ne_request * /*
 
   if (Tls)
   {
-    FileSystem->SetSessionTls(Session, true);
+    FileSystem->SetSessionTls(Session, true, true);
   }
 }
 //---------------------------------------------------------------------------
@@ -430,10 +492,112 @@ void __fastcall TWebDAVFileSystem::CloseNeonSession()
   }
 }
 //---------------------------------------------------------------------------
+UnicodeString __fastcall TWebDAVFileSystem::GetPoolKey(const UnicodeString & Url)
+{
+  TSessionData * Data = FTerminal->SessionData;
+  return
+    FORMAT(L"%s|%s|%s|%d|%s|%d|%s|%d|%d|%d",
+      (Url, Data->SessionName, Data->UserNameExpanded, int(Data->ProxyMethod), Data->ProxyHost, Data->ProxyPort,
+       Data->TlsCertificateFile, int(Data->MinTlsVersion), int(Data->MaxTlsVersion), Data->Timeout));
+}
+//---------------------------------------------------------------------------
+bool __fastcall TWebDAVFileSystem::AcquirePooledSession(const UnicodeString & Url)
+{
+  ExpireWebDAVSessionPool(false);
+
+  UnicodeString Key = GetPoolKey(Url);
+  UnicodeString Password = FTerminal->SessionData->Password;
+  TGuard Guard(WebDAVSessionPoolSection.get());
+  // Most recently parked first, it is the most likely one to still have its connection open.
+  // The pooled session is authenticated already, so it is taken over only by a session
+  // that proves to know the same password. Sessions without stored password never take over.
+  TWebDAVSessionPool::iterator I = WebDAVSessionPool.end();
+  if (!Password.IsEmpty())
+  {
+    I = WebDAVSessionPool.begin();
+    while ((I != WebDAVSessionPool.end()) &&
+           ((I->Key != Key) || !AES256Verify(Password, I->PasswordVerifier)))
+    {
+      ++I;
+    }
+  }
+
+  bool Result = (I != WebDAVSessionPool.end());
+  if (Result)
+  {
+    FNeonSession = I->Session;
+    FUserName = I->UserName;
+    FPassword = I->Password;
+    FStoredPasswordTried = true;
+    FSessionInfo.SecurityProtocolName = I->SessionInfo.SecurityProtocolName;
+    FSessionInfo.CSCipher = I->SessionInfo.CSCipher;
+    FSessionInfo.SCCipher = I->SessionInfo.SCCipher;
+    FSessionInfo.Certificate = I->SessionInfo.Certificate;
+    FSessionInfo.CertificateFingerprint = I->SessionInfo.CertificateFingerprint;
+    FSessionInfo.CertificateVerifiedManually = I->SessionInfo.CertificateVerifiedManually;
+    FTlsVersionStr = I->TlsVersionStr;
+    WebDAVSessionPool.erase(I);
+
+    FTerminal->LogEvent(FORMAT(L"Reusing pooled connection (%d more pooled).", (int(WebDAVSessionPool.size()))));
+  }
+  return Result;
+}
+//---------------------------------------------------------------------------
+void __fastcall TWebDAVFileSystem::ReleaseNeonSession()
+{
+  // Sessions with lock store have lock hooks registered with this file system,
+  // keep it simple and do not reuse those.
+  // Sessions without stored password cannot be reused (see AcquirePooledSession).
+  bool CanPool =
+    (FNeonSession != NULL) && (FNeonLockStore == NULL) && !FCurrentUrl.IsEmpty() &&
+    !FTerminal->SessionData->Password.IsEmpty();
+  if (!CanPool)
+  {
+    CloseNeonSession();
+  }
+  else
+  {
+    // Detach everything that refers to this file system
+    ne_unhook_create_request(FNeonSession, NeonCreateRequest, this);
+    ne_unhook_pre_send(FNeonSession, NeonPreSend, this);
+    ne_unhook_post_send(FNeonSession, NeonPostSend, this);
+    ne_unhook_post_headers(FNeonSession, NeonPostHeaders, this);
+    ne_set_notifier(FNeonSession, NULL, NULL);
+    ne_set_aux_request_init(FNeonSession, NULL, NULL);
+    ne_remove_server_auth(FNeonSession);
+    ne_ssl_set_verify(FNeonSession, NULL, NULL);
+    ne_ssl_provide_clicert(FNeonSession, NULL, NULL);
+    SetNeonTlsInit(FNeonSession, NULL);
+    ne_set_session_private(FNeonSession, SESSION_FS_KEY, NULL);
+    SetNeonSessionTerminal(FNeonSession, NULL);
+
+    TWebDAVPooledSession Pooled;
+    Pooled.Key = GetPoolKey(FCurrentUrl);
+    Pooled.Session = FNeonSession;
+    Pooled.Parked = GetTickCount();
+    Pooled.UserName = FUserName;
+    Pooled.Password = FPassword;
+    AES256CreateVerifier(FTerminal->SessionData->Password, Pooled.PasswordVerifier);
+    Pooled.SessionInfo = FSessionInfo;
+    Pooled.TlsVersionStr = FTlsVersionStr;
+    FNeonSession = NULL;
+
+    ExpireWebDAVSessionPool(false);
+    TGuard Guard(WebDAVSessionPoolSection.get());
+    WebDAVSessionPool.push_front(Pooled);
+    while (WebDAVSessionPool.size() > WebDAVSessionPoolMax)
+    {
+      DestroyNeonSession(WebDAVSessionPool.back().Session);
+      WebDAVSessionPool.pop_back();
+    }
+    FTerminal->LogEvent(FORMAT(L"Connection kept in pool (%d pooled).", (int(WebDAVSessionPool.size()))));
+  }
+}
+//---------------------------------------------------------------------------
 void __fastcall TWebDAVFileSystem::Close()
 {
   DebugAssert(FActive);
-  CloseNeonSession();
+  ReleaseNeonSession();
   FTerminal->Closed();
   FActive = false;
   UnregisterFromNeonDebug(FTerminal);
@@ -581,6 +745,7 @@ bool __fastcall TWebDAVFileSystem::IsCapable(int Capability) const
     case fcPreservingTimestampDirs:
     case fcResumeSupport:
     case fcChangePassword:
+    case fcPipelinedChanges:
       return false;
 
     case fcLocking:
@@ -718,28 +883,97 @@ struct TReadFileData
   TWebDAVFileSystem * FileSystem;
   TRemoteFile * File;
   TRemoteFileList * FileList;
+  int Count;
 };
 //---------------------------------------------------------------------------
-int __fastcall TWebDAVFileSystem::ReadDirectoryInternal(
-  const UnicodeString & Path, TRemoteFileList * FileList)
+// Properties consumed by ParsePropResultSet (and lock discovery).
+// Requesting these only, instead of allprop, saves servers from computing
+// expensive properties (quotas, ETags, dead properties) for every entry.
+static const ne_propname ListingProps[] =
+{
+  { DAV_PROP_NAMESPACE, PROP_CONTENT_LENGTH },
+  { DAV_PROP_NAMESPACE, PROP_LAST_MODIFIED },
+  { DAV_PROP_NAMESPACE, PROP_RESOURCE_TYPE },
+  { DAV_PROP_NAMESPACE, PROP_HIDDEN },
+  { DAV_PROP_NAMESPACE, PROP_OWNER },
+  { DAV_PROP_NAMESPACE, PROP_DISPLAY_NAME },
+  { DAV_PROP_NAMESPACE, PROP_LOCK_DISCOVERY },
+  { MODDAV_PROP_NAMESPACE, PROP_EXECUTABLE },
+  { NULL, NULL }
+};
+//---------------------------------------------------------------------------
+int __fastcall TWebDAVFileSystem::ReadDirectoryProps(
+  const UnicodeString & Path, TRemoteFileList * FileList, bool AllProp, int & StatusCode, int & Count)
 {
   TReadFileData Data;
   Data.FileSystem = this;
   Data.File = NULL;
   Data.FileList = FileList;
+  Data.Count = 0;
   ClearNeonError();
   ne_propfind_handler * PropFindHandler = ne_propfind_create(FNeonSession, PathToNeon(Path), NE_DEPTH_ONE);
   void * DiscoveryContext = ne_lock_register_discovery(PropFindHandler);
   int Result;
   try
   {
-    Result = ne_propfind_allprop(PropFindHandler, NeonPropsResult, &Data);
+    if (AllProp)
+    {
+      Result = ne_propfind_allprop(PropFindHandler, NeonPropsResult, &Data);
+    }
+    else
+    {
+      Result = ne_propfind_named(PropFindHandler, ListingProps, NeonPropsResult, &Data);
+    }
+    StatusCode = ne_get_status(ne_propfind_get_request(PropFindHandler))->code;
   }
   __finally
   {
     ne_lock_discovery_free(DiscoveryContext);
     ne_propfind_destroy(PropFindHandler);
   }
+  Count = Data.Count;
+  return Result;
+}
+//---------------------------------------------------------------------------
+int __fastcall TWebDAVFileSystem::ReadDirectoryInternal(
+  const UnicodeString & Path, TRemoteFileList * FileList)
+{
+  unsigned int Started = GetTickCount();
+  int StatusCode = 0;
+  int Count = 0;
+  int Result;
+  if (FAllPropListing)
+  {
+    Result = ReadDirectoryProps(Path, FileList, true, StatusCode, Count);
+  }
+  else
+  {
+    Result = ReadDirectoryProps(Path, FileList, false, StatusCode, Count);
+    // Some servers reject named PROPFIND (or answer it with an empty multistatus).
+    // Authentication and "not found" errors would fail with allprop too, so do not retry those.
+    bool Rejected =
+      ((Result == NE_ERROR) && !FCancelled &&
+       (StatusCode != 401) && (StatusCode != 404) && (StatusCode != 407)) ||
+      ((Result == NE_OK) && (Count == 0));
+    if (Rejected)
+    {
+      FTerminal->LogEvent(
+        FORMAT(L"Named properties listing failed (status %d), retrying with all properties.", (StatusCode)));
+      FileList->Reset();
+      Result = ReadDirectoryProps(Path, FileList, true, StatusCode, Count);
+      if (Result == NE_OK)
+      {
+        FTerminal->LogEvent(L"Will use all properties listing for this session.");
+        FAllPropListing = true;
+      }
+    }
+  }
+  if ((Result == NE_OK) && (FTerminal->Configuration->ActualLogProtocol >= 1))
+  {
+    FTerminal->LogEvent(
+      FORMAT(L"Listed %d entries of \"%s\" using %s in %d ms.",
+        (Count, Path, (FAllPropListing ? L"allprop" : L"named properties"), int(GetTickCount() - Started))));
+  }
   return Result;
 }
 //---------------------------------------------------------------------------
@@ -783,6 +1017,24 @@ void __fastcall TWebDAVFileSystem::ReadDirectory(TRemoteFileList * FileList)
   CheckStatus(NeonStatus);
 }
 //---------------------------------------------------------------------------
+bool __fastcall TWebDAVFileSystem::ReadDirectoryTree(const UnicodeString & /*Directory*/, TObjectList * /*FileLists*/)
+{
+  return false;
+}
+//---------------------------------------------------------------------------
+void __fastcall TWebDAVFileSystem::ChangeFilesProperties(TStrings * FileList,
+  const TRemoteProperties * /*Properties*/, TStrings * FailedFiles)
+{
+  DebugFail();
+  FailedFiles->Assign(FileList);
+}
+//---------------------------------------------------------------------------
+void __fastcall TWebDAVFileSystem::DeleteFiles(TStrings * FileList, TStrings * FailedFiles)
+{
+  DebugFail();
+  FailedFiles->Assign(FileList);
+}
+//---------------------------------------------------------------------------
 void __fastcall TWebDAVFileSystem::ReadSymlink(TRemoteFile * /*SymlinkFile*/,
   TRemoteFile *& /*File*/)
 {
@@ -802,6 +1054,7 @@ void TWebDAVFileSystem::NeonPropsResult(
   UnicodeString Path = StrFromNeon(PathUnescape(Uri->path).c_str());
 
   TReadFileData & Data = *static_cast<TReadFileData *>(UserData);
+  Data.Count++;
   if (Data.FileList != NULL)
   {
     UnicodeString FileListPath = Data.FileSystem->AbsolutePath(Data.FileList->Directory, false);
@@ -971,6 +1224,7 @@ int __fastcall TWebDAVFileSystem::CustomReadFileInternal(const UnicodeString Fil
   Data.FileSystem = this;
   Data.File = AFile.get();
   Data.FileList = NULL;
+  Data.Count = 0;
   ClearNeonError();
   int Result =
     ne_simple_propfind(FNeonSession, PathToNeon(FileName), NE_DEPTH_ZERO, NULL,
@@ -39,6 +39,9 @@ public:
     const TRemoteFile * File, const TRemoteProperties * Properties,
     TChmodSessionAction & Action);
   virtual bool __fastcall LoadFilesProperties(TStrings * FileList);
+  virtual void __fastcall ChangeFilesProperties(TStrings * FileList,
+    const TRemoteProperties * Properties, TStrings * FailedFiles);
+  virtual void __fastcall DeleteFiles(TStrings * FileList, TStrings * FailedFiles);
   virtual void __fastcall CalculateFilesChecksum(const UnicodeString & Alg,
     TStrings * FileList, TStrings * Checksums,
     TCalculatedChecksumEvent OnCalculatedChecksum);
@@ -67,6 +70,7 @@ public:
   virtual void __fastcall LookupUsersGroups();
   virtual void __fastcall ReadCurrentDirectory();
   virtual void __fastcall ReadDirectory(TRemoteFileList * FileList);
+  virtual bool __fastcall ReadDirectoryTree(const UnicodeString & Directory, TObjectList * FileLists);
   virtual void __fastcall ReadFile(const UnicodeString FileName,
     TRemoteFile *& File);
   virtual void __fastcall ReadSymlink(TRemoteFile * SymlinkFile,
@@ -168,6 +172,8 @@ private:
   UnicodeString FLastAuthorizationProtocol;
   bool FAuthenticationRetry;
   bool FNtlmAuthenticationFailed;
+  bool FAllPropListing;
+  UnicodeString FCurrentUrl;
 
   void __fastcall CustomReadFile(UnicodeString FileName,
     TRemoteFile *& File, TRemoteFile * ALinkedByFile);
@@ -179,6 +185,8 @@ private:
   UnicodeString __fastcall GetRedirectUrl();
   UnicodeString __fastcall ParsePathFromUrl(const UnicodeString & Url);
   int __fastcall ReadDirectoryInternal(const UnicodeString & Path, TRemoteFileList * FileList);
+  int __fastcall ReadDirectoryProps(
+    const UnicodeString & Path, TRemoteFileList * FileList, bool AllProp, int & StatusCode, int & Count);
   int __fastcall RenameFileInternal(const UnicodeString & FileName, const UnicodeString & NewName);
   int __fastcall CopyFileInternal(const UnicodeString & FileName, const UnicodeString & NewName);
   bool __fastcall IsValidRedirect(int NeonStatus, UnicodeString & Path);
@@ -188,8 +196,11 @@ private:
   void __fastcall DiscardLock(const RawByteString & Path);
   bool __fastcall IsNtlmAuthentication();
   static void NeonAuxRequestInit(ne_session_s * Session, ne_request * Request, void * UserData);
-  void __fastcall SetSessionTls(ne_session_s * Session, bool Aux);
-  void __fastcall InitSession(ne_session_s * Session);
+  void __fastcall SetSessionTls(ne_session_s * Session, bool Aux, bool TrustDefaultCA);
+  void __fastcall InitSession(ne_session_s * Session, bool Pooled = false);
+  UnicodeString __fastcall GetPoolKey(const UnicodeString & Url);
+  bool __fastcall AcquirePooledSession(const UnicodeString & Url);
+  void __fastcall ReleaseNeonSession();
 };
 //------------------------------------------------------------------------------
 #endif
@@ -45,6 +45,9 @@ CAsyncSslSocketLayer::CAsyncSslSocketLayer()
   m_bFailureSent = FALSE;
   m_nVerificationResult = 0;
   m_nVerificationDepth = 0;
+  m_cachedsession = false;
+  m_nCachedVerificationResult = 0;
+  m_nCachedVerificationDepth = 0;
   m_mayTriggerRead = true;
   m_mayTriggerWrite = true;
   m_mayTriggerReadUp = true;
@@ -52,6 +55,7 @@ CAsyncSslSocketLayer::CAsyncSslSocketLayer()
 
   m_onCloseCalled = false;
   m_Main = NULL;
+  m_Tools = NULL;
   m_sessionid = NULL;
   m_sessionreuse = true;
 
@@ -737,6 +741,7 @@ int CAsyncSslSocketLayer::InitSSLConnection(bool clientMode,
   //Init SSL connection
   void *ssl_sessionid = NULL;
   m_Main = main;
+  m_Tools = tools;
   m_sessionreuse = sessionreuse;
   if ((m_Main != NULL) && m_sessionreuse)
   {
@@ -757,7 +762,18 @@ int CAsyncSslSocketLayer::InitSSLConnection(bool clientMode,
   }
   else
   {
-    SSL_set_session(m_ssl, NULL);
+    SSL_SESSION * cachedsession = NULL;
+    if ((m_Main == NULL) && m_sessionreuse && clientMode)
+    {
+      // Session of an earlier control connection to the same server
+      cachedsession = m_Tools->RetrieveTlsSession(m_nCachedVerificationResult, m_nCachedVerificationDepth);
+    }
+    SSL_set_session(m_ssl, cachedsession);
+    if (cachedsession != NULL)
+    {
+      m_cachedsession = true;
+      SSL_SESSION_free(cachedsession);
+    }
   }
   if (clientMode)
   {
@@ -800,6 +816,7 @@ void CAsyncSslSocketLayer::ResetSslSession()
   m_bUseSSL = FALSE;
   m_nVerificationResult = 0;
   m_nVerificationDepth = 0;
+  m_cachedsession = false;
 
   m_bSslEstablished = FALSE;
   if (m_sslbio)
@@ -1147,12 +1164,24 @@ void CAsyncSslSocketLayer::apps_ssl_info_callback(const SSL *s, int where, int r
           pLayer->LogSocketMessageRaw(FZ_LOG_INFO, L"Session ID changed");
         }
         pLayer->m_sessionid = sessionid;
+        // Sessions received before the certificate is accepted are cached in SetNotifyReply
+        if ((pLayer->m_Main == NULL) && (pLayer->m_Tools != NULL) && pLayer->m_bSslEstablished)
+        {
+          pLayer->m_Tools->StoreTlsSession(sessionid, pLayer->m_nVerificationResult, pLayer->m_nVerificationDepth);
+        }
       }
       else
       {
         SSL_SESSION_free(sessionid);
       }
     }
+    if (pLayer->m_cachedsession && SSL_session_reused(pLayer->m_ssl) && !pLayer->m_bSslEstablished)
+    {
+      // verify_callback is not called for a resumed session,
+      // have the certificate checked with the result of the original verification
+      pLayer->m_nVerificationResult = pLayer->m_nCachedVerificationResult;
+      pLayer->m_nVerificationDepth = pLayer->m_nCachedVerificationDepth;
+    }
     int error = SSL_get_verify_result(pLayer->m_ssl);
     pLayer->DoLayerCallback(LAYERCALLBACK_LAYERSPECIFIC, SSL_VERIFY_CERT, error);
     pLayer->m_bBlocking = TRUE;
@@ -1573,6 +1602,11 @@ void CAsyncSslSocketLayer::SetNotifyReply(int nID, int nCode, int result)
 
   if (!result)
   {
+    if ((m_Main == NULL) && (m_Tools != NULL))
+    {
+      // never resume a session with a rejected certificate
+      m_Tools->DropTlsSession();
+    }
     m_nNetworkError = WSAECONNABORTED;
     WSASetLastError(WSAECONNABORTED);
     if (!m_bFailureSent)
@@ -1584,6 +1618,10 @@ void CAsyncSslSocketLayer::SetNotifyReply(int nID, int nCode, int result)
     return;
   }
   m_bSslEstablished = TRUE;
+  if ((m_Main == NULL) && (m_Tools != NULL) && (m_sessionid != NULL))
+  {
+    m_Tools->StoreTlsSession(m_sessionid, m_nVerificationResult, m_nVerificationDepth);
+  }
   PrintSessionInfo();
   DoLayerCallback(LAYERCALLBACK_LAYERSPECIFIC, SSL_INFO, SSL_INFO_ESTABLISHED);
 
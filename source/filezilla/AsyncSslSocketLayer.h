@@ -188,6 +188,10 @@ private:
   CString m_CertStorage;
   int m_nVerificationResult;
   int m_nVerificationDepth;
+  // Verification result of the certificate of a session resumed from the cache
+  bool m_cachedsession;
+  int m_nCachedVerificationResult;
+  int m_nCachedVerificationDepth;
 
   static struct t_SslLayerList
   {
@@ -202,6 +206,7 @@ private:
   SSL_SESSION * m_sessionid;
   bool m_sessionreuse;
   CAsyncSslSocketLayer * m_Main;
+  CFileZillaTools * m_Tools;
 
   // Data channels for encrypted/unencrypted data
   BIO* m_nbio; // Network side, sends/receives encrypted data
@@ -452,6 +452,7 @@ bool __fastcall TFileZillaIntf::HandleMessage(WPARAM wParam, LPARAM lParam)
           Dest.Link = Source.bLink;
           CopyFileTime(Dest.Time, Source.date);
           Dest.LinkTarget = Source.linkTarget;
+          Dest.Section = Source.section;
         }
 
         int Num = Directory->num;
@@ -38,6 +38,7 @@ struct TListDataEntry
   bool Link;
   TRemoteFileTime Time;
   const wchar_t * LinkTarget;
+  const wchar_t * Section;
 };
 //---------------------------------------------------------------------------
 struct TFtpsCertificateData
@@ -13,6 +13,9 @@ public:
   virtual wchar_t * LastSysErrorMessage() = 0;
   virtual std::wstring GetClientString() = 0;
   virtual void SetupSsl(ssl_st * Ssl) = 0;
+  virtual SSL_SESSION * RetrieveTlsSession(int & VerificationResult, int & VerificationDepth) = 0;
+  virtual void StoreTlsSession(SSL_SESSION * Session, int VerificationResult, int VerificationDepth) = 0;
+  virtual void DropTlsSession() = 0;
 };
 //---------------------------------------------------------------------------
 #endif // FileZillaToolsH
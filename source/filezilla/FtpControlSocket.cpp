@@ -177,6 +177,7 @@ CFtpControlSocket::CFtpControlSocket(CMainThread *pMainThread, CFileZillaTools *
   m_zlibSupported = false;
   m_zlibLevel = 8;
 #endif
+  m_transferType = TYPE_UNKNOWN;
 
   m_bUTF8 = true;
   m_hasClntCmd = false;
@@ -1542,6 +1543,7 @@ void CFtpControlSocket::DoClose(int nError /*=0*/)
   m_zlibSupported = false;
   m_zlibLevel = 0;
 #endif
+  m_transferType = TYPE_UNKNOWN;
 
   m_bUTF8 = false;
   m_hasClntCmd = false;
@@ -1595,6 +1597,8 @@ void CFtpControlSocket::CheckForTimeout()
 void CFtpControlSocket::FtpCommand(LPCTSTR pCommand)
 {
   m_Operation.nOpMode=CSMODE_COMMAND;
+  // The command may change the data type
+  m_transferType = TYPE_UNKNOWN;
   Send(pCommand);
 }
 
@@ -1776,6 +1780,13 @@ void CFtpControlSocket::List(BOOL bFinish, int nError /*=FALSE*/, CServerPath pa
     {
       ShowStatus(IDS_STATUSMSG_DIRLISTSUCCESSFUL,FZ_LOG_PROGRESS);
       SetDirectoryListing(pData->pDirectoryListing);
+      if (GetOptionVal(OPTION_MPEXT_LIST_RECURSIVE))
+      {
+        // Recursive listing mixes entries of all subdirectories,
+        // it cannot be used to lookup files of the working directory
+        delete m_pDirectoryListing;
+        m_pDirectoryListing = 0;
+      }
       ResetOperation(FZ_REPLY_OK);
       return;
     }
@@ -1887,6 +1898,7 @@ void CFtpControlSocket::List(BOOL bFinish, int nError /*=FALSE*/, CServerPath pa
     case LIST_TYPE:
       if (code!=2 && code!=3)
         error=TRUE;
+      m_transferType = error ? TYPE_UNKNOWN : TYPE_ASCII;
       m_Operation.nOpState = LIST_PORT_PASV;
       break;
     case LIST_PORT_PASV:
@@ -1992,6 +2004,11 @@ void CFtpControlSocket::List(BOOL bFinish, int nError /*=FALSE*/, CServerPath pa
       return;
     }
   }
+  if ((m_Operation.nOpState==LIST_TYPE) && !NeedTypeCommand(TYPE_ASCII))
+  {
+    m_Operation.nOpState = LIST_PORT_PASV;
+  }
+
   if (m_Operation.nOpState==LIST_INIT)
   { //Initialize some variables
     pData=new CListData;
@@ -2273,6 +2290,11 @@ void CFtpControlSocket::List(BOOL bFinish, int nError /*=FALSE*/, CServerPath pa
     m_pTransferSocket->SetActive();
 
     cmd = GetListingCmd();
+    if (GetOptionVal(OPTION_MPEXT_LIST_RECURSIVE) && !UsingMlsd())
+    {
+      // "LIST -a" => "LIST -aR"
+      cmd += (cmd == L"LIST") ? L" -R" : L"R";
+    }
     if (!Send(cmd))
       return;
 
@@ -2433,7 +2455,18 @@ void CFtpControlSocket::ListFile(CString filename, const CServerPath &path)
       // Force binary mode, as according to RFC 6359,
       // SIZE command returns size as transferred over the stream.
       // Moreover ProFTPD does not even support SIZE command in ASCII mode
-      if (Send(L"TYPE I"))
+      if (!NeedTypeCommand(TYPE_BINARY))
+      {
+        if (Send(L"SIZE " + pData->path))
+        {
+          m_Operation.nOpState = LISTFILE_SIZE;
+        }
+        else
+        {
+          error = TRUE;
+        }
+      }
+      else if (Send(L"TYPE I"))
       {
         m_Operation.nOpState = LISTFILE_TYPE;
       }
@@ -2460,6 +2493,7 @@ void CFtpControlSocket::ListFile(CString filename, const CServerPath &path)
     break;
   case LISTFILE_TYPE:
     // Do not really care if TYPE succeeded or not
+    m_transferType = (GetReplyCode() == 2) ? TYPE_BINARY : TYPE_UNKNOWN;
     if (Send(L"SIZE " + pData->path))
     {
       m_Operation.nOpState = LISTFILE_SIZE;
@@ -3106,9 +3140,15 @@ void CFtpControlSocket::FileTransfer(t_transferfile *transferfile/*=0*/,BOOL bFi
       break;
     case FILETRANSFER_LIST_TYPE:
       if (code != 2 && code != 3)
+      {
+        m_transferType = TYPE_UNKNOWN;
         nReplyError = FZ_REPLY_ERROR;
+      }
       else
+      {
+        m_transferType = TYPE_ASCII;
         m_Operation.nOpState = FILETRANSFER_LIST_PORTPASV;
+      }
       break;
     case FILETRANSFER_LIST_PORTPASV:
       if (code!=3 && code!=2)
@@ -3349,6 +3389,15 @@ void CFtpControlSocket::FileTransfer(t_transferfile *transferfile/*=0*/,BOOL bFi
           pData->pFileSize=new _int64;
           *pData->pFileSize=size;
         }
+        // With binary type, servers that announce SIZE fail it with 550 only,
+        // when the file does not exist, so there's no point asking for its timestamp.
+        else if ((code == 5) && (m_transferType == TYPE_BINARY) &&
+                 (m_serverCapabilities.GetCapability(size_command) == yes))
+        {
+          m_Operation.nOpState=FILETRANSFER_TYPE;
+          nReplyError=CheckOverwriteFile();
+          break;
+        }
       }
       m_Operation.nOpState=FILETRANSFER_NOLIST_MDTM;
       break;
@@ -3362,7 +3411,14 @@ void CFtpControlSocket::FileTransfer(t_transferfile *transferfile/*=0*/,BOOL bFi
       break;
     case FILETRANSFER_TYPE:
       if (code!=2 && code!=3)
+      {
+        m_transferType = TYPE_UNKNOWN;
         nReplyError = FZ_REPLY_ERROR;
+      }
+      else
+      {
+        m_transferType = (pData->transferfile.nType == 1) ? TYPE_ASCII : TYPE_BINARY;
+      }
       m_Operation.nOpState = NeedModeCommand() ? FILETRANSFER_MODE : (NeedOptsCommand() ? FILETRANSFER_OPTS : FILETRANSFER_PORTPASV);
       break;
     case FILETRANSFER_WAIT:
@@ -3788,6 +3844,17 @@ void CFtpControlSocket::FileTransfer(t_transferfile *transferfile/*=0*/,BOOL bFi
   /////////////////
   //Send commands//
   /////////////////
+  // Skip TYPE command, when the server already uses the data type we need
+  if ((m_Operation.nOpState == FILETRANSFER_LIST_TYPE) && !NeedTypeCommand(TYPE_ASCII))
+  {
+    m_Operation.nOpState = FILETRANSFER_LIST_PORTPASV;
+  }
+  else if ((m_Operation.nOpState == FILETRANSFER_TYPE) &&
+           !NeedTypeCommand((pData->transferfile.nType == 1) ? TYPE_ASCII : TYPE_BINARY))
+  {
+    m_Operation.nOpState = NeedModeCommand() ? FILETRANSFER_MODE : (NeedOptsCommand() ? FILETRANSFER_OPTS : FILETRANSFER_PORTPASV);
+  }
+
   BOOL bError=FALSE;
   switch(m_Operation.nOpState)
   {
@@ -5111,6 +5178,8 @@ void CFtpControlSocket::SendKeepAliveCommand()
   //Choose a random command from the list
   TCHAR commands[4][7]={L"PWD",L"REST 0",L"TYPE A",L"TYPE I"};
   int choice=(rand()*4)/(RAND_MAX+1);
+  if (choice >= 2)
+    m_transferType = TYPE_UNKNOWN;
   Send(commands[choice]);
 }
 
@@ -6124,6 +6193,11 @@ bool CFtpControlSocket::NeedModeCommand()
 #endif
 }
 
+bool CFtpControlSocket::NeedTypeCommand(int transferType)
+{
+  return (m_transferType != transferType);
+}
+
 bool CFtpControlSocket::NeedOptsCommand()
 {
 #ifndef MPEXT_NO_ZLIB
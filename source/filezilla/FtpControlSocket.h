@@ -131,6 +131,7 @@ protected:
   int FileTransferListState(bool get);
   bool NeedModeCommand();
   bool NeedOptsCommand();
+  bool NeedTypeCommand(int transferType);
   CString GetListingCmd();
 
   bool InitConnect();
@@ -190,6 +191,9 @@ protected:
   bool m_zlibSupported;
   int m_zlibLevel;
 #endif
+  // Data type acknowledged by the server
+  enum { TYPE_UNKNOWN = -1, TYPE_BINARY, TYPE_ASCII };
+  int m_transferType;
 
   bool m_bUTF8;
   bool m_bAnnouncesUTF8;
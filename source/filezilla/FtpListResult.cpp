@@ -409,14 +409,22 @@ t_directory::t_direntry *CFtpListResult::getList(int &num, bool mlst)
     char *tmpline = new char[strlen(line) + 1];
     strcpy(tmpline, line);
     t_directory::t_direntry direntry;
-    if (parseLine(tmpline, strlen(tmpline), direntry, tmp, mlst))
+    bool section = !mlst && parseSection(tmpline, strlen(tmpline));
+    if (section || parseLine(tmpline, strlen(tmpline), direntry, tmp, mlst))
     {
       delete [] tmpline;
-      if (tmp)
-        m_server.nServerType |= tmp;
-      if (direntry.name!=L"." && direntry.name!=L"..")
+      if (section)
       {
-        AddLine(direntry);
+        // noop
+      }
+      else
+      {
+        if (tmp)
+          m_server.nServerType |= tmp;
+        if (direntry.name!=L"." && direntry.name!=L"..")
+        {
+          AddLine(direntry);
+        }
       }
       if (m_prevline)
       {
@@ -538,6 +546,27 @@ BOOL CFtpListResult::parseLine(const char *lineToParse, const int linelen, t_dir
   return FALSE;
 }
 
+// Recursive listing (LIST -R) separates subdirectories with a "path:" heading,
+// e.g. "./subdir:" or "/absolute/path/subdir:"
+bool CFtpListResult::parseSection(const char * line, const int linelen)
+{
+  if ((linelen < 2) || (line[linelen - 1] != ':') ||
+      !GetOptionVal(OPTION_MPEXT_LIST_RECURSIVE))
+  {
+    return false;
+  }
+
+  // Unlikely, but an entry can theoretically end with a colon too
+  t_directory::t_direntry direntry;
+  if (parseAsUnix(line, linelen, direntry) || parseAsDos(line, linelen, direntry))
+  {
+    return false;
+  }
+
+  copyStr(m_Section, 0, line, linelen - 1);
+  return true;
+}
+
 // Used only with LISTDEBUG
 void CFtpListResult::AddData(char *data, int size)
 {
@@ -588,14 +617,22 @@ void CFtpListResult::AddData(char *data, int size)
     int tmp;
     char *tmpline = new char[strlen(line) + 1];
     strcpy(tmpline, line);
-    if (parseLine(tmpline, strlen(tmpline), direntry, tmp, false))
+    bool section = parseSection(tmpline, strlen(tmpline));
+    if (section || parseLine(tmpline, strlen(tmpline), direntry, tmp, false))
     {
       delete [] tmpline;
-      if (tmp)
-        m_server.nServerType |= tmp;
-      if (direntry.name!=L"." && direntry.name!=L"..")
+      if (section)
       {
-        AddLine(direntry);
+        // noop
+      }
+      else
+      {
+        if (tmp)
+          m_server.nServerType |= tmp;
+        if (direntry.name!=L"." && direntry.name!=L"..")
+        {
+          AddLine(direntry);
+        }
       }
       if (m_prevline)
       {
@@ -749,6 +786,8 @@ char * CFtpListResult::GetLine()
 
 void CFtpListResult::AddLine(t_directory::t_direntry &direntry)
 {
+  direntry.section = m_Section;
+
   if (m_server.nTimeZoneOffset &&
     direntry.date.hasdate && direntry.date.hastime && !direntry.date.utc)
   {
@@ -42,6 +42,7 @@ private:
   tEntryList m_EntryList;
 
   BOOL parseLine(const char * lineToParse, const int linelen, t_directory::t_direntry & direntry, int & nFTPServerType, bool mlst);
+  bool parseSection(const char * line, const int linelen);
 
   BOOL parseAsVMS(const char * line, const int linelen, t_directory::t_direntry & direntry);
   BOOL parseAsEPLF(const char * line, const int linelen, t_directory::t_direntry & direntry);
@@ -77,6 +78,9 @@ private:
   // Month names map
   std::map<CString, int> m_MonthNamesMap;
 
+  // Heading of the current subdirectory of recursive listing
+  CString m_Section;
+
 protected:
   bool * m_bUTF8;
   void copyStr(CString & target, int pos, const char * source, int len, bool mayInvalidateUTF8 = false);
@@ -38,6 +38,7 @@ public:
       bool utc;
     } date;
     CString linkTarget;
+    CString section; // subdirectory heading of recursive (LIST -R) listing
   } * direntry;
   t_server server;
   t_directory & operator=(const t_directory & a);
@@ -271,6 +271,9 @@
 #define UNKNOWN_FILE_ENCRYPTION 747
 #define INVALID_ENCRYPT_KEY     748
 #define UNREQUESTED_FILE        749
+#define TAR_INIT_ERROR          750
+#define TAR_INVALID_HEADER      751
+#define COPY_INTO_ITSELF        752
 
 #define CORE_CONFIRMATION_STRINGS 300
 #define CONFIRM_PROLONG_TIMEOUT3 301
@@ -296,6 +296,7 @@
 #define USAGE_BROWSE            1586
 #define PUTTY_SETTINGS_INSTRUCTIONS 1587
 #define PUTTY_SETTINGS_SITE_NAME 1588
+#define USAGE_EVENTFEED         1589
 
 #define WIN_FORMS_STRINGS       1600
 #define COPY_FILE               1605
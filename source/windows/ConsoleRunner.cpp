@@ -2208,6 +2208,7 @@ void __fastcall Usage(TConsole * Console)
   PrintUsageSyntax(Console,
     FORMAT(L"[/%s=<logfile> [/loglevel=<level>]] [/%s=[<count>%s]<size>]", (LowerCase(LOG_SWITCH), LowerCase(LOGSIZE_SWITCH), LOGSIZE_SEPARATOR)));
   PrintUsageSyntax(Console, L"[/xmllog=<logfile> [/xmlgroups]]");
+  PrintUsageSyntax(Console, L"[/eventfeed=<file|pipe>]");
   PrintUsageSyntax(Console,
     FORMAT(L"[/%s=<inifile>]", (LowerCase(INI_SWITCH))));
   PrintUsageSyntax(Console, FORMAT(L"[/%s config1=value1 config2=value2 ...]", (LowerCase(RAW_CONFIG_SWITCH))));
@@ -2256,6 +2257,7 @@ void __fastcall Usage(TConsole * Console)
   RegisterSwitch(SwitchesUsage, TProgramParams::FormatSwitch(LOGSIZE_SWITCH) + L"=", USAGE_LOGSIZE);
   RegisterSwitch(SwitchesUsage, L"/xmllog=", USAGE_XMLLOG);
   RegisterSwitch(SwitchesUsage, L"/xmlgroups", USAGE_XMLGROUPS);
+  RegisterSwitch(SwitchesUsage, L"/eventfeed=", USAGE_EVENTFEED);
   RegisterSwitch(SwitchesUsage, TProgramParams::FormatSwitch(INI_SWITCH) + L"=", USAGE_INI);
   RegisterSwitch(SwitchesUsage, TProgramParams::FormatSwitch(RAW_CONFIG_SWITCH), USAGE_RAWCONFIG);
   RegisterSwitch(SwitchesUsage, TProgramParams::FormatSwitch(RAWTRANSFERSETTINGS_SWITCH), USAGE_RAWTRANSFERSETTINGS);
@@ -2799,6 +2801,7 @@ int __fastcall Console(TConsoleMode Mode)
 
         CheckLogParam(Params);
         CheckXmlLogParam(Params);
+        CheckEventFeedParam(Params);
 
         Result = Runner->Run(Session, Params,
           (ScriptCommands->Count > 0 ? ScriptCommands : NULL),
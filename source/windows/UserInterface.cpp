@@ -1422,6 +1422,16 @@ bool __fastcall CheckXmlLogParam(TProgramParams * Params)
   return Result;
 }
 //---------------------------------------------------------------------------
+void __fastcall CheckEventFeedParam(TProgramParams * Params)
+{
+  UnicodeString FeedFile;
+  if (Params->FindSwitch(L"EventFeed", FeedFile) && CheckSafe(Params))
+  {
+    Configuration->Usage->Inc(L"ScriptEventFeed");
+    Configuration->TemporaryEventFeed(FeedFile);
+  }
+}
+//---------------------------------------------------------------------------
 bool __fastcall CheckSafe(TProgramParams * Params)
 {
   // Originally we warned when the test didn't pass,
@@ -102,6 +102,7 @@ class TProgramParams;
 bool __fastcall CheckSafe(TProgramParams * Params);
 void __fastcall CheckLogParam(TProgramParams * Params);
 bool __fastcall CheckXmlLogParam(TProgramParams * Params);
+void __fastcall CheckEventFeedParam(TProgramParams * Params);
 
 UnicodeString __fastcall GetToolbarKey(const UnicodeString & ToolbarName);
 UnicodeString __fastcall GetToolbarsLayoutStr(TControl * OwnerControl);